@@ -0,0 +1,462 @@
+#include "bake_occlusion.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <numeric>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#	define BAKE_OCCLUSION_SSE_ 1
+#	include <xmmintrin.h>
+#else
+#	define BAKE_OCCLUSION_SSE_ 0
+#endif
+
+namespace
+{
+	// Tweakables
+	constexpr std::size_t kPacketSize = 4;
+	constexpr std::size_t kVertexBlock = 64; // vertices per work item
+	constexpr std::size_t kMaxStackDepth = 64;
+
+	constexpr float kDetEpsilon = 1e-12f;
+
+	struct Ray_
+	{
+		glm::vec3 origin;
+		glm::vec3 dir;
+		glm::vec3 invDir;
+		float tMax;
+	};
+
+	std::uint32_t build_node_(
+		OcclusionBvh&,
+		std::vector<glm::vec3> const& aTriangles,
+		std::vector<glm::vec3> const& aCentroids,
+		std::uint32_t* aBegin, std::uint32_t* aEnd
+	);
+
+	bool hit_box_( Ray_ const&, OcclusionNode const& );
+	bool hit_packet_( Ray_ const&, OcclusionPacket const&, std::uint32_t aCount );
+	bool occluded_( OcclusionBvh const&, Ray_ const& );
+
+	// Bakes vertices [aBegin, aEnd) of a mesh into aOut; returns the number
+	// of rays traced
+	std::uint64_t bake_vertices_( OcclusionBvh const&, OcclusionMesh const&, std::size_t aRaysPerVertex, float aRadius, float aBias, std::size_t aBegin, std::size_t aEnd, float* aOut );
+
+	float radical_inverse_( std::uint32_t );
+	std::uint32_t hash_u32_( std::uint32_t );
+	void orthonormal_basis_( glm::vec3 const& aN, glm::vec3& aT, glm::vec3& aB );
+}
+
+//--    build_occlusion_bvh()           ///{{{2///////////////////////////////
+OcclusionBvh build_occlusion_bvh( std::vector<glm::vec3> const& aTriangles )
+{
+	assert( aTriangles.size() % 3 == 0 );
+
+	OcclusionBvh bvh;
+	bvh.sceneMin = glm::vec3( std::numeric_limits<float>::max() );
+	bvh.sceneMax = glm::vec3( -std::numeric_limits<float>::max() );
+
+	std::size_t const triCount = aTriangles.size() / 3;
+
+	std::vector<glm::vec3> centroids( triCount );
+	for( std::size_t i = 0; i < triCount; ++i )
+	{
+		auto const& a = aTriangles[i*3+0], & b = aTriangles[i*3+1], & c = aTriangles[i*3+2];
+		centroids[i] = (a + b + c) / 3.f;
+
+		bvh.sceneMin = glm::min( bvh.sceneMin, glm::min( a, glm::min( b, c ) ) );
+		bvh.sceneMax = glm::max( bvh.sceneMax, glm::max( a, glm::max( b, c ) ) );
+	}
+
+	if( 0 == triCount )
+		return bvh;
+
+	std::vector<std::uint32_t> order( triCount );
+	std::iota( order.begin(), order.end(), 0u );
+
+	bvh.nodes.reserve( 2 * (triCount / kPacketSize + 1) );
+	bvh.packets.reserve( triCount / kPacketSize + 1 );
+
+	build_node_( bvh, aTriangles, centroids, order.data(), order.data() + order.size() );
+	return bvh;
+}
+
+//--    bake_vertex_occlusion()         ///{{{2///////////////////////////////
+std::vector<std::vector<float>> bake_vertex_occlusion( OcclusionBvh const& aBvh, std::vector<OcclusionMesh> const& aMeshes, std::size_t aRaysPerVertex, float aRadius, float aBias, unsigned aThreads, OcclusionStats* aStats, std::vector<OcclusionStats>* aMeshStats )
+{
+	auto const startTime = std::chrono::steady_clock::now();
+
+	// Work items are blocks of kVertexBlock vertices of a single mesh, so that
+	// many small meshes keep all threads busy. Items of mesh i start at
+	// firstBlock[i].
+	std::vector<std::vector<float>> ret( aMeshes.size() );
+	std::vector<std::size_t> firstBlock( aMeshes.size()+1, 0 );
+	for( std::size_t i = 0; i < aMeshes.size(); ++i )
+	{
+		auto const& mesh = *aMeshes[i].mesh;
+		assert( !aMeshes[i].instances->empty() );
+
+		std::size_t const vertexCount = mesh.vert.size();
+		ret[i].assign( vertexCount, 1.f );
+
+		bool const skip = aBvh.nodes.empty() || 0 == aRaysPerVertex || mesh.norm.empty();
+		firstBlock[i+1] = firstBlock[i] + (skip ? 0 : (vertexCount + kVertexBlock - 1) / kVertexBlock);
+	}
+
+	std::size_t const blockCount = firstBlock.back();
+
+	std::atomic<std::size_t> nextBlock{ 0 };
+	std::atomic<std::uint64_t> rayCount{ 0 };
+
+	// Per mesh, summed over the blocks (and thus over all threads)
+	std::vector<std::atomic<std::uint64_t>> meshRays( aMeshes.size() );
+	std::vector<std::atomic<std::uint64_t>> meshNanoseconds( aMeshes.size() );
+
+	auto const worker_ = [&] {
+		std::uint64_t rays = 0;
+
+		for( std::size_t block = nextBlock++; block < blockCount; block = nextBlock++ )
+		{
+			auto const mesh = std::size_t(std::upper_bound( firstBlock.begin(), firstBlock.end(), block ) - firstBlock.begin()) - 1;
+			std::size_t const begin = (block - firstBlock[mesh]) * kVertexBlock;
+			std::size_t const end = std::min( ret[mesh].size(), begin + kVertexBlock );
+
+			auto const blockStart = std::chrono::steady_clock::now();
+			auto const blockRays = bake_vertices_( aBvh, aMeshes[mesh], aRaysPerVertex, aRadius, aBias, begin, end, ret[mesh].data() );
+			auto const blockTime = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - blockStart );
+
+			meshRays[mesh] += blockRays;
+			meshNanoseconds[mesh] += std::uint64_t(blockTime.count());
+			rays += blockRays;
+		}
+
+		rayCount += rays;
+	};
+
+	std::vector<std::thread> threads;
+	for( unsigned i = 1; i < std::min<std::size_t>( std::max( aThreads, 1u ), std::max<std::size_t>( blockCount, 1 ) ); ++i )
+		threads.emplace_back( worker_ );
+
+	worker_();
+
+	for( auto& thread : threads )
+		thread.join();
+
+	if( aStats )
+	{
+		aStats->rays = rayCount;
+		aStats->seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - startTime ).count();
+	}
+
+	if( aMeshStats )
+	{
+		aMeshStats->resize( aMeshes.size() );
+		for( std::size_t i = 0; i < aMeshes.size(); ++i )
+		{
+			(*aMeshStats)[i].rays = meshRays[i];
+			(*aMeshStats)[i].seconds = meshNanoseconds[i] * 1e-9;
+		}
+	}
+
+	return ret;
+}
+
+//--    $ local                         ///{{{1///////////////////////////////
+namespace
+{
+	std::uint64_t bake_vertices_( OcclusionBvh const& aBvh, OcclusionMesh const& aMesh, std::size_t aRaysPerVertex, float aRadius, float aBias, std::size_t aBegin, std::size_t aEnd, float* aOut )
+	{
+		auto const& mesh = *aMesh.mesh;
+		auto const& instances = *aMesh.instances;
+
+		std::uint64_t rays = 0;
+		for( std::size_t v = aBegin; v < aEnd; ++v )
+		{
+			float const len = glm::length( mesh.norm[v] );
+			if( len <= 0.f )
+				continue;
+
+			// Per-vertex rotation of the (shared) Hammersley point set
+			std::uint32_t const seed = hash_u32_( std::uint32_t(v) );
+			float const r0 = (seed & 0xffff) / 65536.f;
+			float const r1 = (seed >> 16) / 65536.f;
+
+			std::size_t unoccluded = 0;
+			for( std::size_t i = 0; i < aRaysPerVertex; ++i )
+			{
+				// Rays cycle through the instances
+				auto const& xform = instances[i % instances.size()];
+				glm::vec3 const pos = xform * glm::vec4( mesh.vert[v], 1.f );
+				glm::vec3 const n = glm::normalize( glm::mat3( xform ) * (mesh.norm[v] / len) );
+
+				glm::vec3 t, b;
+				orthonormal_basis_( n, t, b );
+
+				// Cosine-weighted hemisphere sample
+				float const u0 = std::fmod( (i + 0.5f) / aRaysPerVertex + r0, 1.f );
+				float const u1 = std::fmod( radical_inverse_( std::uint32_t(i) ) + r1, 1.f );
+
+				float const r = std::sqrt( u0 );
+				float const phi = 6.2831853f * u1;
+				glm::vec3 const dir = r*std::cos( phi ) * t + r*std::sin( phi ) * b + std::sqrt( std::max( 0.f, 1.f - u0 ) ) * n;
+
+				Ray_ ray;
+				ray.origin = pos + n * aBias;
+				ray.dir = dir;
+				for( int k = 0; k < 3; ++k )
+				{
+					float const d = std::abs( dir[k] ) < 1e-20f ? std::copysign( 1e-20f, dir[k] ) : dir[k];
+					ray.invDir[k] = 1.f / d;
+				}
+				ray.tMax = aRadius;
+
+				if( !occluded_( aBvh, ray ) )
+					++unoccluded;
+			}
+
+			aOut[v] = float(unoccluded) / float(aRaysPerVertex);
+			rays += aRaysPerVertex;
+		}
+
+		return rays;
+	}
+
+	std::uint32_t build_node_( OcclusionBvh& aBvh, std::vector<glm::vec3> const& aTriangles, std::vector<glm::vec3> const& aCentroids, std::uint32_t* aBegin, std::uint32_t* aEnd )
+	{
+		auto const nodeIndex = std::uint32_t(aBvh.nodes.size());
+		aBvh.nodes.emplace_back();
+
+		OcclusionNode node{};
+		node.bmin = glm::vec3( std::numeric_limits<float>::max() );
+		node.bmax = glm::vec3( -std::numeric_limits<float>::max() );
+
+		glm::vec3 cmin( std::numeric_limits<float>::max() ), cmax( -std::numeric_limits<float>::max() );
+		for( auto* it = aBegin; it != aEnd; ++it )
+		{
+			for( std::size_t k = 0; k < 3; ++k )
+			{
+				node.bmin = glm::min( node.bmin, aTriangles[*it*3+k] );
+				node.bmax = glm::max( node.bmax, aTriangles[*it*3+k] );
+			}
+
+			cmin = glm::min( cmin, aCentroids[*it] );
+			cmax = glm::max( cmax, aCentroids[*it] );
+		}
+
+		auto const count = std::size_t(aEnd - aBegin);
+		if( count <= kPacketSize )
+		{
+			OcclusionPacket packet{}; // zero = degenerate
+			for( std::size_t i = 0; i < count; ++i )
+			{
+				auto const tri = aBegin[i];
+				glm::vec3 const v0 = aTriangles[tri*3+0];
+				glm::vec3 const e1 = aTriangles[tri*3+1] - v0;
+				glm::vec3 const e2 = aTriangles[tri*3+2] - v0;
+
+				for( int k = 0; k < 3; ++k )
+				{
+					packet.v0[k][i] = v0[k];
+					packet.e1[k][i] = e1[k];
+					packet.e2[k][i] = e2[k];
+				}
+			}
+
+			node.index = std::uint32_t(aBvh.packets.size());
+			node.count = std::uint32_t(count);
+			aBvh.packets.emplace_back( packet );
+
+			aBvh.nodes[nodeIndex] = node;
+			return nodeIndex;
+		}
+
+		// Median split along the longest axis of the centroid bounds
+		glm::vec3 const extent = cmax - cmin;
+		int axis = 0;
+		if( extent.y > extent[axis] ) axis = 1;
+		if( extent.z > extent[axis] ) axis = 2;
+
+		auto* const mid = aBegin + count/2;
+		std::nth_element( aBegin, mid, aEnd, [&] (std::uint32_t aX, std::uint32_t aY) {
+			return aCentroids[aX][axis] < aCentroids[aY][axis];
+		} );
+
+		build_node_( aBvh, aTriangles, aCentroids, aBegin, mid );
+		node.index = build_node_( aBvh, aTriangles, aCentroids, mid, aEnd );
+		node.count = 0;
+
+		aBvh.nodes[nodeIndex] = node;
+		return nodeIndex;
+	}
+
+	bool hit_box_( Ray_ const& aRay, OcclusionNode const& aNode )
+	{
+		glm::vec3 const t0 = (aNode.bmin - aRay.origin) * aRay.invDir;
+		glm::vec3 const t1 = (aNode.bmax - aRay.origin) * aRay.invDir;
+
+		glm::vec3 const tnear = glm::min( t0, t1 );
+		glm::vec3 const tfar = glm::max( t0, t1 );
+
+		float const tmin = std::max( std::max( tnear.x, tnear.y ), std::max( tnear.z, 0.f ) );
+		float const tmax = std::min( std::min( tfar.x, tfar.y ), std::min( tfar.z, aRay.tMax ) );
+
+		return tmin <= tmax;
+	}
+
+#	if BAKE_OCCLUSION_SSE_
+	bool hit_packet_( Ray_ const& aRay, OcclusionPacket const& aPacket, std::uint32_t )
+	{
+		// Moeller-Trumbore, four triangles at a time. Empty slots are
+		// degenerate (det = 0) and are rejected by the determinant test.
+		__m128 const dx = _mm_set1_ps( aRay.dir.x );
+		__m128 const dy = _mm_set1_ps( aRay.dir.y );
+		__m128 const dz = _mm_set1_ps( aRay.dir.z );
+
+		__m128 const e1x = _mm_load_ps( aPacket.e1[0] ), e1y = _mm_load_ps( aPacket.e1[1] ), e1z = _mm_load_ps( aPacket.e1[2] );
+		__m128 const e2x = _mm_load_ps( aPacket.e2[0] ), e2y = _mm_load_ps( aPacket.e2[1] ), e2z = _mm_load_ps( aPacket.e2[2] );
+
+		// p = d x e2
+		__m128 const px = _mm_sub_ps( _mm_mul_ps( dy, e2z ), _mm_mul_ps( dz, e2y ) );
+		__m128 const py = _mm_sub_ps( _mm_mul_ps( dz, e2x ), _mm_mul_ps( dx, e2z ) );
+		__m128 const pz = _mm_sub_ps( _mm_mul_ps( dx, e2y ), _mm_mul_ps( dy, e2x ) );
+
+		__m128 const det = _mm_add_ps( _mm_add_ps( _mm_mul_ps( e1x, px ), _mm_mul_ps( e1y, py ) ), _mm_mul_ps( e1z, pz ) );
+
+		__m128 const zero = _mm_setzero_ps();
+		__m128 const absDet = _mm_max_ps( det, _mm_sub_ps( zero, det ) );
+
+		__m128 valid = _mm_cmpgt_ps( absDet, _mm_set1_ps( kDetEpsilon ) );
+		if( 0 == _mm_movemask_ps( valid ) )
+			return false;
+
+		__m128 const inv = _mm_div_ps( _mm_set1_ps( 1.f ), det );
+
+		// s = o - v0
+		__m128 const sx = _mm_sub_ps( _mm_set1_ps( aRay.origin.x ), _mm_load_ps( aPacket.v0[0] ) );
+		__m128 const sy = _mm_sub_ps( _mm_set1_ps( aRay.origin.y ), _mm_load_ps( aPacket.v0[1] ) );
+		__m128 const sz = _mm_sub_ps( _mm_set1_ps( aRay.origin.z ), _mm_load_ps( aPacket.v0[2] ) );
+
+		__m128 const u = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( sx, px ), _mm_mul_ps( sy, py ) ), _mm_mul_ps( sz, pz ) ), inv );
+
+		// q = s x e1
+		__m128 const qx = _mm_sub_ps( _mm_mul_ps( sy, e1z ), _mm_mul_ps( sz, e1y ) );
+		__m128 const qy = _mm_sub_ps( _mm_mul_ps( sz, e1x ), _mm_mul_ps( sx, e1z ) );
+		__m128 const qz = _mm_sub_ps( _mm_mul_ps( sx, e1y ), _mm_mul_ps( sy, e1x ) );
+
+		__m128 const v = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, qx ), _mm_mul_ps( dy, qy ) ), _mm_mul_ps( dz, qz ) ), inv );
+		__m128 const t = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( e2x, qx ), _mm_mul_ps( e2y, qy ) ), _mm_mul_ps( e2z, qz ) ), inv );
+
+		valid = _mm_and_ps( valid, _mm_cmpge_ps( u, zero ) );
+		valid = _mm_and_ps( valid, _mm_cmpge_ps( v, zero ) );
+		valid = _mm_and_ps( valid, _mm_cmple_ps( _mm_add_ps( u, v ), _mm_set1_ps( 1.f ) ) );
+		valid = _mm_and_ps( valid, _mm_cmpgt_ps( t, zero ) );
+		valid = _mm_and_ps( valid, _mm_cmplt_ps( t, _mm_set1_ps( aRay.tMax ) ) );
+
+		return 0 != _mm_movemask_ps( valid );
+	}
+#	else // !BAKE_OCCLUSION_SSE_
+	bool hit_packet_( Ray_ const& aRay, OcclusionPacket const& aPacket, std::uint32_t aCount )
+	{
+		for( std::uint32_t i = 0; i < aCount; ++i )
+		{
+			glm::vec3 const v0( aPacket.v0[0][i], aPacket.v0[1][i], aPacket.v0[2][i] );
+			glm::vec3 const e1( aPacket.e1[0][i], aPacket.e1[1][i], aPacket.e1[2][i] );
+			glm::vec3 const e2( aPacket.e2[0][i], aPacket.e2[1][i], aPacket.e2[2][i] );
+
+			glm::vec3 const p = glm::cross( aRay.dir, e2 );
+			float const det = glm::dot( e1, p );
+			if( std::abs( det ) <= kDetEpsilon )
+				continue;
+
+			float const inv = 1.f / det;
+
+			glm::vec3 const s = aRay.origin - v0;
+			float const u = glm::dot( s, p ) * inv;
+			if( u < 0.f || u > 1.f )
+				continue;
+
+			glm::vec3 const q = glm::cross( s, e1 );
+			float const v = glm::dot( aRay.dir, q ) * inv;
+			if( v < 0.f || u + v > 1.f )
+				continue;
+
+			float const t = glm::dot( e2, q ) * inv;
+			if( t > 0.f && t < aRay.tMax )
+				return true;
+		}
+
+		return false;
+	}
+#	endif // ~ BAKE_OCCLUSION_SSE_
+
+	bool occluded_( OcclusionBvh const& aBvh, Ray_ const& aRay )
+	{
+		std::uint32_t stack[kMaxStackDepth];
+		std::size_t top = 0;
+		stack[top++] = 0;
+
+		while( top )
+		{
+			auto const& node = aBvh.nodes[stack[--top]];
+			if( !hit_box_( aRay, node ) )
+				continue;
+
+			if( node.count )
+			{
+				if( hit_packet_( aRay, aBvh.packets[node.index], node.count ) )
+					return true;
+				continue;
+			}
+
+			// Any hit terminates the ray, so the visiting order only matters
+			// for performance.
+			assert( top + 2 <= kMaxStackDepth );
+			stack[top++] = node.index;
+			stack[top++] = std::uint32_t(&node - aBvh.nodes.data()) + 1;
+		}
+
+		return false;
+	}
+
+	float radical_inverse_( std::uint32_t aBits )
+	{
+		aBits = (aBits << 16u) | (aBits >> 16u);
+		aBits = ((aBits & 0x55555555u) << 1u) | ((aBits & 0xAAAAAAAAu) >> 1u);
+		aBits = ((aBits & 0x33333333u) << 2u) | ((aBits & 0xCCCCCCCCu) >> 2u);
+		aBits = ((aBits & 0x0F0F0F0Fu) << 4u) | ((aBits & 0xF0F0F0F0u) >> 4u);
+		aBits = ((aBits & 0x00FF00FFu) << 8u) | ((aBits & 0xFF00FF00u) >> 8u);
+		return float(aBits) * 2.3283064365386963e-10f; // / 2^32
+	}
+
+	std::uint32_t hash_u32_( std::uint32_t aX )
+	{
+		aX ^= aX >> 16;
+		aX *= 0x7feb352du;
+		aX ^= aX >> 15;
+		aX *= 0x846ca68bu;
+		aX ^= aX >> 16;
+		return aX;
+	}
+
+	void orthonormal_basis_( glm::vec3 const& aN, glm::vec3& aT, glm::vec3& aB )
+	{
+		// Duff et al., "Building an Orthonormal Basis, Revisited" (2017)
+		float const sign = std::copysign( 1.f, aN.z );
+		float const a = -1.f / (sign + aN.z);
+		float const b = aN.x * aN.y * a;
+
+		aT = glm::vec3( 1.f + sign * aN.x * aN.x * a, sign * b, -sign * aN.x );
+		aB = glm::vec3( b, sign + aN.y * aN.y * a, -aN.y );
+	}
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
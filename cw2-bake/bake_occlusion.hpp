@@ -0,0 +1,98 @@
+#ifndef BAKE_OCCLUSION_HPP_4C9E2B17_D60A_4F38_A5E1_7B83F0C2964D
+#define BAKE_OCCLUSION_HPP_4C9E2B17_D60A_4F38_A5E1_7B83F0C2964D
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x3.hpp>
+
+#include "index_mesh.hpp"
+
+//--    types                                   ///{{{1///////////////////////
+
+/* Four triangles in SoA form, so that a ray can be tested against all of
+ * them at once. Unused slots hold degenerate triangles, which never hit.
+ */
+struct alignas(16) OcclusionPacket
+{
+	float v0[3][4];
+	float e1[3][4];
+	float e2[3][4];
+};
+
+struct OcclusionNode
+{
+	glm::vec3 bmin;
+	std::uint32_t index;  // leaf: packet index; inner: right child
+	glm::vec3 bmax;
+	std::uint32_t count;  // leaf: number of triangles (1-4); inner: 0
+};
+
+/* Bounding volume hierarchy over the whole scene. Inner nodes store their
+ * left child immediately after themselves.
+ */
+struct OcclusionBvh
+{
+	std::vector<OcclusionNode> nodes;
+	std::vector<OcclusionPacket> packets;
+
+	glm::vec3 sceneMin, sceneMax;
+};
+
+// A mesh to bake, with the transforms of its instances (at least one)
+struct OcclusionMesh
+{
+	IndexedMesh const* mesh;
+	std::vector<glm::mat4x3> const* instances;
+};
+
+struct OcclusionStats
+{
+	std::uint64_t rays = 0;
+	double seconds = 0.0;
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+/* Builds a BVH over a triangle soup (three world-space positions per
+ * triangle). Triangles are split at the median centroid along the longest
+ * axis, until each leaf fits into a single OcclusionPacket.
+ */
+OcclusionBvh build_occlusion_bvh(
+	std::vector<glm::vec3> const& aTriangles
+);
+
+/* Computes per-vertex ambient occlusion for each mesh: the fraction of
+ * cosine-weighted hemisphere rays (around the vertex normal) that do not hit
+ * any geometry within aRadius. Returns one value in [0,1] per vertex of each
+ * mesh; 1 is fully unoccluded.
+ *
+ * Instanced meshes share their vertex data, so rays are distributed over all
+ * instance transforms and the result is the average over the instances.
+ * Rays start aBias away from the surface, to avoid self-intersection.
+ *
+ * All meshes are baked in one go: aThreads threads are started once and
+ * pick up blocks of vertices from any mesh. Ray/triangle tests use SSE when
+ * available.
+ *
+ * aStats receives the total (wall clock) time. aMeshStats receives one entry
+ * per mesh, with the time summed over the threads that worked on it.
+ */
+std::vector<std::vector<float>> bake_vertex_occlusion(
+	OcclusionBvh const&,
+	std::vector<OcclusionMesh> const&,
+	std::size_t aRaysPerVertex,
+	float aRadius,
+	float aBias,
+	unsigned aThreads,
+	OcclusionStats* aStats = nullptr,
+	std::vector<OcclusionStats>* aMeshStats = nullptr
+);
+
+#endif // BAKE_OCCLUSION_HPP_4C9E2B17_D60A_4F38_A5E1_7B83F0C2964D
@@ -0,0 +1,86 @@
+#ifndef BOUNDED_QUEUE_HPP_93B5E0D4_2A7C_4E61_8F1B_C4D62A07E358
+#define BOUNDED_QUEUE_HPP_93B5E0D4_2A7C_4E61_8F1B_C4D62A07E358
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <condition_variable>
+
+#include <cstddef>
+
+//--    classes                                 ///{{{1///////////////////////
+
+/* Queue with a fixed capacity, for handing work from a producer thread to a
+ * consumer thread. push() blocks while the queue is full, so the producer
+ * can never run more than the capacity ahead of the consumer. This bounds
+ * the memory held by items in flight.
+ *
+ * close() wakes up all waiting threads: subsequent push()es fail, and pop()
+ * fails once the remaining items have been drained.
+ */
+template< typename tItem >
+class BoundedQueue
+{
+	public:
+		explicit BoundedQueue( std::size_t aCapacity )
+			: mCapacity( aCapacity ? aCapacity : 1 )
+		{}
+
+		BoundedQueue( BoundedQueue const& ) = delete;
+		BoundedQueue& operator= (BoundedQueue const&) = delete;
+
+	public:
+		bool push( tItem aItem )
+		{
+			std::unique_lock<std::mutex> lock( mMutex );
+			mNotFull.wait( lock, [this] { return mClosed || mItems.size() < mCapacity; } );
+
+			if( mClosed )
+				return false;
+
+			mItems.emplace_back( std::move(aItem) );
+			mNotEmpty.notify_one();
+			return true;
+		}
+
+		bool pop( tItem& aItem )
+		{
+			std::unique_lock<std::mutex> lock( mMutex );
+			mNotEmpty.wait( lock, [this] { return mClosed || !mItems.empty(); } );
+
+			if( mItems.empty() )
+				return false;
+
+			aItem = std::move(mItems.front());
+			mItems.pop_front();
+			mNotFull.notify_one();
+			return true;
+		}
+
+		void close()
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mClosed = true;
+			mNotFull.notify_all();
+			mNotEmpty.notify_all();
+		}
+
+		std::size_t capacity() const noexcept
+		{
+			return mCapacity;
+		}
+
+	private:
+		std::size_t const mCapacity;
+
+		std::mutex mMutex;
+		std::condition_variable mNotFull, mNotEmpty;
+
+		std::deque<tItem> mItems;
+		bool mClosed = false;
+};
+
+#endif // BOUNDED_QUEUE_HPP_93B5E0D4_2A7C_4E61_8F1B_C4D62A07E358
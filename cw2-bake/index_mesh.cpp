@@ -1,8 +1,11 @@
 #include "index_mesh.hpp"
 
+#include <array>
 #include <numeric>
 #include <unordered_map>
+#include <unordered_set>
 #include <tgen.h>
+#include <cstring>
 #include <cstddef>
 #include <math.h>
 #include <glm/glm.hpp>
@@ -41,12 +44,20 @@ namespace
 		std::vector<glm::vec3> const&
 	);
 
+	// tolerances, in the form used by mergable_()
+	struct MergeParams_
+	{
+		float position;
+		float normalCos; // cosine of the maximal normal angle
+		float texcoord;
+	};
+
 	// is a vertex mergable?
 	bool mergable_( 
 		TriangleSoup const&, 
 		std::size_t aVertexAIndex, std::size_t aVertexBIndex,
 		glm::vec3 const& aVertexAPos, glm::vec3 const& aVertexBPos,
-		float
+		MergeParams_ const&
 	);
 
 	// collapse vertices
@@ -59,9 +70,23 @@ namespace
 		VicinityMap_ const&, 
 		Discretizer_ const&, 
 		TriangleSoup const&, 
-		float
+		MergeParams_ const&
+	);
+
+	// merge bit-identical vertices (hashing only)
+	std::size_t collapse_exact_( 
+		IndexBuffer_&, 
+		VertexMapping_&, 
+		TriangleSoup const&
 	);
 
+	// drop degenerate and duplicate triangles, and unused vertices
+	void remove_bad_triangles_(
+		IndexBuffer_&,
+		VertexMapping_&,
+		TriangleSoup const&,
+		WeldStats&
+	);
 }
 
 //--    IndexedMesh                     ///{{{2///////////////////////////////
@@ -71,8 +96,10 @@ IndexedMesh::IndexedMesh()
 {}
 
 //--    make_indexed_mesh()             ///{{{2///////////////////////////////
-IndexedMesh make_indexed_mesh( TriangleSoup const& aSoup, float aErrorTolerance )
+IndexedMesh make_indexed_mesh( TriangleSoup const& aSoup, WeldTolerances const& aTolerances, WeldStats* aStats )
 {
+	WeldStats stats;
+
 	// compute bounding volume
 	glm::vec3 bmin( std::numeric_limits<float>::max() );
 	glm::vec3 bmax( std::numeric_limits<float>::min() );
@@ -83,32 +110,77 @@ IndexedMesh make_indexed_mesh( TriangleSoup const& aSoup, float aErrorTolerance
 		bmax = max( bmax, aSoup.vert[vert] );
 	}
 
-	auto const fmin = bmin - glm::vec3( kAABBMarginFactor * aErrorTolerance );
-	auto const fmax = bmax + glm::vec3( kAABBMarginFactor * aErrorTolerance );
+	// collapse exact duplicates. This is cheap, and typically removes most
+	// of the vertices of a triangle soup.
+	IndexBuffer_ indices;
+	VertexMapping_ vertexMapping;
 
-	// Compute grid size
-	auto const side = fmax - fmin;
-	float const maxSide = std::max( side.x, std::max( side.y, side.z ) );
+	std::size_t verts = collapse_exact_( indices, vertexMapping, aSoup );
+	stats.exactMerged = aSoup.vert.size() - verts;
 
-	float const numCells = maxSide / (2.f*aErrorTolerance);
-	std::size_t subdiv = std::min( kSparseGridMaxSize, std::size_t(numCells+.5f) );
+	// collapse near duplicates among the remaining vertices
+	bool const tolerant = aTolerances.position > 0.f || aTolerances.normalAngle > 0.f || aTolerances.texcoord > 0.f;
+	if( tolerant && verts > 1 )
+	{
+		TriangleSoup unique;
+		unique.vert.reserve( verts );
+		unique.text.reserve( verts );
+		for( auto const from : vertexMapping )
+		{
+			unique.vert.emplace_back( aSoup.vert[from] );
+			unique.text.emplace_back( aSoup.text[from] );
+			if( !aSoup.norm.empty() )
+				unique.norm.emplace_back( aSoup.norm[from] );
+		}
 
-	// parameters for discretization
-	Discretizer_ dis( std::uint32_t(subdiv), fmin, maxSide );
+		float const posTol = std::max( aTolerances.position, std::numeric_limits<float>::min() );
 
-	// build the vincinity map
-	VicinityMap_ vincinityMap;
-	build_vicinity_map_( vincinityMap, dis, aSoup.vert );
+		auto const fmin = bmin - glm::vec3( kAABBMarginFactor * posTol );
+		auto const fmax = bmax + glm::vec3( kAABBMarginFactor * posTol );
 
-	// collapse vertices
-	IndexBuffer_ indices;
-	VertexMapping_ vertexMapping;
+		// Compute grid size
+		auto const side = fmax - fmin;
+		float const maxSide = std::max( side.x, std::max( side.y, side.z ) );
+
+		float const numCells = std::min( float(kSparseGridMaxSize), maxSide / (2.f*posTol) );
+		std::size_t const subdiv = std::max( std::size_t(1), std::size_t(numCells+.5f) );
+
+		// parameters for discretization
+		Discretizer_ dis( std::uint32_t(subdiv), fmin, maxSide );
+
+		// build the vincinity map
+		VicinityMap_ vincinityMap;
+		build_vicinity_map_( vincinityMap, dis, unique.vert );
+
+		MergeParams_ const params{ aTolerances.position, std::cos( aTolerances.normalAngle ), aTolerances.texcoord };
 
-	size_t verts = collapse_vertices_( indices, vertexMapping, vincinityMap, dis, aSoup, aErrorTolerance );
+		IndexBuffer_ uniqueIndices;
+		VertexMapping_ uniqueMapping;
+		std::size_t const welded = collapse_vertices_( uniqueIndices, uniqueMapping, vincinityMap, dis, unique, params );
+
+		assert( uniqueIndices.size() == verts );
+		stats.toleranceMerged = verts - welded;
+
+		// compose: soup -> unique -> welded
+		for( auto& index : indices )
+			index = uniqueIndices[index];
+		for( auto& from : uniqueMapping )
+			from = vertexMapping[from];
+
+		vertexMapping = std::move(uniqueMapping);
+		verts = welded;
+	}
 
 	assert( indices.size() == aSoup.vert.size() );
 	assert( verts == vertexMapping.size() );
 
+	// remove triangles that welding made degenerate, and duplicates
+	remove_bad_triangles_( indices, vertexMapping, aSoup, stats );
+	verts = vertexMapping.size();
+
+	if( aStats )
+		*aStats = stats;
+
 	// shuffle vertex data
 	IndexedMesh ret;
 		
@@ -358,34 +430,37 @@ namespace
 
 namespace
 {
-	bool mergable_( TriangleSoup const& aSoup, size_t aI, size_t aJ, glm::vec3 const& aIPos, glm::vec3 const& aJPos, float aErrorTolerance )
+	bool mergable_( TriangleSoup const& aSoup, size_t aI, size_t aJ, glm::vec3 const& aIPos, glm::vec3 const& aJPos, MergeParams_ const& aParams )
 	{
 		// Compare all elements component-wise. 
 		// start with positions, since we've already got those
 		for( std::size_t i = 0; i < 3; ++i )
 		{
-			if( std::abs(aIPos[i]-aJPos[i]) > aErrorTolerance )
+			if( std::abs(aIPos[i]-aJPos[i]) > aParams.position )
 				return false;
 		}
 
-		// Compare normals
-		if( !aSoup.norm.empty() )
-		{
-			auto const nI = aSoup.norm[aI];
-			auto const nJ = aSoup.norm[aJ];
-			for( size_t i = 0; i < 3; ++i )
-			{
-				if( std::abs(nI[i]-nJ[i]) > aErrorTolerance )
-					return false;
-			}
-		}
-
 		// Compare tex coord
 		auto const tI = aSoup.text[aI];
 		auto const tJ = aSoup.text[aJ];
 		for( std::size_t i = 0; i < 2; ++i )
 		{
-			if( std::abs(tI[i]-tJ[i]) > aErrorTolerance )
+			if( std::abs(tI[i]-tJ[i]) > aParams.texcoord )
+				return false;
+		}
+
+		// Compare normals by angle. Normals in the input are not necessarily
+		// unit length; zero-length normals only merge with each other.
+		if( !aSoup.norm.empty() )
+		{
+			auto const nI = aSoup.norm[aI];
+			auto const nJ = aSoup.norm[aJ];
+
+			float const lenSq = glm::dot( nI, nI ) * glm::dot( nJ, nJ );
+			if( lenSq <= 0.f )
+				return nI == nJ;
+
+			if( glm::dot( nI, nJ ) < aParams.normalCos * std::sqrt( lenSq ) )
 				return false;
 		}
 	
@@ -424,7 +499,7 @@ namespace
 	}
 
 	// Merge vertices
-	size_t collapse_vertices_( IndexBuffer_& aIndices, VertexMapping_& aVertices, VicinityMap_ const& aVM, Discretizer_ const& aD, TriangleSoup const& aSoup, float aMaxError )
+	size_t collapse_vertices_( IndexBuffer_& aIndices, VertexMapping_& aVertices, VicinityMap_ const& aVM, Discretizer_ const& aD, TriangleSoup const& aSoup, MergeParams_ const& aParams )
 	{
 		aVertices.clear();
 		aVertices.reserve( aSoup.vert.size() );
@@ -469,7 +544,7 @@ namespace
 					if( ~std::size_t(0) != collapseMap[idx] ) continue; // don't remerge
 
 					auto const other = aSoup.vert[idx];
-					if( mergable_( aSoup, i, idx, self, other, aMaxError ) )
+					if( mergable_( aSoup, i, idx, self, other, aParams ) )
 					{
 						std::size_t toWhere;
 						
@@ -508,4 +583,133 @@ namespace
 	}
 }
 
+namespace
+{
+	// Exact vertex key: the bit patterns of all attributes
+	using VertexKey_ = std::array<std::uint32_t,8>;
+
+	struct VertexKeyHash_
+	{
+		std::size_t operator()( VertexKey_ const& aKey ) const noexcept
+		{
+			std::uint64_t hash = 0xcbf29ce484222325ull;
+			for( auto const word : aKey )
+				hash = (hash ^ word) * 0x100000001b3ull;
+			return std::size_t(hash ^ (hash >> 32));
+		}
+	};
+
+	void put_key_( VertexKey_& aKey, std::size_t aAt, float aValue )
+	{
+		aValue += 0.f; // -0 => +0, so that both hash the same
+		std::memcpy( &aKey[aAt], &aValue, sizeof(float) );
+	}
+
+	size_t collapse_exact_( IndexBuffer_& aIndices, VertexMapping_& aVertices, TriangleSoup const& aSoup )
+	{
+		aVertices.clear();
+		aIndices.clear();
+		aIndices.reserve( aSoup.vert.size() );
+
+		std::unordered_map<VertexKey_,std::uint32_t,VertexKeyHash_> unique;
+		unique.reserve( aSoup.vert.size() );
+
+		for( std::size_t i = 0; i < aSoup.vert.size(); ++i )
+		{
+			VertexKey_ key{};
+			for( std::size_t k = 0; k < 3; ++k )
+				put_key_( key, k, aSoup.vert[i][k] );
+			for( std::size_t k = 0; k < 2; ++k )
+				put_key_( key, 3+k, aSoup.text[i][k] );
+			if( !aSoup.norm.empty() )
+			{
+				for( std::size_t k = 0; k < 3; ++k )
+					put_key_( key, 5+k, aSoup.norm[i][k] );
+			}
+
+			auto const [it, isNew] = unique.emplace( key, std::uint32_t(aVertices.size()) );
+			if( isNew )
+				aVertices.push_back( i );
+
+			aIndices.push_back( it->second );
+		}
+
+		return aVertices.size();
+	}
+
+	void remove_bad_triangles_( IndexBuffer_& aIndices, VertexMapping_& aVertices, TriangleSoup const& aSoup, WeldStats& aStats )
+	{
+		struct TriangleHash_
+		{
+			std::size_t operator()( std::array<std::uint32_t,3> const& aTri ) const noexcept
+			{
+				std::uint64_t const h = (std::uint64_t(aTri[0]) * 0x9e3779b97f4a7c15ull) ^ (std::uint64_t(aTri[1]) * 0xc2b2ae3d27d4eb4full) ^ aTri[2];
+				return std::size_t(h ^ (h >> 29));
+			}
+		};
+
+		std::unordered_set<std::array<std::uint32_t,3>,TriangleHash_> seen;
+		seen.reserve( aIndices.size()/3 );
+
+		IndexBuffer_ kept;
+		kept.reserve( aIndices.size() );
+
+		for( std::size_t t = 0; t+2 < aIndices.size(); t += 3 )
+		{
+			std::uint32_t const a = aIndices[t+0], b = aIndices[t+1], c = aIndices[t+2];
+
+			bool degenerate = (a == b || b == c || c == a);
+			if( !degenerate )
+			{
+				auto const& pa = aSoup.vert[aVertices[a]];
+				glm::vec3 const n = glm::cross( aSoup.vert[aVertices[b]] - pa, aSoup.vert[aVertices[c]] - pa );
+				degenerate = (glm::vec3( 0.f ) == n);
+			}
+
+			if( degenerate )
+			{
+				++aStats.degenerateTriangles;
+				continue;
+			}
+
+			// Canonical rotation (smallest index first) keeps the winding, so
+			// that back-to-back (two-sided) triangles are not removed.
+			std::array<std::uint32_t,3> key{ a, b, c };
+			if( b < a && b < c )
+				key = { b, c, a };
+			else if( c < a && c < b )
+				key = { c, a, b };
+
+			if( !seen.insert( key ).second )
+			{
+				++aStats.duplicateTriangles;
+				continue;
+			}
+
+			kept.push_back( a );
+			kept.push_back( b );
+			kept.push_back( c );
+		}
+
+		// Renumber vertices in order of first use, dropping unused ones
+		std::vector<std::uint32_t> remap( aVertices.size(), ~std::uint32_t(0) );
+		VertexMapping_ vertices;
+		vertices.reserve( aVertices.size() );
+
+		for( auto& index : kept )
+		{
+			if( ~std::uint32_t(0) == remap[index] )
+			{
+				remap[index] = std::uint32_t(vertices.size());
+				vertices.push_back( aVertices[index] );
+			}
+
+			index = remap[index];
+		}
+
+		aIndices = std::move(kept);
+		aVertices = std::move(vertices);
+	}
+}
+
 //--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab: 
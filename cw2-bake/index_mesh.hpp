@@ -6,6 +6,7 @@
 
 #include <vector>
 
+#include <cstddef>
 #include <cstdint>
 
 #include <glm/vec2.hpp>
@@ -34,11 +35,39 @@ struct IndexedMesh
 	IndexedMesh();
 };
 
+/* Tolerances for welding vertices. Two vertices are merged if their
+ * positions differ by at most `position` (per component), their normals by
+ * at most `normalAngle` (radians) and their texture coordinates by at most
+ * `texcoord` (per component). If all tolerances are zero, only exact
+ * duplicates are merged, which requires no spatial search.
+ */
+struct WeldTolerances
+{
+	float position = 1e-6f;
+	float normalAngle = 1e-6f;
+	float texcoord = 1e-6f;
+};
+
+struct WeldStats
+{
+	std::size_t exactMerged = 0;       // vertices removed as exact duplicates
+	std::size_t toleranceMerged = 0;   // vertices removed by the tolerances
+	std::size_t degenerateTriangles = 0;
+	std::size_t duplicateTriangles = 0;
+};
+
 //--    functions                               ///{{{1///////////////////////
 
+/* Welds the vertices of a triangle soup into an indexed mesh. Exact
+ * duplicates are merged first, by hashing; only the remaining unique
+ * vertices are searched for near matches. Triangles that become degenerate
+ * (repeated vertex or zero area) and duplicate triangles (same vertices in
+ * the same winding) are removed, as are the vertices that are left unused.
+ */
 IndexedMesh make_indexed_mesh(
 	TriangleSoup const&,
-	float aErrorTol = 1e-6f
+	WeldTolerances const& = WeldTolerances{},
+	WeldStats* = nullptr
 );
 
 void ensure_normals( IndexedMesh& );
@@ -1,5 +1,6 @@
 #include "load_model_obj.hpp"
 
+#include <fstream>
 #include <unordered_set>
 
 #include <cassert>
@@ -11,6 +12,13 @@
 #include "input_model.hpp"
 namespace lut = labutils;
 
+namespace
+{
+	std::vector<InputMaterialInfo> convert_materials_( rapidobj::Materials const&, std::string const& aPrefix );
+
+	std::string path_prefix_( char const* aPath );
+}
+
 InputModel load_wavefront_obj( char const* aPath )
 {
 	assert( aPath );
@@ -27,13 +35,7 @@ InputModel load_wavefront_obj( char const* aPath )
 	rapidobj::Triangulate( result );
 
 	// Find the path to the OBJ file
-	char const* pathBeg = aPath;
-	char const* pathEnd = std::strrchr( pathBeg, '/' );
-	
-	std::string const prefix = pathEnd
-		? std::string( pathBeg, pathEnd+1 )
-		: ""
-	;
+	std::string const prefix = path_prefix_( aPath );
 
 	// Convert the OBJ data into a InputModel structure.
 	// First, extract material data.
@@ -41,40 +43,7 @@ InputModel load_wavefront_obj( char const* aPath )
 
 	ret.modelSourcePath = aPath;
 
-	for( auto const& mat : result.materials )
-	{
-		InputMaterialInfo mi;
-
-		mi.materialName  = mat.name;
-
-		mi.baseColor   = glm::vec3( mat.diffuse[0], mat.diffuse[1], mat.diffuse[2] );
-
-		mi.baseRoughness  = mat.roughness;
-		mi.baseMetalness  = mat.metallic;
-
-		if( !mat.diffuse_texname.empty() )
-			mi.baseColorTexturePath  = prefix + mat.diffuse_texname;
-
-		if( !mat.roughness_texname.empty() )
-			mi.roughnessTexturePath  = prefix + mat.roughness_texname;
-		if( !mat.metallic_texname.empty() )
-			mi.metalnessTexturePath  = prefix + mat.metallic_texname;
-
-		if( !mat.alpha_texname.empty() )
-			mi.alphaMaskTexturePath  = prefix + mat.alpha_texname;
-
-		if( !mat.normal_texname.empty() )
-			mi.normalMapTexturePath  = prefix + mat.normal_texname;
-
-#	if 0
-		mi.diffuseColor  = glm::vec3( mat.diffuse[0], mat.diffuse[1], mat.diffuse[2] );
-
-		if( !mat.diffuse_texname.empty() )
-			mi.diffuseTexturePath  = prefix + mat.diffuse_texname;
-#	endif
-
-		ret.materials.emplace_back( std::move(mi) );
-	}
+	ret.materials = convert_materials_( result.materials, prefix );
 
 	// Next, extract the actual mesh data. There are some complications:
 	// - OBJ use separate indices to positions, normals and texture coords. To
@@ -169,3 +138,91 @@ InputModel load_wavefront_obj( char const* aPath )
 	return ret;
 }
 
+std::vector<InputMaterialInfo> load_wavefront_mtl( char const* aObjPath, std::vector<std::string> const& aLibraries, std::filesystem::path const& aTempDir )
+{
+	assert( aObjPath );
+
+	if( aLibraries.empty() )
+		return {};
+
+	// rapidobj only parses material libraries as part of an OBJ file. Give it
+	// a stub that references the libraries, and let it look for them next to
+	// the original OBJ file.
+	auto const stubPath = aTempDir / "materials.obj";
+	{
+		std::ofstream stub( stubPath );
+		for( auto const& lib : aLibraries )
+			stub << "mtllib " << lib << "\n";
+
+		if( !stub )
+			throw lut::Error( "Unable to write '%s'", stubPath.string().c_str() );
+	}
+
+	// Relative search paths are resolved against the stub's directory
+	auto const objDir = std::filesystem::absolute( aObjPath ).parent_path();
+	auto result = rapidobj::ParseFile( stubPath, rapidobj::MaterialLibrary::SearchPath( objDir ) );
+
+	std::error_code ec;
+	std::filesystem::remove( stubPath, ec );
+
+	if( result.error )
+		throw lut::Error( "Unable to load materials for '%s': %s", aObjPath, result.error.code.message().c_str() );
+
+	return convert_materials_( result.materials, path_prefix_( aObjPath ) );
+}
+
+namespace
+{
+	std::vector<InputMaterialInfo> convert_materials_( rapidobj::Materials const& aMaterials, std::string const& aPrefix )
+	{
+		std::vector<InputMaterialInfo> ret;
+
+		for( auto const& mat : aMaterials )
+		{
+			InputMaterialInfo mi;
+
+			mi.materialName  = mat.name;
+
+			mi.baseColor   = glm::vec3( mat.diffuse[0], mat.diffuse[1], mat.diffuse[2] );
+
+			mi.baseRoughness  = mat.roughness;
+			mi.baseMetalness  = mat.metallic;
+
+			if( !mat.diffuse_texname.empty() )
+				mi.baseColorTexturePath  = aPrefix + mat.diffuse_texname;
+
+			if( !mat.roughness_texname.empty() )
+				mi.roughnessTexturePath  = aPrefix + mat.roughness_texname;
+			if( !mat.metallic_texname.empty() )
+				mi.metalnessTexturePath  = aPrefix + mat.metallic_texname;
+
+			if( !mat.alpha_texname.empty() )
+				mi.alphaMaskTexturePath  = aPrefix + mat.alpha_texname;
+
+			if( !mat.normal_texname.empty() )
+				mi.normalMapTexturePath  = aPrefix + mat.normal_texname;
+
+#	if 0
+			mi.diffuseColor  = glm::vec3( mat.diffuse[0], mat.diffuse[1], mat.diffuse[2] );
+
+			if( !mat.diffuse_texname.empty() )
+				mi.diffuseTexturePath  = aPrefix + mat.diffuse_texname;
+#	endif
+
+			ret.emplace_back( std::move(mi) );
+		}
+
+		return ret;
+	}
+
+	std::string path_prefix_( char const* aPath )
+	{
+		char const* pathBeg = aPath;
+		char const* pathEnd = std::strrchr( pathBeg, '/' );
+		
+		return pathEnd
+			? std::string( pathBeg, pathEnd+1 )
+			: ""
+		;
+	}
+}
@@ -1,10 +1,23 @@
 #ifndef LOAD_MODEL_OBJ_HPP_7FB6DF28_3D89_48DD_9FD8_4E53FB04723C
 #define LOAD_MODEL_OBJ_HPP_7FB6DF28_3D89_48DD_9FD8_4E53FB04723C
 
+#include <string>
+#include <vector>
+#include <filesystem>
+
 #include "input_model.hpp"
 
 // Load a Wavefront OBJ model
 InputModel load_wavefront_obj( char const* aPath );
 
+// Load only the materials of a Wavefront OBJ model, from the given material
+// libraries (names as in the OBJ's mtllib statements). A small stub file is
+// written to aTempDir while loading.
+std::vector<InputMaterialInfo> load_wavefront_mtl(
+	char const* aObjPath,
+	std::vector<std::string> const& aLibraries,
+	std::filesystem::path const& aTempDir
+);
+
 #endif // LOAD_MODEL_OBJ_HPP_7FB6DF28_3D89_48DD_9FD8_4E53FB04723C
 
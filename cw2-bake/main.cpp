@@ -1,20 +1,42 @@
+#include <random>
+#include <chrono>
+#include <string>
+#include <thread>
 #include <iterator>
 #include <vector>
 #include <typeinfo>
+#include <algorithm>
+#include <limits>
 #include <exception>
+#include <functional>
 #include <filesystem>
 #include <system_error>
 #include <unordered_map>
 
+#include <cmath>
 #include <cstdio>
+#include <cassert>
 #include <cstring>
 
 #include <tgen.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <stb_image.h>
 
 #include "index_mesh.hpp"
 #include "input_model.hpp"
 #include "load_model_obj.hpp"
+#include "mesh_instances.hpp"
+#include "split_mesh.hpp"
+#include "texture_dedup.hpp"
+#include "texture_budget.hpp"
+#include "texture_average.hpp"
+#include "bake_occlusion.hpp"
+#include "output_file.hpp"
+#include "bounded_queue.hpp"
+#include "spill_model_obj.hpp"
+#include "task_graph.hpp"
 
 #include "../labutils/error.hpp"
 namespace lut = labutils;
@@ -40,54 +62,203 @@ namespace
 	 * indicate that this is a custom format by myself (=scsmbil) with
 	 * additional tangent space information.
 	 */
-	constexpr char kFileVariant[16] = "scsmbil-pac";//scsmbil-tan default scsmbil-pac
+	constexpr char kFileVariant[16] = "scsmbil-avg";//scsmbil-tan default scsmbil-pac scsmbil-ins scsmbil-chk scsmbil-ilv scsmbil-ao scsmbil-str scsmbil-ooc scsmbil-avg
+
+	/* Vertex layouts. See cw2/baked_model.hpp for the exact byte layout of
+	 * each; the values are stored in the file header.
+	 */
+	enum class VertexLayout_ : std::uint32_t
+	{
+		separate = 0,    // one array per attribute
+		interleaved = 1, // one packed stream per mesh
+		hybrid = 2       // positions + one packed stream for everything else
+	};
+
+	constexpr std::size_t kPackedAttributeSize = 28; // uv, normal, tangent, TBN
+
+	// Bits of the vertex flags in the file header
+	constexpr std::uint32_t kVertexFlagOcclusion = 0x1;
+
+	// Tweakables
+	constexpr float kDefaultWeldPosition = 1e-5f;
+	constexpr float kDefaultWeldNormalDegrees = 1.f;
+	constexpr float kDefaultWeldTexcoord = 1e-5f;
+
+	constexpr std::size_t kDefaultMaxChunkTriangles = 4096;
+	constexpr float kDefaultMaxChunkExtent = 0.f; // disabled
+
+	constexpr std::size_t kCullProbeCount = 256;
+	constexpr float kCullProbeSize = 0.25f; // fraction of the largest scene extent
+
+	constexpr std::size_t kWriterQueueDepth = 4; // serialized meshes in flight
+
+	constexpr std::size_t kDefaultOcclusionRays = 64;
+	constexpr float kDefaultOcclusionRadius = 0.1f; // fraction of the largest scene extent
+	constexpr float kOcclusionBias = 1e-4f; // fraction of the largest scene extent
+
+	constexpr std::uint64_t kDefaultBucketTriangles = 1024*1024; // out-of-core mode
 
 	// types
+	struct BakeOptions_
+	{
+		std::string input = "assets-src/cw2/sponza-pbr.obj";
+		std::string output = "assets/cw2/sponza-pbr_tan_packed.comp5822mesh";
+
+		WeldTolerances weld{ kDefaultWeldPosition, glm::radians( kDefaultWeldNormalDegrees ), kDefaultWeldTexcoord };
+
+		std::size_t maxChunkTriangles = kDefaultMaxChunkTriangles;
+		float maxChunkExtent = kDefaultMaxChunkExtent;
+		bool chunkSweep = false;
+
+		VertexLayout_ layout = VertexLayout_::interleaved;
+
+		std::uint64_t textureBudget = 0; // bytes; 0 = unlimited
+
+		bool occlusion = false;
+		std::size_t occlusionRays = kDefaultOcclusionRays;
+		float occlusionRadius = 0.f; // 0 = kDefaultOcclusionRadius
+
+		bool outOfCore = false;
+		std::uint64_t bucketTriangles = kDefaultBucketTriangles;
+		std::string tempDir; // empty = next to the output
+
+		bool serialStages = false;
+	};
+
 	struct TextureInfo_
 	{
 		std::uint32_t uniqueId;
 		std::uint8_t channels;
 		std::string newPath;
+		std::string sourcePath; // file to copy; shared by identical textures
+		std::uint32_t averageColor = kDefaultAverageColor; // RGBA8, R in low byte
+	};
+
+	struct OutputMesh_
+	{
+		std::size_t materialIndex;
+		IndexedMesh mesh;
+		std::vector<glm::mat4x3> instances;
+
+		std::vector<float> occlusion; // per vertex; empty if not baked
+	};
+
+	struct MaterialAreas_
+	{
+		// Per material, summed over all instances
+		std::vector<double> world;
+		std::vector<double> uv;
 	};
 
 	// local functions:
+	BakeOptions_ parse_options_( int, char* [] );
+
 	void process_model_(
-		char const* aOutput,
-		char const* aInputOBJ,
+		BakeOptions_ const&,
 		glm::mat4x4 const& aStaticTransform = glm::mat4x4( 1.f ) //TODO
 	);
 
+	void process_model_out_of_core_(
+		BakeOptions_ const&
+	);
+
 
 	void write_model_data_(
-		FILE*,
+		OutputFile&,
 		InputModel const&,
-		std::vector<IndexedMesh> const&,
-		std::unordered_map<std::string,TextureInfo_> const&
+		std::function<bool (OutputMesh_&)> const& aNextMesh,
+		std::unordered_map<std::string,TextureInfo_> const&,
+		VertexLayout_,
+		bool aWithOcclusion
+	);
+
+	std::vector<std::uint8_t> serialize_mesh_(
+		OutputMesh_ const&,
+		VertexLayout_,
+		bool aWithOcclusion
+	);
+
+	std::vector<std::uint8_t> pack_vertices_(
+		IndexedMesh const&,
+		std::vector<float> const& aOcclusion,
+		bool aWithPositions
+	);
+
+	void bake_occlusion_(
+		std::vector<OutputMesh_>&,
+		std::size_t aRays,
+		float aRadius
+	);
+
+	std::vector<OutputMesh_> split_meshes_(
+		std::vector<OutputMesh_> const&,
+		std::size_t aMaxTriangles,
+		float aMaxExtent
+	);
+
+	void report_chunks_(
+		std::vector<OutputMesh_> const& aUnsplit,
+		std::vector<OutputMesh_> const& aChunks
 	);
 
 
 	std::vector<IndexedMesh> index_meshes_(
 		InputModel const&,
-		float aErrorTolerance = 1e-5f
+		WeldTolerances const&,
+		WeldStats* = nullptr
+	);
+
+	std::unordered_map<std::string,TextureInfo_> prepare_textures_(
+		InputModel const&,
+		std::filesystem::path const& aTexDir
 	);
 
 	std::unordered_map<std::string,TextureInfo_> find_unique_textures_(
-		InputModel const&
+		InputModel const&,
+		TextureDedupStats* = nullptr
 	);
 
 	std::unordered_map<std::string,TextureInfo_> new_paths_(
 		std::unordered_map<std::string,TextureInfo_>,
 		std::filesystem::path const& aTexDir
 	);
+
+	void add_material_areas_(
+		MaterialAreas_&,
+		OutputMesh_ const&
+	);
+
+	void output_textures_(
+		InputModel const&,
+		MaterialAreas_ const&,
+		std::unordered_map<std::string,TextureInfo_> const&,
+		std::filesystem::path const& aRootDir,
+		std::filesystem::path const& aTexDir,
+		std::uint64_t aBudget
+	);
+
+	std::vector<BudgetTexture> plan_texture_budget_(
+		InputModel const&,
+		MaterialAreas_ const&,
+		std::unordered_map<std::string,TextureInfo_> const&,
+		std::filesystem::path const& aRootDir,
+		std::uint64_t aBudget
+	);
+
+	void report_texture_budget_(
+		std::vector<BudgetTexture> const&
+	);
 }
 
 
-int main() try
+int main( int aArgc, char* aArgv[] ) try
 {
-	process_model_(
-		"assets/cw2/sponza-pbr_tan_packed.comp5822mesh",
-		"assets-src/cw2/sponza-pbr.obj"
-	);
+	auto const options = parse_options_( aArgc, aArgv );
+
+	if( options.outOfCore )
+		process_model_out_of_core_( options );
+	else
+		process_model_( options );
 
 	return 0;
 }
@@ -99,109 +270,429 @@ catch( std::exception const& eErr )
 
 namespace
 {
-	void process_model_( char const* aOutput, char const* aInputOBJ, glm::mat4x4 const& aStaticTransform )
+	BakeOptions_ parse_options_( int aArgc, char* aArgv[] )
+	{
+		// Usage:
+		//   cw2-bake [options] [input.obj output.comp5822mesh]
+		// Options:
+		//   --weld-pos E           position tolerance for welding vertices
+		//   --weld-normal D        normal tolerance for welding, in degrees
+		//   --weld-uv E            texture coordinate tolerance for welding
+		//                          (all three 0 = weld exact duplicates only)
+		//   --max-chunk-tris N     split meshes into chunks of at most N
+		//                          triangles (0 = no limit)
+		//   --max-chunk-extent E   split meshes into chunks no larger than E
+		//                          along any axis (0 = no limit)
+		//   --chunk-sweep          report chunking statistics for a range
+		//                          of triangle limits
+		//   --layout L             vertex layout: separate, interleaved
+		//                          (default) or hybrid
+		//   --texture-budget MB    downscale textures until they fit into
+		//                          MB megabytes of VRAM (0 = no limit)
+		//   --ao                   bake per-vertex ambient occlusion
+		//   --ao-rays N            rays per vertex (default 64)
+		//   --ao-radius R          maximum occluder distance (default: 10%
+		//                          of the largest scene extent)
+		//   --out-of-core          stream the OBJ and spill per-material
+		//                          buckets to disk instead of loading the
+		//                          whole model (no instancing or AO)
+		//   --bucket-tris N        triangles per spilled bucket (default
+		//                          1M); bounds the memory used for indexing
+		//   --temp-dir PATH        directory for spilled buckets (default:
+		//                          <output>-tmp next to the output)
+		//   --serial-stages        run the bake stages one after another
+		//                          instead of concurrently (for comparison)
+		BakeOptions_ ret;
+
+		std::vector<char const*> positional;
+		for( int i = 1; i < aArgc; ++i )
+		{
+			std::string const arg = aArgv[i];
+
+			auto const value_ = [&] () -> char const* {
+				if( i+1 >= aArgc )
+					throw lut::Error( "Option '%s' requires a value", arg.c_str() );
+				return aArgv[++i];
+			};
+
+			if( "--weld-pos" == arg )
+				ret.weld.position = std::stof( value_() );
+			else if( "--weld-normal" == arg )
+				ret.weld.normalAngle = glm::radians( std::stof( value_() ) );
+			else if( "--weld-uv" == arg )
+				ret.weld.texcoord = std::stof( value_() );
+			else if( "--max-chunk-tris" == arg )
+				ret.maxChunkTriangles = std::size_t(std::stoull( value_() ));
+			else if( "--max-chunk-extent" == arg )
+				ret.maxChunkExtent = std::stof( value_() );
+			else if( "--chunk-sweep" == arg )
+				ret.chunkSweep = true;
+			else if( "--layout" == arg )
+			{
+				std::string const layout = value_();
+				if( "separate" == layout )
+					ret.layout = VertexLayout_::separate;
+				else if( "interleaved" == layout )
+					ret.layout = VertexLayout_::interleaved;
+				else if( "hybrid" == layout )
+					ret.layout = VertexLayout_::hybrid;
+				else
+					throw lut::Error( "Unknown vertex layout '%s'", layout.c_str() );
+			}
+			else if( "--texture-budget" == arg )
+				ret.textureBudget = std::uint64_t(std::stod( value_() ) * 1024.0 * 1024.0);
+			else if( "--ao" == arg )
+				ret.occlusion = true;
+			else if( "--ao-rays" == arg )
+				ret.occlusionRays = std::size_t(std::stoull( value_() ));
+			else if( "--ao-radius" == arg )
+				ret.occlusionRadius = std::stof( value_() );
+			else if( "--out-of-core" == arg )
+				ret.outOfCore = true;
+			else if( "--bucket-tris" == arg )
+				ret.bucketTriangles = std::max<std::uint64_t>( 1, std::stoull( value_() ) );
+			else if( "--temp-dir" == arg )
+				ret.tempDir = value_();
+			else if( "--serial-stages" == arg )
+				ret.serialStages = true;
+			else if( 0 == arg.compare( 0, 2, "--" ) )
+				throw lut::Error( "Unknown option '%s'", arg.c_str() );
+			else
+				positional.emplace_back( aArgv[i] );
+		}
+
+		if( positional.size() == 2 )
+		{
+			ret.input = positional[0];
+			ret.output = positional[1];
+		}
+		else if( !positional.empty() )
+		{
+			throw lut::Error( "Expected input and output paths, got %zu arguments", positional.size() );
+		}
+
+		return ret;
+	}
+
+	void process_model_( BakeOptions_ const& aOptions, glm::mat4x4 const& aStaticTransform )
 	{
+		char const* const outputPath = aOptions.output.c_str();
+		char const* const inputPath = aOptions.input.c_str();
+
 		static constexpr std::size_t vertexSize = sizeof(float)*(3+3+2);
 
 		// Figure out output paths
-		std::filesystem::path const outname( aOutput );
+		std::filesystem::path const outname( outputPath );
 		std::filesystem::path const rootdir = outname.parent_path();
 		std::filesystem::path const basename = outname.stem();
 		std::filesystem::path const texdir = basename.string() + "-tex";
 
-		// Load input model
-		auto const model = load_wavefront_obj( aInputOBJ );
+		/* The stages form a small task graph:
+		 *
+		 *   parse -+-> index -> instance+split [-> occlusion] -+-> write
+		 *          |                                            |
+		 *          +-> find textures ---------------------------+-> copy textures
+		 *
+		 * Texture processing is mostly I/O and does not depend on the
+		 * geometry, so it overlaps with indexing and writing. With a texture
+		 * budget, copying needs the per-material areas, which are computed
+		 * before the write task consumes the meshes.
+		 *
+		 * Stages print their results as they finish, so the output of
+		 * concurrent stages may be interleaved.
+		 */
+		InputModel model;
+		std::vector<IndexedMesh> indexed;
+		std::vector<OutputMesh_> meshes;
+		std::unordered_map<std::string,TextureInfo_> textures;
+		MaterialAreas_ areas;
 
-		std::size_t inputVerts = 0;
-		for( auto const& imesh : model.meshes )
-			inputVerts += imesh.vertexCount;
+		// Ensure output directory exists
+		std::filesystem::create_directories( rootdir );
 
-		std::printf( "%s: %zu meshes, %zu materials\n", aInputOBJ, model.meshes.size(), model.materials.size() );
-		std::printf( " - triangle soup vertices: %zu => %zu kB\n", inputVerts, inputVerts*vertexSize/1024 );
+		TaskGraph graph;
 
-		// Index meshes
-		auto const indexed = index_meshes_( model );
+		auto const parse = graph.add( "parse", [&] {
+			model = load_wavefront_obj( inputPath );
 
-		std::size_t outputVerts = 0, outputIndices = 0;
-		for( auto const& mesh : indexed )
-		{
-			outputVerts += mesh.vert.size();
-			outputIndices += mesh.indices.size();
-		}
+			std::size_t inputVerts = 0;
+			for( auto const& imesh : model.meshes )
+				inputVerts += imesh.vertexCount;
 
-		std::printf( " - indexed vertices: %zu with %zu indices => %zu kB\n", outputVerts, outputIndices, (outputVerts*vertexSize + outputIndices*sizeof(std::uint32_t))/1024 );
+			std::printf( "%s: %zu meshes, %zu materials\n", inputPath, model.meshes.size(), model.materials.size() );
+			std::printf( " - triangle soup vertices: %zu => %zu kB\n", inputVerts, inputVerts*vertexSize/1024 );
+		} );
 
-		// Find list of unique textures
-		auto const textures = new_paths_( find_unique_textures_( model ), texdir );
+		auto const index = graph.add( "index", [&] {
+			// Index meshes
+			auto const weldStart = std::chrono::steady_clock::now();
 
-		std::printf( " - unique textures: %zu\n", textures.size() );
+			WeldStats weldStats;
+			indexed = index_meshes_( model, aOptions.weld, &weldStats );
 
-		// Ensure output directory exists
-		std::filesystem::create_directories( rootdir );
+			auto const weldTime = std::chrono::duration<double>( std::chrono::steady_clock::now() - weldStart ).count();
+
+			// The de-indexed vertex data is no longer needed; only the material
+			// and mesh lists are used from here on.
+			model.positions = {};
+			model.normals = {};
+			model.texcoords = {};
+
+			std::size_t outputVerts = 0, outputIndices = 0;
+			for( auto const& mesh : indexed )
+			{
+				outputVerts += mesh.vert.size();
+				outputIndices += mesh.indices.size();
+			}
 
-		// Output mesh data
-		auto mainpath = rootdir / basename;
-		mainpath.replace_extension( "comp5822mesh" );
+			std::printf( " - indexed vertices: %zu with %zu indices => %zu kB\n", outputVerts, outputIndices, (outputVerts*vertexSize + outputIndices*sizeof(std::uint32_t))/1024 );
+			std::printf( "   welding (pos %g, normal %g deg, uv %g): %zu exact + %zu within tolerance merged, %.1f ms\n", aOptions.weld.position, glm::degrees( aOptions.weld.normalAngle ), aOptions.weld.texcoord, weldStats.exactMerged, weldStats.toleranceMerged, weldTime * 1000.0 );
+			std::printf( "   removed triangles: %zu degenerate, %zu duplicate\n", weldStats.degenerateTriangles, weldStats.duplicateTriangles );
+		}, { parse } );
 
-		FILE* fof = std::fopen( mainpath.string().c_str(), "wb" );
-		if( !fof )
-			throw lut::Error( "Unable to open '%s' for writing", mainpath.string().c_str() );
+		auto geometry = graph.add( "instance+split", [&] {
+			// Find meshes that are copies of each other (up to a rigid transform)
+			std::vector<std::size_t> meshMaterials;
+			for( auto const& imesh : model.meshes )
+				meshMaterials.emplace_back( imesh.materialIndex );
 
-		try
+			auto const instances = find_mesh_instances( indexed, meshMaterials );
+
+			std::size_t uniqueVerts = 0, uniqueIndices = 0;
+			for( auto const& group : instances )
+			{
+				uniqueVerts += indexed[group.prototype].vert.size();
+				uniqueIndices += indexed[group.prototype].indices.size();
+			}
+
+			std::printf( " - instancing: %zu meshes => %zu unique geometries (%zu draw calls saved)\n", indexed.size(), instances.size(), indexed.size()-instances.size() );
+			std::printf( "   unique vertices: %zu with %zu indices => %zu kB\n", uniqueVerts, uniqueIndices, (uniqueVerts*vertexSize + uniqueIndices*sizeof(std::uint32_t))/1024 );
+
+			// Split large meshes into spatial chunks
+			std::vector<OutputMesh_> unsplit;
+			for( auto const& group : instances )
+			{
+				OutputMesh_ out{ model.meshes[group.prototype].materialIndex, std::move(indexed[group.prototype]), group.transforms };
+				compute_bounds( out.mesh );
+				unsplit.emplace_back( std::move(out) );
+			}
+
+			if( aOptions.chunkSweep )
+			{
+				for( std::size_t tris : { 256, 1024, 4096, 16384, 65536 } )
+				{
+					std::printf( " - chunk sweep: max %zu triangles\n", tris );
+					report_chunks_( unsplit, split_meshes_( unsplit, tris, aOptions.maxChunkExtent ) );
+				}
+			}
+
+			meshes = split_meshes_( unsplit, aOptions.maxChunkTriangles, aOptions.maxChunkExtent );
+
+			std::printf( " - chunking: max %zu triangles, max extent %g\n", aOptions.maxChunkTriangles, aOptions.maxChunkExtent );
+			report_chunks_( unsplit, meshes );
+		}, { index } );
+
+		// Bake ambient occlusion
+		if( aOptions.occlusion )
 		{
-			write_model_data_( fof, model, indexed, textures );
+			geometry = graph.add( "occlusion", [&] {
+				bake_occlusion_( meshes, aOptions.occlusionRays, aOptions.occlusionRadius );
+			}, { geometry } );
 		}
-		catch( ... )
+
+		// Find list of unique textures
+		auto const findTextures = graph.add( "find textures", [&] {
+			textures = prepare_textures_( model, texdir );
+		}, { parse } );
+
+		std::vector<TaskGraph::TaskId> writeDeps{ geometry, findTextures };
+		std::vector<TaskGraph::TaskId> copyDeps{ findTextures };
+
+		if( aOptions.textureBudget )
 		{
-			std::fclose( fof );
-			throw;
+			auto const measure = graph.add( "material areas", [&] {
+				for( auto const& omesh : meshes )
+					add_material_areas_( areas, omesh );
+			}, { geometry } );
+
+			writeDeps.emplace_back( measure );
+			copyDeps.emplace_back( measure );
 		}
 
-		std::fclose( fof );
+		graph.add( "write", [&] {
+			// Output mesh data
+			auto mainpath = rootdir / basename;
+			mainpath.replace_extension( "comp5822mesh" );
 
-		// Copy textures
-		std::filesystem::create_directories( rootdir / texdir );
+			// Meshes are released as soon as they have been serialized
+			OutputFile fof( mainpath.string().c_str() );
 
-		std::size_t errors = 0;
-		for( auto const& entry : textures )
-		{
-			auto const dest = rootdir / entry.second.newPath;
+			std::size_t nextMesh = 0;
+			write_model_data_( fof, model, [&] (OutputMesh_& aMesh) {
+				if( meshes.size() == nextMesh )
+					return false;
+
+				aMesh = std::move(meshes[nextMesh++]);
+				return true;
+			}, textures, aOptions.layout, aOptions.occlusion );
+
+			std::printf( "Wrote %s: %zu kB\n", mainpath.string().c_str(), std::size_t(fof.tell()/1024) );
+			fof.close();
+		}, std::move(writeDeps) );
+
+		graph.add( "copy textures", [&] {
+			output_textures_( model, areas, textures, rootdir, texdir, aOptions.textureBudget );
+		}, std::move(copyDeps) );
+
+		graph.run( !aOptions.serialStages );
+		graph.report();
+	}
+
+	void process_model_out_of_core_( BakeOptions_ const& aOptions )
+	{
+		char const* const outputPath = aOptions.output.c_str();
+		char const* const inputPath = aOptions.input.c_str();
+
+		static constexpr std::size_t vertexSize = sizeof(float)*(3+3+2);
+
+		// Figure out output paths
+		std::filesystem::path const outname( outputPath );
+		std::filesystem::path const rootdir = outname.parent_path();
+		std::filesystem::path const basename = outname.stem();
+		std::filesystem::path const texdir = basename.string() + "-tex";
 
+		std::filesystem::path const tempdir = aOptions.tempDir.empty()
+			? rootdir / (basename.string() + "-tmp")
+			: std::filesystem::path( aOptions.tempDir )
+		;
+
+		if( aOptions.occlusion )
+			std::fprintf( stderr, "Warning: --ao is not supported together with --out-of-core; ignored\n" );
+
+		// Stream the input into per-material buckets on disk
+		auto const spillStart = std::chrono::steady_clock::now();
+
+		auto spilled = spill_wavefront_obj( inputPath, tempdir, aOptions.bucketTriangles );
+
+		auto const spillTime = std::chrono::duration<double>( std::chrono::steady_clock::now() - spillStart ).count();
+
+		auto const& model = spilled.model;
+
+		std::printf( "%s: %llu triangles, %zu materials (out of core)\n", inputPath, (unsigned long long)spilled.triangleCount, model.materials.size() );
+		std::printf( " - spilled %zu buckets of at most %llu triangles to %s: %llu kB, %.1f ms\n", spilled.buckets.size(), (unsigned long long)aOptions.bucketTriangles, tempdir.string().c_str(), (unsigned long long)(spilled.bytesSpilled/1024), spillTime * 1000.0 );
+		std::printf( "   v/vt/vn arrays held in memory: %llu kB\n", (unsigned long long)(spilled.peakAttributeBytes/1024) );
+
+		// Remove bucket files that are left over if baking fails
+		auto const remove_buckets_ = [&] {
 			std::error_code ec;
-			bool ret = std::filesystem::copy_file( 
-				entry.first,
-				dest,
-				std::filesystem::copy_options::none,
-				ec
-			);
+			for( auto const& bucket : spilled.buckets )
+				std::filesystem::remove( bucket.path, ec );
 
-			if( !ret )
-			{
-				++errors;
-				std::fprintf( stderr, "copy_file(): '%s' failed: %s (%s)\n", dest.string().c_str(), ec.message().c_str(), ec.category().name() );
-			}
-		}
+			// Only succeeds if the directory is empty
+			std::filesystem::remove( tempdir, ec );
+		};
 
-		auto const total = textures.size();
-		std::printf( "Copied %zu textures out of %zu.\n", total-errors, total );
-		if( errors )
+		try
 		{
-			std::fprintf( stderr, "Some copies reported an error. Currently, the code will never overwrite existing files. The errors likely just indicate that the file was copied previously. Remove old files manually, if necessary.\n" );
+			auto const textures = prepare_textures_( model, texdir );
+
+			// Ensure output directory exists
+			std::filesystem::create_directories( rootdir );
+
+			auto mainpath = rootdir / basename;
+			mainpath.replace_extension( "comp5822mesh" );
+
+			// Each bucket is loaded, indexed and split on the writer's producer
+			// thread, so only one bucket (plus the queued serialized meshes) is
+			// in memory at a time.
+			MaterialAreas_ areas;
+			WeldStats weldStats;
+			std::uint64_t outputVerts = 0, outputIndices = 0;
+			std::size_t largestBucket = 0;
+
+			std::size_t nextBucket = 0;
+			std::vector<OutputMesh_> pending;
+
+			auto const next_mesh_ = [&] (OutputMesh_& aMesh) {
+				while( pending.empty() )
+				{
+					if( spilled.buckets.size() == nextBucket )
+						return false;
+
+					auto const& bucket = spilled.buckets[nextBucket++];
+
+					auto const soup = load_spilled_bucket( bucket );
+
+					std::error_code ec;
+					std::filesystem::remove( bucket.path, ec );
+
+					largestBucket = std::max( largestBucket, soup.vert.size() );
+
+					WeldStats stats;
+					auto mesh = make_indexed_mesh( soup, aOptions.weld, &stats );
+
+					weldStats.exactMerged += stats.exactMerged;
+					weldStats.toleranceMerged += stats.toleranceMerged;
+					weldStats.degenerateTriangles += stats.degenerateTriangles;
+					weldStats.duplicateTriangles += stats.duplicateTriangles;
+
+					compute_bounds( mesh );
+
+					for( auto& chunk : split_mesh( mesh, aOptions.maxChunkTriangles, aOptions.maxChunkExtent ) )
+					{
+						outputVerts += chunk.vert.size();
+						outputIndices += chunk.indices.size();
+
+						pending.emplace_back( OutputMesh_{ bucket.materialIndex, std::move(chunk), { glm::mat4x3( 1.f ) } } );
+						if( aOptions.textureBudget )
+							add_material_areas_( areas, pending.back() );
+					}
+
+					// Hand out chunks in order
+					std::reverse( pending.begin(), pending.end() );
+				}
+
+				aMesh = std::move(pending.back());
+				pending.pop_back();
+				return true;
+			};
+
+			OutputFile fof( mainpath.string().c_str() );
+			write_model_data_( fof, model, next_mesh_, textures, aOptions.layout, false );
+
+			std::printf( " - indexed vertices: %llu with %llu indices => %llu kB; largest bucket %zu soup vertices => %zu kB\n", (unsigned long long)outputVerts, (unsigned long long)outputIndices, (unsigned long long)((outputVerts*vertexSize + outputIndices*sizeof(std::uint32_t))/1024), largestBucket, largestBucket*vertexSize/1024 );
+			std::printf( "   welding (pos %g, normal %g deg, uv %g): %zu exact + %zu within tolerance merged\n", aOptions.weld.position, glm::degrees( aOptions.weld.normalAngle ), aOptions.weld.texcoord, weldStats.exactMerged, weldStats.toleranceMerged );
+			std::printf( "   removed triangles: %zu degenerate, %zu duplicate\n", weldStats.degenerateTriangles, weldStats.duplicateTriangles );
+
+			std::printf( "Wrote %s: %llu kB\n", mainpath.string().c_str(), (unsigned long long)(fof.tell()/1024) );
+			fof.close();
+
+			remove_buckets_();
+
+			// Copy textures
+			output_textures_( model, areas, textures, rootdir, texdir, aOptions.textureBudget );
+		}
+		catch( ... )
+		{
+			remove_buckets_();
+			throw;
 		}
 	}
 }
 
 namespace
 {
-	void checked_write_( FILE* aOut, std::size_t aBytes, void const* aData )
+	void checked_write_( OutputFile& aOut, std::size_t aBytes, void const* aData )
 	{
-		auto const ret = std::fwrite( aData, 1, aBytes, aOut );
-
-		if( ret != aBytes )
-			throw lut::Error( "fwrite() failed: %zu instead of %zu", ret, aBytes );
+		aOut.write( aData, aBytes );
+	}
+	void checked_write_( std::vector<std::uint8_t>& aOut, std::size_t aBytes, void const* aData )
+	{
+		auto const* bytes = static_cast<std::uint8_t const*>(aData);
+		aOut.insert( aOut.end(), bytes, bytes + aBytes );
 	}
 
-	void write_string_( FILE* aOut, char const* aString )
+	void write_string_( OutputFile& aOut, char const* aString )
 	{
 		// Write a string
 		// Format:
@@ -213,14 +704,22 @@ namespace
 		checked_write_( aOut, length, aString );
 	}
 
-	void write_model_data_( FILE* aOut, InputModel const& aModel, std::vector<IndexedMesh> const& aIndexedMeshes, std::unordered_map<std::string,TextureInfo_> const& aTextures )
+	void write_model_data_( OutputFile& aOut, InputModel const& aModel, std::function<bool (OutputMesh_&)> const& aNextMesh, std::unordered_map<std::string,TextureInfo_> const& aTextures, VertexLayout_ aLayout, bool aWithOcclusion )
 	{
 		// Write header
 		// Format:
 		//   - char[16] : file magic
 		//   - char[16] : file variant ID
+		//   - uint32_t : vertex layout (see VertexLayout_)
+		//   - uint32_t : vertex flags (kVertexFlagOcclusion)
 		checked_write_( aOut, sizeof(char)*16, kFileMagic );
 		checked_write_( aOut, sizeof(char)*16, kFileVariant );
+
+		std::uint32_t const layout = std::uint32_t(aLayout);
+		checked_write_( aOut, sizeof(layout), &layout );
+
+		std::uint32_t const vertexFlags = aWithOcclusion ? kVertexFlagOcclusion : 0;
+		checked_write_( aOut, sizeof(vertexFlags), &vertexFlags );
 		
 		// Write list of unique textures
 		// Format:
@@ -228,11 +727,19 @@ namespace
 		//  - repeat U times:
 		//    - string : path to texture 
 		//    - uint8_t : number of channels in texture
-		std::vector<TextureInfo_ const*> orderedUnqiue( aTextures.size() );
+		//    - uint32_t : average color (RGBA8, R in the least significant byte)
+		// Several paths may share a uniqueId if their content is identical.
+		std::size_t uniqueCount = 0;
+		for( auto const& tex : aTextures )
+			uniqueCount = std::max( uniqueCount, std::size_t(tex.second.uniqueId)+1 );
+
+		std::vector<TextureInfo_ const*> orderedUnqiue( uniqueCount );
 		for( auto const& tex : aTextures )
 		{
-			assert( !orderedUnqiue[tex.second.uniqueId] );
-			orderedUnqiue[tex.second.uniqueId] = &tex.second;
+			auto& slot = orderedUnqiue[tex.second.uniqueId];
+			assert( !slot || slot->newPath == tex.second.newPath );
+			if( !slot || tex.second.channels > slot->channels )
+				slot = &tex.second;
 		}
 
 		std::uint32_t const textureCount = std::uint32_t(orderedUnqiue.size());
@@ -245,6 +752,9 @@ namespace
 
 			std::uint8_t channels = tex->channels;
 			checked_write_( aOut, sizeof(channels), &channels );
+
+			std::uint32_t const averageColor = tex->averageColor;
+			checked_write_( aOut, sizeof(averageColor), &averageColor );
 		}
 
 		// Write material information
@@ -284,49 +794,378 @@ namespace
 		}
 
 		// Write mesh data
+		// Only one copy of each unique geometry is written. Copies are stored
+		// as a list of instance transforms. Large meshes are split into
+		// chunks; each chunk is written as a separate mesh.
 		// Format:
 		//  - uint32_t : M = number of meshes
 		//  - repeat M times:
 		//    - uint32_t : material index
+		//    - vec3 : bounding box minimum (before instance transform)
+		//    - vec3 : bounding box maximum (before instance transform)
 		//    - uint32_t : V = number of vertices
 		//    - uint32_t : I = number of indices
-		//    - repeat V times: vec3 position
-		//    - repeat V times: vec3 normal
-		//    - repeat V times: vec2 texture coordinate
+		//    - vertex data, depending on the layout:
+		//      separate:
+		//      - repeat V times: vec3 position
+		//      - repeat V times: vec3 normal
+		//      - repeat V times: vec2 texture coordinate
+		//      - repeat V times: vec4 tangent
+		//      interleaved:
+		//      - repeat V times: 40-byte packed vertex (see pack_vertices_)
+		//      hybrid:
+		//      - repeat V times: vec3 position
+		//      - repeat V times: 28-byte packed attributes (see pack_vertices_)
 		//    - repeat I times: uint32_t index
-		std::uint32_t const meshCount = std::uint32_t(aModel.meshes.size());
+		//    - separate layout only: repeat V times: uint32_t packed TBN
+		//    - separate layout with kVertexFlagOcclusion only: repeat V
+		//      times: uint8_t ambient occlusion (UNORM). The packed layouts
+		//      store occlusion in the w component of the normal instead.
+		//    - uint32_t : N = number of instances (at least one)
+		//    - repeat N times: mat4x3 instance transform (column major)
+		//  - repeat M times: uint64_t offset of the mesh data from the start of
+		//    the file (allows seeking to individual meshes)
+		//
+		// Meshes are pulled from aNextMesh and serialized on a separate thread,
+		// and handed to the writer through a bounded queue. Each mesh is
+		// released once serialized, so at most kWriterQueueDepth serialized
+		// meshes are held in addition to whatever aNextMesh holds. The number
+		// of meshes is not known up front: the count is patched and the offset
+		// table is appended at the end.
+		std::uint32_t meshCount = 0;
+		auto const countOffset = aOut.tell();
 		checked_write_( aOut, sizeof(meshCount), &meshCount );
 
-		assert( aModel.meshes.size() == aIndexedMeshes.size() );
-		for( std::size_t i = 0; i < aModel.meshes.size(); ++i )
+		std::vector<std::uint64_t> offsets;
+
+		BoundedQueue<std::vector<std::uint8_t>> queue( kWriterQueueDepth );
+
+		std::exception_ptr producerError;
+		std::thread producer( [&] {
+			try
+			{
+				OutputMesh_ omesh;
+				while( aNextMesh( omesh ) )
+				{
+					assert( !aWithOcclusion || omesh.occlusion.size() == omesh.mesh.vert.size() );
+
+					auto block = serialize_mesh_( omesh, aLayout, aWithOcclusion );
+					omesh = OutputMesh_{};
+
+					if( !queue.push( std::move(block) ) )
+						break;
+				}
+			}
+			catch( ... )
+			{
+				producerError = std::current_exception();
+			}
+
+			queue.close();
+		} );
+
+		std::size_t largest = 0;
+		try
 		{
-			auto const& mmesh = aModel.meshes[i];
+			std::vector<std::uint8_t> block;
+			while( queue.pop( block ) )
+			{
+				offsets.emplace_back( aOut.tell() );
+				largest = std::max( largest, block.size() );
+				checked_write_( aOut, block.size(), block.data() );
+			}
+		}
+		catch( ... )
+		{
+			queue.close();
+			producer.join();
+			throw;
+		}
+
+		producer.join();
+
+		if( producerError )
+			std::rethrow_exception( producerError );
+
+		if( offsets.size() > std::numeric_limits<std::uint32_t>::max() )
+			throw lut::Error( "Too many meshes: %zu", offsets.size() );
+
+		meshCount = std::uint32_t(offsets.size());
+		aOut.patch( countOffset, &meshCount, sizeof(meshCount) );
+
+		checked_write_( aOut, sizeof(std::uint64_t)*offsets.size(), offsets.data() );
+
+		std::printf( " - streamed %zu meshes, largest %zu kB, queue depth %zu\n", offsets.size(), largest/1024, queue.capacity() );
+	}
+
+	std::vector<std::uint8_t> serialize_mesh_( OutputMesh_ const& aMesh, VertexLayout_ aLayout, bool aWithOcclusion )
+	{
+		// See write_model_data_() for the format
+		std::vector<std::uint8_t> ret;
+		ret.reserve( sizeof(std::uint32_t)*4 + sizeof(glm::vec3)*2
+			+ aMesh.mesh.vert.size() * (kPackedAttributeSize + sizeof(glm::vec3)*2 + sizeof(glm::vec4))
+			+ aMesh.mesh.indices.size() * sizeof(std::uint32_t)
+			+ aMesh.instances.size() * sizeof(glm::mat4x3)
+		);
+
+		std::uint32_t materialIndex = std::uint32_t(aMesh.materialIndex);
+		checked_write_( ret, sizeof(materialIndex), &materialIndex );
+
+		auto const& imesh = aMesh.mesh;
+
+		checked_write_( ret, sizeof(glm::vec3), &imesh.aabbMin );
+		checked_write_( ret, sizeof(glm::vec3), &imesh.aabbMax );
+
+		std::uint32_t vertexCount = std::uint32_t(imesh.vert.size());
+		checked_write_( ret, sizeof(vertexCount), &vertexCount );
+		std::uint32_t indexCount = std::uint32_t(imesh.indices.size());
+		checked_write_( ret, sizeof(indexCount), &indexCount );
+
+		if( VertexLayout_::separate == aLayout )
+		{
+			checked_write_( ret, sizeof(glm::vec3)*vertexCount, imesh.vert.data() );
+			checked_write_( ret, sizeof(glm::vec3)*vertexCount, imesh.norm.data() );
+			checked_write_( ret, sizeof(glm::vec2)*vertexCount, imesh.text.data() );
+			checked_write_(ret, sizeof(glm::vec4) * vertexCount, imesh.tangent.data());
+			checked_write_( ret, sizeof(std::uint32_t)*indexCount, imesh.indices.data());
+			checked_write_(ret, sizeof(std::uint32_t) * vertexCount, imesh.packedTBN.data());
+
+			if( aWithOcclusion )
+			{
+				assert( aMesh.occlusion.size() == vertexCount );
+
+				std::vector<std::uint8_t> occlusion( vertexCount );
+				for( std::size_t i = 0; i < vertexCount; ++i )
+					occlusion[i] = std::uint8_t(std::lround( glm::clamp( aMesh.occlusion[i], 0.f, 1.f ) * 255.f ));
+
+				checked_write_( ret, occlusion.size(), occlusion.data() );
+			}
+		}
+		else
+		{
+			if( VertexLayout_::hybrid == aLayout )
+				checked_write_( ret, sizeof(glm::vec3)*vertexCount, imesh.vert.data() );
+
+			auto const packed = pack_vertices_( imesh, aMesh.occlusion, VertexLayout_::interleaved == aLayout );
+			checked_write_( ret, packed.size(), packed.data() );
+			checked_write_( ret, sizeof(std::uint32_t)*indexCount, imesh.indices.data());
+		}
+
+		std::uint32_t instanceCount = std::uint32_t(aMesh.instances.size());
+		checked_write_( ret, sizeof(instanceCount), &instanceCount );
+		checked_write_( ret, sizeof(glm::mat4x3)*instanceCount, aMesh.instances.data() );
+
+		return ret;
+	}
+}
+
+namespace
+{
+	std::vector<std::uint8_t> pack_vertices_( IndexedMesh const& aMesh, std::vector<float> const& aOcclusion, bool aWithPositions )
+	{
+		// Packed vertex:
+		//  - vec3 position (12 bytes; only if aWithPositions)
+		//  - vec2 texture coordinate (8 bytes)
+		//  - 4x int16 normal, SNORM, w = ambient occlusion or 1 (8 bytes)
+		//  - 4x int16 tangent, SNORM, w = handedness (8 bytes)
+		//  - uint32_t packed TBN quaternion (4 bytes)
+		std::size_t const stride = kPackedAttributeSize + (aWithPositions ? sizeof(glm::vec3) : 0);
+
+		std::vector<std::uint8_t> ret( stride * aMesh.vert.size() );
+
+		auto* out = ret.data();
+		auto const put_ = [&] (void const* aData, std::size_t aBytes) {
+			std::memcpy( out, aData, aBytes );
+			out += aBytes;
+		};
+
+		for( std::size_t i = 0; i < aMesh.vert.size(); ++i )
+		{
+			if( aWithPositions )
+				put_( &aMesh.vert[i], sizeof(glm::vec3) );
+
+			put_( &aMesh.text[i], sizeof(glm::vec2) );
+
+			glm::vec3 const n = aMesh.norm.empty() ? glm::vec3( 0.f ) : aMesh.norm[i];
+			float const occlusion = aOcclusion.empty() ? 1.f : aOcclusion[i];
+			std::uint64_t const normal = glm::packSnorm4x16( glm::vec4( n, occlusion ) );
+			put_( &normal, sizeof(normal) );
+
+			std::uint64_t const tangent = glm::packSnorm4x16( aMesh.tangent[i] );
+			put_( &tangent, sizeof(tangent) );
+
+			put_( &aMesh.packedTBN[i], sizeof(std::uint32_t) );
+		}
+
+		assert( out == ret.data() + ret.size() );
+		return ret;
+	}
+}
+
+namespace
+{
+	std::vector<OutputMesh_> split_meshes_( std::vector<OutputMesh_> const& aMeshes, std::size_t aMaxTriangles, float aMaxExtent )
+	{
+		std::vector<OutputMesh_> ret;
+
+		for( auto const& omesh : aMeshes )
+		{
+			for( auto& chunk : split_mesh( omesh.mesh, aMaxTriangles, aMaxExtent ) )
+				ret.emplace_back( OutputMesh_{ omesh.materialIndex, std::move(chunk), omesh.instances } );
+		}
+
+		return ret;
+	}
+
+	void bake_occlusion_( std::vector<OutputMesh_>& aMeshes, std::size_t aRays, float aRadius )
+	{
+		auto const startTime = std::chrono::steady_clock::now();
+
+		// The whole scene, including all instances, acts as occluder
+		std::vector<glm::vec3> triangles;
+		for( auto const& omesh : aMeshes )
+		{
+			auto const& mesh = omesh.mesh;
+			for( auto const& xform : omesh.instances )
+			{
+				for( auto const index : mesh.indices )
+					triangles.emplace_back( xform * glm::vec4( mesh.vert[index], 1.f ) );
+			}
+		}
+
+		auto const bvh = build_occlusion_bvh( triangles );
+
+		auto const buildTime = std::chrono::duration<double>( std::chrono::steady_clock::now() - startTime ).count();
+
+		auto const sceneSize = bvh.sceneMax - bvh.sceneMin;
+		float const extent = std::max( sceneSize.x, std::max( sceneSize.y, sceneSize.z ) );
+		float const radius = aRadius > 0.f ? aRadius : kDefaultOcclusionRadius * extent;
+		float const bias = kOcclusionBias * extent;
 
-			std::uint32_t materialIndex = std::uint32_t(mmesh.materialIndex);
-			checked_write_( aOut, sizeof(materialIndex), &materialIndex );
+		auto const threads = std::max( 1u, std::thread::hardware_concurrency() );
 
-			auto const& imesh = aIndexedMeshes[i];
+		std::printf( " - ambient occlusion: %zu rays/vertex, radius %g, %u threads\n", aRays, radius, threads );
+		std::printf( "   BVH: %zu triangles, %zu nodes, %.1f ms\n", triangles.size()/3, bvh.nodes.size(), buildTime * 1000.0 );
 
-			std::uint32_t vertexCount = std::uint32_t(imesh.vert.size());
-			checked_write_( aOut, sizeof(vertexCount), &vertexCount );
-			std::uint32_t indexCount = std::uint32_t(imesh.indices.size());
-			checked_write_( aOut, sizeof(indexCount), &indexCount );
+		std::vector<OcclusionMesh> jobs;
+		for( auto const& omesh : aMeshes )
+			jobs.emplace_back( OcclusionMesh{ &omesh.mesh, &omesh.instances } );
 
-			checked_write_( aOut, sizeof(glm::vec3)*vertexCount, imesh.vert.data() );
-			checked_write_( aOut, sizeof(glm::vec3)*vertexCount, imesh.norm.data() );
-			checked_write_( aOut, sizeof(glm::vec2)*vertexCount, imesh.text.data() );
-			checked_write_(aOut, sizeof(glm::vec4) * vertexCount, imesh.tangent.data());
-			checked_write_( aOut, sizeof(std::uint32_t)*indexCount, imesh.indices.data());
-			checked_write_(aOut, sizeof(std::uint32_t) * vertexCount, imesh.packedTBN.data());
+		OcclusionStats stats;
+		std::vector<OcclusionStats> meshStats;
+		auto occlusion = bake_vertex_occlusion( bvh, jobs, aRays, radius, bias, threads, &stats, &meshStats );
+
+		for( std::size_t i = 0; i < aMeshes.size(); ++i )
+		{
+			auto& omesh = aMeshes[i];
+			omesh.occlusion = std::move( occlusion[i] );
+
+			double average = 0.0;
+			for( auto const ao : omesh.occlusion )
+				average += ao;
+			average /= double(std::max( omesh.occlusion.size(), std::size_t(1) ));
+
+			// Thread time; meshes are baked concurrently
+			auto const& ms = meshStats[i];
+			std::printf( "   mesh %3zu: %6zu vertices x %zu instances, %8.1f ms, %6.2f Mrays/s, average %.2f\n", i, omesh.mesh.vert.size(), omesh.instances.size(), ms.seconds * 1000.0, ms.rays / std::max( ms.seconds, 1e-9 ) * 1e-6, average );
 		}
+
+		std::printf( "   total: %llu rays in %.2f s => %.2f Mrays/s\n", (unsigned long long)stats.rays, stats.seconds, stats.rays / std::max( stats.seconds, 1e-9 ) * 1e-6 );
+	}
+
+	void report_chunks_( std::vector<OutputMesh_> const& aUnsplit, std::vector<OutputMesh_> const& aChunks )
+	{
+		// World-space boxes of all drawn (mesh, instance) pairs
+		struct Drawable_
+		{
+			glm::vec3 bmin, bmax;
+			std::size_t triangles;
+		};
+
+		auto const drawables_ = [] (std::vector<OutputMesh_> const& aMeshes) {
+			std::vector<Drawable_> ret;
+			for( auto const& omesh : aMeshes )
+			{
+				auto const& mesh = omesh.mesh;
+				for( auto const& xform : omesh.instances )
+				{
+					Drawable_ d{ glm::vec3( std::numeric_limits<float>::max() ), glm::vec3( -std::numeric_limits<float>::max() ), mesh.indices.size()/3 };
+					for( int corner = 0; corner < 8; ++corner )
+					{
+						glm::vec3 const p(
+							(corner & 1) ? mesh.aabbMax.x : mesh.aabbMin.x,
+							(corner & 2) ? mesh.aabbMax.y : mesh.aabbMin.y,
+							(corner & 4) ? mesh.aabbMax.z : mesh.aabbMin.z
+						);
+						auto const q = xform * glm::vec4( p, 1.f );
+						d.bmin = glm::min( d.bmin, q );
+						d.bmax = glm::max( d.bmax, q );
+					}
+					ret.emplace_back( d );
+				}
+			}
+			return ret;
+		};
+
+		auto const before = drawables_( aUnsplit );
+		auto const after = drawables_( aChunks );
+
+		std::size_t triangles = 0, chunkTriangles = 0, vertsBefore = 0, vertsAfter = 0;
+		glm::vec3 smin( std::numeric_limits<float>::max() ), smax( -std::numeric_limits<float>::max() );
+		for( auto const& d : before )
+		{
+			triangles += d.triangles;
+			smin = glm::min( smin, d.bmin );
+			smax = glm::max( smax, d.bmax );
+		}
+		for( auto const& omesh : aUnsplit )
+			vertsBefore += omesh.mesh.vert.size();
+		for( auto const& omesh : aChunks )
+		{
+			vertsAfter += omesh.mesh.vert.size();
+			chunkTriangles += omesh.mesh.indices.size()/3;
+		}
+
+		// Culling estimate: fraction of triangles whose drawable overlaps a
+		// randomly placed box (a stand-in for a view volume).
+		std::mt19937 rng( 5822 );
+		std::uniform_real_distribution<float> unit( 0.f, 1.f );
+
+		auto const sceneSize = smax - smin;
+		glm::vec3 const probeHalf( 0.5f * kCullProbeSize * std::max( sceneSize.x, std::max( sceneSize.y, sceneSize.z ) ) );
+		double fracBefore = 0.0, fracAfter = 0.0;
+		for( std::size_t i = 0; i < kCullProbeCount; ++i )
+		{
+			glm::vec3 const center = smin + sceneSize * glm::vec3( unit(rng), unit(rng), unit(rng) );
+			glm::vec3 const pmin = center - probeHalf;
+			glm::vec3 const pmax = center + probeHalf;
+
+			auto const submitted_ = [&] (std::vector<Drawable_> const& aDrawables) {
+				std::size_t tris = 0;
+				for( auto const& d : aDrawables )
+				{
+					if( glm::all( glm::lessThanEqual( d.bmin, pmax ) ) && glm::all( glm::lessThanEqual( pmin, d.bmax ) ) )
+						tris += d.triangles;
+				}
+				return double(tris) / double(std::max( triangles, std::size_t(1) ));
+			};
+
+			fracBefore += submitted_( before );
+			fracAfter += submitted_( after );
+		}
+
+		std::printf( "   chunks: %zu meshes => %zu chunks, %.1f triangles/chunk on average\n", aUnsplit.size(), aChunks.size(), double(chunkTriangles) / double(std::max( aChunks.size(), std::size_t(1) )) );
+		std::printf( "   duplicated boundary vertices: %zu (%+.1f%%)\n", vertsAfter-vertsBefore, 100.0 * (double(vertsAfter)/double(std::max( vertsBefore, std::size_t(1) )) - 1.0) );
+		std::printf( "   culling probe: %.1f%% of triangles submitted before, %.1f%% after (%zu draws)\n", 100.0*fracBefore/kCullProbeCount, 100.0*fracAfter/kCullProbeCount, after.size() );
 	}
 }
 
 namespace
 {
-	std::vector<IndexedMesh> index_meshes_( InputModel const& aModel, float aErrorTolerance )
+	std::vector<IndexedMesh> index_meshes_( InputModel const& aModel, WeldTolerances const& aTolerances, WeldStats* aStats )
 	{
 		std::vector<IndexedMesh> indexed;
+		WeldStats total;
 
 		for( auto const& imesh : aModel.meshes )
 		{
@@ -347,16 +1186,58 @@ namespace
 				soup.norm.emplace_back( aModel.normals[i] );
 
 
-			indexed.emplace_back( make_indexed_mesh( soup, aErrorTolerance ) );
+			WeldStats stats;
+			indexed.emplace_back( make_indexed_mesh( soup, aTolerances, &stats ) );
+
+			total.exactMerged += stats.exactMerged;
+			total.toleranceMerged += stats.toleranceMerged;
+			total.degenerateTriangles += stats.degenerateTriangles;
+			total.duplicateTriangles += stats.duplicateTriangles;
 		}
 
+		if( aStats )
+			*aStats = total;
+
 		return indexed;
 	}
 }
 
 namespace
 {
-	std::unordered_map<std::string,TextureInfo_> find_unique_textures_( InputModel const& aModel )
+	std::unordered_map<std::string,TextureInfo_> prepare_textures_( InputModel const& aModel, std::filesystem::path const& aTexDir )
+	{
+		TextureDedupStats texStats;
+		auto textures = new_paths_( find_unique_textures_( aModel, &texStats ), aTexDir );
+
+		std::size_t uniqueTextures = 0;
+		for( auto const& entry : textures )
+			uniqueTextures = std::max( uniqueTextures, std::size_t(entry.second.uniqueId)+1 );
+
+		std::printf( " - unique textures: %zu paths => %zu unique\n", textures.size(), uniqueTextures );
+		std::printf( "   identical content: %zu byte-identical, %zu pixel-identical (%zu files decoded)\n", texStats.byteIdentical, texStats.pixelIdentical, texStats.decoded );
+		std::printf( "   saved: %zu kB disk, %zu kB VRAM\n", std::size_t(texStats.diskSaved/1024), std::size_t(texStats.vramSaved/1024) );
+
+		// Average colors, used by the viewer as placeholders while streaming
+		auto const averageStart = std::chrono::steady_clock::now();
+
+		std::vector<std::string> sources( uniqueTextures );
+		for( auto const& entry : textures )
+			sources[entry.second.uniqueId] = entry.second.sourcePath;
+
+		std::size_t failed = 0;
+		auto const threads = std::max( 1u, std::thread::hardware_concurrency() );
+		auto const colors = average_texture_colors( sources, threads, &failed );
+
+		for( auto& entry : textures )
+			entry.second.averageColor = colors[entry.second.uniqueId];
+
+		auto const averageTime = std::chrono::duration<double>( std::chrono::steady_clock::now() - averageStart ).count();
+		std::printf( "   average colors: %zu textures (%zu failed), %.1f ms\n", sources.size(), failed, averageTime * 1000.0 );
+
+		return textures;
+	}
+
+	std::unordered_map<std::string,TextureInfo_> find_unique_textures_( InputModel const& aModel, TextureDedupStats* aStats )
 	{
 		std::unordered_map<std::string,TextureInfo_> unique;
 
@@ -385,6 +1266,29 @@ namespace
 			add_unique_( mat.normalMapTexturePath, 4 );  // eh...
 		}
 
+		// Merge textures with identical content but different paths
+		std::vector<std::string> paths( texid );
+		for( auto const& entry : unique )
+			paths[entry.second.uniqueId] = entry.first;
+
+		auto const representative = find_duplicate_textures( paths, aStats );
+
+		// Renumber, so that the IDs of the remaining textures are contiguous
+		std::vector<std::uint32_t> newIds( texid, ~std::uint32_t(0) );
+		std::uint32_t nextId = 0;
+		for( std::uint32_t i = 0; i < texid; ++i )
+		{
+			if( representative[i] == i )
+				newIds[i] = nextId++;
+		}
+
+		for( auto& entry : unique )
+		{
+			auto const rep = representative[entry.second.uniqueId];
+			entry.second.uniqueId = newIds[rep];
+			entry.second.sourcePath = paths[rep];
+		}
+
 		return unique;
 	}
 
@@ -392,7 +1296,7 @@ namespace
 	{
 		for( auto& entry : aTextures )
 		{
-			std::filesystem::path const originalPath( entry.first );
+			std::filesystem::path const originalPath( entry.second.sourcePath );
 			auto const filename = originalPath.filename();
 			auto const newpath = aTexDir / filename;
 		
@@ -405,6 +1309,187 @@ namespace
 		// argument, NRVO is unlikely to occur.
 		return aTextures; 
 	}
+
+	void add_material_areas_( MaterialAreas_& aAreas, OutputMesh_ const& aMesh )
+	{
+		// Surface area covered by the mesh's material, in world space and in
+		// UV space. Instances are rigid copies, so each one adds the same area.
+		if( aAreas.world.size() <= aMesh.materialIndex )
+		{
+			aAreas.world.resize( aMesh.materialIndex+1, 0.0 );
+			aAreas.uv.resize( aMesh.materialIndex+1, 0.0 );
+		}
+
+		auto const& mesh = aMesh.mesh;
+		double const copies = double(aMesh.instances.size());
+
+		for( std::size_t i = 0; i+2 < mesh.indices.size(); i += 3 )
+		{
+			auto const i0 = mesh.indices[i+0], i1 = mesh.indices[i+1], i2 = mesh.indices[i+2];
+
+			glm::vec3 const e0 = mesh.vert[i1] - mesh.vert[i0];
+			glm::vec3 const e1 = mesh.vert[i2] - mesh.vert[i0];
+			aAreas.world[aMesh.materialIndex] += copies * 0.5 * glm::length( glm::cross( e0, e1 ) );
+
+			glm::vec2 const t0 = mesh.text[i1] - mesh.text[i0];
+			glm::vec2 const t1 = mesh.text[i2] - mesh.text[i0];
+			aAreas.uv[aMesh.materialIndex] += copies * 0.5 * std::abs( t0.x*t1.y - t0.y*t1.x );
+		}
+	}
+
+	void output_textures_( InputModel const& aModel, MaterialAreas_ const& aAreas, std::unordered_map<std::string,TextureInfo_> const& aTextures, std::filesystem::path const& aRootDir, std::filesystem::path const& aTexDir, std::uint64_t aBudget )
+	{
+		std::size_t uniqueTextures = 0;
+		for( auto const& entry : aTextures )
+			uniqueTextures = std::max( uniqueTextures, std::size_t(entry.second.uniqueId)+1 );
+
+		// Pick texture resolutions that fit the VRAM budget
+		std::vector<BudgetTexture> budget;
+		if( aBudget )
+		{
+			budget = plan_texture_budget_( aModel, aAreas, aTextures, aRootDir, aBudget );
+			report_texture_budget_( budget );
+		}
+
+		std::filesystem::create_directories( aRootDir / aTexDir );
+
+		std::size_t errors = 0, total = 0;
+		std::vector<bool> copied( uniqueTextures, false );
+
+		// Downscaled textures are written by the resampler instead
+		if( !budget.empty() )
+		{
+			std::size_t resized = 0;
+			for( std::size_t i = 0; i < budget.size(); ++i )
+			{
+				if( budget[i].chosenWidth != budget[i].width || budget[i].chosenHeight != budget[i].height )
+				{
+					copied[i] = true;
+					++resized;
+				}
+			}
+
+			auto const threads = std::max( 1u, std::thread::hardware_concurrency() );
+			auto const failed = downscale_textures( budget, threads );
+
+			std::printf( "Downscaled %zu textures out of %zu (%u threads).\n", resized-failed, resized, threads );
+			errors += failed;
+		}
+		for( auto const& entry : aTextures )
+		{
+			// Identical textures share a single file
+			if( copied[entry.second.uniqueId] )
+				continue;
+
+			copied[entry.second.uniqueId] = true;
+			++total;
+
+			auto const dest = aRootDir / entry.second.newPath;
+
+			std::error_code ec;
+			bool ret = std::filesystem::copy_file( 
+				entry.second.sourcePath,
+				dest,
+				std::filesystem::copy_options::none,
+				ec
+			);
+
+			if( !ret )
+			{
+				++errors;
+				std::fprintf( stderr, "copy_file(): '%s' failed: %s (%s)\n", dest.string().c_str(), ec.message().c_str(), ec.category().name() );
+			}
+		}
+
+		std::printf( "Copied %zu textures out of %zu.\n", total-errors, total );
+		if( errors )
+		{
+			std::fprintf( stderr, "Some copies reported an error. Currently, the code will never overwrite existing files. The errors likely just indicate that the file was copied previously. Remove old files manually, if necessary.\n" );
+		}
+	}
+
+	std::vector<BudgetTexture> plan_texture_budget_( InputModel const& aModel, MaterialAreas_ const& aAreas, std::unordered_map<std::string,TextureInfo_> const& aTextures, std::filesystem::path const& aRootDir, std::uint64_t aBudget )
+	{
+		// One entry per unique texture
+		std::size_t count = 0;
+		for( auto const& entry : aTextures )
+			count = std::max( count, std::size_t(entry.second.uniqueId)+1 );
+
+		std::vector<BudgetTexture> ret( count );
+		for( auto const& entry : aTextures )
+		{
+			auto& tex = ret[entry.second.uniqueId];
+			tex.sourcePath = entry.second.sourcePath;
+			tex.outputPath = (aRootDir / entry.second.newPath).string();
+			tex.density = std::numeric_limits<double>::infinity();
+		}
+
+		for( auto& tex : ret )
+		{
+			int comp;
+			if( !stbi_info( tex.sourcePath.c_str(), &tex.width, &tex.height, &comp ) )
+				throw lut::Error( "Unable to read image info for '%s'", tex.sourcePath.c_str() );
+		}
+
+		// Texel density of a texture is the highest density of any material
+		// that samples it. Textures that no geometry uses keep +inf, and are
+		// therefore reduced first.
+		std::vector<bool> used( count, false );
+		for( std::size_t m = 0; m < aModel.materials.size() && m < aAreas.world.size(); ++m )
+		{
+			if( aAreas.world[m] <= 0.0 )
+				continue;
+
+			auto const& mat = aModel.materials[m];
+			for( auto const* path : { &mat.baseColorTexturePath, &mat.roughnessTexturePath, &mat.metalnessTexturePath, &mat.alphaMaskTexturePath, &mat.normalMapTexturePath } )
+			{
+				if( path->empty() )
+					continue;
+
+				auto const id = aTextures.at( *path ).uniqueId;
+				auto& tex = ret[id];
+
+				double const density = double(tex.width) * tex.height * aAreas.uv[m] / aAreas.world[m];
+				tex.density = used[id] ? std::max( tex.density, density ) : density;
+				used[id] = true;
+			}
+		}
+
+		if( !fit_texture_budget( ret, aBudget ) )
+			std::fprintf( stderr, "Warning: textures do not fit the budget of %zu kB even at the minimum size\n", std::size_t(aBudget/1024) );
+
+		return ret;
+	}
+
+	void report_texture_budget_( std::vector<BudgetTexture> const& aTextures )
+	{
+		std::uint64_t before = 0, after = 0;
+		for( auto const& tex : aTextures )
+		{
+			before += texture_vram_size( tex.width, tex.height );
+			after += texture_vram_size( tex.chosenWidth, tex.chosenHeight );
+		}
+
+		std::printf( " - texture budget: %zu kB => %zu kB VRAM\n", std::size_t(before/1024), std::size_t(after/1024) );
+
+		// Highest (original) density first
+		std::vector<BudgetTexture const*> order;
+		for( auto const& tex : aTextures )
+			order.emplace_back( &tex );
+
+		std::stable_sort( order.begin(), order.end(), [] (BudgetTexture const* aX, BudgetTexture const* aY) {
+			return aX->density > aY->density;
+		} );
+
+		std::printf( "   %-40s %11s    %11s  %12s  %12s\n", "texture", "original", "chosen", "density", "final" );
+		for( auto const* tex : order )
+		{
+			double const ratio = double(tex->chosenWidth) * tex->chosenHeight / (double(tex->width) * tex->height);
+			auto const name = std::filesystem::path( tex->sourcePath ).filename().string();
+
+			std::printf( "   %-40s %5dx%-5d => %5dx%-5d  %12.1f  %12.1f\n", name.c_str(), tex->width, tex->height, tex->chosenWidth, tex->chosenHeight, tex->density, tex->density * ratio );
+		}
+	}
 }
 
 
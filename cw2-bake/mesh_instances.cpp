@@ -0,0 +1,281 @@
+#include "mesh_instances.hpp"
+
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+
+#include <cmath>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace
+{
+	// Tweakables
+	constexpr double kNormalCosTolerance = 0.999; // ~2.5 degrees
+	constexpr int kJacobiMaxSweeps = 32;
+
+	// Cached per-mesh data
+	struct MeshFrame_
+	{
+		glm::dvec3 centroid;
+		double magnitude; // largest absolute coordinate; scales the tolerance
+	};
+
+	MeshFrame_ compute_frame_( IndexedMesh const& );
+
+	// Rigid-invariant hash: material, topology and texture coordinates. These
+	// do not change when a mesh is moved around, so copies of the same mesh
+	// land in the same bucket. Positions and normals are checked separately.
+	std::uint64_t canonical_hash_( IndexedMesh const&, std::size_t aMaterial );
+
+	bool same_canonical_form_( IndexedMesh const&, IndexedMesh const& );
+
+	// Best-fit rigid transform from A to B (Horn's quaternion method) and
+	// verification of the result.
+	bool match_rigid_(
+		IndexedMesh const& aA, MeshFrame_ const& aFrameA,
+		IndexedMesh const& aB, MeshFrame_ const& aFrameB,
+		float aTolerance,
+		glm::mat4x3& aTransform
+	);
+
+	// Eigenvector for the largest eigenvalue of a symmetric 4x4 matrix
+	glm::dvec4 principal_eigenvector_( double aMat[4][4] );
+}
+
+//--    find_mesh_instances()           ///{{{2///////////////////////////////
+std::vector<MeshInstanceGroup> find_mesh_instances( std::vector<IndexedMesh> const& aMeshes, std::vector<std::size_t> const& aMaterials, float aTolerance )
+{
+	assert( aMeshes.size() == aMaterials.size() );
+
+	std::vector<MeshFrame_> frames;
+	frames.reserve( aMeshes.size() );
+	for( auto const& mesh : aMeshes )
+		frames.emplace_back( compute_frame_( mesh ) );
+
+	std::vector<MeshInstanceGroup> groups;
+	std::unordered_map<std::uint64_t,std::vector<std::size_t>> buckets;
+
+	for( std::size_t i = 0; i < aMeshes.size(); ++i )
+	{
+		auto const& mesh = aMeshes[i];
+		auto& bucket = buckets[canonical_hash_( mesh, aMaterials[i] )];
+
+		bool found = false;
+		for( auto const groupIndex : bucket )
+		{
+			auto& group = groups[groupIndex];
+			auto const proto = group.prototype;
+
+			if( aMaterials[proto] != aMaterials[i] )
+				continue;
+			if( !same_canonical_form_( aMeshes[proto], mesh ) )
+				continue;
+
+			glm::mat4x3 xform;
+			if( !match_rigid_( aMeshes[proto], frames[proto], mesh, frames[i], aTolerance, xform ) )
+				continue;
+
+			group.members.emplace_back( i );
+			group.transforms.emplace_back( xform );
+			found = true;
+			break;
+		}
+
+		if( !found )
+		{
+			MeshInstanceGroup group;
+			group.prototype = i;
+			group.members.emplace_back( i );
+			group.transforms.emplace_back( glm::mat4x3( 1.f ) );
+
+			bucket.emplace_back( groups.size() );
+			groups.emplace_back( std::move(group) );
+		}
+	}
+
+	return groups;
+}
+
+//--    $ local                         ///{{{1///////////////////////////////
+namespace
+{
+	MeshFrame_ compute_frame_( IndexedMesh const& aMesh )
+	{
+		MeshFrame_ ret{ glm::dvec3( 0.0 ), 1.0 };
+
+		for( auto const& v : aMesh.vert )
+		{
+			ret.centroid += glm::dvec3( v );
+
+			auto const a = glm::abs( v );
+			ret.magnitude = std::max( ret.magnitude, double(std::max( a.x, std::max( a.y, a.z ) )) );
+		}
+
+		if( !aMesh.vert.empty() )
+			ret.centroid /= double(aMesh.vert.size());
+
+		return ret;
+	}
+
+	std::uint64_t canonical_hash_( IndexedMesh const& aMesh, std::size_t aMaterial )
+	{
+		// FNV-1a
+		std::uint64_t hash = 14695981039346656037ull;
+		auto const mix_ = [&] (void const* aData, std::size_t aBytes) {
+			auto const* bytes = static_cast<unsigned char const*>(aData);
+			for( std::size_t i = 0; i < aBytes; ++i )
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+		};
+
+		std::uint64_t const header[3] = { aMaterial, aMesh.vert.size(), aMesh.indices.size() };
+		mix_( header, sizeof(header) );
+		mix_( aMesh.indices.data(), aMesh.indices.size()*sizeof(std::uint32_t) );
+		mix_( aMesh.text.data(), aMesh.text.size()*sizeof(glm::vec2) );
+
+		return hash;
+	}
+
+	bool same_canonical_form_( IndexedMesh const& aA, IndexedMesh const& aB )
+	{
+		if( aA.vert.size() != aB.vert.size() || aA.norm.size() != aB.norm.size() )
+			return false;
+		if( aA.indices != aB.indices )
+			return false;
+
+		return 0 == std::memcmp( aA.text.data(), aB.text.data(), aA.text.size()*sizeof(glm::vec2) );
+	}
+
+	bool match_rigid_( IndexedMesh const& aA, MeshFrame_ const& aFrameA, IndexedMesh const& aB, MeshFrame_ const& aFrameB, float aTolerance, glm::mat4x3& aTransform )
+	{
+		auto const vertexCount = aA.vert.size();
+		double const tol = aTolerance * std::max( aFrameA.magnitude, aFrameB.magnitude );
+
+		// Quick reject: distances to the centroid are preserved by any rigid
+		// transform.
+		for( std::size_t i = 0; i < vertexCount; ++i )
+		{
+			double const da = glm::length( glm::dvec3(aA.vert[i]) - aFrameA.centroid );
+			double const db = glm::length( glm::dvec3(aB.vert[i]) - aFrameB.centroid );
+
+			if( std::abs( da - db ) > 2.0*tol )
+				return false;
+		}
+
+		// Cross-covariance
+		double S[3][3]{};
+		for( std::size_t i = 0; i < vertexCount; ++i )
+		{
+			auto const a = glm::dvec3(aA.vert[i]) - aFrameA.centroid;
+			auto const b = glm::dvec3(aB.vert[i]) - aFrameB.centroid;
+
+			for( int r = 0; r < 3; ++r )
+			{
+				for( int c = 0; c < 3; ++c )
+					S[r][c] += a[r] * b[c];
+			}
+		}
+
+		// Horn's symmetric 4x4 matrix; the eigenvector with the largest
+		// eigenvalue is the rotation quaternion (w,x,y,z).
+		double N[4][4] = {
+			{ S[0][0]+S[1][1]+S[2][2], S[1][2]-S[2][1], S[2][0]-S[0][2], S[0][1]-S[1][0] },
+			{ S[1][2]-S[2][1], S[0][0]-S[1][1]-S[2][2], S[0][1]+S[1][0], S[2][0]+S[0][2] },
+			{ S[2][0]-S[0][2], S[0][1]+S[1][0], -S[0][0]+S[1][1]-S[2][2], S[1][2]+S[2][1] },
+			{ S[0][1]-S[1][0], S[2][0]+S[0][2], S[1][2]+S[2][1], -S[0][0]-S[1][1]+S[2][2] }
+		};
+
+		auto const q = principal_eigenvector_( N );
+		glm::dmat3 const R = glm::mat3_cast( glm::normalize( glm::dquat( q[0], q[1], q[2], q[3] ) ) );
+		glm::dvec3 const t = aFrameB.centroid - R * aFrameA.centroid;
+
+		// Verify
+		for( std::size_t i = 0; i < vertexCount; ++i )
+		{
+			auto const p = R * glm::dvec3(aA.vert[i]) + t;
+			if( glm::length( p - glm::dvec3(aB.vert[i]) ) > tol )
+				return false;
+		}
+
+		for( std::size_t i = 0; i < aA.norm.size(); ++i )
+		{
+			auto const n = R * glm::dvec3(aA.norm[i]);
+			if( glm::dot( n, glm::dvec3(aB.norm[i]) ) < kNormalCosTolerance * glm::length( n ) * glm::length( glm::dvec3(aB.norm[i]) ) )
+				return false;
+		}
+
+		aTransform = glm::mat4x3( glm::dmat4x3( R[0], R[1], R[2], t ) );
+		return true;
+	}
+
+	glm::dvec4 principal_eigenvector_( double aMat[4][4] )
+	{
+		// Cyclic Jacobi: rotate away off-diagonal elements, accumulating the
+		// rotations in V. The columns of V are the eigenvectors.
+		double V[4][4]{};
+		for( int i = 0; i < 4; ++i )
+			V[i][i] = 1.0;
+
+		for( int sweep = 0; sweep < kJacobiMaxSweeps; ++sweep )
+		{
+			double off = 0.0;
+			for( int p = 0; p < 4; ++p )
+			{
+				for( int r = p+1; r < 4; ++r )
+					off += aMat[p][r]*aMat[p][r];
+			}
+
+			if( off < 1e-30 )
+				break;
+
+			for( int p = 0; p < 4; ++p )
+			{
+				for( int r = p+1; r < 4; ++r )
+				{
+					if( 0.0 == aMat[p][r] )
+						continue;
+
+					double const theta = (aMat[r][r] - aMat[p][p]) / (2.0*aMat[p][r]);
+					double const t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta*theta + 1.0));
+					double const c = 1.0 / std::sqrt(t*t + 1.0);
+					double const s = t * c;
+
+					for( int k = 0; k < 4; ++k )
+					{
+						double const kp = aMat[k][p], kr = aMat[k][r];
+						aMat[k][p] = c*kp - s*kr;
+						aMat[k][r] = s*kp + c*kr;
+					}
+					for( int k = 0; k < 4; ++k )
+					{
+						double const pk = aMat[p][k], rk = aMat[r][k];
+						aMat[p][k] = c*pk - s*rk;
+						aMat[r][k] = s*pk + c*rk;
+					}
+					for( int k = 0; k < 4; ++k )
+					{
+						double const kp = V[k][p], kr = V[k][r];
+						V[k][p] = c*kp - s*kr;
+						V[k][r] = s*kp + c*kr;
+					}
+				}
+			}
+		}
+
+		int best = 0;
+		for( int i = 1; i < 4; ++i )
+		{
+			if( aMat[i][i] > aMat[best][best] )
+				best = i;
+		}
+
+		return glm::dvec4( V[0][best], V[1][best], V[2][best], V[3][best] );
+	}
+}
@@ -0,0 +1,48 @@
+#ifndef MESH_INSTANCES_HPP_4C0E7A52_9B1D_4F7E_A3C6_1D8E2B95F047
+#define MESH_INSTANCES_HPP_4C0E7A52_9B1D_4F7E_A3C6_1D8E2B95F047
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+
+#include <cstddef>
+
+#include <glm/mat4x3.hpp>
+
+#include "index_mesh.hpp"
+
+//--    types                                   ///{{{1///////////////////////
+
+/* A set of meshes that are identical up to a rigid transform (rotation and
+ * translation; no scaling or mirroring). The geometry of the prototype is
+ * stored once; each member is drawn as an instance of it. transforms[i]
+ * maps the prototype into the position of members[i], so the first entry
+ * (the prototype itself) is always the identity.
+ */
+struct MeshInstanceGroup
+{
+	std::size_t prototype;
+
+	std::vector<std::size_t> members;
+	std::vector<glm::mat4x3> transforms;
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+/* Groups meshes by rigid-transform equivalence. aMaterials[i] is the material
+ * of aMeshes[i]; meshes with different materials are never merged. Meshes
+ * are considered equal if, after the best-fit rigid transform, every
+ * position is within aTolerance (relative to the magnitude of the
+ * coordinates) and every normal within a small angle.
+ *
+ * Every mesh ends up in exactly one group; groups are ordered by their
+ * prototype index.
+ */
+std::vector<MeshInstanceGroup> find_mesh_instances(
+	std::vector<IndexedMesh> const&,
+	std::vector<std::size_t> const& aMaterials,
+	float aTolerance = 1e-4f
+);
+
+#endif // MESH_INSTANCES_HPP_4C0E7A52_9B1D_4F7E_A3C6_1D8E2B95F047
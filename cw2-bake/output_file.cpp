@@ -0,0 +1,165 @@
+#include "output_file.hpp"
+
+#include <algorithm>
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_WIN32)
+#	include <malloc.h>
+#endif
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// Tweakables
+	constexpr std::size_t kBufferAlignment = 4096;
+
+	void* aligned_alloc_( std::size_t aSize );
+	void aligned_free_( void* );
+}
+
+//--    OutputFile                      ///{{{2///////////////////////////////
+OutputFile::OutputFile( char const* aPath, std::size_t aBufferSize )
+	: mBuffer( nullptr, &aligned_free_ )
+{
+	// Round up, as required by aligned allocation
+	mBufferSize = (std::max<std::size_t>( aBufferSize, 1 ) + kBufferAlignment-1) / kBufferAlignment * kBufferAlignment;
+
+	mBuffer.reset( static_cast<unsigned char*>(aligned_alloc_( mBufferSize )) );
+	if( !mBuffer )
+		throw lut::Error( "Unable to allocate %zu byte output buffer", mBufferSize );
+
+	mFile = std::fopen( aPath, "wb" );
+	if( !mFile )
+		throw lut::Error( "Unable to open '%s' for writing", aPath );
+
+	// Buffering is done by this class
+	std::setvbuf( mFile, nullptr, _IONBF, 0 );
+}
+
+OutputFile::~OutputFile()
+{
+	if( mFile )
+	{
+		try
+		{
+			flush_();
+		}
+		catch( ... )
+		{}
+
+		std::fclose( mFile );
+	}
+}
+
+void OutputFile::write( void const* aData, std::size_t aBytes )
+{
+	auto const* bytes = static_cast<unsigned char const*>(aData);
+	mOffset += aBytes;
+
+	if( mBuffered + aBytes <= mBufferSize )
+	{
+		std::memcpy( mBuffer.get() + mBuffered, bytes, aBytes );
+		mBuffered += aBytes;
+		return;
+	}
+
+	flush_();
+
+	if( aBytes >= mBufferSize )
+	{
+		auto const ret = std::fwrite( bytes, 1, aBytes, mFile );
+		if( ret != aBytes )
+			throw lut::Error( "fwrite() failed: %zu instead of %zu", ret, aBytes );
+		return;
+	}
+
+	std::memcpy( mBuffer.get(), bytes, aBytes );
+	mBuffered = aBytes;
+}
+
+void OutputFile::patch( std::uint64_t aOffset, void const* aData, std::size_t aBytes )
+{
+	if( aOffset + aBytes > mOffset )
+		throw lut::Error( "OutputFile::patch(): range [%llu, %llu) is beyond the end of the file", (unsigned long long)aOffset, (unsigned long long)(aOffset + aBytes) );
+
+	flush_();
+
+	seek_( aOffset );
+
+	auto const ret = std::fwrite( aData, 1, aBytes, mFile );
+	if( ret != aBytes )
+		throw lut::Error( "fwrite() failed: %zu instead of %zu", ret, aBytes );
+
+	seek_( mOffset );
+}
+
+std::uint64_t OutputFile::tell() const noexcept
+{
+	return mOffset;
+}
+
+void OutputFile::close()
+{
+	if( !mFile )
+		return;
+
+	flush_();
+
+	auto const ret = std::fclose( mFile );
+	mFile = nullptr;
+
+	if( 0 != ret )
+		throw lut::Error( "fclose() failed" );
+}
+
+void OutputFile::flush_()
+{
+	if( 0 == mBuffered )
+		return;
+
+	auto const ret = std::fwrite( mBuffer.get(), 1, mBuffered, mFile );
+	if( ret != mBuffered )
+		throw lut::Error( "fwrite() failed: %zu instead of %zu", ret, mBuffered );
+
+	mBuffered = 0;
+}
+
+void OutputFile::seek_( std::uint64_t aOffset )
+{
+#	if defined(_WIN32)
+	auto const ret = _fseeki64( mFile, static_cast<__int64>(aOffset), SEEK_SET );
+#	else
+	auto const ret = fseeko( mFile, static_cast<off_t>(aOffset), SEEK_SET );
+#	endif
+
+	if( 0 != ret )
+		throw lut::Error( "Unable to seek to offset %llu", (unsigned long long)aOffset );
+}
+
+//--    $ local                         ///{{{1///////////////////////////////
+namespace
+{
+	void* aligned_alloc_( std::size_t aSize )
+	{
+#		if defined(_WIN32)
+		return _aligned_malloc( aSize, kBufferAlignment );
+#		else
+		return std::aligned_alloc( kBufferAlignment, aSize );
+#		endif
+	}
+
+	void aligned_free_( void* aPtr )
+	{
+#		if defined(_WIN32)
+		_aligned_free( aPtr );
+#		else
+		std::free( aPtr );
+#		endif
+	}
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
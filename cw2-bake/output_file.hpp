@@ -0,0 +1,61 @@
+#ifndef OUTPUT_FILE_HPP_5E8A2C71_B04D_4A93_9C6F_13D7E2B85A40
+#define OUTPUT_FILE_HPP_5E8A2C71_B04D_4A93_9C6F_13D7E2B85A40
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <memory>
+
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+
+//--    constants                               ///{{{1///////////////////////
+constexpr std::size_t kDefaultOutputBufferSize = 4*1024*1024;
+
+//--    classes                                 ///{{{1///////////////////////
+
+/* Binary output file with a large, page-aligned write buffer. Small writes
+ * are collected in the buffer and handed to the OS in large blocks; writes
+ * larger than the buffer bypass it.
+ *
+ * patch() overwrites bytes that were written earlier (e.g., counts and
+ * offsets that are only known once the rest of the file has been written).
+ * Offsets are 64-bit throughout.
+ *
+ * Errors are reported by throwing labutils::Error.
+ */
+class OutputFile
+{
+	public:
+		explicit OutputFile( char const* aPath, std::size_t aBufferSize = kDefaultOutputBufferSize );
+		~OutputFile();
+
+		OutputFile( OutputFile const& ) = delete;
+		OutputFile& operator= (OutputFile const&) = delete;
+
+	public:
+		void write( void const*, std::size_t );
+		void patch( std::uint64_t aOffset, void const*, std::size_t );
+
+		std::uint64_t tell() const noexcept;
+
+		// Flushes and closes the file. Called by the destructor, but errors
+		// can only be reported when close() is called explicitly.
+		void close();
+
+	private:
+		void flush_();
+		void seek_( std::uint64_t );
+
+	private:
+		std::FILE* mFile = nullptr;
+
+		std::unique_ptr<unsigned char,void (*)(void*)> mBuffer;
+		std::size_t mBufferSize = 0;
+		std::size_t mBuffered = 0;
+
+		std::uint64_t mOffset = 0; // logical end of the file
+};
+
+#endif // OUTPUT_FILE_HPP_5E8A2C71_B04D_4A93_9C6F_13D7E2B85A40
@@ -0,0 +1,419 @@
+#include "spill_model_obj.hpp"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <cstdio>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+#include "load_model_obj.hpp"
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// Tweakables
+	constexpr std::size_t kReadChunkSize = 16*1024*1024;
+	constexpr std::size_t kBucketBufferSize = 1024*1024;
+	constexpr std::size_t kMaxOpenBucketFiles = 64; // least recently used are closed
+
+	// On-disk vertex format of the buckets
+	struct SpillVertex_
+	{
+		glm::vec3 position;
+		glm::vec2 texcoord;
+		glm::vec3 normal;
+	};
+
+	static_assert( sizeof(SpillVertex_) == 32 );
+
+	using File_ = std::unique_ptr<std::FILE,int (*)(std::FILE*)>;
+
+	// A bucket that is still being written. Its file may be closed
+	// temporarily (see kMaxOpenBucketFiles); it is then reopened for
+	// appending.
+	struct OpenBucket_
+	{
+		std::string material;
+		File_ file{ nullptr, &std::fclose };
+		std::unique_ptr<char[]> buffer;
+		std::uint64_t lastUse = 0;
+		SpilledBucket info;
+	};
+
+	char const* skip_space_( char const* );
+	char const* skip_token_( char const* );
+	bool is_keyword_( char const* aBeg, char const* aKeyword );
+
+	std::size_t resolve_index_( long aIndex, std::size_t aCount, std::uint64_t aLine );
+}
+
+//--    spill_wavefront_obj()           ///{{{2///////////////////////////////
+SpilledModel spill_wavefront_obj( char const* aPath, std::filesystem::path const& aTempDir, std::uint64_t aMaxBucketTriangles )
+{
+	File_ fin( std::fopen( aPath, "rb" ), &std::fclose );
+	if( !fin )
+		throw lut::Error( "Unable to open OBJ file '%s'", aPath );
+
+	std::filesystem::create_directories( aTempDir );
+
+	SpilledModel ret;
+	ret.model.modelSourcePath = aPath;
+
+	std::vector<glm::vec3> positions, normals;
+	std::vector<glm::vec2> texcoords;
+
+	std::vector<std::string> libraries;
+
+	// Buckets. Only the most recent bucket of each material is being
+	// written, and at most kMaxOpenBucketFiles of those have their file
+	// open (with a write buffer) at any time.
+	std::vector<std::unique_ptr<OpenBucket_>> open;
+	std::unordered_map<std::string,OpenBucket_*> byMaterial;
+	std::vector<std::pair<std::string,SpilledBucket>> closed;
+
+	std::size_t openFiles = 0;
+	std::uint64_t useCounter = 0;
+	std::vector<std::unique_ptr<char[]>> freeBuffers;
+
+	auto const close_file_ = [&] (OpenBucket_& aBucket) {
+		if( !aBucket.file )
+			return;
+
+		if( 0 != std::fclose( aBucket.file.release() ) )
+			throw lut::Error( "Unable to write '%s'", aBucket.info.path.string().c_str() );
+
+		freeBuffers.emplace_back( std::move(aBucket.buffer) );
+		--openFiles;
+	};
+
+	auto const open_file_ = [&] (OpenBucket_& aBucket, char const* aMode) {
+		if( openFiles >= kMaxOpenBucketFiles )
+		{
+			OpenBucket_* lru = nullptr;
+			for( auto const& bucket : open )
+			{
+				if( bucket->file && (!lru || bucket->lastUse < lru->lastUse) )
+					lru = bucket.get();
+			}
+
+			assert( lru );
+			close_file_( *lru );
+		}
+
+		aBucket.file.reset( std::fopen( aBucket.info.path.string().c_str(), aMode ) );
+		if( !aBucket.file )
+			throw lut::Error( "Unable to open '%s' for writing", aBucket.info.path.string().c_str() );
+
+		++openFiles;
+
+		if( freeBuffers.empty() )
+			aBucket.buffer.reset( new char[kBucketBufferSize] );
+		else
+		{
+			aBucket.buffer = std::move(freeBuffers.back());
+			freeBuffers.pop_back();
+		}
+
+		std::setvbuf( aBucket.file.get(), aBucket.buffer.get(), _IOFBF, kBucketBufferSize );
+	};
+
+	auto const close_bucket_ = [&] (OpenBucket_& aBucket) {
+		close_file_( aBucket );
+
+		ret.bytesSpilled += aBucket.info.triangleCount * 3 * sizeof(SpillVertex_);
+		closed.emplace_back( aBucket.material, aBucket.info );
+	};
+
+	auto const open_bucket_ = [&] (OpenBucket_& aBucket) {
+		aBucket.info.path = aTempDir / ("bucket-" + std::to_string( closed.size() + open.size() ) + ".bin");
+		aBucket.info.triangleCount = 0;
+
+		open_file_( aBucket, "wb" );
+	};
+
+	// Marks the bucket as used; reopens its file if it had been closed
+	auto const use_bucket_ = [&] (OpenBucket_& aBucket) {
+		aBucket.lastUse = ++useCounter;
+		if( !aBucket.file )
+			open_file_( aBucket, "ab" );
+	};
+
+	auto const bucket_for_ = [&] (std::string const& aMaterial) {
+		auto& slot = byMaterial[aMaterial];
+		if( !slot )
+		{
+			open.emplace_back( std::make_unique<OpenBucket_>() );
+			slot = open.back().get();
+			slot->material = aMaterial;
+			slot->lastUse = ++useCounter;
+			open_bucket_( *slot );
+		}
+		return slot;
+	};
+
+	OpenBucket_* current = nullptr;
+	std::vector<SpillVertex_> polygon;
+
+	auto const parse_line_ = [&] (char const* aBeg, std::uint64_t aLine) {
+		char const* p = skip_space_( aBeg );
+
+		if( is_keyword_( p, "v" ) )
+		{
+			char* end = const_cast<char*>(p+1);
+			glm::vec3 v;
+			for( int k = 0; k < 3; ++k )
+				v[k] = std::strtof( end, &end );
+			positions.emplace_back( v );
+		}
+		else if( is_keyword_( p, "vt" ) )
+		{
+			char* end = const_cast<char*>(p+2);
+			glm::vec2 v;
+			for( int k = 0; k < 2; ++k )
+				v[k] = std::strtof( end, &end );
+			texcoords.emplace_back( v );
+		}
+		else if( is_keyword_( p, "vn" ) )
+		{
+			char* end = const_cast<char*>(p+2);
+			glm::vec3 v;
+			for( int k = 0; k < 3; ++k )
+				v[k] = std::strtof( end, &end );
+			normals.emplace_back( v );
+		}
+		else if( is_keyword_( p, "f" ) )
+		{
+			if( !current )
+				current = bucket_for_( "" );
+
+			// Vertices are v, v/vt, v//vn or v/vt/vn
+			polygon.clear();
+			for( p = skip_space_( p+1 ); *p != '\n' && *p != '\r' && *p != '#'; p = skip_space_( p ) )
+			{
+				char* end;
+				SpillVertex_ vert{};
+
+				long const vi = std::strtol( p, &end, 10 );
+				if( end == p )
+					throw lut::Error( "%s:%llu: malformed face", aPath, (unsigned long long)aLine );
+				vert.position = positions[resolve_index_( vi, positions.size(), aLine )];
+
+				if( '/' == *end )
+				{
+					p = end+1;
+					if( '/' != *p )
+					{
+						long const ti = std::strtol( p, &end, 10 );
+						if( end != p )
+							vert.texcoord = texcoords[resolve_index_( ti, texcoords.size(), aLine )];
+					}
+					else
+						end = const_cast<char*>(p);
+
+					if( '/' == *end )
+					{
+						p = end+1;
+						long const ni = std::strtol( p, &end, 10 );
+						if( end != p )
+							vert.normal = normals[resolve_index_( ni, normals.size(), aLine )];
+					}
+				}
+
+				polygon.emplace_back( vert );
+				p = end;
+			}
+
+			if( polygon.size() < 3 )
+				return;
+
+			use_bucket_( *current );
+
+			// Triangulate as a fan
+			for( std::size_t i = 1; i+1 < polygon.size(); ++i )
+			{
+				if( current->info.triangleCount >= aMaxBucketTriangles )
+				{
+					close_bucket_( *current );
+					open_bucket_( *current );
+				}
+
+				SpillVertex_ const tri[3] = { polygon[0], polygon[i], polygon[i+1] };
+				if( 3 != std::fwrite( tri, sizeof(SpillVertex_), 3, current->file.get() ) )
+					throw lut::Error( "Unable to write '%s'", current->info.path.string().c_str() );
+
+				++current->info.triangleCount;
+				++ret.triangleCount;
+			}
+		}
+		else if( is_keyword_( p, "usemtl" ) )
+		{
+			p = skip_space_( p+6 );
+			current = bucket_for_( std::string( p, skip_token_( p ) ) );
+		}
+		else if( is_keyword_( p, "mtllib" ) )
+		{
+			for( p = skip_space_( p+6 ); *p != '\n' && *p != '\r'; p = skip_space_( p ) )
+			{
+				auto const* end = skip_token_( p );
+				libraries.emplace_back( p, end );
+				p = end;
+			}
+		}
+
+		// Anything else (o, g, s, comments, ...) is ignored: faces are grouped
+		// by material only.
+	};
+
+	// Read the file in chunks. Each chunk is processed up to its last full
+	// line; the remainder is moved to the front of the buffer.
+	std::vector<char> buffer( kReadChunkSize + 1 );
+	std::size_t filled = 0;
+	std::uint64_t line = 0;
+
+	for( bool eof = false; !eof; )
+	{
+		if( filled == buffer.size()-1 )
+			buffer.resize( buffer.size() * 2 ); // single line longer than the buffer
+
+		auto const read = std::fread( buffer.data() + filled, 1, buffer.size()-1 - filled, fin.get() );
+		if( std::ferror( fin.get() ) )
+			throw lut::Error( "Error reading '%s'", aPath );
+
+		filled += read;
+		eof = (0 == read);
+
+		// Terminate the last line
+		if( eof && filled && '\n' != buffer[filled-1] )
+			buffer[filled++] = '\n';
+
+		char const* beg = buffer.data();
+		char const* const end = buffer.data() + filled;
+		while( auto const* nl = static_cast<char const*>(std::memchr( beg, '\n', std::size_t(end-beg) )) )
+		{
+			parse_line_( beg, ++line );
+			beg = nl+1;
+		}
+
+		filled = std::size_t(end - beg);
+		std::memmove( buffer.data(), beg, filled );
+	}
+
+	ret.peakAttributeBytes = positions.capacity() * sizeof(glm::vec3) + normals.capacity() * sizeof(glm::vec3) + texcoords.capacity() * sizeof(glm::vec2);
+
+	for( auto& bucket : open )
+		close_bucket_( *bucket );
+
+	// Materials
+	ret.model.materials = load_wavefront_mtl( aPath, libraries, aTempDir );
+
+	std::unordered_map<std::string,std::size_t> materialIndices;
+	for( std::size_t i = 0; i < ret.model.materials.size(); ++i )
+		materialIndices.emplace( ret.model.materials[i].materialName, i );
+
+	// Faces before the first usemtl get a plain default material
+	if( byMaterial.count( "" ) && !materialIndices.count( "" ) )
+	{
+		InputMaterialInfo mi{};
+		mi.materialName = "(default)";
+		mi.baseColor = glm::vec3( 0.8f );
+		mi.baseRoughness = 1.f;
+		mi.baseMetalness = 0.f;
+
+		materialIndices.emplace( "", ret.model.materials.size() );
+		ret.model.materials.emplace_back( std::move(mi) );
+	}
+
+	for( auto& [material, bucket] : closed )
+	{
+		if( 0 == bucket.triangleCount )
+		{
+			std::error_code ec;
+			std::filesystem::remove( bucket.path, ec );
+			continue;
+		}
+
+		auto const it = materialIndices.find( material );
+		if( materialIndices.end() == it )
+			throw lut::Error( "%s: faces use unknown material '%s'", aPath, material.c_str() );
+
+		bucket.materialIndex = it->second;
+		ret.buckets.emplace_back( std::move(bucket) );
+	}
+
+	return ret;
+}
+
+//--    load_spilled_bucket()           ///{{{2///////////////////////////////
+TriangleSoup load_spilled_bucket( SpilledBucket const& aBucket )
+{
+	File_ fin( std::fopen( aBucket.path.string().c_str(), "rb" ), &std::fclose );
+	if( !fin )
+		throw lut::Error( "Unable to open '%s'", aBucket.path.string().c_str() );
+
+	std::size_t const count = std::size_t(aBucket.triangleCount * 3);
+
+	std::vector<SpillVertex_> verts( count );
+	if( count != std::fread( verts.data(), sizeof(SpillVertex_), count, fin.get() ) )
+		throw lut::Error( "Unable to read %zu vertices from '%s'", count, aBucket.path.string().c_str() );
+
+	TriangleSoup ret;
+	ret.vert.reserve( count );
+	ret.text.reserve( count );
+	ret.norm.reserve( count );
+
+	for( auto const& v : verts )
+	{
+		ret.vert.emplace_back( v.position );
+		ret.text.emplace_back( v.texcoord );
+		ret.norm.emplace_back( v.normal );
+	}
+
+	return ret;
+}
+
+//--    $ local                         ///{{{1///////////////////////////////
+namespace
+{
+	char const* skip_space_( char const* aPtr )
+	{
+		while( ' ' == *aPtr || '\t' == *aPtr )
+			++aPtr;
+		return aPtr;
+	}
+
+	char const* skip_token_( char const* aPtr )
+	{
+		while( ' ' != *aPtr && '\t' != *aPtr && '\n' != *aPtr && '\r' != *aPtr )
+			++aPtr;
+		return aPtr;
+	}
+
+	bool is_keyword_( char const* aBeg, char const* aKeyword )
+	{
+		auto const len = std::strlen( aKeyword );
+		if( 0 != std::strncmp( aBeg, aKeyword, len ) )
+			return false;
+
+		char const next = aBeg[len];
+		return ' ' == next || '\t' == next;
+	}
+
+	std::size_t resolve_index_( long aIndex, std::size_t aCount, std::uint64_t aLine )
+	{
+		// OBJ indices are 1-based; negative indices are relative to the end
+		long long const index = aIndex > 0 ? aIndex - 1 : (long long)(aCount) + aIndex;
+		if( 0 == aIndex || index < 0 || std::size_t(index) >= aCount )
+			throw lut::Error( "OBJ line %llu: index %ld out of range (%zu elements)", (unsigned long long)aLine, aIndex, aCount );
+
+		return std::size_t(index);
+	}
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
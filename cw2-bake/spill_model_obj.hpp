@@ -0,0 +1,63 @@
+#ifndef SPILL_MODEL_OBJ_HPP_0B7E4D29_61A3_4F85_B2C8_9D14E6A3F70C
+#define SPILL_MODEL_OBJ_HPP_0B7E4D29_61A3_4F85_B2C8_9D14E6A3F70C
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+#include <filesystem>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "index_mesh.hpp"
+#include "input_model.hpp"
+
+//--    types                                   ///{{{1///////////////////////
+
+/* A run of de-indexed triangles with a single material, stored in a
+ * temporary file. Each vertex is stored as vec3 position, vec2 texture
+ * coordinate and vec3 normal.
+ */
+struct SpilledBucket
+{
+	std::size_t materialIndex;
+	std::filesystem::path path;
+	std::uint64_t triangleCount;
+};
+
+/* Result of spilling an OBJ file. `model` has the materials only; the mesh
+ * list and the vertex arrays are empty. The geometry is in `buckets`.
+ */
+struct SpilledModel
+{
+	InputModel model;
+	std::vector<SpilledBucket> buckets;
+
+	std::uint64_t triangleCount = 0;
+	std::uint64_t bytesSpilled = 0;
+	std::uint64_t peakAttributeBytes = 0; // v/vt/vn arrays held in memory
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+/* Reads a Wavefront OBJ file in fixed-size chunks and writes its faces,
+ * de-indexed and grouped by material, to bucket files in aTempDir. A bucket
+ * is closed and a new one started for the same material once it holds
+ * aMaxBucketTriangles triangles, so that every bucket can be indexed in
+ * memory on its own.
+ *
+ * Only the indexed attribute arrays (v, vt, vn) are kept in memory; faces
+ * are never accumulated. Polygons are triangulated as fans. All counts and
+ * file sizes are 64-bit.
+ */
+SpilledModel spill_wavefront_obj(
+	char const* aPath,
+	std::filesystem::path const& aTempDir,
+	std::uint64_t aMaxBucketTriangles
+);
+
+// Reads a bucket back as a triangle soup
+TriangleSoup load_spilled_bucket( SpilledBucket const& );
+
+#endif // SPILL_MODEL_OBJ_HPP_0B7E4D29_61A3_4F85_B2C8_9D14E6A3F70C
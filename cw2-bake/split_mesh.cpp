@@ -0,0 +1,175 @@
+#include "split_mesh.hpp"
+
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+#include <cassert>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+namespace
+{
+	struct SplitContext_
+	{
+		IndexedMesh const* mesh;
+		std::size_t maxTriangles;
+		float maxExtent;
+
+		std::vector<glm::vec3> centroids;
+		std::vector<std::uint32_t> remap; // old vertex -> chunk-local vertex
+
+		std::vector<IndexedMesh> chunks;
+	};
+
+	void split_recursive_( SplitContext_&, std::uint32_t* aBegin, std::uint32_t* aEnd );
+
+	IndexedMesh make_chunk_( SplitContext_&, std::uint32_t const* aBegin, std::uint32_t const* aEnd );
+}
+
+//--    split_mesh()                    ///{{{2///////////////////////////////
+std::vector<IndexedMesh> split_mesh( IndexedMesh const& aMesh, std::size_t aMaxTriangles, float aMaxExtent )
+{
+	auto const triCount = aMesh.indices.size() / 3;
+
+	SplitContext_ ctx;
+	ctx.mesh = &aMesh;
+	ctx.maxTriangles = aMaxTriangles ? aMaxTriangles : std::numeric_limits<std::size_t>::max();
+	ctx.maxExtent = aMaxExtent > 0.f ? aMaxExtent : std::numeric_limits<float>::max();
+
+	ctx.centroids.resize( triCount );
+	for( std::size_t i = 0; i < triCount; ++i )
+	{
+		auto const& a = aMesh.vert[aMesh.indices[3*i+0]];
+		auto const& b = aMesh.vert[aMesh.indices[3*i+1]];
+		auto const& c = aMesh.vert[aMesh.indices[3*i+2]];
+		ctx.centroids[i] = (a + b + c) / 3.f;
+	}
+
+	ctx.remap.assign( aMesh.vert.size(), ~std::uint32_t(0) );
+
+	std::vector<std::uint32_t> tris( triCount );
+	std::iota( tris.begin(), tris.end(), 0u );
+
+	split_recursive_( ctx, tris.data(), tris.data() + tris.size() );
+
+	return std::move(ctx.chunks);
+}
+
+//--    compute_bounds()                ///{{{2///////////////////////////////
+void compute_bounds( IndexedMesh& aMesh )
+{
+	aMesh.aabbMin = glm::vec3( std::numeric_limits<float>::max() );
+	aMesh.aabbMax = glm::vec3( -std::numeric_limits<float>::max() );
+
+	for( auto const& v : aMesh.vert )
+	{
+		aMesh.aabbMin = glm::min( aMesh.aabbMin, v );
+		aMesh.aabbMax = glm::max( aMesh.aabbMax, v );
+	}
+}
+
+//--    $ local                         ///{{{1///////////////////////////////
+namespace
+{
+	void split_recursive_( SplitContext_& aCtx, std::uint32_t* aBegin, std::uint32_t* aEnd )
+	{
+		auto const& mesh = *aCtx.mesh;
+		auto const count = std::size_t(aEnd - aBegin);
+
+		// Bounds of the triangles (for the extent limit) and of their
+		// centroids (for picking the split axis)
+		glm::vec3 bmin( std::numeric_limits<float>::max() ), bmax( -std::numeric_limits<float>::max() );
+		glm::vec3 cmin( std::numeric_limits<float>::max() ), cmax( -std::numeric_limits<float>::max() );
+		for( auto it = aBegin; it != aEnd; ++it )
+		{
+			for( std::size_t j = 0; j < 3; ++j )
+			{
+				auto const& v = mesh.vert[mesh.indices[3*(*it)+j]];
+				bmin = glm::min( bmin, v );
+				bmax = glm::max( bmax, v );
+			}
+
+			cmin = glm::min( cmin, aCtx.centroids[*it] );
+			cmax = glm::max( cmax, aCtx.centroids[*it] );
+		}
+
+		auto const extent = bmax - bmin;
+		float const maxExtent = std::max( extent.x, std::max( extent.y, extent.z ) );
+
+		auto const csize = cmax - cmin;
+		int axis = 0;
+		if( csize.y > csize[axis] ) axis = 1;
+		if( csize.z > csize[axis] ) axis = 2;
+
+		bool const small = count <= aCtx.maxTriangles && maxExtent <= aCtx.maxExtent;
+		if( small || count < 2 || csize[axis] <= 0.f )
+		{
+			aCtx.chunks.emplace_back( make_chunk_( aCtx, aBegin, aEnd ) );
+			return;
+		}
+
+		// Median split
+		auto const mid = aBegin + count/2;
+		std::nth_element( aBegin, mid, aEnd, [&] (std::uint32_t aA, std::uint32_t aB) {
+			return aCtx.centroids[aA][axis] < aCtx.centroids[aB][axis];
+		} );
+
+		split_recursive_( aCtx, aBegin, mid );
+		split_recursive_( aCtx, mid, aEnd );
+	}
+
+	IndexedMesh make_chunk_( SplitContext_& aCtx, std::uint32_t const* aBegin, std::uint32_t const* aEnd )
+	{
+		auto const& mesh = *aCtx.mesh;
+
+		// Keep triangles in their original order; this keeps the post-
+		// transform cache behaviour of the input.
+		std::vector<std::uint32_t> tris( aBegin, aEnd );
+		std::sort( tris.begin(), tris.end() );
+
+		IndexedMesh ret;
+		std::vector<std::uint32_t> used;
+
+		ret.indices.reserve( tris.size()*3 );
+		for( auto const tri : tris )
+		{
+			for( std::size_t j = 0; j < 3; ++j )
+			{
+				auto const old = mesh.indices[3*tri+j];
+				if( ~std::uint32_t(0) == aCtx.remap[old] )
+				{
+					aCtx.remap[old] = std::uint32_t(used.size());
+					used.emplace_back( old );
+				}
+
+				ret.indices.emplace_back( aCtx.remap[old] );
+			}
+		}
+
+		ret.vert.reserve( used.size() );
+		ret.text.reserve( used.size() );
+		ret.tangent.reserve( used.size() );
+		ret.packedTBN.reserve( used.size() );
+		if( !mesh.norm.empty() )
+			ret.norm.reserve( used.size() );
+
+		for( auto const old : used )
+		{
+			ret.vert.emplace_back( mesh.vert[old] );
+			ret.text.emplace_back( mesh.text[old] );
+			ret.tangent.emplace_back( mesh.tangent[old] );
+			ret.packedTBN.emplace_back( mesh.packedTBN[old] );
+			if( !mesh.norm.empty() )
+				ret.norm.emplace_back( mesh.norm[old] );
+
+			aCtx.remap[old] = ~std::uint32_t(0);
+		}
+
+		compute_bounds( ret );
+		return ret;
+	}
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
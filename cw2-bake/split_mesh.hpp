@@ -0,0 +1,34 @@
+#ifndef SPLIT_MESH_HPP_A3F1C6E2_57B0_4D29_8E4A_90C2D7B31E58
+#define SPLIT_MESH_HPP_A3F1C6E2_57B0_4D29_8E4A_90C2D7B31E58
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+
+#include <cstddef>
+
+#include "index_mesh.hpp"
+
+//--    functions                               ///{{{1///////////////////////
+
+/* Splits a mesh into spatially coherent chunks. Triangles are partitioned
+ * recursively at the median of their centroids along the longest axis, until
+ * each chunk has at most aMaxTriangles triangles and its bounds are no larger
+ * than aMaxExtent along any axis. Either limit can be disabled by passing 0.
+ *
+ * Each chunk is re-indexed locally: vertices shared by triangles in the same
+ * chunk stay shared; only vertices on the boundary between chunks are
+ * duplicated. aabbMin/aabbMax are set to the bounds of each chunk.
+ *
+ * A mesh below both limits is returned as a single chunk.
+ */
+std::vector<IndexedMesh> split_mesh(
+	IndexedMesh const&,
+	std::size_t aMaxTriangles,
+	float aMaxExtent
+);
+
+void compute_bounds( IndexedMesh& );
+
+#endif // SPLIT_MESH_HPP_A3F1C6E2_57B0_4D29_8E4A_90C2D7B31E58
@@ -0,0 +1,161 @@
+#include "task_graph.hpp"
+
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <utility>
+#include <algorithm>
+#include <exception>
+#include <condition_variable>
+
+#include <cstdio>
+#include <cassert>
+
+//--    TaskGraph                       ///{{{2///////////////////////////////
+TaskGraph::TaskId TaskGraph::add( char const* aName, std::function<void ()> aTask, std::vector<TaskId> aDependencies )
+{
+	TaskId const id = mTasks.size();
+
+	for( auto const dep : aDependencies )
+	{
+		assert( dep < id );
+		(void)dep;
+	}
+
+	Task_ task;
+	task.name = aName;
+	task.task = std::move(aTask);
+	task.dependencies = std::move(aDependencies);
+
+	mTasks.emplace_back( std::move(task) );
+	return id;
+}
+
+void TaskGraph::run( bool aConcurrent )
+{
+	mConcurrent = aConcurrent;
+
+	if( aConcurrent )
+		run_concurrent_();
+	else
+		run_serial_();
+}
+
+void TaskGraph::report() const
+{
+	// Longest chain of dependent tasks
+	std::vector<double> path( mTasks.size(), 0.0 );
+	double critical = 0.0, active = 0.0;
+	for( std::size_t i = 0; i < mTasks.size(); ++i )
+	{
+		double const duration = mTasks[i].end - mTasks[i].start;
+
+		double longest = 0.0;
+		for( auto const dep : mTasks[i].dependencies )
+			longest = std::max( longest, path[dep] );
+
+		path[i] = longest + duration;
+		critical = std::max( critical, path[i] );
+		active += duration;
+	}
+
+	std::printf( " - stages (%s): %.1f ms wall, %.1f ms active, %.1f ms critical path\n", mConcurrent ? "concurrent" : "serial", mWallTime * 1000.0, active * 1000.0, critical * 1000.0 );
+	for( auto const& task : mTasks )
+		std::printf( "   %-20s %8.1f ms .. %8.1f ms  (%8.1f ms active)\n", task.name.c_str(), task.start * 1000.0, task.end * 1000.0, (task.end - task.start) * 1000.0 );
+}
+
+void TaskGraph::run_serial_()
+{
+	auto const startTime = std::chrono::steady_clock::now();
+	auto const now_ = [&] {
+		return std::chrono::duration<double>( std::chrono::steady_clock::now() - startTime ).count();
+	};
+
+	for( auto& task : mTasks )
+	{
+		task.start = now_();
+		task.task();
+		task.end = now_();
+	}
+
+	mWallTime = now_();
+}
+
+void TaskGraph::run_concurrent_()
+{
+	auto const startTime = std::chrono::steady_clock::now();
+	auto const now_ = [&] {
+		return std::chrono::duration<double>( std::chrono::steady_clock::now() - startTime ).count();
+	};
+
+	enum class State_ { pending, running, done };
+	std::vector<State_> state( mTasks.size(), State_::pending );
+
+	std::mutex mutex;
+	std::condition_variable finished;
+	std::exception_ptr error;
+	std::size_t running = 0;
+
+	std::vector<std::thread> threads;
+
+	std::unique_lock<std::mutex> lock( mutex );
+	for( ;; )
+	{
+		// Start all tasks whose dependencies are done
+		for( std::size_t i = 0; i < mTasks.size() && !error; ++i )
+		{
+			if( State_::pending != state[i] )
+				continue;
+
+			auto const& deps = mTasks[i].dependencies;
+			if( !std::all_of( deps.begin(), deps.end(), [&] (TaskId aDep) { return State_::done == state[aDep]; } ) )
+				continue;
+
+			state[i] = State_::running;
+			++running;
+
+			threads.emplace_back( [&, i] {
+				auto& task = mTasks[i];
+				task.start = now_();
+
+				std::exception_ptr taskError;
+				try
+				{
+					task.task();
+				}
+				catch( ... )
+				{
+					taskError = std::current_exception();
+				}
+
+				task.end = now_();
+
+				std::lock_guard<std::mutex> guard( mutex );
+				if( taskError && !error )
+					error = taskError;
+
+				state[i] = State_::done;
+				--running;
+				finished.notify_one();
+			} );
+		}
+
+		// Tasks only depend on earlier tasks, so if nothing is running, all
+		// tasks are done (or an error stopped further tasks from starting).
+		if( 0 == running )
+			break;
+
+		finished.wait( lock );
+	}
+	lock.unlock();
+
+	for( auto& thread : threads )
+		thread.join();
+
+	mWallTime = now_();
+
+	if( error )
+		std::rethrow_exception( error );
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
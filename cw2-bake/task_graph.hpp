@@ -0,0 +1,62 @@
+#ifndef TASK_GRAPH_HPP_4C19A7E2_8D3B_4F06_A5E1_72B0D96C3F18
+#define TASK_GRAPH_HPP_4C19A7E2_8D3B_4F06_A5E1_72B0D96C3F18
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <cstddef>
+
+//--    classes                                 ///{{{1///////////////////////
+
+/* Small dependency graph of coarse tasks (e.g., the stages of the baker).
+ * A task may only depend on tasks that were added before it, so the order
+ * of add() is always a valid serial order.
+ *
+ * run() starts each task on its own thread as soon as all of its
+ * dependencies have finished. The tasks are expected to be few and long
+ * running; any parallelism within a task is up to the task itself. If a
+ * task throws, no further tasks are started, and the first exception is
+ * rethrown once the running tasks have finished.
+ *
+ * The time at which each task was active is recorded for report().
+ */
+class TaskGraph
+{
+	public:
+		using TaskId = std::size_t;
+
+	public:
+		TaskId add( char const* aName, std::function<void ()> aTask, std::vector<TaskId> aDependencies = {} );
+
+		// aConcurrent = false runs the tasks one at a time, in order of add()
+		void run( bool aConcurrent = true );
+
+		// Prints the active time of each task, the wall time, and the length
+		// of the critical path through the graph.
+		void report() const;
+
+	private:
+		void run_serial_();
+		void run_concurrent_();
+
+	private:
+		struct Task_
+		{
+			std::string name;
+			std::function<void ()> task;
+			std::vector<TaskId> dependencies;
+
+			double start = 0.0, end = 0.0; // seconds since the start of run()
+		};
+
+		std::vector<Task_> mTasks;
+
+		bool mConcurrent = true;
+		double mWallTime = 0.0;
+};
+
+#endif // TASK_GRAPH_HPP_4C19A7E2_8D3B_4F06_A5E1_72B0D96C3F18
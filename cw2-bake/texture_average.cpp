@@ -0,0 +1,80 @@
+#include "texture_average.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <algorithm>
+
+#include <cstdio>
+
+#include <stb_image.h>
+
+namespace
+{
+	bool average_one_( std::string const& aPath, std::uint32_t& aColor );
+}
+
+//--    average_texture_colors()        ///{{{2///////////////////////////////
+std::vector<std::uint32_t> average_texture_colors( std::vector<std::string> const& aPaths, unsigned aThreads, std::size_t* aFailed )
+{
+	std::vector<std::uint32_t> ret( aPaths.size(), kDefaultAverageColor );
+
+	std::atomic<std::size_t> next{ 0 };
+	std::atomic<std::size_t> failed{ 0 };
+
+	auto const worker_ = [&] {
+		for( std::size_t i = next++; i < aPaths.size(); i = next++ )
+		{
+			if( !average_one_( aPaths[i], ret[i] ) )
+			{
+				std::fprintf( stderr, "average_texture_colors(): '%s' failed to load\n", aPaths[i].c_str() );
+				++failed;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for( unsigned i = 1; i < std::max( aThreads, 1u ); ++i )
+		threads.emplace_back( worker_ );
+
+	worker_();
+
+	for( auto& thread : threads )
+		thread.join();
+
+	if( aFailed )
+		*aFailed = failed;
+
+	return ret;
+}
+
+//--    $ local                         ///{{{1///////////////////////////////
+namespace
+{
+	bool average_one_( std::string const& aPath, std::uint32_t& aColor )
+	{
+		int w, h, comp;
+		std::unique_ptr<stbi_uc,void (*)(void*)> pixels( stbi_load( aPath.c_str(), &w, &h, &comp, 4 ), &stbi_image_free );
+		if( !pixels )
+			return false;
+
+		std::uint64_t sum[4] = {};
+		std::size_t const count = std::size_t(w) * h;
+		for( std::size_t i = 0; i < count; ++i )
+		{
+			for( std::size_t c = 0; c < 4; ++c )
+				sum[c] += pixels.get()[i*4+c];
+		}
+
+		aColor = 0;
+		for( std::size_t c = 0; c < 4; ++c )
+		{
+			auto const avg = std::uint32_t( (sum[c] + count/2) / std::max<std::size_t>( count, 1 ) );
+			aColor |= std::min( avg, 255u ) << (8*c);
+		}
+
+		return true;
+	}
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,33 @@
+#ifndef TEXTURE_AVERAGE_HPP_D19B2721_6C24_4046_B17A_B3ECB8302A0D
+#define TEXTURE_AVERAGE_HPP_D19B2721_6C24_4046_B17A_B3ECB8302A0D
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+//--    constants                               ///{{{1///////////////////////
+
+// Returned for textures that cannot be loaded (opaque mid grey)
+constexpr std::uint32_t kDefaultAverageColor = 0xff808080;
+
+//--    functions                               ///{{{1///////////////////////
+
+/* Returns the average RGBA8 color of each texture, packed with R in the
+ * least significant byte. The viewer uses it as a 1x1 placeholder until the
+ * texture itself has been streamed in. Work is spread over aThreads threads.
+ *
+ * Textures that fail to load get kDefaultAverageColor; their number is
+ * returned through aFailed, if given.
+ */
+std::vector<std::uint32_t> average_texture_colors(
+	std::vector<std::string> const& aPaths,
+	unsigned aThreads,
+	std::size_t* aFailed = nullptr
+);
+
+#endif // TEXTURE_AVERAGE_HPP_D19B2721_6C24_4046_B17A_B3ECB8302A0D
@@ -0,0 +1,224 @@
+#include "texture_budget.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <algorithm>
+
+#include <cmath>
+#include <cstdio>
+#include <cctype>
+
+#include <stb_image.h>
+#include <stb_image_write.h>
+
+namespace
+{
+	// Tweakables
+	constexpr int kLanczosLobes = 3;
+	constexpr int kJpegQuality = 95;
+
+	double lanczos_( double aX );
+
+	// Resample one axis. aStride/aPitch describe how to step between
+	// samples along and across the resampled axis.
+	void resample_axis_(
+		float const* aSrc, std::size_t aSrcLen,
+		float* aDst, std::size_t aDstLen,
+		std::size_t aLines, std::size_t aChannels,
+		std::size_t aSrcStride, std::size_t aSrcPitch,
+		std::size_t aDstStride, std::size_t aDstPitch
+	);
+
+	bool downscale_one_( BudgetTexture const& );
+
+	bool write_image_( std::string const& aPath, int aW, int aH, int aComp, unsigned char const* );
+}
+
+//--    texture_vram_size()             ///{{{2///////////////////////////////
+std::uint64_t texture_vram_size( int aWidth, int aHeight )
+{
+	return std::uint64_t(aWidth) * aHeight * 4 * 4 / 3;
+}
+
+//--    fit_texture_budget()            ///{{{2///////////////////////////////
+bool fit_texture_budget( std::vector<BudgetTexture>& aTextures, std::uint64_t aBudgetBytes, int aMinSize )
+{
+	std::uint64_t total = 0;
+	for( auto& tex : aTextures )
+	{
+		tex.chosenWidth = tex.width;
+		tex.chosenHeight = tex.height;
+		total += texture_vram_size( tex.width, tex.height );
+	}
+
+	// Current density of a texture: halving the resolution quarters it.
+	auto const density_ = [] (BudgetTexture const& aTex) {
+		double const ratio = double(aTex.chosenWidth) * aTex.chosenHeight / (double(aTex.width) * aTex.height);
+		return aTex.density * ratio;
+	};
+
+	while( total > aBudgetBytes )
+	{
+		BudgetTexture* best = nullptr;
+		for( auto& tex : aTextures )
+		{
+			if( tex.chosenWidth/2 < aMinSize || tex.chosenHeight/2 < aMinSize )
+				continue;
+
+			if( !best || density_( tex ) > density_( *best ) )
+				best = &tex;
+		}
+
+		if( !best )
+			return false;
+
+		total -= texture_vram_size( best->chosenWidth, best->chosenHeight );
+		best->chosenWidth /= 2;
+		best->chosenHeight /= 2;
+		total += texture_vram_size( best->chosenWidth, best->chosenHeight );
+	}
+
+	return true;
+}
+
+//--    downscale_textures()            ///{{{2///////////////////////////////
+std::size_t downscale_textures( std::vector<BudgetTexture> const& aTextures, unsigned aThreads )
+{
+	std::atomic<std::size_t> next{ 0 };
+	std::atomic<std::size_t> failed{ 0 };
+
+	auto const worker_ = [&] {
+		for( std::size_t i = next++; i < aTextures.size(); i = next++ )
+		{
+			auto const& tex = aTextures[i];
+			if( tex.chosenWidth == tex.width && tex.chosenHeight == tex.height )
+				continue;
+
+			if( !downscale_one_( tex ) )
+			{
+				std::fprintf( stderr, "downscale_textures(): '%s' => '%s' failed\n", tex.sourcePath.c_str(), tex.outputPath.c_str() );
+				++failed;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for( unsigned i = 1; i < std::max( aThreads, 1u ); ++i )
+		threads.emplace_back( worker_ );
+
+	worker_();
+
+	for( auto& thread : threads )
+		thread.join();
+
+	return failed;
+}
+
+//--    $ local                         ///{{{1///////////////////////////////
+namespace
+{
+	double lanczos_( double aX )
+	{
+		constexpr double pi = 3.14159265358979323846;
+
+		aX = std::abs( aX );
+		if( aX < 1e-8 )
+			return 1.0;
+		if( aX >= kLanczosLobes )
+			return 0.0;
+
+		double const px = pi * aX;
+		return kLanczosLobes * std::sin( px ) * std::sin( px / kLanczosLobes ) / (px*px);
+	}
+
+	void resample_axis_( float const* aSrc, std::size_t aSrcLen, float* aDst, std::size_t aDstLen, std::size_t aLines, std::size_t aChannels, std::size_t aSrcStride, std::size_t aSrcPitch, std::size_t aDstStride, std::size_t aDstPitch )
+	{
+		// When minifying, the kernel is widened by the scale factor, so that
+		// it acts as a low-pass filter at the new sampling rate.
+		double const scale = double(aSrcLen) / double(aDstLen);
+		double const filterScale = std::max( scale, 1.0 );
+		double const support = kLanczosLobes * filterScale;
+
+		std::vector<double> weights;
+		for( std::size_t o = 0; o < aDstLen; ++o )
+		{
+			double const center = (o + 0.5) * scale - 0.5;
+			auto const first = std::ptrdiff_t(std::floor( center - support )) + 1;
+			auto const last = std::ptrdiff_t(std::floor( center + support ));
+
+			weights.clear();
+			double sum = 0.0;
+			for( auto s = first; s <= last; ++s )
+			{
+				double const w = lanczos_( (s - center) / filterScale );
+				weights.emplace_back( w );
+				sum += w;
+			}
+
+			for( std::size_t line = 0; line < aLines; ++line )
+			{
+				for( std::size_t c = 0; c < aChannels; ++c )
+				{
+					double acc = 0.0;
+					for( auto s = first; s <= last; ++s )
+					{
+						auto const clamped = std::size_t(std::clamp<std::ptrdiff_t>( s, 0, std::ptrdiff_t(aSrcLen)-1 ));
+						acc += weights[s-first] * aSrc[clamped*aSrcStride + line*aSrcPitch + c];
+					}
+
+					aDst[o*aDstStride + line*aDstPitch + c] = float(acc / sum);
+				}
+			}
+		}
+	}
+
+	bool downscale_one_( BudgetTexture const& aTex )
+	{
+		int w, h, comp;
+		std::unique_ptr<stbi_uc,void (*)(void*)> pixels( stbi_load( aTex.sourcePath.c_str(), &w, &h, &comp, 0 ), &stbi_image_free );
+		if( !pixels )
+			return false;
+
+		std::size_t const C = std::size_t(comp);
+		std::size_t const dw = std::size_t(aTex.chosenWidth), dh = std::size_t(aTex.chosenHeight);
+
+		std::vector<float> src( std::size_t(w)*h*C );
+		for( std::size_t i = 0; i < src.size(); ++i )
+			src[i] = pixels.get()[i];
+
+		// Horizontal, then vertical
+		std::vector<float> tmp( dw*h*C );
+		resample_axis_( src.data(), std::size_t(w), tmp.data(), dw, std::size_t(h), C, C, std::size_t(w)*C, C, dw*C );
+
+		std::vector<float> dst( dw*dh*C );
+		resample_axis_( tmp.data(), std::size_t(h), dst.data(), dh, dw, C, dw*C, C, dw*C, C );
+
+		std::vector<unsigned char> out( dst.size() );
+		for( std::size_t i = 0; i < dst.size(); ++i )
+			out[i] = (unsigned char)std::clamp( std::lround( dst[i] ), 0l, 255l );
+
+		return write_image_( aTex.outputPath, int(dw), int(dh), comp, out.data() );
+	}
+
+	bool write_image_( std::string const& aPath, int aW, int aH, int aComp, unsigned char const* aData )
+	{
+		auto const dot = aPath.find_last_of( '.' );
+		std::string ext = std::string::npos == dot ? "" : aPath.substr( dot+1 );
+		for( auto& ch : ext )
+			ch = char(std::tolower( (unsigned char)ch ));
+
+		if( "jpg" == ext || "jpeg" == ext )
+			return 0 != stbi_write_jpg( aPath.c_str(), aW, aH, aComp, aData, kJpegQuality );
+		if( "png" == ext )
+			return 0 != stbi_write_png( aPath.c_str(), aW, aH, aComp, aData, aW*aComp );
+		if( "tga" == ext )
+			return 0 != stbi_write_tga( aPath.c_str(), aW, aH, aComp, aData );
+		if( "bmp" == ext )
+			return 0 != stbi_write_bmp( aPath.c_str(), aW, aH, aComp, aData );
+
+		return false;
+	}
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,60 @@
+#ifndef TEXTURE_BUDGET_HPP_6A1D40C3_8E25_4B9F_B7D2_3F08C6E91A57
+#define TEXTURE_BUDGET_HPP_6A1D40C3_8E25_4B9F_B7D2_3F08C6E91A57
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+//--    types                                   ///{{{1///////////////////////
+struct BudgetTexture
+{
+	std::string sourcePath;
+	std::string outputPath;
+
+	int width = 0, height = 0;     // original size
+	int chosenWidth = 0, chosenHeight = 0;
+
+	// Texels per unit of world-space area at the original resolution. This
+	// is the highest density over all materials that use the texture.
+	// Textures that are not used by any geometry have a density of +inf.
+	double density = 0.0;
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+/* Returns the VRAM used by a texture of the given size (RGBA8 plus the full
+ * mip chain).
+ */
+std::uint64_t texture_vram_size( int aWidth, int aHeight );
+
+/* Chooses chosenWidth/chosenHeight for each texture so that the total VRAM
+ * fits aBudgetBytes. The texture with the highest remaining texel density
+ * is halved until the budget is met; this removes texels where they
+ * matter least. Textures are never reduced below aMinSize.
+ *
+ * Returns false if the budget cannot be met.
+ */
+bool fit_texture_budget(
+	std::vector<BudgetTexture>&,
+	std::uint64_t aBudgetBytes,
+	int aMinSize = 16
+);
+
+/* Resamples every texture whose chosen size differs from the original,
+ * using a separable Lanczos-3 filter, and writes the result to outputPath.
+ * The output format follows the extension of outputPath (jpg, png, tga or
+ * bmp). Work is spread over aThreads threads.
+ *
+ * Returns the number of textures that failed to load or write.
+ */
+std::size_t downscale_textures(
+	std::vector<BudgetTexture> const&,
+	unsigned aThreads
+);
+
+#endif // TEXTURE_BUDGET_HPP_6A1D40C3_8E25_4B9F_B7D2_3F08C6E91A57
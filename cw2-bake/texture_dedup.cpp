@@ -0,0 +1,246 @@
+#include "texture_dedup.hpp"
+
+#include <map>
+#include <memory>
+#include <utility>
+
+#include <cstdio>
+#include <cstring>
+
+#include <stb_image.h>
+
+namespace
+{
+	// Tweakables
+	constexpr std::size_t kReadChunkSize = 1024*1024;
+
+	struct FileInfo_
+	{
+		bool ok = false;
+		std::uint64_t size = 0;
+		std::uint64_t hash = 0;
+		int width = 0, height = 0;
+	};
+
+	using Pixels_ = std::unique_ptr<stbi_uc,void (*)(void*)>;
+
+	std::uint64_t hash_bytes_( void const*, std::size_t, std::uint64_t aSeed );
+
+	bool hash_file_( char const*, std::uint64_t& aSize, std::uint64_t& aHash );
+	bool same_file_contents_( char const*, char const* );
+
+	Pixels_ load_rgba_( char const*, int& aWidth, int& aHeight );
+
+	std::uint64_t vram_size_( FileInfo_ const& );
+}
+
+//--    find_duplicate_textures()       ///{{{2///////////////////////////////
+std::vector<std::size_t> find_duplicate_textures( std::vector<std::string> const& aPaths, TextureDedupStats* aStats )
+{
+	TextureDedupStats stats;
+
+	std::vector<std::size_t> ret( aPaths.size() );
+	std::vector<FileInfo_> infos( aPaths.size() );
+
+	// Pass 1: byte-identical files. Cheap, since it only reads the files.
+	std::map<std::pair<std::uint64_t,std::uint64_t>,std::vector<std::size_t>> byFile;
+	for( std::size_t i = 0; i < aPaths.size(); ++i )
+	{
+		ret[i] = i;
+
+		auto& info = infos[i];
+		auto const* path = aPaths[i].c_str();
+
+		if( !hash_file_( path, info.size, info.hash ) )
+			continue;
+
+		int comp;
+		if( !stbi_info( path, &info.width, &info.height, &comp ) )
+			continue;
+
+		info.ok = true;
+
+		auto& candidates = byFile[std::make_pair( info.size, info.hash )];
+		for( auto const other : candidates )
+		{
+			if( same_file_contents_( aPaths[other].c_str(), path ) )
+			{
+				ret[i] = other;
+				break;
+			}
+		}
+
+		if( ret[i] == i )
+		{
+			candidates.emplace_back( i );
+			continue;
+		}
+
+		++stats.byteIdentical;
+		stats.diskSaved += info.size;
+		stats.vramSaved += vram_size_( info );
+	}
+
+	// Pass 2: pixel-identical files (e.g., the same image saved with
+	// different compression settings or in different formats). Only files
+	// that share their dimensions with another file need to be decoded.
+	std::map<std::pair<int,int>,std::vector<std::size_t>> bySize;
+	for( std::size_t i = 0; i < aPaths.size(); ++i )
+	{
+		if( infos[i].ok && ret[i] == i )
+			bySize[std::make_pair( infos[i].width, infos[i].height )].emplace_back( i );
+	}
+
+	for( auto const& entry : bySize )
+	{
+		auto const& group = entry.second;
+		if( group.size() < 2 )
+			continue;
+
+		std::map<std::uint64_t,std::vector<std::size_t>> byPixels;
+		for( auto const i : group )
+		{
+			int w, h;
+			auto const pixels = load_rgba_( aPaths[i].c_str(), w, h );
+			++stats.decoded;
+
+			if( !pixels )
+				continue;
+
+			std::size_t const bytes = std::size_t(w)*h*4;
+			auto& candidates = byPixels[hash_bytes_( pixels.get(), bytes, 0 )];
+
+			for( auto const other : candidates )
+			{
+				// Verify; hash matches are rare, so re-decoding is fine.
+				int ow, oh;
+				auto const opixels = load_rgba_( aPaths[other].c_str(), ow, oh );
+				if( opixels && ow == w && oh == h && 0 == std::memcmp( opixels.get(), pixels.get(), bytes ) )
+				{
+					ret[i] = other;
+					break;
+				}
+			}
+
+			if( ret[i] == i )
+			{
+				candidates.emplace_back( i );
+				continue;
+			}
+
+			++stats.pixelIdentical;
+			stats.diskSaved += infos[i].size;
+			stats.vramSaved += vram_size_( infos[i] );
+		}
+	}
+
+	// Make sure that every entry points directly at its representative
+	for( std::size_t i = 0; i < ret.size(); ++i )
+	{
+		while( ret[ret[i]] != ret[i] )
+			ret[i] = ret[ret[i]];
+	}
+
+	if( aStats )
+		*aStats = stats;
+
+	return ret;
+}
+
+//--    $ local                         ///{{{1///////////////////////////////
+namespace
+{
+	std::uint64_t hash_bytes_( void const* aData, std::size_t aBytes, std::uint64_t aSeed )
+	{
+		// Simple word-at-a-time multiplicative hash. Not cryptographic; every
+		// match is verified by the caller.
+		constexpr std::uint64_t kMul = 0x9e3779b97f4a7c15ull;
+
+		auto const* bytes = static_cast<unsigned char const*>(aData);
+		std::uint64_t hash = aSeed ^ (aBytes * kMul);
+
+		std::size_t i = 0;
+		for( ; i + 8 <= aBytes; i += 8 )
+		{
+			std::uint64_t word;
+			std::memcpy( &word, bytes+i, 8 );
+
+			hash = (hash ^ word) * kMul;
+			hash ^= hash >> 29;
+		}
+		for( ; i < aBytes; ++i )
+		{
+			hash = (hash ^ bytes[i]) * kMul;
+			hash ^= hash >> 29;
+		}
+
+		return hash;
+	}
+
+	bool hash_file_( char const* aPath, std::uint64_t& aSize, std::uint64_t& aHash )
+	{
+		FILE* fin = std::fopen( aPath, "rb" );
+		if( !fin )
+			return false;
+
+		std::vector<unsigned char> buffer( kReadChunkSize );
+
+		aSize = 0;
+		aHash = 0;
+		while( auto const read = std::fread( buffer.data(), 1, buffer.size(), fin ) )
+		{
+			aHash = hash_bytes_( buffer.data(), read, aHash );
+			aSize += read;
+		}
+
+		bool const ok = !std::ferror( fin );
+		std::fclose( fin );
+		return ok;
+	}
+
+	bool same_file_contents_( char const* aPathA, char const* aPathB )
+	{
+		FILE* fa = std::fopen( aPathA, "rb" );
+		if( !fa )
+			return false;
+
+		FILE* fb = std::fopen( aPathB, "rb" );
+		if( !fb )
+		{
+			std::fclose( fa );
+			return false;
+		}
+
+		std::vector<unsigned char> ba( kReadChunkSize ), bb( kReadChunkSize );
+
+		bool same = true;
+		while( same )
+		{
+			auto const ra = std::fread( ba.data(), 1, ba.size(), fa );
+			auto const rb = std::fread( bb.data(), 1, bb.size(), fb );
+
+			if( ra != rb || 0 != std::memcmp( ba.data(), bb.data(), ra ) )
+				same = false;
+			if( 0 == ra )
+				break;
+		}
+
+		std::fclose( fa );
+		std::fclose( fb );
+		return same;
+	}
+
+	Pixels_ load_rgba_( char const* aPath, int& aWidth, int& aHeight )
+	{
+		int comp;
+		return Pixels_( stbi_load( aPath, &aWidth, &aHeight, &comp, 4 ), &stbi_image_free );
+	}
+
+	std::uint64_t vram_size_( FileInfo_ const& aInfo )
+	{
+		// Textures are uploaded as RGBA8 with a full mip chain (~4/3)
+		return std::uint64_t(aInfo.width) * aInfo.height * 4 * 4 / 3;
+	}
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,43 @@
+#ifndef TEXTURE_DEDUP_HPP_E2B7D95A_1F34_4C8E_9A06_5C71F3B0D2A4
+#define TEXTURE_DEDUP_HPP_E2B7D95A_1F34_4C8E_9A06_5C71F3B0D2A4
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+//--    types                                   ///{{{1///////////////////////
+struct TextureDedupStats
+{
+	std::size_t byteIdentical = 0;   // duplicates found by the file hash
+	std::size_t pixelIdentical = 0;  // duplicates found by decoding
+	std::size_t decoded = 0;         // number of files that had to be decoded
+
+	std::uint64_t diskSaved = 0;     // bytes, of the texture files
+	std::uint64_t vramSaved = 0;     // bytes, RGBA8 including the mip chain
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+/* Finds textures with identical content under different paths. Returns, for
+ * each input path, the index of the path that should be used in its place
+ * (the first path with the same content; a path that is unique maps to
+ * itself).
+ *
+ * Files are first compared by size and a hash of their bytes. Remaining
+ * files with the same dimensions are then decoded (as RGBA) and compared
+ * by a hash of the pixel data. Candidate matches are verified byte-by-byte
+ * before they are merged.
+ *
+ * Files that cannot be read or decoded are never merged.
+ */
+std::vector<std::size_t> find_duplicate_textures(
+	std::vector<std::string> const& aPaths,
+	TextureDedupStats* aStats = nullptr
+);
+
+#endif // TEXTURE_DEDUP_HPP_E2B7D95A_1F34_4C8E_9A06_5C71F3B0D2A4
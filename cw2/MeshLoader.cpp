@@ -1,311 +1,187 @@
 #include "MeshLoader.hpp"
-#include <limits>
 
-#include <cstring> // for std::memcpy()
+#include "geometry_pool.hpp"
+
+#include "../labutils/profiler.hpp"
 
-#include "../labutils/error.hpp"
-#include "../labutils/vkutil.hpp"
-#include "../labutils/to_string.hpp"
 #include "glm/vec4.hpp"
+#include "glm/mat3x4.hpp"
+#include "glm/matrix.hpp"
 namespace lut = labutils;
 
-IndexedMesh create_indexed_mesh(labutils::VulkanContext const& aContext, labutils::Allocator const& aAllocator, BakedModel const& model, std::uint32_t meshIndex)
+namespace
 {
+	// A block of CPU data that is uploaded into one of the pool's streams
+	struct UploadSource_
+	{
+		void const* data;
+		std::size_t size;
+	};
 
-	BakedMeshData mesh = model.meshes[meshIndex];
-	
-	//See if this is a foliage mesh
-	std::uint32_t materialId = model.meshes[meshIndex].materialId;
-	std::uint32_t alphaId = model.materials[materialId].alphaMaskTextureId;
-	std::uint32_t normalId = model.materials[materialId].normalMapTextureId;
-
-	bool isAlpha = false;
-	bool isNormalMap = false;
-	if (alphaId != 0xffffffff)// if this is a foliage mesh
+	void add_attribute_(VertexInputDescription& aDesc, std::uint32_t aBinding, std::uint32_t aLocation, VkFormat aFormat, std::uint32_t aOffset)
 	{
-		isAlpha = true;
+		VkVertexInputAttributeDescription attr{};
+		attr.binding = aBinding; // must match binding above
+		attr.location = aLocation; // must match shader
+		attr.format = aFormat;
+		attr.offset = aOffset;
+		aDesc.attributes.push_back(attr);
 	}
 
-	if (normalId != 0xffffffff)
+	std::uint32_t add_binding_(VertexInputDescription& aDesc, std::uint32_t aStride, VkVertexInputRate aRate = VK_VERTEX_INPUT_RATE_VERTEX)
 	{
-		isNormalMap = true;
+		VkVertexInputBindingDescription binding{};
+		binding.binding = std::uint32_t(aDesc.bindings.size());
+		binding.stride = aStride;
+		binding.inputRate = aRate;
+		aDesc.bindings.push_back(binding);
+		return binding.binding;
 	}
+}
 
+VertexInputDescription describe_vertex_input(BakedVertexLayout aLayout)
+{
+	VertexInputDescription desc;
+
+	// Packed attributes: texcoord, normal (SNORM16), tangent (SNORM16), TBN
+	auto const add_packed_ = [&](std::uint32_t aBinding, std::uint32_t aBase) {
+		add_attribute_(desc, aBinding, 1, VK_FORMAT_R32G32_SFLOAT, aBase + 0);
+		add_attribute_(desc, aBinding, 2, VK_FORMAT_R16G16B16A16_SNORM, aBase + 8);
+		add_attribute_(desc, aBinding, 3, VK_FORMAT_R16G16B16A16_SNORM, aBase + 16);
+		add_attribute_(desc, aBinding, 4, VK_FORMAT_R32_UINT, aBase + 24);
+	};
 
-	lut::Buffer vertexPosGPU = lut::create_buffer(
-		aAllocator,
-		mesh.positions.size() * sizeof(glm::vec3),
-		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VMA_MEMORY_USAGE_GPU_ONLY
-	);
-
-	lut::Buffer texCoordGPU = lut::create_buffer(
-		aAllocator,
-		mesh.texcoords.size() * sizeof(glm::vec2),
-		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VMA_MEMORY_USAGE_GPU_ONLY
-	);
-
-	lut::Buffer normalGPU = lut::create_buffer(
-		aAllocator,
-		mesh.normals.size() * sizeof(glm::vec3),
-		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VMA_MEMORY_USAGE_GPU_ONLY
-	);
-
-	lut::Buffer indicesGPU = lut::create_buffer(
-		aAllocator,
-		mesh.indices.size() * sizeof(std::uint32_t),
-		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VMA_MEMORY_USAGE_GPU_ONLY
-	);
-
-	lut::Buffer tangentGPU = lut::create_buffer(
-		aAllocator,
-		mesh.tangents.size() * sizeof(glm::vec4),
-		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VMA_MEMORY_USAGE_GPU_ONLY
-	);
-
-	lut::Buffer packedGPU = lut::create_buffer(
-		aAllocator,
-		mesh.packedTBN.size() * sizeof(std::uint32_t),
-		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VMA_MEMORY_USAGE_GPU_ONLY
-	);
-
-
-	//===========================Staging buffer initialize==================================
-	lut::Buffer posStaging = lut::create_buffer(
-		aAllocator,
-		mesh.positions.size() * sizeof(glm::vec3),
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VMA_MEMORY_USAGE_CPU_TO_GPU
-	);
-
-	lut::Buffer texCoordStaging = lut::create_buffer(
-		aAllocator,
-		mesh.texcoords.size() * sizeof(glm::vec2),
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VMA_MEMORY_USAGE_CPU_TO_GPU
-	);
-
-	lut::Buffer normalStaging = lut::create_buffer(
-		aAllocator,
-		mesh.normals.size() * sizeof(glm::vec3),
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VMA_MEMORY_USAGE_CPU_TO_GPU
-	);
-
-	lut::Buffer indicesStaging = lut::create_buffer(
-		aAllocator,
-		mesh.indices.size() * sizeof(std::uint32_t),
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VMA_MEMORY_USAGE_CPU_TO_GPU
-	);
-
-	lut::Buffer tangentStaging = lut::create_buffer(
-		aAllocator,
-		mesh.tangents.size() * sizeof(glm::vec4),
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VMA_MEMORY_USAGE_CPU_TO_GPU
-	);
-
-	lut::Buffer packedStaging = lut::create_buffer(
-		aAllocator,
-		mesh.packedTBN.size() * sizeof(std::uint32_t),
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VMA_MEMORY_USAGE_CPU_TO_GPU
-	);
-
-	void* posPtr = nullptr;
-	if (auto const res = vmaMapMemory(aAllocator.allocator, posStaging.allocation, &posPtr); VK_SUCCESS != res)
+	switch (aLayout)
+	{
+	case BakedVertexLayout::separate:
+		add_attribute_(desc, add_binding_(desc, sizeof(float) * 3), 0, VK_FORMAT_R32G32B32_SFLOAT, 0);
+		add_attribute_(desc, add_binding_(desc, sizeof(float) * 2), 1, VK_FORMAT_R32G32_SFLOAT, 0);
+		add_attribute_(desc, add_binding_(desc, sizeof(float) * 4), 2, VK_FORMAT_R32G32B32A32_SFLOAT, 0); // w = occlusion
+		add_attribute_(desc, add_binding_(desc, sizeof(float) * 4), 3, VK_FORMAT_R32G32B32A32_SFLOAT, 0);
+		add_attribute_(desc, add_binding_(desc, sizeof(std::uint32_t)), 4, VK_FORMAT_R32_UINT, 0);
+		break;
+
+	case BakedVertexLayout::interleaved:
 	{
-		throw lut::Error("Mapping memory for writing\n"
-			"vmaMapMemory() returned %s", lut::to_string(res).c_str());
+		auto const binding = add_binding_(desc, kBakedInterleavedVertexSize);
+		add_attribute_(desc, binding, 0, VK_FORMAT_R32G32B32_SFLOAT, 0);
+		add_packed_(binding, sizeof(float) * 3);
+		break;
 	}
-	std::memcpy(posPtr, mesh.positions.data(), mesh.positions.size() * sizeof(glm::vec3));
-	vmaUnmapMemory(aAllocator.allocator, posStaging.allocation);
 
-
-	void* texPtr = nullptr;
-	if (auto const res = vmaMapMemory(aAllocator.allocator, texCoordStaging.allocation, &texPtr); VK_SUCCESS != res)
-	{
-		throw lut::Error("Mapping memory for writing\n"
-			"vmaMapMemory() returned %s", lut::to_string(res).c_str());
+	case BakedVertexLayout::hybrid:
+		add_attribute_(desc, add_binding_(desc, sizeof(float) * 3), 0, VK_FORMAT_R32G32B32_SFLOAT, 0);
+		add_packed_(add_binding_(desc, kBakedPackedAttributeSize), 0);
+		break;
 	}
-	std::memcpy(texPtr, mesh.texcoords.data(), mesh.texcoords.size() * sizeof(glm::vec2));
-	vmaUnmapMemory(aAllocator.allocator, texCoordStaging.allocation);
 
+	//Per-instance transform: three rows of a 3x4 matrix
+	auto const instanceBinding = add_binding_(desc, sizeof(float) * 12, VK_VERTEX_INPUT_RATE_INSTANCE);
+	for (std::uint32_t row = 0; row < 3; ++row)
+		add_attribute_(desc, instanceBinding, 5 + row, VK_FORMAT_R32G32B32A32_SFLOAT, row * sizeof(float) * 4);
 
-	void* norPtr = nullptr;
-	if (auto const res = vmaMapMemory(aAllocator.allocator, normalStaging.allocation, &norPtr); VK_SUCCESS != res)
-	{
-		throw lut::Error("Mapping memory for writing\n"
-			"vmaMapMemory() returned %s", lut::to_string(res).c_str());
-	}
-	std::memcpy(norPtr, mesh.normals.data(), mesh.normals.size() * sizeof(glm::vec3));
-	vmaUnmapMemory(aAllocator.allocator, normalStaging.allocation);
+	return desc;
+}
 
+IndexedMesh create_indexed_mesh(GeometryPool& aPool, labutils::UploadBatch& aUploads, BakedModel const& model, std::uint32_t meshIndex)
+{
+	LUT_PROFILE_ZONE("create_indexed_mesh");
 
+	BakedMeshData const& mesh = model.meshes[meshIndex];
 
-	void* indicePtr = nullptr;
-	if (auto const res = vmaMapMemory(aAllocator.allocator, indicesStaging.allocation, &indicePtr); VK_SUCCESS != res)
-	{
-		throw lut::Error("Mapping memory for writing\n"
-			"vmaMapMemory() returned %s", lut::to_string(res).c_str());
-	}
-	std::memcpy(indicePtr, mesh.indices.data(), mesh.indices.size() * sizeof(std::uint32_t));
-	vmaUnmapMemory(aAllocator.allocator, indicesStaging.allocation);
+	// Instance transforms are uploaded as rows (three vec4s per instance),
+	// which the vertex shader reads at locations 5-7.
+	std::vector<glm::mat3x4> instanceRows;
+	for (auto const& xform : mesh.instances)
+		instanceRows.emplace_back(glm::transpose(xform));
 
-	void* tangentPtr = nullptr;
-	if (auto const res = vmaMapMemory(aAllocator.allocator, tangentStaging.allocation, &tangentPtr); VK_SUCCESS != res)
+	// The shader reads ambient occlusion from normal.w. The packed layouts
+	// already store it there; the separate layout stores it as its own
+	// array, which is merged into the normals here.
+	std::vector<glm::vec4> normals;
+	if (BakedVertexLayout::separate == model.layout)
 	{
-		throw lut::Error("Mapping memory for writing\n"
-			"vmaMapMemory() returned %s", lut::to_string(res).c_str());
+		normals.reserve(mesh.normals.size());
+		for (std::size_t i = 0; i < mesh.normals.size(); ++i)
+		{
+			float const occlusion = mesh.occlusion.empty() ? 1.f : mesh.occlusion[i] / 255.f;
+			normals.emplace_back(mesh.normals[i], occlusion);
+		}
 	}
-	std::memcpy(tangentPtr, mesh.tangents.data(), mesh.tangents.size() * sizeof(glm::vec4));
-	vmaUnmapMemory(aAllocator.allocator, tangentStaging.allocation);
 
+	//See if this is a foliage mesh
+	std::uint32_t materialId = mesh.materialId;
+	std::uint32_t alphaId = model.materials[materialId].alphaMaskTextureId;
+	std::uint32_t normalId = model.materials[materialId].normalMapTextureId;
 
-	void* packedPtr = nullptr;
-	if (auto const res = vmaMapMemory(aAllocator.allocator, packedStaging.allocation, &packedPtr); VK_SUCCESS != res)
+	bool isAlpha = false;
+	bool isNormalMap = false;
+	if (alphaId != 0xffffffff)// if this is a foliage mesh
 	{
-		throw lut::Error("Mapping memory for writing\n"
-			"vmaMapMemory() returned %s", lut::to_string(res).c_str());
+		isAlpha = true;
 	}
-	std::memcpy(packedPtr, mesh.packedTBN.data(), mesh.packedTBN.size() * sizeof(std::uint32_t));
-	vmaUnmapMemory(aAllocator.allocator, packedStaging.allocation);
 
-	// We need to ensure that the Vulkan resources are alive until all the
-//  transfers have completed. For simplicity, we will just wait for the
-//  operations to complete with a fence. A more complex solution might want
-//  to queue transfers, let these take place in the background while
-//  performing other tasks.
-
-	lut::Fence uploadComplete = lut::create_fence(aContext);
-
-	// Queue data uploads from staging buffers to the final buffers
-	// This uses a separate command pool for simplicity.
-	lut::CommandPool uploadPool = create_command_pool(aContext);
-	VkCommandBuffer uploadCmd = alloc_command_buffer(aContext, uploadPool.handle);
-	VkCommandBufferBeginInfo beginInfo{};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = 0;
-	beginInfo.pInheritanceInfo = nullptr;
-
-	if (auto const res = vkBeginCommandBuffer(uploadCmd, &beginInfo); VK_SUCCESS != res)
+	if (normalId != 0xffffffff)
 	{
-		throw lut::Error("Beginning command buffer recording\n"
-			"vkBeginCommandBuffer() returned %s", lut::to_string(res).c_str());
+		isNormalMap = true;
 	}
 
-	VkBufferCopy pcopy{};
-	pcopy.size = mesh.positions.size() * sizeof(glm::vec3);
-	vkCmdCopyBuffer(uploadCmd, posStaging.buffer, vertexPosGPU.buffer, 1, &pcopy);
-	lut::buffer_barrier(uploadCmd,
-		vertexPosGPU.buffer,
-		VK_ACCESS_TRANSFER_WRITE_BIT,
-		VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-		VK_PIPELINE_STAGE_TRANSFER_BIT,
-		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-	);
-
-	VkBufferCopy tcopy{};
-	tcopy.size = mesh.texcoords.size() * sizeof(glm::vec2);
-	vkCmdCopyBuffer(uploadCmd, texCoordStaging.buffer, texCoordGPU.buffer, 1, &tcopy);
-	lut::buffer_barrier(uploadCmd,
-		texCoordGPU.buffer,
-		VK_ACCESS_TRANSFER_WRITE_BIT,
-		VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-		VK_PIPELINE_STAGE_TRANSFER_BIT,
-		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-	);
-
-	VkBufferCopy ncopy{};
-	ncopy.size = mesh.normals.size() * sizeof(glm::vec3);
-	vkCmdCopyBuffer(uploadCmd, normalStaging.buffer, normalGPU.buffer, 1, &ncopy);
-	lut::buffer_barrier(uploadCmd,
-		normalGPU.buffer,
-		VK_ACCESS_TRANSFER_WRITE_BIT,
-		VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-		VK_PIPELINE_STAGE_TRANSFER_BIT,
-		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-	);
+	// Vertex streams in binding order (must match describe_vertex_input()),
+	// followed by the instance stream.
+	std::vector<UploadSource_> sources;
+	auto const add_vertex_stream_ = [&](void const* aData, std::size_t aSize) {
+		sources.push_back({ aData, aSize });
+	};
 
-	VkBufferCopy icopy{};
-	icopy.size = mesh.indices.size() * sizeof(std::uint32_t);
-	vkCmdCopyBuffer(uploadCmd, indicesStaging.buffer, indicesGPU.buffer, 1, &icopy);
-	lut::buffer_barrier(uploadCmd,
-		indicesGPU.buffer,
-		VK_ACCESS_TRANSFER_WRITE_BIT,
-		VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-		VK_PIPELINE_STAGE_TRANSFER_BIT,
-		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-	);
+	switch (model.layout)
+	{
+	case BakedVertexLayout::separate:
+		add_vertex_stream_(mesh.positions.data(), mesh.positions.size() * sizeof(glm::vec3));
+		add_vertex_stream_(mesh.texcoords.data(), mesh.texcoords.size() * sizeof(glm::vec2));
+		add_vertex_stream_(normals.data(), normals.size() * sizeof(glm::vec4));
+		add_vertex_stream_(mesh.tangents.data(), mesh.tangents.size() * sizeof(glm::vec4));
+		add_vertex_stream_(mesh.packedTBN.data(), mesh.packedTBN.size() * sizeof(std::uint32_t));
+		break;
+	case BakedVertexLayout::interleaved:
+		add_vertex_stream_(mesh.packed.data(), mesh.packed.size());
+		break;
+	case BakedVertexLayout::hybrid:
+		add_vertex_stream_(mesh.positions.data(), mesh.positions.size() * sizeof(glm::vec3));
+		add_vertex_stream_(mesh.packed.data(), mesh.packed.size());
+		break;
+	}
 
-	VkBufferCopy tancopy{};
-	tancopy.size = mesh.tangents.size() * sizeof(glm::vec4);
-	vkCmdCopyBuffer(uploadCmd, tangentStaging.buffer, tangentGPU.buffer, 1, &tancopy);
-	lut::buffer_barrier(uploadCmd,
-		tangentGPU.buffer,
-		VK_ACCESS_TRANSFER_WRITE_BIT,
-		VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-		VK_PIPELINE_STAGE_TRANSFER_BIT,
-		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-	);
+	add_vertex_stream_(instanceRows.data(), instanceRows.size() * sizeof(glm::mat3x4));
 
-	VkBufferCopy packcopy{};
-	packcopy.size = mesh.packedTBN.size() * sizeof(std::uint32_t);
-	vkCmdCopyBuffer(uploadCmd, packedStaging.buffer, packedGPU.buffer, 1, &packcopy);
-	lut::buffer_barrier(uploadCmd,
-		packedGPU.buffer,
-		VK_ACCESS_TRANSFER_WRITE_BIT,
-		VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-		VK_PIPELINE_STAGE_TRANSFER_BIT,
-		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-	);
+	//===========================GPU buffers and uploads==================================
+	// The copies are recorded into the shared batch; the batch owns the
+	// staging memory until the uploads have completed (see flush()).
+	std::uint32_t const vertexCount = mesh.vertexCount;
+	std::uint32_t const indexCount = std::uint32_t(mesh.indices.size());
+	std::uint32_t const instanceCount = std::uint32_t(instanceRows.size());
 
+	auto const range = aPool.allocate(vertexCount, indexCount, instanceCount);
+	auto const& buffers = aPool.vertex_buffers(range.block);
 
-	if (auto const res = vkEndCommandBuffer(uploadCmd); VK_SUCCESS != res)
+	for (std::uint32_t i = 0; i < sources.size(); ++i)
 	{
-		throw lut::Error("Ending command buffer recording\n"
-			"vkEndCommandBuffer() returned %s", lut::to_string(res).c_str());
-	}
+		bool const isInstance = i + 1 == sources.size();
+		auto const first = isInstance ? range.firstInstance : std::uint32_t(range.vertexOffset);
 
-	// Submit transfer commands
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &uploadCmd;
-	if (auto const res = vkQueueSubmit(aContext.graphicsQueue, 1, &submitInfo, uploadComplete.handle); VK_SUCCESS != res)
-	{
-		throw lut::Error("Submitting commands\n"
-			"vkQueueSubmit() returned %s", lut::to_string(res).c_str());
-	}
-	// Wait for commands to finish before we destroy the temporary resources
-	// required for the transfers (staging buffers, command pool, ...)
-	//
-	// The code doesnt destory the resources implicitly  the resources are
-	// destroyed by the destructors of the labutils wrappers for the various
-	// objects once we leave the functions scope.
-	if (auto const res = vkWaitForFences(aContext.device, 1, &uploadComplete.handle, VK_TRUE, std::numeric_limits<std::uint64_t>::max()); VK_SUCCESS != res)
-	{
-		throw lut::Error("Waiting for upload to complete\n"
-			"vkWaitForFences() returned %s", lut::to_string(res).c_str());
+		aUploads.upload_buffer(buffers[i], sources[i].data, sources[i].size, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, aPool.vertex_offset(i, first));
 	}
 
+	aUploads.upload_buffer(aPool.index_buffer(range.block), mesh.indices.data(), indexCount * sizeof(std::uint32_t), VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, range.firstIndex * VkDeviceSize(sizeof(std::uint32_t)));
 
 	return IndexedMesh{
-		std::move(vertexPosGPU),
-		std::move(texCoordGPU),
-		std::move(normalGPU),
-		std::move(indicesGPU),
 		mesh.materialId,
-		static_cast<uint32_t> (mesh.indices.size()),
+		indexCount,
+		instanceCount,
 		isAlpha,
 		isNormalMap,
-		std::move(tangentGPU),
-		std::move(packedGPU)
+		range.block,
+		range.firstIndex,
+		range.vertexOffset,
+		range.firstInstance
 	};
-}
\ No newline at end of file
+}
@@ -1,42 +1,48 @@
 #pragma once
 
+#include <vector>
+
 #include "../labutils/vulkan_context.hpp"
 
 #include "../labutils/vkbuffer.hpp"
-#include "../labutils/allocator.hpp" 
+#include "../labutils/allocator.hpp"
+#include "../labutils/upload_batch.hpp"
 
 #include "baked_model.hpp"
 
 
+class GeometryPool;
+
 struct IndexedMesh
 {
 	std::uint32_t materialId;
 	std::uint32_t indexSize;
+	std::uint32_t instanceCount;
 	bool isAlphaMask;
 	bool isNormalMap;
 
-	labutils::Buffer pos;
-	labutils::Buffer texcoords;
-	labutils::Buffer normals;
-	labutils::Buffer indices;
-	labutils::Buffer tangent;
-	labutils::Buffer packedTBN;
-
-	//Default constructor
-	IndexedMesh(labutils::Buffer pPos, labutils::Buffer pTexCoord, labutils::Buffer pNormal,
-		labutils::Buffer pIndices, std::uint32_t pMaterialId, std::uint32_t pIndexSize,bool isAlphaMask, bool isNormalMap
-	, labutils::Buffer pTangent, labutils::Buffer ppackedTBN)
-		:pos(std::move(pPos)),texcoords(std::move(pTexCoord)),normals(std::move(pNormal)),
-		indices(std::move(pIndices)),materialId(pMaterialId),indexSize(pIndexSize), isAlphaMask(isAlphaMask),isNormalMap(isNormalMap),
-		tangent(std::move(pTangent)),packedTBN(std::move(ppackedTBN))
-	{}
-
-
-	IndexedMesh(IndexedMesh&& other)noexcept :
-		pos(std::move(other.pos)), texcoords(std::move(other.texcoords)), normals(std::move(other.normals)),
-		indices(std::move(other.indices)), materialId(other.materialId), indexSize(other.indexSize), isAlphaMask(other.isAlphaMask), isNormalMap(other.isNormalMap),
-		tangent(std::move(other.tangent)),packedTBN(std::move(other.packedTBN))
-	{}
+	// Location of the mesh in the GeometryPool: the vertex buffers (in
+	// binding order, as described by describe_vertex_input(), with the
+	// per-instance transforms last) and index buffer of block geometryBlock.
+	std::uint32_t geometryBlock;
+	std::uint32_t firstIndex;
+	std::int32_t vertexOffset;
+	std::uint32_t firstInstance;
+};
+
+// Vertex input state matching the buffers created by create_indexed_mesh()
+// for a given layout. Shader locations are the same for all layouts:
+//   0 position, 1 texcoord, 2 normal, 3 tangent, 4 packed TBN,
+//   5-7 instance transform rows
+struct VertexInputDescription
+{
+	std::vector<VkVertexInputBindingDescription> bindings;
+	std::vector<VkVertexInputAttributeDescription> attributes;
 };
 
-IndexedMesh create_indexed_mesh(labutils::VulkanContext const&, labutils::Allocator const&, BakedModel const&,std::uint32_t meshIndex);
\ No newline at end of file
+VertexInputDescription describe_vertex_input(BakedVertexLayout);
+
+// Allocates the geometry of mesh meshIndex from aPool and records its
+// uploads into aUploads. The geometry may only be used once the batch has
+// been flushed.
+IndexedMesh create_indexed_mesh(GeometryPool& aPool, labutils::UploadBatch& aUploads, BakedModel const&, std::uint32_t meshIndex);
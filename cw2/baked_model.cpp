@@ -4,13 +4,14 @@
 #include <cstring>
 
 #include "../labutils/error.hpp"
+#include "../labutils/profiler.hpp"
 namespace lut = labutils;
 
 namespace
 {
 	// See cw2-bake/main.cpp for more info
 	constexpr char kFileMagic[16] = "\0\0COMP582PMmesh";// \0\0COMP582TMmesh \0\0COMP5822Mmesh \0\0COMP582PMmesh
-	constexpr char kFileVariant[16] = "scsmbil-pac";// scsmbil-tan default scsmbil-pac
+	constexpr char kFileVariant[16] = "scsmbil-avg";// scsmbil-tan default scsmbil-pac scsmbil-ins scsmbil-chk scsmbil-ilv scsmbil-ao scsmbil-str scsmbil-ooc scsmbil-avg
 
 	constexpr std::uint32_t kMaxString = 32*1024;
 
@@ -20,6 +21,8 @@ namespace
 
 BakedModel load_baked_model( char const* aModelPath )
 {
+	LUT_PROFILE_ZONE( "load_baked_model" );
+
 	FILE* fin = std::fopen( aModelPath, "rb" );
 	if( !fin )
 		throw lut::Error( "load_baked_model(): unable to open '%s' for reading", aModelPath );
@@ -93,6 +96,13 @@ namespace
 		if( 0 != std::memcmp( variant, kFileVariant, 16 ) )
 			throw lut::Error( "load_baked_model_(): %s: file variant is '%s', expected '%s'", aInputName, variant, kFileVariant );
 
+		auto const layout = read_uint32_( aFin );
+		if( layout > std::uint32_t(BakedVertexLayout::hybrid) )
+			throw lut::Error( "load_baked_model_(): %s: unknown vertex layout %u", aInputName, layout );
+
+		ret.layout = BakedVertexLayout(layout);
+		ret.vertexFlags = read_uint32_( aFin );
+
 		// Read texture info
 		auto const textureCount = read_uint32_( aFin );
 		for( std::uint32_t i = 0; i < textureCount; ++i )
@@ -104,6 +114,8 @@ namespace
 			checked_read_( aFin, sizeof(std::uint8_t), &channels );
 			info.channels = channels;
 
+			checked_read_( aFin, sizeof(std::uint32_t), &info.averageColor );
+
 			ret.textures.emplace_back( std::move(info) );
 		}
 
@@ -127,36 +139,89 @@ namespace
 
 		// Read mesh data
 		auto const meshCount = read_uint32_( aFin );
+
+		// Meshes are stored back-to-back, so the offset table at the end is
+		// only used to check the positions (where ftell() can represent them).
+		std::vector<long> positions( meshCount );
+
 		for( std::uint32_t i = 0; i < meshCount; ++i )
 		{
+			positions[i] = std::ftell( aFin );
+
 			BakedMeshData data;
 			data.materialId = read_uint32_( aFin );
 			assert( data.materialId < ret.materials.size() );
 
+			checked_read_( aFin, sizeof(glm::vec3), &data.aabbMin );
+			checked_read_( aFin, sizeof(glm::vec3), &data.aabbMax );
+
 			auto const V = read_uint32_( aFin );
 			auto const I = read_uint32_( aFin );
 
-			data.positions.resize( V );
-			checked_read_( aFin, V*sizeof(glm::vec3), data.positions.data() );
+			data.vertexCount = V;
+
+			if( BakedVertexLayout::interleaved == ret.layout )
+			{
+				data.packed.resize( V*kBakedInterleavedVertexSize );
+				checked_read_( aFin, data.packed.size(), data.packed.data() );
+			}
+			else if( BakedVertexLayout::hybrid == ret.layout )
+			{
+				data.positions.resize( V );
+				checked_read_( aFin, V*sizeof(glm::vec3), data.positions.data() );
 
-			data.normals.resize( V );
-			checked_read_( aFin, V*sizeof(glm::vec3), data.normals.data() );
+				data.packed.resize( V*kBakedPackedAttributeSize );
+				checked_read_( aFin, data.packed.size(), data.packed.data() );
+			}
+			else
+			{
+				data.positions.resize( V );
+				checked_read_( aFin, V*sizeof(glm::vec3), data.positions.data() );
 
-			data.texcoords.resize( V );
-			checked_read_( aFin, V*sizeof(glm::vec2), data.texcoords.data() );
+				data.normals.resize( V );
+				checked_read_( aFin, V*sizeof(glm::vec3), data.normals.data() );
 
-			data.tangents.resize(V);
-			checked_read_(aFin, V * sizeof(glm::vec4), data.tangents.data());
+				data.texcoords.resize( V );
+				checked_read_( aFin, V*sizeof(glm::vec2), data.texcoords.data() );
+
+				data.tangents.resize(V);
+				checked_read_(aFin, V * sizeof(glm::vec4), data.tangents.data());
+			}
 
 			data.indices.resize( I );
 			checked_read_( aFin, I*sizeof(std::uint32_t), data.indices.data() );
 
-			data.packedTBN.resize(V);
-			checked_read_(aFin, V * sizeof(std::uint32_t), data.packedTBN.data());
+			if( BakedVertexLayout::separate == ret.layout )
+			{
+				data.packedTBN.resize(V);
+				checked_read_(aFin, V * sizeof(std::uint32_t), data.packedTBN.data());
+
+				if( ret.vertexFlags & kBakedVertexFlagOcclusion )
+				{
+					data.occlusion.resize( V );
+					checked_read_( aFin, V, data.occlusion.data() );
+				}
+			}
+
+			auto const N = read_uint32_( aFin );
+			if( 0 == N )
+				throw lut::Error( "load_baked_model_(): %s: mesh %u has no instances", aInputName, i );
+
+			data.instances.resize( N );
+			checked_read_( aFin, N*sizeof(glm::mat4x3), data.instances.data() );
 
 			ret.meshes.emplace_back( std::move(data) );
 		}
 
+		std::vector<std::uint64_t> offsets( meshCount );
+		checked_read_( aFin, meshCount*sizeof(std::uint64_t), offsets.data() );
+
+		for( std::uint32_t i = 0; i < meshCount; ++i )
+		{
+			if( positions[i] >= 0 && std::uint64_t(positions[i]) != offsets[i] )
+				throw lut::Error( "load_baked_model_(): %s: mesh %u at offset %ld, expected %llu", aInputName, i, positions[i], (unsigned long long)offsets[i] );
+		}
+
 		// Check
 		char byte;
 		auto const check = std::fread( &byte, 1, 1, aFin );
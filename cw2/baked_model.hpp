@@ -9,18 +9,22 @@
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <glm/mat4x3.hpp>
 
 /* Baked file format:
  *
  *  1. Header:
- *    - 16*char: file magic = "\0\0COMP5822Mmesh"
- *    - 16*char: variant = "default" (changes later)
+ *    - 16*char: file magic = "\0\0COMP582PMmesh"
+ *    - 16*char: variant = "scsmbil-avg"
+ *    - 1*uint32_t: vertex layout (see BakedVertexLayout)
+ *    - 1*uint32_t: vertex flags (kBakedVertexFlagOcclusion)
  *
  *  2. Textures
  *    - 1*uint32_t: U = number of (unique) textures
  *    - repeat U times:
  *      - string: path to texture
  *      - 1*uint8_t: number of channels in texture
+ *      - 1*uint32_t: average color (RGBA8, R in the least significant byte)
  *
  *  3. Material information
  *    - 1*uint32_t: M = number of materials
@@ -35,12 +39,37 @@
  *    - 1*uint32_t: M = number of meshes
  *    - repeat M times:
  *      - uint32_t : material index
+ *      - vec3 : bounding box minimum (before instance transform)
+ *      - vec3 : bounding box maximum (before instance transform)
  *      - uint32_t : V = number of vertices
  *      - uint32_t : I = number of indices
- *      - repeat V times: vec3 position
- *      - repeat V times: vec3 normal
- *      - repeat V times: vec2 texture coordinate
+ *      - vertex data, see below
  *      - repeat I times: uint32_t index
+ *      - separate layout only: repeat V times: uint32_t packed TBN quaternion
+ *      - separate layout with kBakedVertexFlagOcclusion only: repeat V times:
+ *        uint8_t ambient occlusion (UNORM)
+ *      - uint32_t : N = number of instances (at least one)
+ *      - repeat N times: mat4x3 instance transform (column major)
+ *    - repeat M times: uint64_t offset of the mesh from the start of the file
+ *
+ *    The offset table follows the meshes, since the baker can stream meshes
+ *    before it knows how many there are (the count is patched afterwards).
+ *
+ *    Meshes that are identical up to a rigid transform are stored only
+ *    once; each copy is an instance. The first instance of a mesh is the
+ *    identity. Large meshes are split into spatial chunks by the baker;
+ *    each chunk is stored as a separate mesh with its own bounds.
+ *
+ *    Vertex data depends on the vertex layout:
+ *    - separate: V*vec3 position, V*vec3 normal, V*vec2 texture coordinate,
+ *      V*vec4 tangent (packed TBN follows the indices, see above)
+ *    - interleaved: V*40 bytes; each vertex is
+ *        vec3 position, vec2 texture coordinate, 4*int16 normal (SNORM,
+ *        w = ambient occlusion, or 1 if not baked), 4*int16 tangent (SNORM,
+ *        w = handedness), uint32_t packed TBN
+ *    - hybrid: V*vec3 position, then V*28 bytes; same as interleaved but
+ *      without the position. The position-only stream can be bound by
+ *      itself for depth-only passes.
  *
  * Strings are stored as
  *   - 1*uint32_t: N = length of string in chars, including terminating \0
@@ -68,10 +97,23 @@
  *   for each mesh (one for each attribute and one for the indices).
  */
 
+enum class BakedVertexLayout : std::uint32_t
+{
+	separate = 0,
+	interleaved = 1,
+	hybrid = 2
+};
+
+constexpr std::size_t kBakedInterleavedVertexSize = 40;
+constexpr std::size_t kBakedPackedAttributeSize = 28;
+
+constexpr std::uint32_t kBakedVertexFlagOcclusion = 0x1; // per-vertex ambient occlusion
+
 struct BakedTextureInfo
 {
 	std::string path;
 	std::uint8_t channels;
+	std::uint32_t averageColor; // RGBA8, R in the least significant byte
 };
 
 struct BakedMaterialInfo
@@ -87,18 +129,33 @@ struct BakedMeshData
 {
 	std::uint32_t materialId;
 
+	glm::vec3 aabbMin, aabbMax; // bounds before the instance transform
+
+	std::uint32_t vertexCount;
+
+	// separate and hybrid layouts
 	std::vector<glm::vec3> positions;
+
+	// separate layout only
 	std::vector<glm::vec2> texcoords;
 	std::vector<glm::vec3> normals;
-
-	std::vector<std::uint32_t> indices;
 	std::vector<glm::vec4> tangents;
 	std::vector<uint32_t> packedTBN;
+	std::vector<std::uint8_t> occlusion; // empty unless kBakedVertexFlagOcclusion
 
+	// interleaved and hybrid layouts: packed vertices or packed attributes
+	std::vector<std::uint8_t> packed;
+
+	std::vector<std::uint32_t> indices;
+
+	std::vector<glm::mat4x3> instances;
 };
 
 struct BakedModel
 {
+	BakedVertexLayout layout;
+	std::uint32_t vertexFlags;
+
 	std::vector<BakedTextureInfo> textures;
 	std::vector<BakedMaterialInfo> materials;
 	std::vector<BakedMeshData> meshes;
@@ -0,0 +1,129 @@
+#include "geometry_pool.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+GeometryPool::GeometryPool(lut::Allocator const& aAllocator, VertexInputDescription const& aInput, GeometryBlockSize const& aBlockSize)
+	: mAllocator(aAllocator)
+	, mBindings(aInput.bindings)
+	, mBlockSize(aBlockSize)
+{
+	for (std::size_t i = 0; i < mBindings.size(); ++i)
+	{
+		if (mBindings[i].binding != i)
+			throw lut::Error("GeometryPool: vertex input bindings must be numbered consecutively");
+	}
+}
+
+GeometryPool::Range GeometryPool::allocate(std::uint32_t aVertexCount, std::uint32_t aIndexCount, std::uint32_t aInstanceCount)
+{
+	auto const fits_ = [&](Block_ const& aBlock) {
+		return aBlock.capacity.vertices - aBlock.used.vertices >= aVertexCount
+			&& aBlock.capacity.indices - aBlock.used.indices >= aIndexCount
+			&& aBlock.capacity.instances - aBlock.used.instances >= aInstanceCount;
+	};
+
+	// Only the newest block has room left, in practice
+	if (mBlocks.empty() || !fits_(mBlocks.back()))
+	{
+		GeometryBlockSize size = mBlockSize;
+		size.vertices = std::max(size.vertices, aVertexCount);
+		size.indices = std::max(size.indices, aIndexCount);
+		size.instances = std::max(size.instances, aInstanceCount);
+
+		create_block_(size);
+	}
+
+	auto& block = mBlocks.back();
+
+	Range ret{};
+	ret.block = std::uint32_t(mBlocks.size() - 1);
+	ret.vertexOffset = std::int32_t(block.used.vertices);
+	ret.firstIndex = block.used.indices;
+	ret.firstInstance = block.used.instances;
+
+	block.used.vertices += aVertexCount;
+	block.used.indices += aIndexCount;
+	block.used.instances += aInstanceCount;
+
+	for (auto const& binding : mBindings)
+		mUsedBytes += VkDeviceSize(binding.stride) * (VK_VERTEX_INPUT_RATE_INSTANCE == binding.inputRate ? aInstanceCount : aVertexCount);
+	mUsedBytes += VkDeviceSize(aIndexCount) * sizeof(std::uint32_t);
+
+	return ret;
+}
+
+VkDeviceSize GeometryPool::vertex_offset(std::uint32_t aBinding, std::uint32_t aElement) const noexcept
+{
+	assert(aBinding < mBindings.size());
+	return VkDeviceSize(mBindings[aBinding].stride) * aElement;
+}
+
+std::vector<VkBuffer> const& GeometryPool::vertex_buffers(std::uint32_t aBlock) const noexcept
+{
+	assert(aBlock < mBlocks.size());
+	return mBlocks[aBlock].vertexBufferHandles;
+}
+
+VkBuffer GeometryPool::index_buffer(std::uint32_t aBlock) const noexcept
+{
+	assert(aBlock < mBlocks.size());
+	return mBlocks[aBlock].indices.buffer;
+}
+
+std::size_t GeometryPool::block_count() const noexcept
+{
+	return mBlocks.size();
+}
+
+std::size_t GeometryPool::buffer_count() const noexcept
+{
+	return mBlocks.size() * (mBindings.size() + 1);
+}
+
+VkDeviceSize GeometryPool::capacity_bytes() const noexcept
+{
+	return mCapacityBytes;
+}
+
+VkDeviceSize GeometryPool::used_bytes() const noexcept
+{
+	return mUsedBytes;
+}
+
+void GeometryPool::create_block_(GeometryBlockSize const& aSize)
+{
+	Block_ block;
+	block.capacity = aSize;
+	block.used = GeometryBlockSize{ 0, 0, 0 };
+
+	for (auto const& binding : mBindings)
+	{
+		auto const count = VK_VERTEX_INPUT_RATE_INSTANCE == binding.inputRate ? aSize.instances : aSize.vertices;
+		auto const bytes = std::max<VkDeviceSize>(VkDeviceSize(binding.stride) * count, 4);
+
+		block.vertexBuffers.emplace_back(lut::create_buffer(
+			mAllocator,
+			bytes,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY
+		));
+		block.vertexBufferHandles.emplace_back(block.vertexBuffers.back().buffer);
+		mCapacityBytes += bytes;
+	}
+
+	auto const indexBytes = std::max<VkDeviceSize>(VkDeviceSize(aSize.indices) * sizeof(std::uint32_t), 4);
+	block.indices = lut::create_buffer(
+		mAllocator,
+		indexBytes,
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VMA_MEMORY_USAGE_GPU_ONLY
+	);
+	mCapacityBytes += indexBytes;
+
+	mBlocks.emplace_back(std::move(block));
+}
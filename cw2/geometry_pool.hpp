@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../labutils/vkbuffer.hpp"
+#include "../labutils/allocator.hpp"
+
+#include "MeshLoader.hpp"
+
+// Capacity of a GeometryPool block, in elements
+struct GeometryBlockSize
+{
+	std::uint32_t vertices = 1u << 20;
+	std::uint32_t indices = 4u << 20;
+	std::uint32_t instances = 64u << 10;
+};
+
+// Device-local geometry of all meshes, sub-allocated from a few large
+// buffers: one buffer per vertex input binding plus one index buffer per
+// block. All per-vertex bindings of a block share the same vertex range, so
+// a mesh is drawn with vkCmdDrawIndexed()'s firstIndex, vertexOffset and
+// firstInstance after binding its block once.
+//
+// Ranges are handed out by a bump allocator; a new block is created when
+// the current one is full (sized up for meshes that exceed the default
+// capacity). Ranges are never freed, which suits a static scene.
+class GeometryPool
+{
+	public:
+		struct Range
+		{
+			std::uint32_t block;
+			std::int32_t vertexOffset;
+			std::uint32_t firstIndex;
+			std::uint32_t firstInstance;
+		};
+
+	public:
+		GeometryPool(labutils::Allocator const&, VertexInputDescription const&, GeometryBlockSize const& = GeometryBlockSize{});
+
+		GeometryPool(GeometryPool const&) = delete;
+		GeometryPool& operator= (GeometryPool const&) = delete;
+
+	public:
+		Range allocate(std::uint32_t aVertexCount, std::uint32_t aIndexCount, std::uint32_t aInstanceCount);
+
+		// Byte offset of element aElement in binding aBinding
+		VkDeviceSize vertex_offset(std::uint32_t aBinding, std::uint32_t aElement) const noexcept;
+
+		// Buffers of block aBlock in binding order, for vkCmdBindVertexBuffers()
+		std::vector<VkBuffer> const& vertex_buffers(std::uint32_t aBlock) const noexcept;
+		VkBuffer index_buffer(std::uint32_t aBlock) const noexcept;
+
+		std::size_t block_count() const noexcept;
+		std::size_t buffer_count() const noexcept;
+
+		VkDeviceSize capacity_bytes() const noexcept;
+		VkDeviceSize used_bytes() const noexcept;
+
+	private:
+		void create_block_(GeometryBlockSize const&);
+
+	private:
+		struct Block_
+		{
+			GeometryBlockSize capacity;
+			GeometryBlockSize used;
+
+			std::vector<labutils::Buffer> vertexBuffers;
+			std::vector<VkBuffer> vertexBufferHandles;
+			labutils::Buffer indices;
+		};
+
+		labutils::Allocator const& mAllocator;
+		std::vector<VkVertexInputBindingDescription> mBindings;
+		GeometryBlockSize mBlockSize;
+
+		std::vector<Block_> mBlocks;
+		VkDeviceSize mCapacityBytes = 0;
+		VkDeviceSize mUsedBytes = 0;
+};
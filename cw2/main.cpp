@@ -4,6 +4,7 @@
 #include <tuple>
 #include <chrono>
 #include <limits>
+#include <algorithm>
 #include <vector>
 #include <stdexcept>
 
@@ -12,6 +13,8 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <cmath>
+#include <optional>
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
@@ -35,10 +38,17 @@ using namespace labutils::literals;
 #include "../labutils/vkobject.hpp"
 #include "../labutils/vkbuffer.hpp"
 #include "../labutils/allocator.hpp" 
+#include "../labutils/upload_batch.hpp"
+#include "../labutils/pipeline_cache.hpp"
+#include "../labutils/sampler_cache.hpp"
+#include "../labutils/parallel_recorder.hpp"
+#include "../labutils/profiler.hpp"
 namespace lut = labutils;
 
 #include "baked_model.hpp"
 #include "MeshLoader.hpp"
+#include "geometry_pool.hpp"
+#include "texture_cache.hpp"
 
 #include <chrono>
 #include<vulkan/vulkan.h>
@@ -56,6 +66,7 @@ namespace
 #		define SHADERDIR_ "D:/Working/MSc Game Engineering/Vulkan/A2/cw2/assets/cw2/shaders/"
 		constexpr char const* kVertShaderPath = SHADERDIR_ "default.vert.spv";
 		constexpr char const* kFragShaderPath = SHADERDIR_ "default.frag.spv";
+		constexpr char const* kBindlessFragShaderPath = SHADERDIR_ "bindless.frag.spv";
 
 		constexpr char const* kVertDensityShaderPath = SHADERDIR_ "defaultDensity.vert.spv";
 		constexpr char const* kGeomDensityShaderPath = SHADERDIR_ "defaultDensity.geom.spv";
@@ -67,6 +78,12 @@ namespace
 		constexpr char const* kMateriaPath = MODELDIR_ "sponza_with_ship.mtl";
 #		undef MODELDIR_
 
+		// Pipeline cache, kept across runs (see lut::PipelineCache)
+		constexpr char const* kPipelineCachePath = "pipeline_cache.bin";
+
+		// Chrome trace of the recorded profiler zones, written when P is pressed
+		constexpr char const* kTracePath = "cw2-trace.json";
+
 #		define TEXTUREDIR_ "assets/cw1/"
 		constexpr char const* kFloorTexture = TEXTUREDIR_ "asphalt.png";
 #		undef TEXTUREDIR_
@@ -89,6 +106,34 @@ namespace
 		constexpr float kCameraFastMult = 5.f; // speed multiplier 
 		constexpr float kCameraSlowMult = 0.05f; // speed multiplier 
 		constexpr float kCameraMouseSensitivity = 0.001f; // radians per pixel 
+
+		// Stream textures from 1x1 placeholders instead of loading all of them
+		// up front; resident levels are kept within the budget (and within
+		// the device memory budget, evicting textures that aren't visible).
+		constexpr bool kStreamTextures = true;
+		constexpr VkDeviceSize kTextureBudget = 512*1024*1024;
+
+		// Bind all textures once, as a single array indexed through a
+		// material storage buffer, if the device supports descriptor
+		// indexing. Otherwise each material gets its own descriptor set.
+		constexpr bool kBindlessTextures = true;
+
+		// Strength of the ambient term. Without baked ambient occlusion it is
+		// kept negligible, as nothing would darken creases and contact areas;
+		// with occlusion (cw2-bake --ao) it provides visible fill light.
+		constexpr float kAmbient = 0.0001f;
+		constexpr float kOccludedAmbient = 0.02f;
+
+		// Frames that the CPU may record ahead of the GPU. One frame waits for
+		// the previous one to finish (lowest latency); more frames overlap CPU
+		// and GPU work at the cost of latency. Independent of the number of
+		// swapchain images.
+		constexpr std::uint32_t kFramesInFlight = 2;
+
+		// Threads that record the draws into secondary command buffers; 0
+		// uses one per hardware thread. T cycles through 1 to this many at
+		// runtime, for comparing recording times.
+		constexpr unsigned kRecordThreads = 0;
 	}
 
 	// GLFW callbacks
@@ -117,6 +162,9 @@ namespace
 		float previousX = 0.f, previousY = 0.f;
 		bool wasMousing = false;
 		glm::mat4 camera2world = glm::identity<glm::mat4>();
+
+		bool writeTrace = false;
+		bool cycleRecordThreads = false;
 	};
 
 
@@ -145,18 +193,54 @@ namespace
 			float intensity;
 		};
 
+		// Texture indices of a material, for the bindless path; must match
+		// the Material struct in bindless.frag (std430)
+		struct MaterialData
+		{
+			std::uint32_t baseColor;
+			std::uint32_t roughness;
+			std::uint32_t metalness;
+			std::uint32_t alphaMask;
+			std::uint32_t normalMap;
+		};
+
 		static_assert(sizeof(SceneUniform) <= 65536, "SceneUniform must be less than 65536 bytes for vkCmdUpdateBuffer");
 		static_assert(sizeof(SceneUniform) % 4 == 0, "SceneUniform size must be a multiple of 4 bytes");
+		static_assert(sizeof(MaterialData) == 5 * sizeof(std::uint32_t), "MaterialData must be tightly packed");
 
 	}
 
 	// Local types/structures:
 
+	// Resources of one frame in flight. A slot is reused once its fence has
+	// signalled; until then, the GPU may still read its uniform buffers,
+	// descriptor sets and command buffer.
+	struct FrameSlot
+	{
+		lut::CommandPool cpool;
+		VkCommandBuffer cbuffer = VK_NULL_HANDLE;
+		lut::Fence fence;
+		lut::Semaphore imageAvailable;
+
+		lut::Buffer sceneUBO;
+		lut::Buffer lightUBO;
+		VkDescriptorSet sceneDescriptors = VK_NULL_HANDLE;
+		VkDescriptorSet lightDescriptors = VK_NULL_HANDLE;
+
+		// Texture descriptors: the bindless set, or one set per material.
+		// Textures changed by streaming are rewritten when the slot is
+		// reused.
+		VkDescriptorSet bindlessDescriptors = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> materialDescriptors;
+		std::vector<std::uint32_t> changedTextures;
+	};
+
 	// Local functions:
 	void glfw_callback_key_press(GLFWwindow*, int, int, int, int);
 	lut::RenderPass create_render_pass(lut::VulkanWindow const&);
 
-	lut::PipelineLayout create_pipeline_layout(lut::VulkanContext const&, VkDescriptorSetLayout const&, VkDescriptorSetLayout aObjectLayout, VkDescriptorSetLayout const& aLightSource
+	lut::PipelineLayout create_pipeline_layout(lut::VulkanContext const&, VkDescriptorSetLayout const&, VkDescriptorSetLayout aObjectLayout, VkDescriptorSetLayout const& aLightSource,
+		std::uint32_t aFragmentPushConstantSize = 0
 	);
 
 	lut::DescriptorSetLayout create_scene_descriptor_layout(lut::VulkanWindow const&);
@@ -164,11 +248,53 @@ namespace
 	lut::DescriptorSetLayout create_lightSource_descriptor_layout(lut::VulkanWindow const&);
 	lut::DescriptorSetLayout create_object_descriptor_layout(lut::VulkanWindow const&);
 
-	lut::Pipeline create_piepline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout);
+	// Bindless materials: set 1 holds the material storage buffer (binding 0)
+	// and an array with all textures (binding 1), indexed by texture ID.
+	// Textures that no material uses are left unwritten (partially bound).
+	bool supports_bindless_textures(lut::VulkanWindow const&, std::uint32_t aTextureCount);
+	lut::DescriptorSetLayout create_bindless_descriptor_layout(lut::VulkanWindow const&, std::uint32_t aTextureCount);
+	lut::DescriptorPool create_bindless_descriptor_pool(lut::VulkanWindow const&, std::uint32_t aTextureCount, std::uint32_t aSetCount);
+
+	// Pipeline variants: every combination of material features gets its own
+	// pipeline, with the features baked into default.frag as specialization
+	// constants. Variants with an alpha mask use the blended pipeline state;
+	// they sort last, so that they are drawn after all opaque meshes.
+	constexpr std::uint32_t kVariantNormalMap = 1u << 0;
+	constexpr std::uint32_t kVariantAlphaMask = 1u << 1;
+	constexpr std::uint32_t kVariantCount = 4;
+
+	std::uint32_t pipeline_variant(BakedModel const&, std::uint32_t aMeshIndex);
+
+	// Specialization constants of the fragment shaders
+	struct FragmentConstants
+	{
+		VkBool32 alphaMask;
+		VkBool32 normalMap;
+		float ambient;
+	};
+
+	// Mesh indices grouped by pipeline variant, in draw order
+	std::vector<std::vector<std::uint32_t>> group_draws_by_variant(BakedModel const&);
+
+	struct VariantDraw
+	{
+		std::uint32_t variant;
+		std::uint32_t mesh;
+	};
+
+	// The draws of all variants as a single list in draw order, which
+	// record_commands() splits across threads
+	std::vector<VariantDraw> flatten_draws(std::vector<std::vector<std::uint32_t>> const&);
+
+	// Creates the pipelines of the variants that are used by aDraws (the
+	// others are left empty)
+	std::vector<lut::Pipeline> create_variant_pipelines(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout, VertexInputDescription const&, char const* aFragShaderPath, float aAmbient, VkPipelineCache, std::vector<std::vector<std::uint32_t>> const& aDraws);
+
+	lut::Pipeline create_piepline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout, VertexInputDescription const&, char const* aFragShaderPath, float aAmbient, VkPipelineCache, std::uint32_t aVariant);
 
 	VkBuffer create_color_uniform_buffer(std::vector<glsl::ColorUniform>const& colorUniform, lut::VulkanWindow const& window);
 
-	lut::Pipeline create_alpha_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout);
+	lut::Pipeline create_alpha_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout, VertexInputDescription const&, char const* aFragShaderPath, float aAmbient, VkPipelineCache, std::uint32_t aVariant);
 
 
 	void create_swapchain_framebuffers(
@@ -188,14 +314,26 @@ namespace
 	);
 
 	void update_user_state(UserState&, float aElapsedTime);
+
+	// On-screen size (pixels) of the largest mesh instance using each texture,
+	// from the instance bounding spheres; 0 for textures of instances that are
+	// behind the camera.
+	std::vector<float> compute_texture_screen_sizes(
+		BakedModel const&,
+		std::vector<IndexedMesh> const&,
+		UserState const&,
+		std::uint32_t aFramebufferHeight
+	);
+
 	void record_commands(
 		VkCommandBuffer,
 		VkRenderPass,
 		VkFramebuffer,
-		VkPipeline pipeTexture,
-		VkPipeline pipeAlpha,
+		std::vector<lut::Pipeline> const& aVariantPipes,
+		std::vector<VariantDraw> const& aDraws,
 		VkExtent2D const&,
 		std::vector<IndexedMesh>* indexedMesh,
+		GeometryPool const&,
 		VkBuffer aSceneUBO,
 		glsl::SceneUniform
 		const& aSceneUniform,
@@ -204,8 +342,11 @@ namespace
 		VkPipelineLayout,
 		VkDescriptorSet aSceneDescriptors,
 		VkDescriptorSet lightDescriptors,
-		std::vector<VkDescriptorSet*>* objectsDescriptors,
-		std::vector<VkDescriptorSet*>* diffuseDescriptors
+		VkDescriptorSet aBindlessDescriptors,
+		std::vector<VkDescriptorSet> const& aMaterialDescriptors,
+		std::vector<VkDescriptorSet*>* diffuseDescriptors,
+		lut::ParallelRecorder&,
+		std::uint32_t aFrameIndex
 	);
 	void submit_commands(
 		lut::VulkanContext const&,
@@ -227,6 +368,11 @@ int main() try
 {
 	//TODO-implement me.
 
+	// Everything up to the first frame is recorded as one zone
+	lut::profiler_set_thread_name("main");
+	std::optional<lut::ProfileScope> startupZone;
+	startupZone.emplace("startup");
+
 	// Create our Vulkan Window
 	lut::VulkanWindow window = lut::make_vulkan_window();
 
@@ -241,19 +387,46 @@ int main() try
 
 	//scene Uniform descriptor
 	lut::DescriptorSetLayout sceneLayout = create_scene_descriptor_layout(window);
-	//TODO- (Section 4) create object descriptor set layout
-	lut::DescriptorSetLayout objectLayout = create_object_descriptor_layout(window);
 
 	lut::DescriptorSetLayout lightLayout = create_lightSource_descriptor_layout(window);
 
 	// Intialize resources
 	lut::RenderPass renderPass = create_render_pass(window);
 
-	lut::PipelineLayout pipeLayout = create_pipeline_layout(window, sceneLayout.handle, objectLayout.handle, lightLayout.handle);
+	//Load model; the vertex layout of the model determines the pipeline vertex input
+	BakedModel bakedModel = load_baked_model("assets/cw2/sponza-pbr_tan_packed.comp5822mesh");
+	VertexInputDescription const vertexInput = describe_vertex_input(bakedModel.layout);
+
+	//Object descriptor set layout: bindless (all textures of the model in one
+	//set) if the device allows it, one set per material otherwise
+	auto const textureCount = std::uint32_t(bakedModel.textures.size());
+	bool const bindless = cfg::kBindlessTextures && supports_bindless_textures(window, textureCount);
+	std::printf("Materials: %s\n", bindless ? "bindless (descriptor indexing)" : "one descriptor set per material");
+
+	lut::DescriptorSetLayout objectLayout = bindless
+		? create_bindless_descriptor_layout(window, textureCount)
+		: create_object_descriptor_layout(window);
+
+	// The bindless path selects the material of each draw with a push constant
+	lut::PipelineLayout pipeLayout = create_pipeline_layout(window, sceneLayout.handle, objectLayout.handle, lightLayout.handle, bindless ? sizeof(std::uint32_t) : 0);
+	char const* const fragShaderPath = bindless ? cfg::kBindlessFragShaderPath : cfg::kFragShaderPath;
 
-	//Pipe line
-	lut::Pipeline pipe = create_piepline(window, renderPass.handle, pipeLayout.handle);
-	lut::Pipeline alphaPipe = create_alpha_pipeline(window, renderPass.handle, pipeLayout.handle);
+	//Pipe line; pipelines are created through a cache that persists across runs
+	lut::PipelineCache pipelineCache(window, cfg::kPipelineCachePath);
+
+	// Draws are grouped by variant once; only the variants in use are created
+	auto const variantDraws = group_draws_by_variant(bakedModel);
+	auto const drawList = flatten_draws(variantDraws);
+	auto const variantsUsed = std::size_t(std::count_if(variantDraws.begin(), variantDraws.end(), [](auto const& aDraws) { return !aDraws.empty(); }));
+
+	auto const pipelineStart = Clock_::now();
+	float const ambient = (bakedModel.vertexFlags & kBakedVertexFlagOcclusion) ? cfg::kOccludedAmbient : cfg::kAmbient;
+	std::printf("Ambient: %g (%s)\n", ambient, (bakedModel.vertexFlags & kBakedVertexFlagOcclusion) ? "baked occlusion" : "no baked occlusion");
+
+	std::vector<lut::Pipeline> pipes = create_variant_pipelines(window, renderPass.handle, pipeLayout.handle, vertexInput, fragShaderPath, ambient, pipelineCache.handle(), variantDraws);
+	pipelineCache.add_creation_time(std::chrono::duration<double>(Clock_::now() - pipelineStart).count(), variantsUsed);
+	std::printf("Pipeline variants: %zu of %u in use\n", variantsUsed, kVariantCount);
+	pipelineCache.report();
 
 	// Create VMA allocator
 	lut::Allocator allocator = lut::create_allocator(window);
@@ -266,242 +439,316 @@ int main() try
 	create_swapchain_framebuffers(window, renderPass.handle, framebuffers, depthBufferView.handle);
 
 
-	lut::CommandPool cpool = lut::create_command_pool(window, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
-
-	std::vector<VkCommandBuffer> cbuffers;
-	std::vector<lut::Fence> cbfences;
-
-	for (std::size_t i = 0; i < framebuffers.size(); ++i)
+	// Frames in flight; each slot's command pool is reset as a whole when the
+	// slot is reused
+	std::vector<FrameSlot> frames(cfg::kFramesInFlight);
+	for (auto& frame : frames)
 	{
-		cbuffers.emplace_back(lut::alloc_command_buffer(window, cpool.handle));
-		cbfences.emplace_back(lut::create_fence(window, VK_FENCE_CREATE_SIGNALED_BIT));
+		frame.cpool = lut::create_command_pool(window, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+		frame.cbuffer = lut::alloc_command_buffer(window, frame.cpool.handle);
+		frame.fence = lut::create_fence(window, VK_FENCE_CREATE_SIGNALED_BIT);
+		frame.imageAvailable = lut::create_semaphore(window);
 	}
 
-	//create descriptor pool
-	lut::DescriptorPool dpool = lut::create_descriptor_pool(window);
+	// Draws are recorded into secondary command buffers from per-thread,
+	// per-frame command pools
+	lut::ParallelRecorder recorder(window, cfg::kFramesInFlight, cfg::kRecordThreads);
+	std::printf("Recording draws with %u thread(s); press T to change\n", recorder.threads());
+
+	//create descriptor pool; sized for the scene and light sets of each frame
+	//in flight plus, per frame in flight, one texture set per material (five
+	//samplers each)
+	auto const materialCount = std::uint32_t(bakedModel.materials.size());
+	auto const frameSets = 2 * cfg::kFramesInFlight;
+	auto const materialSetCount = materialCount * cfg::kFramesInFlight;
+	lut::DescriptorPool dpool = lut::create_descriptor_pool(window, 5 * materialSetCount + frameSets, materialSetCount + frameSets);
 
 		
 	//Load model and meshes----------------------------------------------------------------------
-	BakedModel bakedModel = load_baked_model("assets/cw2/sponza-pbr_tan_packed.comp5822mesh");
 	std::vector<IndexedMesh>* indexedMesh = new std::vector<IndexedMesh>;
-	for (int i = 0; i < bakedModel.meshes.size(); i++)
+	std::size_t totalInstances = 0;
+
+	// All geometry lives in a few large buffers. Size the blocks to the model
+	// (within the default limits) so that it usually fits into a single one.
+	GeometryBlockSize geometrySize{ 0, 0, 0 };
+	for (auto const& mesh : bakedModel.meshes)
 	{
-		auto mesh = bakedModel.meshes[i];
-		IndexedMesh temp = create_indexed_mesh(window, allocator, bakedModel, i);
-		indexedMesh->emplace_back(std::move(temp));
+		geometrySize.vertices += mesh.vertexCount;
+		geometrySize.indices += std::uint32_t(mesh.indices.size());
+		geometrySize.instances += std::uint32_t(mesh.instances.size());
 	}
+	geometrySize.vertices = std::min(geometrySize.vertices, GeometryBlockSize{}.vertices);
+	geometrySize.indices = std::min(geometrySize.indices, GeometryBlockSize{}.indices);
+	geometrySize.instances = std::min(geometrySize.instances, GeometryBlockSize{}.instances);
+
+	GeometryPool geometry(allocator, vertexInput, geometrySize);
+	{
+		// All mesh uploads share a few large command buffers
+		lut::UploadBatch meshUploads(window, allocator);
+		for (int i = 0; i < bakedModel.meshes.size(); i++)
+		{
+			IndexedMesh temp = create_indexed_mesh(geometry, meshUploads, bakedModel, i);
+			totalInstances += temp.instanceCount;
+			indexedMesh->emplace_back(std::move(temp));
+		}
+		meshUploads.flush();
+
+		auto const& stats = meshUploads.stats();
+		std::printf("Mesh uploads: %zu buffers (%zu with dedicated staging), %.1f MiB in %zu submits, %zu stalls, %.1f ms GPU wait => %.1f MiB/s\n", stats.bufferUploads, stats.dedicatedStaging, stats.bytes / (1024.0 * 1024.0), stats.submits, stats.stalls, stats.waitSeconds * 1000.0, stats.bytes / (1024.0 * 1024.0) / std::max(stats.activeSeconds, 1e-9));
+	}
+	std::printf("Loaded %zu meshes: %zu instances in %zu instanced draw calls\n", indexedMesh->size(), totalInstances, indexedMesh->size());
+	std::printf("Geometry pool: %zu blocks, %zu buffers, %.1f of %.1f MiB used\n", geometry.block_count(), geometry.buffer_count(), geometry.used_bytes() / (1024.0 * 1024.0), geometry.capacity_bytes() / (1024.0 * 1024.0));
+	std::printf("Vertex layout %u: %zu vertex buffer bindings per draw\n", std::uint32_t(bakedModel.layout), vertexInput.bindings.size());
 	//Load model and meshes----------------------------------------------------------------------
 
 	//Samling textures----------------------------------------------------------------------
-	lut::Sampler defalutSampler = lut::create_default_sampler(window);
+	// Samplers are shared by create info
+	lut::SamplerCache samplers(window);
+	VkSampler const defaultSampler = samplers.get(lut::default_sampler_info());
 	//lut::Sampler defalutSampler = lut::create_anisotrpic_sampler(window);
 	lut::CommandPool loadCmdPool = lut::create_command_pool(window, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
 
-	std::vector<VkDescriptorSet*>* textureDescriptorsSet = new std::vector<VkDescriptorSet*>;
 	std::vector<VkDescriptorSet*>* alphaDescriptorsSet = new std::vector<VkDescriptorSet*>;
 
-	std::vector<lut::Image> imageSet;
-	std::vector<lut::ImageView>imageViewSet;
-
-	std::vector<lut::Image> alphaImageSet;
-	std::vector<lut::ImageView>alphaImageViewSet;
-
-	std::vector<lut::Image> normalMapImageSet;
-	std::vector<lut::ImageView>normalMapImageViewSet;
-
-	int alphaIndex = 0;
-	int normalMapIndex = 0;
-	for (int i = 0; i < indexedMesh->size(); i++)//changed
+	// Textures used by the meshes (may contain duplicates)
+	std::vector<std::uint32_t> usedTextures;
+	for (auto const& mesh : *indexedMesh)
 	{
+		auto const& material = bakedModel.materials[mesh.materialId];
+		usedTextures.insert(usedTextures.end(), { material.baseColorTextureId, material.roughnessTextureId, material.metalnessTextureId });
 
-		std::uint32_t materialId = ((*indexedMesh)[i].materialId);
-		bool isAlpha = (*indexedMesh)[i].isAlphaMask;
-		bool isNormalMap = (*indexedMesh)[i].isNormalMap;
+		if (mesh.isAlphaMask)
+			usedTextures.push_back(material.alphaMaskTextureId);
+		if (mesh.isNormalMap)
+			usedTextures.push_back(material.normalMapTextureId);
+	}
 
+	// Each unique texture is loaded once and shared by all meshes using it
+	TextureCache textureCache(window, allocator, loadCmdPool.handle, bakedModel);
+	if (cfg::kStreamTextures)
+	{
+		textureCache.start_streaming(cfg::kTextureBudget, cfg::kFramesInFlight);
+	}
+	else
+	{
+		// Decode all textures used by the meshes up front, in parallel
+		textureCache.preload(usedTextures);
+	}
 
-		//Sampling base color
-		std::uint32_t baseColorId = bakedModel.materials[materialId].baseColorTextureId;
-		const char* baseColorPath = bakedModel.textures[baseColorId].path.c_str();
+	// Texture descriptor sets, one per material and frame in flight
+	// (fallback without bindless textures). Meshes that share a material
+	// share its set; sets are only allocated for materials that meshes use.
+	lut::DescriptorUpdateTemplate materialTemplate;
 
-		imageSet.push_back(std::move((lut::load_image_texture2d(baseColorPath, window, loadCmdPool.handle, allocator))));
-		imageViewSet.push_back(std::move((lut::create_image_view_texture2d(window, imageSet[3*i].image, VK_FORMAT_R8G8B8A8_UNORM))));
+	// (Re-)writes the texture descriptors of a material in aSet; also used
+	// when streamed textures change
+	auto const update_material_descriptors = [&](VkDescriptorSet aSet, std::uint32_t aMaterialId)
+	{
+		LUT_PROFILE_ZONE("update_material_descriptors");
+
+		auto const& material = bakedModel.materials[aMaterialId];
+
+		//Bindings 0-4: base color, roughness, metalness, alpha mask, normal
+		//map. Materials without alpha mask/normal map bind the base color
+		//there instead.
+		std::uint32_t const textureIds[5] = {
+			material.baseColorTextureId,
+			material.roughnessTextureId,
+			material.metalnessTextureId,
+			0xffffffff != material.alphaMaskTextureId ? material.alphaMaskTextureId : material.baseColorTextureId,
+			0xffffffff != material.normalMapTextureId ? material.normalMapTextureId : material.baseColorTextureId
+		};
 
-		//Sampling roughness
-		std::uint32_t roughnessId = bakedModel.materials[materialId].roughnessTextureId;
-		const char* roughnessPath = bakedModel.textures[roughnessId].path.c_str();
+		VkDescriptorImageInfo textureInfo[5]{};
+		for (std::size_t i = 0; i < 5; ++i)
+		{
+			textureInfo[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			textureInfo[i].imageView = textureCache.view(textureIds[i]);
+			textureInfo[i].sampler = defaultSampler;
+		}
 
-		imageSet.push_back(std::move((lut::load_image_texture2d(roughnessPath, window, loadCmdPool.handle, allocator))));
-		imageViewSet.push_back(std::move((lut::create_image_view_texture2d(window, imageSet[3 * i +1].image, VK_FORMAT_R8G8B8A8_UNORM))));
+		vkUpdateDescriptorSetWithTemplate(window.device, aSet, materialTemplate.handle, textureInfo);
+	};
 
-		//Sampling metalness
-		std::uint32_t metalnessId = bakedModel.materials[materialId].metalnessTextureId;
-		const char* metalnessPath = bakedModel.textures[metalnessId].path.c_str();
+	// Bindless: (re-)writes the array elements of the given textures in
+	// aSet; one set per frame in flight
+	lut::DescriptorPool bindlessPool;
 
-		imageSet.push_back(std::move((lut::load_image_texture2d(metalnessPath, window, loadCmdPool.handle, allocator))));
-		imageViewSet.push_back(std::move((lut::create_image_view_texture2d(window, imageSet[3 * i + 2].image, VK_FORMAT_R8G8B8A8_UNORM))));
+	auto const update_bindless_textures = [&](VkDescriptorSet aSet, std::vector<std::uint32_t> const& aTextureIds)
+	{
+		LUT_PROFILE_ZONE("update_bindless_textures");
 
-		//Sampling alphaTexture
-		if (isAlpha)
+		std::vector<VkDescriptorImageInfo> textureInfos(aTextureIds.size());
+		std::vector<VkWriteDescriptorSet> desc(aTextureIds.size());
+		for (std::size_t i = 0; i < aTextureIds.size(); ++i)
 		{
-			std::uint32_t alphaMaskId = bakedModel.materials[materialId].alphaMaskTextureId;
-			const char* alphaMaskPath = bakedModel.textures[alphaMaskId].path.c_str();
-
-			alphaImageSet.push_back(std::move((lut::load_image_texture2d(alphaMaskPath, window, loadCmdPool.handle, allocator))));
-			
-			std::uint32_t index = alphaImageSet.size() - 1;
-			alphaImageViewSet.push_back(std::move((lut::create_image_view_texture2d(window, alphaImageSet[index].image, VK_FORMAT_R8G8B8A8_UNORM))));
+			textureInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			textureInfos[i].imageView = textureCache.view(aTextureIds[i]);
+			textureInfos[i].sampler = defaultSampler;
+
+			desc[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			desc[i].dstSet = aSet;
+			desc[i].dstBinding = 1;
+			desc[i].dstArrayElement = aTextureIds[i];
+			desc[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			desc[i].descriptorCount = 1;
+			desc[i].pImageInfo = &textureInfos[i];
 		}
 
-		//Sampling normalMap
-		if (isNormalMap)
+		vkUpdateDescriptorSets(window.device, std::uint32_t(desc.size()), desc.data(), 0, nullptr);
+	};
+
+	lut::Buffer materialBuffer;
+	if (bindless)
+	{
+		// Texture indices of all materials; meshes without an alpha mask or
+		// normal map use the base color there, as in the per-mesh sets
+		std::vector<glsl::MaterialData> materials;
+		for (auto const& material : bakedModel.materials)
 		{
-			std::uint32_t normalMapId = bakedModel.materials[materialId].normalMapTextureId;
-			const char* normalMapPath = bakedModel.textures[normalMapId].path.c_str();
+			materials.emplace_back(glsl::MaterialData{
+				material.baseColorTextureId,
+				material.roughnessTextureId,
+				material.metalnessTextureId,
+				0xffffffff != material.alphaMaskTextureId ? material.alphaMaskTextureId : material.baseColorTextureId,
+				0xffffffff != material.normalMapTextureId ? material.normalMapTextureId : material.baseColorTextureId
+			});
+		}
 
-			normalMapImageSet.push_back(std::move((lut::load_image_texture2d(normalMapPath, window, loadCmdPool.handle, allocator))));
+		VkDeviceSize const materialBytes = std::max<VkDeviceSize>(materials.size() * sizeof(glsl::MaterialData), 4);
+		materialBuffer = lut::create_buffer(allocator, materialBytes,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY
+		);
 
-			std::uint32_t index = normalMapImageSet.size() - 1;
-			normalMapImageViewSet.push_back(std::move((lut::create_image_view_texture2d(window, normalMapImageSet[index].image, VK_FORMAT_R8G8B8A8_UNORM))));
+		if (!materials.empty())
+		{
+			lut::UploadBatch materialUploads(window, allocator);
+			materialUploads.upload_buffer(materialBuffer.buffer, materials.data(), materials.size() * sizeof(glsl::MaterialData), VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+			materialUploads.flush();
 		}
 
-		
-		VkDescriptorSet* textureDescriptors = new VkDescriptorSet;
-		*textureDescriptors = lut::alloc_desc_set(window, dpool.handle,
-			objectLayout.handle);
-
+		// Each used texture is written once
+		std::vector<bool> isUsed(textureCount, false);
+		std::vector<std::uint32_t> uniqueTextures;
+		for (auto const id : usedTextures)
 		{
-			VkWriteDescriptorSet desc[5]{};
-			VkDescriptorImageInfo textureInfo[5]{};
+			if (!isUsed[id])
+				uniqueTextures.push_back(id);
+			isUsed[id] = true;
+		}
 
-			//Base color
-			textureInfo[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			textureInfo[0].imageView = imageViewSet[3 * i].handle;
-			textureInfo[0].sampler = defalutSampler.handle;
+		bindlessPool = create_bindless_descriptor_pool(window, textureCount, cfg::kFramesInFlight);
+		for (auto& frame : frames)
+		{
+			frame.bindlessDescriptors = lut::alloc_desc_set(window, bindlessPool.handle, objectLayout.handle);
 
+			VkWriteDescriptorSet desc[1]{};
+			VkDescriptorBufferInfo materialInfo{};
+			materialInfo.buffer = materialBuffer.buffer;
+			materialInfo.range = VK_WHOLE_SIZE;
 			desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			desc[0].dstSet = *textureDescriptors;
+			desc[0].dstSet = frame.bindlessDescriptors;
 			desc[0].dstBinding = 0;
-			desc[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			desc[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 			desc[0].descriptorCount = 1;
-			desc[0].pImageInfo = &textureInfo[0];
-
-			//Roughness
-			textureInfo[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			textureInfo[1].imageView = imageViewSet[3 * i +1].handle;
-			textureInfo[1].sampler = defalutSampler.handle;
-
-			desc[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			desc[1].dstSet = *textureDescriptors;
-			desc[1].dstBinding = 1;
-			desc[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			desc[1].descriptorCount = 1;
-			desc[1].pImageInfo = &textureInfo[1];
-
-			//Metalness
-			textureInfo[2].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			textureInfo[2].imageView = imageViewSet[3 * i + 2].handle;
-			textureInfo[2].sampler = defalutSampler.handle;
-
-			desc[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			desc[2].dstSet = *textureDescriptors;
-			desc[2].dstBinding = 2;
-			desc[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			desc[2].descriptorCount = 1;
-			desc[2].pImageInfo = &textureInfo[2];
-
+			desc[0].pBufferInfo = &materialInfo;
+			constexpr auto numSets = sizeof(desc) / sizeof(desc[0]);
+			vkUpdateDescriptorSets(window.device, numSets, desc, 0, nullptr);
 
-			//alphaMask
-			textureInfo[3].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-			if (isAlpha) //If this is not a mesh with alpha texture, then bind the baseColor on binding point
-				textureInfo[3].imageView = alphaImageViewSet[alphaIndex++].handle;
-			else 
-				textureInfo[3].imageView = imageViewSet[3 * i].handle;
-
-			textureInfo[3].sampler = defalutSampler.handle;
-
-			desc[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			desc[3].dstSet = *textureDescriptors;
-			desc[3].dstBinding = 3;
-			desc[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			desc[3].descriptorCount = 1;
-			desc[3].pImageInfo = &textureInfo[3];
-
-
-			//normalMap
-			textureInfo[4].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-			if (isNormalMap) //If this is not a mesh with normalMap texture, then bind the baseColor on binding point
-				textureInfo[4].imageView = normalMapImageViewSet[normalMapIndex++].handle;
-			else
-				textureInfo[4].imageView = imageViewSet[3 * i].handle;
+			update_bindless_textures(frame.bindlessDescriptors, uniqueTextures);
+		}
+	}
+	else
+	{
+		// The five image infos of a material are written in one go
+		std::vector<VkDescriptorUpdateTemplateEntry> entries(5);
+		for (std::uint32_t i = 0; i < 5; ++i)
+		{
+			entries[i].dstBinding = i;
+			entries[i].dstArrayElement = 0;
+			entries[i].descriptorCount = 1;
+			entries[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			entries[i].offset = i * sizeof(VkDescriptorImageInfo);
+			entries[i].stride = sizeof(VkDescriptorImageInfo);
+		}
+		materialTemplate = lut::create_descriptor_update_template(window, objectLayout.handle, entries);
 
-			textureInfo[4].sampler = defalutSampler.handle;
+		std::size_t materialSets = 0;
+		for (auto& frame : frames)
+		{
+			frame.materialDescriptors.assign(materialCount, VK_NULL_HANDLE);
 
-			desc[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			desc[4].dstSet = *textureDescriptors;
-			desc[4].dstBinding = 4;
-			desc[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			desc[4].descriptorCount = 1;
-			desc[4].pImageInfo = &textureInfo[4];
+			materialSets = 0;
+			for (auto const& mesh : *indexedMesh)
+			{
+				auto& set = frame.materialDescriptors[mesh.materialId];
+				if (VK_NULL_HANDLE != set)
+					continue;
 
-			vkUpdateDescriptorSets(window.device, 5, desc, 0, nullptr);
+				set = lut::alloc_desc_set(window, dpool.handle, objectLayout.handle);
+				update_material_descriptors(set, mesh.materialId);
+				++materialSets;
+			}
 		}
-		textureDescriptorsSet->push_back(textureDescriptors);
+
+		std::printf("Material descriptor sets: %zu for %zu meshes, per frame in flight\n", materialSets, indexedMesh->size());
 	}
+	std::printf("Samplers: %zu unique of %zu requested\n", samplers.size(), samplers.requests());
+	textureCache.report();
 	//Samling textures----------------------------------------------------------------------
 
 
-	//Scene uniform----------------------------------------------------------------------
-	lut::Buffer sceneUBO = lut::create_buffer(allocator, sizeof(glsl::SceneUniform),
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY
-	);
-	// allocate descriptor set for uniform buffer
-	VkDescriptorSet sceneDescriptors = lut::alloc_desc_set(window, dpool.handle, sceneLayout.handle);
+	//Scene and light uniforms, one copy per frame in flight----------------------------
+	for (auto& frame : frames)
 	{
-		VkWriteDescriptorSet desc[1]{};
-		VkDescriptorBufferInfo sceneUboInfo{};
-		sceneUboInfo.buffer = sceneUBO.buffer;
-		sceneUboInfo.range = VK_WHOLE_SIZE;
-		desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		desc[0].dstSet = sceneDescriptors;
-		desc[0].dstBinding = 0;
-		desc[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		desc[0].descriptorCount = 1;
-		desc[0].pBufferInfo = &sceneUboInfo;
-		constexpr auto numSets = sizeof(desc) / sizeof(desc[0]);
-		vkUpdateDescriptorSets(window.device, numSets, desc, 0, nullptr);
-	}
-	//Scene uniform----------------------------------------------------------------------
-
+		frame.sceneUBO = lut::create_buffer(allocator, sizeof(glsl::SceneUniform),
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY
+		);
+		frame.lightUBO = lut::create_buffer(allocator, sizeof(glsl::LightSource),
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY
+		);
 
-	//Light uniform----------------------------------------------------------------------
+		frame.sceneDescriptors = lut::alloc_desc_set(window, dpool.handle, sceneLayout.handle);
+		frame.lightDescriptors = lut::alloc_desc_set(window, dpool.handle, lightLayout.handle);
 
-	lut::Buffer lightUBO = lut::create_buffer(allocator, sizeof(glsl::LightSource),
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+		VkDescriptorBufferInfo uboInfo[2]{};
+		uboInfo[0].buffer = frame.sceneUBO.buffer;
+		uboInfo[0].range = VK_WHOLE_SIZE;
+		uboInfo[1].buffer = frame.lightUBO.buffer;
+		uboInfo[1].range = VK_WHOLE_SIZE;
 
-	VkDescriptorSet lightDescriptors = lut::alloc_desc_set(window, dpool.handle, lightLayout.handle);
-	{
-		VkWriteDescriptorSet desc[1]{};
-		VkDescriptorBufferInfo lightUboInfo{};
-		lightUboInfo.buffer = lightUBO.buffer;
-		lightUboInfo.range = VK_WHOLE_SIZE;
+		VkWriteDescriptorSet desc[2]{};
 		desc[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		desc[0].dstSet = lightDescriptors;
+		desc[0].dstSet = frame.sceneDescriptors;
 		desc[0].dstBinding = 0;
 		desc[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 		desc[0].descriptorCount = 1;
-		desc[0].pBufferInfo = &lightUboInfo;
+		desc[0].pBufferInfo = &uboInfo[0];
+		desc[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		desc[1].dstSet = frame.lightDescriptors;
+		desc[1].dstBinding = 0;
+		desc[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		desc[1].descriptorCount = 1;
+		desc[1].pBufferInfo = &uboInfo[1];
 		constexpr auto numSets = sizeof(desc) / sizeof(desc[0]);
 		vkUpdateDescriptorSets(window.device, numSets, desc, 0, nullptr);
 	}
-
-	//Light uniform----------------------------------------------------------------------
+	//Scene and light uniforms----------------------------------------------------------
 
 
 
-	lut::Semaphore imageAvailable = lut::create_semaphore(window);
-	lut::Semaphore renderFinished = lut::create_semaphore(window);
+	// Rendering to a swapchain image signals its semaphore, which the
+	// presentation waits for. The semaphore can only be reused once the image
+	// has been acquired again, so there is one per image rather than one per
+	// frame in flight.
+	std::vector<lut::Semaphore> renderFinished;
+	auto const create_render_finished_semaphores = [&]()
+	{
+		renderFinished.clear();
+		for (std::size_t i = 0; i < framebuffers.size(); ++i)
+			renderFinished.emplace_back(lut::create_semaphore(window));
+	};
+	create_render_finished_semaphores();
 
 	glsl::SceneUniform sceneUniforms{};
 	glsl::ColorUniform colorUniforms{};
@@ -511,8 +758,20 @@ int main() try
 	bool recreateSwapchain = false;
 	auto previousClock = Clock_::now();
 
+	std::uint32_t frameIndex = 0;
+	std::uint64_t framesRendered = 0;
+	double frameWaitSeconds = 0.0;
+	auto const firstFrameClock = Clock_::now();
+
+	startupZone.reset();
+
+	// Per-frame zones must not overwrite the startup timeline
+	lut::profiler_keep_thread_zones();
+
 	while (!glfwWindowShouldClose(window.window))
 	{
+		LUT_PROFILE_ZONE("frame");
+
 		// Let GLFW process events.
 		// glfwPollEvents() checks for events, processes them. If there are no
 		// events, it will return immediately. Alternatively, glfwWaitEvents()
@@ -523,9 +782,24 @@ int main() try
 		// reaction to user input (or similar).
 		glfwPollEvents(); // or: glfwWaitEvents()
 
+		if (state.writeTrace)
+		{
+			lut::profiler_write_chrome_trace(cfg::kTracePath);
+			state.writeTrace = false;
+		}
+
+		if (state.cycleRecordThreads)
+		{
+			recorder.set_threads(recorder.threads() % recorder.max_threads() + 1);
+			std::printf("Recording draws with %u thread(s)\n", recorder.threads());
+			state.cycleRecordThreads = false;
+		}
+
 		// Recreate swap chain?
 		if (recreateSwapchain)
 		{
+			LUT_PROFILE_ZONE("recreate swapchain");
+
 			//TODO: re-create swapchain and associated resources!
 			vkDeviceWaitIdle(window.device);
 
@@ -538,8 +812,9 @@ int main() try
 
 			if (changes.changedSize)
 			{
-				pipe = create_piepline(window, renderPass.handle, pipeLayout.handle);
-				alphaPipe = create_alpha_pipeline(window, renderPass.handle, pipeLayout.handle);
+				auto const rebuildStart = Clock_::now();
+				pipes = create_variant_pipelines(window, renderPass.handle, pipeLayout.handle, vertexInput, fragShaderPath, ambient, pipelineCache.handle(), variantDraws);
+				pipelineCache.add_creation_time(std::chrono::duration<double>(Clock_::now() - rebuildStart).count(), variantsUsed);
 				//pipe = create_density_pipeline(window, renderPass.handle, pipeLayout.handle);
 			}
 
@@ -548,19 +823,87 @@ int main() try
 
 			framebuffers.clear();
 			create_swapchain_framebuffers(window, renderPass.handle, framebuffers, depthBufferView.handle);
+			create_render_finished_semaphores();
 			recreateSwapchain = false;
 			continue;
 		}
 
+		// Stream textures. Frames in flight may still use the old views, so
+		// each slot rewrites its own descriptor sets once it is reused (see
+		// below); the cache keeps the old views alive until then.
+		if (cfg::kStreamTextures)
+		{
+			auto const changed = textureCache.stream(compute_texture_screen_sizes(bakedModel, *indexedMesh, state, window.swapchainExtent.height));
+			for (auto& slot : frames)
+				slot.changedTextures.insert(slot.changedTextures.end(), changed.begin(), changed.end());
+		}
+
+		// Wait until the GPU is done with the oldest frame in flight, whose
+		// slot is reused for this frame
+		auto& frame = frames[frameIndex];
+		{
+			LUT_PROFILE_ZONE("wait for frame fence");
+			auto const waitStart = Clock_::now();
+			if (auto const res = vkWaitForFences(window.device, 1, &frame.fence.handle, VK_TRUE,
+				std::numeric_limits<std::uint64_t>::max()); VK_SUCCESS != res)
+			{
+				throw lut::Error("Unable to wait for frame fence %u\n"
+					"vkWaitForFences() returned %s", frameIndex, lut::to_string(res).c_str());
+			}
+			frameWaitSeconds += std::chrono::duration<double>(Clock_::now() - waitStart).count();
+		}
+
+		// The slot's descriptor sets are no longer in use; catch up with the
+		// textures that streaming has changed since the slot was last used
+		if (!frame.changedTextures.empty())
+		{
+			auto& changed = frame.changedTextures;
+			std::sort(changed.begin(), changed.end());
+			changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+			if (bindless)
+			{
+				update_bindless_textures(frame.bindlessDescriptors, changed);
+			}
+			else
+			{
+				std::vector<bool> isChanged(bakedModel.textures.size(), false);
+				for (auto const id : changed)
+					isChanged[id] = true;
+
+				auto const is_changed_ = [&](std::uint32_t aTextureId) {
+					return 0xffffffff != aTextureId && isChanged[aTextureId];
+				};
+
+				for (std::uint32_t i = 0; i < materialCount; ++i)
+				{
+					if (VK_NULL_HANDLE == frame.materialDescriptors[i])
+						continue;
+
+					auto const& material = bakedModel.materials[i];
+					if (is_changed_(material.baseColorTextureId) || is_changed_(material.roughnessTextureId) || is_changed_(material.metalnessTextureId)
+						|| is_changed_(material.alphaMaskTextureId) || is_changed_(material.normalMapTextureId))
+					{
+						update_material_descriptors(frame.materialDescriptors[i], i);
+					}
+				}
+			}
+
+			changed.clear();
+		}
+
 		//TODO: acquire swapchain image.
 		std::uint32_t imageIndex = 0;
-		auto const acquireRes = vkAcquireNextImageKHR(
-			window.device,
-			window.swapchain,
-			std::numeric_limits<std::uint64_t>::max(),
-			imageAvailable.handle,
-			VK_NULL_HANDLE, &imageIndex);
-
+		VkResult acquireRes;
+		{
+			LUT_PROFILE_ZONE("acquire image");
+			acquireRes = vkAcquireNextImageKHR(
+				window.device,
+				window.swapchain,
+				std::numeric_limits<std::uint64_t>::max(),
+				frame.imageAvailable.handle,
+				VK_NULL_HANDLE, &imageIndex);
+		}
 		if (VK_SUBOPTIMAL_KHR == acquireRes || VK_ERROR_OUT_OF_DATE_KHR == acquireRes)
 		{
 			// This occurs e.g., when the window has been resized. In this case 
@@ -574,77 +917,85 @@ int main() try
 			// the VK SUBOPTIMAL KHR return code, we could continue rendering 
 			// with the current swap chain (unlike VK ERROR OUT OF DATE KHR, 
 			// which does require us to recreate the swap chain). 
+			//
+			// A suboptimal acquire has signalled the frame's imageAvailable
+			// semaphore, so the frame is rendered anyway; skipping it would
+			// leave the semaphore signalled without a wait.
 			recreateSwapchain = true;
-			continue;
+			if (VK_ERROR_OUT_OF_DATE_KHR == acquireRes)
+				continue;
 		}
-
-		if (VK_SUCCESS != acquireRes)
+		else if (VK_SUCCESS != acquireRes)
 		{
 			throw lut::Error("Unable to acquire enxt swapchain image\n"
 				"vkAcquireNextImageKHR() returned %s", lut::to_string(acquireRes).c_str()
 			);
 		}
 
-		//TODO: wait for command buffer to be available
-
-		assert(std::size_t(imageIndex) < cbfences.size());
-
-		if (auto const res = vkWaitForFences(window.device, 1, &cbfences[imageIndex].handle, VK_TRUE,
-			std::numeric_limits<std::uint64_t>::max()); VK_SUCCESS != res)
+		// Only reset the fence once work is certain to be submitted; the
+		// acquire above may bail out to recreate the swapchain
+		if (auto const res = vkResetFences(window.device, 1, &frame.fence.handle); VK_SUCCESS != res)
 		{
-			throw lut::Error("Unable to wait for command buffer fence %u\n"
-				"vkWaitForFences() returned %s", imageIndex, lut::to_string(res).c_str());
+			throw lut::Error("Unable to reset frame fence %u\n" "vkResetFences() returned %s", frameIndex, lut::to_string(res).c_str());
 		}
 
-		if (auto const res = vkResetFences(window.device, 1, &cbfences[imageIndex].handle); VK_SUCCESS != res)
+		if (auto const res = vkResetCommandPool(window.device, frame.cpool.handle, 0); VK_SUCCESS != res)
 		{
-			throw lut::Error("Unable to reset command buffer fence %u\n" "vkResetFences() returned %s", imageIndex, lut::to_string(res).c_str());
+			throw lut::Error("Unable to reset frame command pool %u\n" "vkResetCommandPool() returned %s", frameIndex, lut::to_string(res).c_str());
 		}
 
 		//TODO: record and submit commands
 
-		assert(std::size_t(imageIndex) < cbuffers.size());
 		assert(std::size_t(imageIndex) < framebuffers.size());
+		assert(std::size_t(imageIndex) < renderFinished.size());
 
 		record_commands(
-			cbuffers[imageIndex],
+			frame.cbuffer,
 			renderPass.handle,
 			framebuffers[imageIndex].handle,
-			pipe.handle,
-			alphaPipe.handle,
+			pipes,
+			drawList,
 			window.swapchainExtent,
 			indexedMesh,
-			sceneUBO.buffer,
+			geometry,
+			frame.sceneUBO.buffer,
 			sceneUniforms,
-			lightUBO.buffer,
+			frame.lightUBO.buffer,
 			lightSourceUniforms,
 			pipeLayout.handle,
-			sceneDescriptors,
-			lightDescriptors,
-			textureDescriptorsSet,
-			alphaDescriptorsSet
+			frame.sceneDescriptors,
+			frame.lightDescriptors,
+			frame.bindlessDescriptors,
+			frame.materialDescriptors,
+			alphaDescriptorsSet,
+			recorder,
+			frameIndex
 		);
 
 		submit_commands(
 			window,
-			cbuffers[imageIndex],
-			cbfences[imageIndex].handle,
-			imageAvailable.handle,
-			renderFinished.handle
+			frame.cbuffer,
+			frame.fence.handle,
+			frame.imageAvailable.handle,
+			renderFinished[imageIndex].handle
 		);
 
 		present_results(
 			window.presentQueue,
 			window.swapchain,
 			imageIndex,
-			renderFinished.handle,
+			renderFinished[imageIndex].handle,
 			recreateSwapchain);
 
+		frameIndex = (frameIndex + 1) % cfg::kFramesInFlight;
+		++framesRendered;
+
 
 		auto const now = Clock_::now();
 		auto const dt = std::chrono::duration_cast<Secondsf_>(now - previousClock).count();
 		previousClock = now;
 
+		LUT_PROFILE_ZONE("update");
 		update_user_state(state, dt);
 		update_scene_uniforms(sceneUniforms, window.swapchainExtent.width, window.swapchainExtent.height, state);
 	}
@@ -653,8 +1004,22 @@ int main() try
 	// to ensure that all Vulkan commands have finished before that.
 	vkDeviceWaitIdle(window.device);
 
+	if (framesRendered)
+	{
+		auto const seconds = std::chrono::duration<double>(Clock_::now() - firstFrameClock).count();
+		std::printf("Frames in flight: %u; %llu frames, %.2f ms/frame, %.2f ms/frame waiting for the GPU\n", cfg::kFramesInFlight,
+			static_cast<unsigned long long>(framesRendered), seconds * 1000.0 / framesRendered, frameWaitSeconds * 1000.0 / framesRendered);
+	}
+
+	recorder.report();
+
+	if (cfg::kStreamTextures)
+		textureCache.report();
+
+	pipelineCache.report();
+	pipelineCache.save();
+
 	delete indexedMesh;
-	delete textureDescriptorsSet;
 	delete alphaDescriptorsSet;
 	return 0;
 }
@@ -712,6 +1077,16 @@ namespace
 			state->inputMap[std::size_t(EInputState::slow)] = !isReleased;
 			break;
 
+		case GLFW_KEY_P:
+			if (GLFW_PRESS == aAction)
+				state->writeTrace = true;
+			break;
+
+		case GLFW_KEY_T:
+			if (GLFW_PRESS == aAction)
+				state->cycleRecordThreads = true;
+			break;
+
 		default:
 			;
 		}
@@ -775,6 +1150,46 @@ namespace
 
 	}
 
+	std::vector<float> compute_texture_screen_sizes(BakedModel const& aModel, std::vector<IndexedMesh> const& aMeshes, UserState const& aState, std::uint32_t aFramebufferHeight)
+	{
+		LUT_PROFILE_ZONE("compute_texture_screen_sizes");
+
+		std::vector<float> ret(aModel.textures.size(), 0.f);
+
+		glm::mat4 const world2camera = glm::inverse(aState.camera2world);
+
+		// Pixels per unit of size at unit distance
+		float const scale = aFramebufferHeight / (2.f * std::tan(0.5f * lut::Radians(cfg::kCameraFov).value()));
+
+		for (std::size_t i = 0; i < aMeshes.size(); ++i)
+		{
+			auto const& mesh = aModel.meshes[i];
+			glm::vec3 const center = 0.5f * (mesh.aabbMin + mesh.aabbMax);
+			float const radius = 0.5f * glm::length(mesh.aabbMax - mesh.aabbMin);
+
+			float size = 0.f;
+			for (auto const& instance : mesh.instances)
+			{
+				glm::vec3 const world = instance * glm::vec4(center, 1.f);
+				float const depth = -(world2camera * glm::vec4(world, 1.f)).z;
+				if (depth < -radius)
+					continue; // behind the camera
+
+				size = std::max(size, 2.f * radius * scale / std::max(depth, cfg::kCameraNear));
+			}
+
+			auto const& material = aModel.materials[aMeshes[i].materialId];
+			for (auto const id : { material.baseColorTextureId, material.roughnessTextureId, material.metalnessTextureId })
+				ret[id] = std::max(ret[id], size);
+			if (aMeshes[i].isAlphaMask)
+				ret[material.alphaMaskTextureId] = std::max(ret[material.alphaMaskTextureId], size);
+			if (aMeshes[i].isNormalMap)
+				ret[material.normalMapTextureId] = std::max(ret[material.normalMapTextureId], size);
+		}
+
+		return ret;
+	}
+
 	void update_user_state(UserState& aState, float aElapsedTime)
 	{
 		auto& cam = aState.camera2world;
@@ -834,6 +1249,8 @@ namespace
 
 	lut::RenderPass create_render_pass(lut::VulkanWindow const& aWindow)
 	{
+		LUT_PROFILE_ZONE("create_render_pass");
+
 		VkAttachmentDescription attachments[2]{};
 		attachments[0].format = aWindow.swapchainFormat; //changed! 
 		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
@@ -877,8 +1294,20 @@ namespace
 		passInfo.pAttachments = attachments;
 		passInfo.subpassCount = 1;
 		passInfo.pSubpasses = subpasses;
-		passInfo.dependencyCount = 0; //changed! 
-		passInfo.pDependencies = nullptr; //changed! 
+		// Frames in flight share the depth buffer, and the swapchain image
+		// only becomes available at the color attachment output stage (where
+		// the submit waits for it). Order the attachment accesses with the
+		// previous frame's.
+		VkSubpassDependency deps[1]{};
+		deps[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		deps[0].dstSubpass = 0;
+		deps[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		deps[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		deps[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		deps[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		passInfo.dependencyCount = 1;
+		passInfo.pDependencies = deps;
 		VkRenderPass rpass = VK_NULL_HANDLE;
 
 		if (auto const res = vkCreateRenderPass(aWindow.device, &passInfo, nullptr, &rpass); VK_SUCCESS != res)
@@ -893,9 +1322,11 @@ namespace
 
 
 	lut::PipelineLayout create_pipeline_layout(lut::VulkanContext const& aContext, VkDescriptorSetLayout const& aSceneLayout, VkDescriptorSetLayout aObjectLayout, 
-		VkDescriptorSetLayout const& aLightSource
+		VkDescriptorSetLayout const& aLightSource, std::uint32_t aFragmentPushConstantSize
 	)
 	{
+		LUT_PROFILE_ZONE("create_pipeline_layout");
+
 		//As mentioned, our shaders currently do not have any uniform inputs. 
 		//While we still need to create a pipeline layout object(VkPipelineLayout),
 		// -----------------------------------------------------------------------------
@@ -909,18 +1340,18 @@ namespace
 			aLightSource
 		};
 
-		VkPushConstantRange pushConstantRange{};
-		pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;  // Make the push constant visible in fragment shader
-		pushConstantRange.offset = 0;  // Start at the beginning of the push constant block
-		pushConstantRange.size = sizeof(int) + sizeof(int);  // Size of the push constant block
-
 		//create a pipeline layout object(VkPipelineLayout),
 		VkPipelineLayoutCreateInfo layoutInfo{};
 		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 		layoutInfo.setLayoutCount = sizeof(layouts) / sizeof(layouts[0]);
 		layoutInfo.pSetLayouts = layouts;
-		layoutInfo.pushConstantRangeCount = 1;
-		layoutInfo.pPushConstantRanges = &pushConstantRange;
+		VkPushConstantRange pushConstants{};
+		pushConstants.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		pushConstants.offset = 0;
+		pushConstants.size = aFragmentPushConstantSize;
+
+		layoutInfo.pushConstantRangeCount = aFragmentPushConstantSize ? 1 : 0;
+		layoutInfo.pPushConstantRanges = aFragmentPushConstantSize ? &pushConstants : nullptr;
 
 		VkPipelineLayout layout = VK_NULL_HANDLE;
 		if (auto const res = vkCreatePipelineLayout(aContext.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
@@ -931,14 +1362,76 @@ namespace
 	}
 
 
-	lut::Pipeline create_piepline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout)
+	std::uint32_t pipeline_variant(BakedModel const& aModel, std::uint32_t aMeshIndex)
+	{
+		auto const& material = aModel.materials[aModel.meshes[aMeshIndex].materialId];
+
+		std::uint32_t variant = 0;
+		if (0xffffffff != material.alphaMaskTextureId)
+			variant |= kVariantAlphaMask;
+		if (0xffffffff != material.normalMapTextureId)
+			variant |= kVariantNormalMap;
+		return variant;
+	}
+
+	std::vector<std::vector<std::uint32_t>> group_draws_by_variant(BakedModel const& aModel)
+	{
+		std::vector<std::vector<std::uint32_t>> ret(kVariantCount);
+		for (std::uint32_t i = 0; i < aModel.meshes.size(); ++i)
+			ret[pipeline_variant(aModel, i)].push_back(i);
+
+		// Consecutive draws with the same material don't rebind it. Blended
+		// variants keep the model order.
+		for (std::uint32_t variant = 0; variant < kVariantCount; ++variant)
+		{
+			if (variant & kVariantAlphaMask)
+				continue;
+
+			std::stable_sort(ret[variant].begin(), ret[variant].end(), [&](std::uint32_t aX, std::uint32_t aY) {
+				return aModel.meshes[aX].materialId < aModel.meshes[aY].materialId;
+			});
+		}
+
+		return ret;
+	}
+
+	std::vector<VariantDraw> flatten_draws(std::vector<std::vector<std::uint32_t>> const& aVariantDraws)
+	{
+		std::vector<VariantDraw> ret;
+		for (std::uint32_t variant = 0; variant < aVariantDraws.size(); ++variant)
+		{
+			for (auto const mesh : aVariantDraws[variant])
+				ret.emplace_back(VariantDraw{ variant, mesh });
+		}
+		return ret;
+	}
+
+	std::vector<lut::Pipeline> create_variant_pipelines(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout, VertexInputDescription const& aVertexInput, char const* aFragShaderPath, float aAmbient, VkPipelineCache aCache, std::vector<std::vector<std::uint32_t>> const& aDraws)
+	{
+		LUT_PROFILE_ZONE("create_variant_pipelines");
+
+		std::vector<lut::Pipeline> ret(kVariantCount);
+		for (std::uint32_t variant = 0; variant < kVariantCount; ++variant)
+		{
+			if (aDraws[variant].empty())
+				continue;
+
+			if (variant & kVariantAlphaMask)
+				ret[variant] = create_alpha_pipeline(aWindow, aRenderPass, aPipelineLayout, aVertexInput, aFragShaderPath, aAmbient, aCache, variant);
+			else
+				ret[variant] = create_piepline(aWindow, aRenderPass, aPipelineLayout, aVertexInput, aFragShaderPath, aAmbient, aCache, variant);
+		}
+		return ret;
+	}
+
+	lut::Pipeline create_piepline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout, VertexInputDescription const& aVertexInput, char const* aFragShaderPath, float aAmbient, VkPipelineCache aCache, std::uint32_t aVariant)
 	{
 		// Load shader modules 
 		// For this example, we only use the vertex and fragment shaders.
 		// Other shader stages (geometry, tessellation) aren’t used here, and as such we omit them.
 		// Load the 
 		lut::ShaderModule vert = lut::load_shader_module(aWindow, cfg::kVertShaderPath);
-		lut::ShaderModule frag = lut::load_shader_module(aWindow, cfg::kFragShaderPath);
+		lut::ShaderModule frag = lut::load_shader_module(aWindow, aFragShaderPath);
 
 
 		//There are 2 stages: VertexShader -> Fragment shader
@@ -953,6 +1446,25 @@ namespace
 		stages[1].module = frag.handle;
 		stages[1].pName = "main";
 
+		//Material features of the variant (constant_id 0: alpha mask, 1: normal
+		//map) and the ambient strength (constant_id 2)
+		FragmentConstants const features{
+			(aVariant & kVariantAlphaMask) ? VK_TRUE : VK_FALSE,
+			(aVariant & kVariantNormalMap) ? VK_TRUE : VK_FALSE,
+			aAmbient
+		};
+		VkSpecializationMapEntry featureEntries[3]{};
+		featureEntries[0] = { 0, offsetof(FragmentConstants, alphaMask), sizeof(VkBool32) };
+		featureEntries[1] = { 1, offsetof(FragmentConstants, normalMap), sizeof(VkBool32) };
+		featureEntries[2] = { 2, offsetof(FragmentConstants, ambient), sizeof(float) };
+
+		VkSpecializationInfo specInfo{};
+		specInfo.mapEntryCount = 3;
+		specInfo.pMapEntries = featureEntries;
+		specInfo.dataSize = sizeof(features);
+		specInfo.pData = &features;
+		stages[1].pSpecializationInfo = &specInfo;
+
 
 		VkPipelineDepthStencilStateCreateInfo depthInfo{};
 		depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
@@ -962,26 +1474,9 @@ namespace
 		depthInfo.minDepthBounds = 0.f;
 		depthInfo.maxDepthBounds = 1.f;
 
-		VkVertexInputBindingDescription vertexInputs[5]{};
-		vertexInputs[0].binding = 0;
-		vertexInputs[0].stride = sizeof(float) * 3;
-		vertexInputs[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		vertexInputs[1].binding = 1;
-		vertexInputs[1].stride = sizeof(float) * 2;
-		vertexInputs[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		vertexInputs[2].binding = 2;
-		vertexInputs[2].stride = sizeof(float) * 3;
-		vertexInputs[2].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		vertexInputs[3].binding = 3;
-		vertexInputs[3].stride = sizeof(float) * 4;
-		vertexInputs[3].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		vertexInputs[4].binding = 4;
-		vertexInputs[4].stride = sizeof(std::uint32_t);
-		vertexInputs[4].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		// Vertex inputs depend on the vertex layout of the baked model
+		auto const& vertexInputs = aVertexInput.bindings;
+		auto const& vertexAttributes = aVertexInput.attributes;
 
 		//VkVertexInputBindingDescription vertexInputs[3]{};
 		//vertexInputs[0].binding = 0;
@@ -999,32 +1494,6 @@ namespace
 
 		/**The vertex shader expects two inputs, the position and the color.
 		Consequently, these are described with two VkVertexInputAttributeDescription instances*/
-		VkVertexInputAttributeDescription vertexAttributes[5]{};
-		vertexAttributes[0].binding = 0; // must match binding above 
-		vertexAttributes[0].location = 0; // must match shader 
-		vertexAttributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttributes[0].offset = 0;
-
-		vertexAttributes[1].binding = 1; // must match binding above 
-		vertexAttributes[1].location = 1; // must match shader 
-		vertexAttributes[1].format = VK_FORMAT_R32G32_SFLOAT;
-		vertexAttributes[1].offset = 0;
-
-		vertexAttributes[2].binding = 2; // must match binding above 
-		vertexAttributes[2].location = 2; // must match shader 
-		vertexAttributes[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttributes[2].offset = 0;
-
-		vertexAttributes[3].binding = 3; // must match binding above 
-		vertexAttributes[3].location = 3; // must match shader 
-		vertexAttributes[3].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttributes[3].offset = 0;
-
-		vertexAttributes[4].binding = 4; // must match binding above 
-		vertexAttributes[4].location = 4; // must match shader 
-		vertexAttributes[4].format = VK_FORMAT_R32_UINT;
-		vertexAttributes[4].offset = 0;
-
 		//VkVertexInputAttributeDescription vertexAttributes[3]{};
 		//vertexAttributes[0].binding = 0; // must match binding above 
 		//vertexAttributes[0].location = 0; // must match shader 
@@ -1046,10 +1515,10 @@ namespace
 		//we specify what buffers vertices are sourced from, and what vertex attributes in our shaders these correspond to
 		VkPipelineVertexInputStateCreateInfo inputInfo{};
 		inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		inputInfo.vertexBindingDescriptionCount = 5; // number of vertexInputs above 
-		inputInfo.pVertexBindingDescriptions = vertexInputs;
-		inputInfo.vertexAttributeDescriptionCount = 5; // number of vertexAttributes above 
-		inputInfo.pVertexAttributeDescriptions = vertexAttributes;
+		inputInfo.vertexBindingDescriptionCount = std::uint32_t(vertexInputs.size()); // number of vertexInputs above 
+		inputInfo.pVertexBindingDescriptions = vertexInputs.data();
+		inputInfo.vertexAttributeDescriptionCount = std::uint32_t(vertexAttributes.size()); // number of vertexAttributes above 
+		inputInfo.pVertexAttributeDescriptions = vertexAttributes.data();
 
 
 		//VkPipelineVertexInputStateCreateInfo inputInfo{};
@@ -1158,7 +1627,7 @@ namespace
 		pipeInfo.subpass = 0; // first subpass of aRenderPass 
 
 		VkPipeline pipe = VK_NULL_HANDLE;
-		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, VK_NULL_HANDLE, 1, &pipeInfo, nullptr, &pipe); VK_SUCCESS != res)
+		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe); VK_SUCCESS != res)
 		{
 			throw lut::Error("Unable to create graphics pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str());
 		}
@@ -1167,14 +1636,14 @@ namespace
 	}
 
 
-	lut::Pipeline create_alpha_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout)
+	lut::Pipeline create_alpha_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout, VertexInputDescription const& aVertexInput, char const* aFragShaderPath, float aAmbient, VkPipelineCache aCache, std::uint32_t aVariant)
 	{
 		// Load shader modules 
 		// For this example, we only use the vertex and fragment shaders.
 		// Other shader stages (geometry, tessellation) aren’t used here, and as such we omit them.
 		// Load the 
 		lut::ShaderModule vert = lut::load_shader_module(aWindow, cfg::kVertShaderPath);
-		lut::ShaderModule frag = lut::load_shader_module(aWindow, cfg::kFragShaderPath);
+		lut::ShaderModule frag = lut::load_shader_module(aWindow, aFragShaderPath);
 
 
 		//There are 2 stages: VertexShader -> Fragment shader
@@ -1189,6 +1658,25 @@ namespace
 		stages[1].module = frag.handle;
 		stages[1].pName = "main";
 
+		//Material features of the variant (constant_id 0: alpha mask, 1: normal
+		//map) and the ambient strength (constant_id 2)
+		FragmentConstants const features{
+			(aVariant & kVariantAlphaMask) ? VK_TRUE : VK_FALSE,
+			(aVariant & kVariantNormalMap) ? VK_TRUE : VK_FALSE,
+			aAmbient
+		};
+		VkSpecializationMapEntry featureEntries[3]{};
+		featureEntries[0] = { 0, offsetof(FragmentConstants, alphaMask), sizeof(VkBool32) };
+		featureEntries[1] = { 1, offsetof(FragmentConstants, normalMap), sizeof(VkBool32) };
+		featureEntries[2] = { 2, offsetof(FragmentConstants, ambient), sizeof(float) };
+
+		VkSpecializationInfo specInfo{};
+		specInfo.mapEntryCount = 3;
+		specInfo.pMapEntries = featureEntries;
+		specInfo.dataSize = sizeof(features);
+		specInfo.pData = &features;
+		stages[1].pSpecializationInfo = &specInfo;
+
 
 		VkPipelineDepthStencilStateCreateInfo depthInfo{};
 		depthInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
@@ -1198,26 +1686,9 @@ namespace
 		depthInfo.minDepthBounds = 0.f;
 		depthInfo.maxDepthBounds = 1.f;
 
-		VkVertexInputBindingDescription vertexInputs[5]{};
-		vertexInputs[0].binding = 0;
-		vertexInputs[0].stride = sizeof(float) * 3;
-		vertexInputs[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		vertexInputs[1].binding = 1;
-		vertexInputs[1].stride = sizeof(float) * 2;
-		vertexInputs[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		vertexInputs[2].binding = 2;
-		vertexInputs[2].stride = sizeof(float) * 3;
-		vertexInputs[2].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		vertexInputs[3].binding = 3;
-		vertexInputs[3].stride = sizeof(float) * 4;
-		vertexInputs[3].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		vertexInputs[4].binding = 4;
-		vertexInputs[4].stride = sizeof(std::uint32_t);
-		vertexInputs[4].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		// Vertex inputs depend on the vertex layout of the baked model
+		auto const& vertexInputs = aVertexInput.bindings;
+		auto const& vertexAttributes = aVertexInput.attributes;
 
 		//VkVertexInputBindingDescription vertexInputs[3]{};
 		//vertexInputs[0].binding = 0;
@@ -1235,32 +1706,6 @@ namespace
 
 		/**The vertex shader expects two inputs, the position and the color.
 		Consequently, these are described with two VkVertexInputAttributeDescription instances*/
-		VkVertexInputAttributeDescription vertexAttributes[5]{};
-		vertexAttributes[0].binding = 0; // must match binding above 
-		vertexAttributes[0].location = 0; // must match shader 
-		vertexAttributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttributes[0].offset = 0;
-
-		vertexAttributes[1].binding = 1; // must match binding above 
-		vertexAttributes[1].location = 1; // must match shader 
-		vertexAttributes[1].format = VK_FORMAT_R32G32_SFLOAT;
-		vertexAttributes[1].offset = 0;
-
-		vertexAttributes[2].binding = 2; // must match binding above 
-		vertexAttributes[2].location = 2; // must match shader 
-		vertexAttributes[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttributes[2].offset = 0;
-
-		vertexAttributes[3].binding = 3; // must match binding above 
-		vertexAttributes[3].location = 3; // must match shader 
-		vertexAttributes[3].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexAttributes[3].offset = 0;
-
-		vertexAttributes[4].binding = 4; // must match binding above 
-		vertexAttributes[4].location = 4; // must match shader 
-		vertexAttributes[4].format = VK_FORMAT_R32_UINT;
-		vertexAttributes[4].offset = 0;
-
 		//VkVertexInputAttributeDescription vertexAttributes[3]{};
 		//vertexAttributes[0].binding = 0; // must match binding above 
 		//vertexAttributes[0].location = 0; // must match shader 
@@ -1282,10 +1727,10 @@ namespace
 		//we specify what buffers vertices are sourced from, and what vertex attributes in our shaders these correspond to
 		VkPipelineVertexInputStateCreateInfo inputInfo{};
 		inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		inputInfo.vertexBindingDescriptionCount = 5; // number of vertexInputs above 
-		inputInfo.pVertexBindingDescriptions = vertexInputs;
-		inputInfo.vertexAttributeDescriptionCount = 5; // number of vertexAttributes above 
-		inputInfo.pVertexAttributeDescriptions = vertexAttributes;
+		inputInfo.vertexBindingDescriptionCount = std::uint32_t(vertexInputs.size()); // number of vertexInputs above 
+		inputInfo.pVertexBindingDescriptions = vertexInputs.data();
+		inputInfo.vertexAttributeDescriptionCount = std::uint32_t(vertexAttributes.size()); // number of vertexAttributes above 
+		inputInfo.pVertexAttributeDescriptions = vertexAttributes.data();
 
 
 		//VkPipelineVertexInputStateCreateInfo inputInfo{};
@@ -1403,7 +1848,7 @@ namespace
 		pipeInfo.subpass = 0; // first subpass of aRenderPass 
 
 		VkPipeline pipe = VK_NULL_HANDLE;
-		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, VK_NULL_HANDLE, 1, &pipeInfo, nullptr, &pipe); VK_SUCCESS != res)
+		if (auto const res = vkCreateGraphicsPipelines(aWindow.device, aCache, 1, &pipeInfo, nullptr, &pipe); VK_SUCCESS != res)
 		{
 			throw lut::Error("Unable to create graphics pipeline\n" "vkCreateGraphicsPipelines() returned %s", lut::to_string(res).c_str());
 		}
@@ -1505,10 +1950,11 @@ namespace
 	}
 
 	void record_commands(VkCommandBuffer aCmdBuff, VkRenderPass aRenderPass, VkFramebuffer aFramebuffer, 
-		VkPipeline aGraphicsPipe,
-		VkPipeline aAlphaPipe,
+		std::vector<lut::Pipeline> const& aVariantPipes,
+		std::vector<VariantDraw> const& aDraws,
 		VkExtent2D const& aImageExtent,
 		std::vector<IndexedMesh>* indexedMesh,
+		GeometryPool const& aGeometry,
 		VkBuffer aSceneUBO,
 		glsl::SceneUniform
 		const& aSceneUniform,
@@ -1517,8 +1963,11 @@ namespace
 		VkPipelineLayout aGraphicsLayout,
 		VkDescriptorSet aSceneDescriptors,
 		VkDescriptorSet lightDescriptors,
-		std::vector<VkDescriptorSet*>* objectsDescriptors,
-		std::vector<VkDescriptorSet*>* diffuseDescriptors
+		VkDescriptorSet aBindlessDescriptors,
+		std::vector<VkDescriptorSet> const& aMaterialDescriptors,
+		std::vector<VkDescriptorSet*>* diffuseDescriptors,
+		lut::ParallelRecorder& aRecorder,
+		std::uint32_t aFrameIndex
 		//VkBuffer aSpritePosBuffer,
 		//VkBuffer aSpriteTexBuffer,
 		//std::uint32_t aSpriteVertexCount,
@@ -1526,6 +1975,8 @@ namespace
 		//
 	)
 	{
+		LUT_PROFILE_ZONE("record_commands");
+
 		// Begin recording commands 
 		VkCommandBufferBeginInfo begInfo{};
 		begInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -1590,66 +2041,73 @@ namespace
 		passInfo.clearValueCount = 2;
 		passInfo.pClearValues = clearValues;
 
-		vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-		// Begin drawing indexed mesh with texture mesh pipeline 
-		vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsPipe);
-		vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 0, 1, &aSceneDescriptors, 0, nullptr);
-		vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 2, 1, &lightDescriptors, 0, nullptr);
-
+		vkCmdBeginRenderPass(aCmdBuff, &passInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-		//Bind vertex input for indexed mesh
-		//Draw indexMesh that has no alphaMask, ensuring the "background items" are drew first
-		for (int i = 0; i < indexedMesh->size(); i++)
+		// The draws are split into contiguous ranges that are recorded in
+		// parallel, each into its own secondary command buffer. These don't
+		// inherit any state, so each range binds everything it needs.
+		bool const bindless = VK_NULL_HANDLE != aBindlessDescriptors;
+		auto const record_draws_ = [&](VkCommandBuffer aSecondary, std::uint32_t aBegin, std::uint32_t aEnd)
 		{
-			if (!(*indexedMesh)[i].isAlphaMask)
+			// Scene and light descriptors stay bound across the variant
+			// pipelines, which share one layout
+			vkCmdBindDescriptorSets(aSecondary, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 0, 1, &aSceneDescriptors, 0, nullptr);
+			vkCmdBindDescriptorSets(aSecondary, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 2, 1, &lightDescriptors, 0, nullptr);
+
+			// Bindless: the material set is bound once as well; draws only
+			// push their material ID. Otherwise draws bind the set of their
+			// material. Either happens only when the material changes.
+			if (bindless)
+				vkCmdBindDescriptorSets(aSecondary, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 1, 1, &aBindlessDescriptors, 0, nullptr);
+
+			std::uint32_t boundVariant = ~std::uint32_t(0);
+			std::uint32_t boundMaterial = ~std::uint32_t(0);
+
+			//Bind vertex input for indexed mesh; all meshes in a geometry pool
+			//block share the same buffers, so they are only bound when the
+			//block changes (vertex input bindings survive pipeline changes)
+			std::uint32_t boundBlock = ~std::uint32_t(0);
+
+			//Draws are grouped by variant; the variants without alphaMask come
+			//first, ensuring the "background items" are drew first
+			for (std::uint32_t i = aBegin; i < aEnd; ++i)
 			{
-				vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 1, 1, (*objectsDescriptors)[i], 0, nullptr);
+				auto const& draw = aDraws[i];
+				auto const& mesh = (*indexedMesh)[draw.mesh];
 
-				VkBuffer buffers[5] = { (*indexedMesh)[i].pos.buffer,(*indexedMesh)[i].texcoords.buffer,(*indexedMesh)[i].normals.buffer,(*indexedMesh)[i].tangent.buffer,(*indexedMesh)[i].packedTBN.buffer};
-				VkDeviceSize offsets[5]{};
-				vkCmdBindVertexBuffers(aCmdBuff, 0,5, buffers, offsets);
-
-				vkCmdBindIndexBuffer(aCmdBuff, (*indexedMesh)[i].indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-
-				int isAlpha = 0;
-				int isNormalMap = 0;
-				if ((*indexedMesh)[i].isNormalMap)
+				if (draw.variant != boundVariant)
 				{
-					isNormalMap = 1;
+					vkCmdBindPipeline(aSecondary, VK_PIPELINE_BIND_POINT_GRAPHICS, aVariantPipes[draw.variant].handle);
+					boundVariant = draw.variant;
 				}
-				vkCmdPushConstants(aCmdBuff, aGraphicsLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(int), &isAlpha);
-				vkCmdPushConstants(aCmdBuff, aGraphicsLayout, VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(int), sizeof(int), &isNormalMap);
-				vkCmdDrawIndexed(aCmdBuff, (*indexedMesh)[i].indexSize, 1, 0, 0, 0);
-			}
-
-		}
-
-		vkCmdBindPipeline(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aAlphaPipe);
-
-		for (int i = 0; i < indexedMesh->size(); i++)
-		{
-			if ((*indexedMesh)[i].isAlphaMask)
-			{
-				vkCmdBindDescriptorSets(aCmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 1, 1, (*objectsDescriptors)[i], 0, nullptr);
 
-				VkBuffer buffers[5] = { (*indexedMesh)[i].pos.buffer,(*indexedMesh)[i].texcoords.buffer,(*indexedMesh)[i].normals.buffer,(*indexedMesh)[i].tangent.buffer,(*indexedMesh)[i].packedTBN.buffer };
-				VkDeviceSize offsets[5]{};
-				vkCmdBindVertexBuffers(aCmdBuff, 0, 5, buffers, offsets);
+				if (mesh.materialId != boundMaterial)
+				{
+					if (bindless)
+						vkCmdPushConstants(aSecondary, aGraphicsLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(std::uint32_t), &mesh.materialId);
+					else
+						vkCmdBindDescriptorSets(aSecondary, VK_PIPELINE_BIND_POINT_GRAPHICS, aGraphicsLayout, 1, 1, &aMaterialDescriptors[mesh.materialId], 0, nullptr);
 
-				vkCmdBindIndexBuffer(aCmdBuff, (*indexedMesh)[i].indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+					boundMaterial = mesh.materialId;
+				}
 
-				int isAlpha = 1;
-				int isNormalMap = 0;
-				if ((*indexedMesh)[i].isNormalMap)
+				if (mesh.geometryBlock != boundBlock)
 				{
-					isNormalMap = 1;
+					auto const& buffers = aGeometry.vertex_buffers(mesh.geometryBlock);
+					VkDeviceSize offsets[8]{};
+					assert(buffers.size() <= std::size(offsets));
+					vkCmdBindVertexBuffers(aSecondary, 0, std::uint32_t(buffers.size()), buffers.data(), offsets);
+
+					vkCmdBindIndexBuffer(aSecondary, aGeometry.index_buffer(mesh.geometryBlock), 0, VK_INDEX_TYPE_UINT32);
+					boundBlock = mesh.geometryBlock;
 				}
-				vkCmdPushConstants(aCmdBuff, aGraphicsLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(int), &isAlpha);
-				vkCmdPushConstants(aCmdBuff, aGraphicsLayout, VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(int), sizeof(int), &isNormalMap);
-				vkCmdDrawIndexed(aCmdBuff, (*indexedMesh)[i].indexSize, 1, 0, 0, 0);
+
+				vkCmdDrawIndexed(aSecondary, mesh.indexSize, mesh.instanceCount, mesh.firstIndex, mesh.vertexOffset, mesh.firstInstance);
 			}
-		}
+		};
+
+		auto const& secondaries = aRecorder.record(aFrameIndex, aRenderPass, 0, aFramebuffer, std::uint32_t(aDraws.size()), record_draws_);
+		vkCmdExecuteCommands(aCmdBuff, std::uint32_t(secondaries.size()), secondaries.data());
 
 		// End the render pass 
 		vkCmdEndRenderPass(aCmdBuff);
@@ -1665,6 +2123,8 @@ namespace
 
 	void submit_commands(lut::VulkanContext const& aContext, VkCommandBuffer aCmdBuff, VkFence aFence, VkSemaphore aWaitSemaphore, VkSemaphore aSignalSemaphore)
 	{
+		LUT_PROFILE_ZONE("submit_commands");
+
 
 		//We must wait for the imageAvailable semaphore to become signalled, indicating that the swapchain image is ready,
 		//before we draw to the image
@@ -1696,6 +2156,8 @@ namespace
 
 	lut::DescriptorSetLayout create_scene_descriptor_layout(lut::VulkanWindow const& aWindow)
 	{
+		LUT_PROFILE_ZONE("create_scene_descriptor_layout");
+
 		VkDescriptorSetLayoutBinding bindings[1]{};
 		bindings[0].binding = 0; // number must match the index of the corresponding 
 		// binding = N declaration in the shader(s)! 
@@ -1724,6 +2186,8 @@ namespace
 
 	lut::DescriptorSetLayout create_lightSource_descriptor_layout(lut::VulkanWindow const& aWindow)
 	{
+		LUT_PROFILE_ZONE("create_lightSource_descriptor_layout");
+
 		VkDescriptorSetLayoutBinding bindings[1]{};
 		bindings[0].binding = 0; // this must match the shaders 
 		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -1773,6 +2237,8 @@ namespace
 
 	lut::DescriptorSetLayout create_object_descriptor_layout(lut::VulkanWindow const& aWindow)
 	{
+		LUT_PROFILE_ZONE("create_object_descriptor_layout");
+
 		VkDescriptorSetLayoutBinding bindings[5]{};
 		bindings[0].binding = 0; // this must match the shaders 
 		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -1816,6 +2282,89 @@ namespace
 		return lut::DescriptorSetLayout(aWindow.device, layout);
 	}
 
+	bool supports_bindless_textures(lut::VulkanWindow const& aWindow, std::uint32_t aTextureCount)
+	{
+		if (!aWindow.haveDescriptorIndexing)
+			return false;
+
+		// Each texture is a combined image sampler, which counts as both a
+		// sampler and a sampled image
+		VkPhysicalDeviceProperties props;
+		vkGetPhysicalDeviceProperties(aWindow.physicalDevice, &props);
+
+		auto const& limits = props.limits;
+		if (aTextureCount > limits.maxPerStageDescriptorSamplers || aTextureCount > limits.maxPerStageDescriptorSampledImages
+			|| aTextureCount > limits.maxDescriptorSetSamplers || aTextureCount > limits.maxDescriptorSetSampledImages)
+		{
+			std::fprintf(stderr, "Info: %u textures exceed the descriptor limits for bindless textures\n", aTextureCount);
+			return false;
+		}
+
+		return true;
+	}
+
+	lut::DescriptorSetLayout create_bindless_descriptor_layout(lut::VulkanWindow const& aWindow, std::uint32_t aTextureCount)
+	{
+		LUT_PROFILE_ZONE("create_bindless_descriptor_layout");
+
+		VkDescriptorSetLayoutBinding bindings[2]{};
+		bindings[0].binding = 0; // this must match the shaders 
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		bindings[1].binding = 1; // this must match the shaders 
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[1].descriptorCount = std::max(aTextureCount, 1u);
+		bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorBindingFlags const bindingFlags[2] = {
+			0,
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+		};
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+		flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+		flagsInfo.bindingCount = sizeof(bindingFlags) / sizeof(bindingFlags[0]);
+		flagsInfo.pBindingFlags = bindingFlags;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.pNext = &flagsInfo;
+		layoutInfo.bindingCount = sizeof(bindings) / sizeof(bindings[0]);
+		layoutInfo.pBindings = bindings;
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		if (auto const res = vkCreateDescriptorSetLayout(aWindow.device, &layoutInfo, nullptr, &layout); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create descriptor set layout\n""vkCreateDescriptorSetLayout() returned %s", lut::to_string(res).c_str());
+		}
+
+		return lut::DescriptorSetLayout(aWindow.device, layout);
+	}
+
+	lut::DescriptorPool create_bindless_descriptor_pool(lut::VulkanWindow const& aWindow, std::uint32_t aTextureCount, std::uint32_t aSetCount)
+	{
+		VkDescriptorPoolSize const pools[] = {
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, aSetCount },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, std::max(aTextureCount, 1u) * aSetCount }
+		};
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = aSetCount;
+		poolInfo.poolSizeCount = sizeof(pools) / sizeof(pools[0]);
+		poolInfo.pPoolSizes = pools;
+
+		VkDescriptorPool pool = VK_NULL_HANDLE;
+		if (auto const res = vkCreateDescriptorPool(aWindow.device, &poolInfo, nullptr, &pool); VK_SUCCESS != res)
+		{
+			throw lut::Error("Unable to create descriptor pool\n""vkCreateDescriptorPool() returned %s", lut::to_string(res).c_str());
+		}
+
+		return lut::DescriptorPool(aWindow.device, pool);
+	}
+
 	VkBuffer create_color_uniform_buffer(std::vector<glsl::ColorUniform>const& colorUniform, lut::VulkanWindow const& window)
 	{
 		VkBufferCreateInfo bufferInfo = {};
@@ -1848,6 +2397,8 @@ namespace
 
 	void present_results(VkQueue aPresentQueue, VkSwapchainKHR aSwapchain, std::uint32_t aImageIndex, VkSemaphore aRenderFinished, bool& aNeedToRecreateSwapchain)
 	{
+		LUT_PROFILE_ZONE("present_results");
+
 
 		VkPresentInfoKHR presentInfo{};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -0,0 +1,148 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Bindless variant of default.frag: all textures are in one array, and the
+// texture indices of each material in a storage buffer. The material of a
+// draw is selected with a push constant.
+
+struct LightSource
+{
+	vec4 position;
+	vec4 color;
+	float intensity;
+};
+
+// Material features, one pipeline variant per combination
+layout( constant_id = 0 ) const bool kAlphaMask = false;
+layout( constant_id = 1 ) const bool kNormalMap = false;
+layout( constant_id = 2 ) const float kAmbient = 0.0001;
+
+layout( location = 0 ) in vec2 v2fTexCoord;
+layout( location = 1) in vec3 v2fNormal;
+layout( location = 2) in vec3 v2fFragCoord;
+layout( location = 3) in vec3 v2fCameraPos;
+layout( location = 4) in vec4 v2fTangent;
+layout( location = 5) flat in mat3 v2fUnPackedTBN;
+layout( location = 8) in float v2fOcclusion;
+
+layout( location = 0 ) out vec4 oColor; 
+
+// Texture indices; must match glsl::MaterialData
+struct Material
+{
+	uint baseColor;
+	uint roughness;
+	uint metalness;
+	uint alphaMask;
+	uint normalMap;
+};
+
+layout( set = 1, binding = 0, std430 ) readonly buffer Materials
+{
+	Material materials[];
+} uMaterials;
+
+layout( set = 1, binding = 1 ) uniform sampler2D uTextures[];
+
+layout( push_constant ) uniform Draw
+{
+	uint materialId;
+} uDraw;
+
+layout(set = 2, binding = 0) uniform LightData {
+    LightSource light;
+} lightData;
+
+
+void main()
+{
+	// The material is the same for the whole draw, so the indices are
+	// dynamically uniform
+	Material material = uMaterials.materials[uDraw.materialId];
+	
+	vec3 lightPos = vec3((lightData.light.position).xyz);
+	vec3 cameraPos = v2fCameraPos;
+	vec3 fragPos = v2fFragCoord;
+	mat3 quatTBN_mat3 = v2fUnPackedTBN;
+
+
+	vec3 baseColor = vec3(1.0);
+	float alpha = 1.0;
+	//Texture
+	if(kAlphaMask)
+	{
+		baseColor = texture(uTextures[material.alphaMask],v2fTexCoord).rgb;
+		alpha = texture(uTextures[material.alphaMask],v2fTexCoord).a;
+
+	}else
+	{
+		baseColor = texture(uTextures[material.baseColor],v2fTexCoord).rgb * 0.8;
+	}
+	
+	float roughness = texture(uTextures[material.roughness],v2fTexCoord).r; //Shininess
+	float shininess = 2.0 / (pow(roughness,4) + 0.001) - 2;
+	float metalness = texture(uTextures[material.metalness],v2fTexCoord).r;
+	
+
+	//Direction settings
+	vec3 T = normalize(vec3(v2fTangent.xyz));
+	vec3 N = normalize(v2fNormal);
+	//vec3 N = quatTBN_mat3[2];
+
+	T = normalize(T - dot(T, N) * N);
+	vec3 B = sign(v2fTangent.w) * cross(N,T);
+
+	vec3 V = normalize(cameraPos - fragPos);
+    vec3 L = normalize(lightPos - fragPos);
+	vec3 H = normalize(L + V);
+
+	
+	mat3 TBN = transpose(mat3(T,B,N));
+	//mat3 TBN = transpose(quatTBN_mat3);
+
+	if(kNormalMap)
+	{
+		vec3 normal = texture(uTextures[material.normalMap],v2fTexCoord).rgb;
+		N = normalize ((2.0 * normal - 1.0));
+
+		V = normalize(TBN * V);
+		L = normalize(TBN * L);
+		H = normalize(L + V);
+	}
+
+	float pi = 3.1415926;
+	float NdotL = max(dot(N,L), 0.0);
+	float NdotH = max(dot(N,H),0.0);
+	float NdotV = max(dot(N,V),0.0);
+	float VdotH = dot(V,H);
+
+
+	//Specular
+	vec3 F0 = (1.0 - metalness) * vec3(0.04,0.04,0.04) + metalness*baseColor;
+	vec3 Fv = F0 + (1.0 - F0) * pow( (1.0 - dot(H,V)) ,5);
+
+	//Diffuse
+	vec3 pDiffuse = max(baseColor/pi * (vec3(1.0) - Fv) * (1.0 - metalness),0);
+
+	//Distribution function D
+	float Dh = ((shininess + 2.0) / (2.0 * pi)) * pow(NdotH,shininess);
+
+	//Cook-Torrance model
+	float G1 = 2.0 * ( (NdotH * NdotV) / VdotH);
+	float G2 = 2.0 * ( (NdotH * NdotL) / VdotH);
+	float G = min(1.0, min(G1,G2));
+
+	//Ambient, attenuated by the ambient occlusion baked into the vertices
+	vec3 pAmbient = (lightData.light.color).rgb * baseColor * kAmbient * v2fOcclusion;
+
+	//Specular
+	vec3 specular = ( (Dh * Fv * G) / (4.0 * NdotV * NdotL) );
+	
+	//BRDF
+	vec3 BRDF = max((pDiffuse + specular),0);
+	BRDF = max(BRDF * lightData.light.color.rgb * NdotL,0);
+
+
+	vec3 pColor = (pAmbient + BRDF) * alpha;
+	oColor = vec4(pColor ,alpha);
+}
@@ -7,10 +7,10 @@ struct LightSource
 	float intensity;
 };
 
-layout(push_constant) uniform VertexPushConstants {
-    int isAlpha;
-	int isNormalMap;
-} vertexPushConst;
+// Material features, one pipeline variant per combination
+layout( constant_id = 0 ) const bool kAlphaMask = false;
+layout( constant_id = 1 ) const bool kNormalMap = false;
+layout( constant_id = 2 ) const float kAmbient = 0.0001;
 
 layout( location = 0 ) in vec2 v2fTexCoord;
 layout( location = 1) in vec3 v2fNormal;
@@ -18,6 +18,7 @@ layout( location = 2) in vec3 v2fFragCoord;
 layout( location = 3) in vec3 v2fCameraPos;
 layout( location = 4) in vec4 v2fTangent;
 layout( location = 5) flat in mat3 v2fUnPackedTBN;
+layout( location = 8) in float v2fOcclusion;
 
 layout( location = 0 ) out vec4 oColor; 
 
@@ -44,7 +45,7 @@ void main()
 	vec3 baseColor = vec3(1.0);
 	float alpha = 1.0;
 	//Texture
-	if(vertexPushConst.isAlpha == 1)
+	if(kAlphaMask)
 	{
 		baseColor = texture(uAlphaTexture,v2fTexCoord).rgb;
 		alpha = texture(uAlphaTexture,v2fTexCoord).a;
@@ -75,7 +76,7 @@ void main()
 	mat3 TBN = transpose(mat3(T,B,N));
 	//mat3 TBN = transpose(quatTBN_mat3);
 
-	if(vertexPushConst.isNormalMap == 1)
+	if(kNormalMap)
 	{
 		vec3 normal = texture(uNormalMap,v2fTexCoord).rgb;
 		N = normalize ((2.0 * normal - 1.0));
@@ -107,8 +108,8 @@ void main()
 	float G2 = 2.0 * ( (NdotH * NdotL) / VdotH);
 	float G = min(1.0, min(G1,G2));
 
-	//Ambient
-	vec3 pAmbient = (lightData.light.color).rgb * baseColor * 0.0001;
+	//Ambient, attenuated by the ambient occlusion baked into the vertices
+	vec3 pAmbient = (lightData.light.color).rgb * baseColor * kAmbient * v2fOcclusion;
 
 	//Specular
 	vec3 specular = ( (Dh * Fv * G) / (4.0 * NdotV * NdotL) );
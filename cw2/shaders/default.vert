@@ -2,10 +2,15 @@
 
 layout( location = 0 ) in vec3 iPosition;
 layout( location = 1 ) in vec2 iTexCoord;
-layout( location = 2 ) in vec3 iNormal;
+layout( location = 2 ) in vec4 iNormal; // w = ambient occlusion
 layout( location = 3 ) in vec4 iTangent;
 layout( location = 4) in uint packedTBN;
 
+// Per-instance transform, stored as the three rows of a 3x4 matrix
+layout( location = 5 ) in vec4 iInstanceRow0;
+layout( location = 6 ) in vec4 iInstanceRow1;
+layout( location = 7 ) in vec4 iInstanceRow2;
+
 layout( set = 0, binding = 0 ) uniform UScene
 {
 	mat4 camera;
@@ -61,23 +66,32 @@ layout( location = 2) out vec3 v2fFragCoord;
 layout( location = 3) out vec3 v2fCameraPos;
 layout( location = 4) out vec4 v2fTangent;
 layout( location = 5) out mat3 v2fUnPackedTBN;
+layout( location = 8) out float v2fOcclusion;
 
 void main()
 {
+	// Instance transforms are rigid, so the upper 3x3 part can be used for
+	// directions (normals, tangents) as-is.
+	mat3x4 instance = mat3x4( iInstanceRow0, iInstanceRow1, iInstanceRow2 );
+	mat3 instanceRot = mat3( transpose( instance ) );
+
+	vec3 worldPos = vec4( iPosition, 1.f ) * instance;
 
 	v2fTexCoord = iTexCoord;
 
-	v2fNormal = iNormal;
+	v2fNormal = instanceRot * iNormal.xyz;
+
+	v2fOcclusion = iNormal.w;
 
-	v2fFragCoord = iPosition;
+	v2fFragCoord = worldPos;
 
 	v2fCameraPos = uScene.cameraPos;
 
     vec4 quatTBN = unpackQuat(packedTBN);
 
-    v2fUnPackedTBN = quaternionToMat3(quatTBN);
+    v2fUnPackedTBN = instanceRot * quaternionToMat3(quatTBN);
 
-	v2fTangent = iTangent;
+	v2fTangent = vec4( instanceRot * iTangent.xyz, iTangent.w );
 
-	gl_Position = uScene.projCam * vec4( iPosition, 1.f ); 
+	gl_Position = uScene.projCam * vec4( worldPos, 1.f ); 
 }
@@ -0,0 +1,598 @@
+#include "texture_cache.hpp"
+
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+#include <cstdio>
+#include <cassert>
+
+#include <stb_image.h>
+
+#include "../labutils/error.hpp"
+#include "../labutils/vkutil.hpp"
+#include "../labutils/profiler.hpp"
+#include "../labutils/upload_batch.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// Tweakables for streaming
+	constexpr std::size_t kJobsPerDecoder = 2; // decodes queued or in flight per thread
+	constexpr VkDeviceSize kStreamUploadBytesPerFrame = 64*1024*1024;
+
+	// Fraction of the device budget that may be used; leaves room for
+	// allocations that happen between two frames (and for estimation error)
+	constexpr double kDeviceBudgetHeadroom = 0.9;
+
+	// Size of a level including its mip chain, as counted against the budget
+	VkDeviceSize level_bytes_(std::uint32_t aWidth, std::uint32_t aHeight, std::uint32_t aLevel)
+	{
+		VkDeviceSize const w = std::max(aWidth >> aLevel, 1u);
+		VkDeviceSize const h = std::max(aHeight >> aLevel, 1u);
+		return w * h * 4 * 4 / 3;
+	}
+
+	// Halves an RGBA8 image with a box filter, in place
+	void downsample_(stbi_uc* aPixels, std::uint32_t& aWidth, std::uint32_t& aHeight)
+	{
+		std::uint32_t const w = std::max(aWidth / 2, 1u);
+		std::uint32_t const h = std::max(aHeight / 2, 1u);
+
+		// Destination texels never overtake the source texels that are
+		// still to be read, so this can work in place.
+		for (std::uint32_t y = 0; y < h; ++y)
+		{
+			std::uint32_t const y0 = std::min(2 * y, aHeight - 1), y1 = std::min(2 * y + 1, aHeight - 1);
+			for (std::uint32_t x = 0; x < w; ++x)
+			{
+				std::uint32_t const x0 = std::min(2 * x, aWidth - 1), x1 = std::min(2 * x + 1, aWidth - 1);
+				for (std::uint32_t c = 0; c < 4; ++c)
+				{
+					unsigned const sum = aPixels[(std::size_t(y0) * aWidth + x0) * 4 + c]
+						+ aPixels[(std::size_t(y0) * aWidth + x1) * 4 + c]
+						+ aPixels[(std::size_t(y1) * aWidth + x0) * 4 + c]
+						+ aPixels[(std::size_t(y1) * aWidth + x1) * 4 + c];
+					aPixels[(std::size_t(y) * w + x) * 4 + c] = stbi_uc((sum + 2) / 4);
+				}
+			}
+		}
+
+		aWidth = w;
+		aHeight = h;
+	}
+}
+
+TextureCache::TextureCache(lut::VulkanContext const& aContext, lut::Allocator const& aAllocator, VkCommandPool aCmdPool, BakedModel const& aModel)
+	: mContext(aContext)
+	, mAllocator(aAllocator)
+	, mCmdPool(aCmdPool)
+	, mModel(aModel)
+	, mEntries(aModel.textures.size())
+{}
+
+TextureCache::~TextureCache()
+{
+	stop_streaming_();
+}
+
+VkImageView TextureCache::view(std::uint32_t aTextureId)
+{
+	if (aTextureId >= mEntries.size())
+		throw lut::Error("TextureCache: texture id %u out of range (%zu textures)", aTextureId, mEntries.size());
+
+	++mRequests;
+
+	// Repeated requests are the loads that the cache avoids
+	auto& entry = mEntries[aTextureId];
+	if (entry.requested)
+	{
+		++mHits;
+		mBytesAvoided += entry.bytes;
+	}
+	entry.requested = true;
+
+	if (mStreaming && kPlaceholder == entry.residentLevel)
+		return entry.placeholderView.handle;
+
+	if (VK_NULL_HANDLE != entry.view.handle)
+		return entry.view.handle;
+
+	auto const startTime = std::chrono::steady_clock::now();
+
+	char const* path = mModel.textures[aTextureId].path.c_str();
+	finish_load_(aTextureId, lut::load_image_texture2d(path, mContext, mCmdPool, mAllocator));
+
+	mLoadSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	return entry.view.handle;
+}
+
+void TextureCache::preload(std::vector<std::uint32_t> const& aTextureIds, unsigned aThreads)
+{
+	std::vector<std::uint32_t> ids;
+	std::vector<std::string> paths;
+	std::vector<bool> queued(mEntries.size(), false);
+
+	for (auto const id : aTextureIds)
+	{
+		if (id >= mEntries.size())
+			throw lut::Error("TextureCache: texture id %u out of range (%zu textures)", id, mEntries.size());
+
+		if (queued[id] || VK_NULL_HANDLE != mEntries[id].view.handle)
+			continue;
+
+		queued[id] = true;
+		ids.emplace_back(id);
+		paths.emplace_back(mModel.textures[id].path);
+	}
+
+	if (ids.empty())
+		return;
+
+	LUT_PROFILE_ZONE("TextureCache::preload");
+
+	lut::UploadBatch uploads(mContext, mAllocator);
+	auto images = lut::load_image_textures2d(paths, uploads, mAllocator, aThreads, &mPreloadStats);
+
+	for (std::size_t i = 0; i < ids.size(); ++i)
+		finish_load_(ids[i], std::move(images[i]));
+
+	mLoadSeconds += mPreloadStats.totalSeconds;
+}
+
+void TextureCache::finish_load_(std::uint32_t aTextureId, lut::Image aImage)
+{
+	auto& entry = mEntries[aTextureId];
+	entry.image = std::move(aImage);
+	entry.view = lut::create_image_view_texture2d(mContext, entry.image.image, VK_FORMAT_R8G8B8A8_UNORM);
+
+	VmaAllocationInfo info{};
+	vmaGetAllocationInfo(mAllocator.allocator, entry.image.allocation, &info);
+	entry.bytes = info.size;
+
+	++mLoads;
+	mBytesLoaded += entry.bytes;
+}
+
+void TextureCache::start_streaming(VkDeviceSize aBudget, std::uint32_t aFramesInFlight, unsigned aThreads)
+{
+	if (mStreaming)
+		return;
+
+	LUT_PROFILE_ZONE("TextureCache::start_streaming");
+
+	auto const startTime = std::chrono::steady_clock::now();
+
+	mStreaming = true;
+	mBudget = aBudget;
+	mFramesInFlight = std::max(aFramesInFlight, 1u);
+	mStreamUploads = std::make_unique<lut::UploadBatch>(mContext, mAllocator);
+
+	// Placeholders: a single texel with the average color from the baker
+	for (std::size_t i = 0; i < mEntries.size(); ++i)
+	{
+		auto& entry = mEntries[i];
+		if (VK_NULL_HANDLE != entry.view.handle)
+		{
+			entry.residentLevel = 0; // already loaded in full
+			continue;
+		}
+
+		int w, h, channels;
+		if (stbi_info(mModel.textures[i].path.c_str(), &w, &h, &channels))
+		{
+			entry.width = std::uint32_t(w);
+			entry.height = std::uint32_t(h);
+		}
+		else
+		{
+			std::fprintf(stderr, "TextureCache: '%s' can't be streamed; using its average color\n", mModel.textures[i].path.c_str());
+			entry.failed = true;
+		}
+
+		std::uint32_t const color = mModel.textures[i].averageColor;
+		stbi_uc const texel[4] = {
+			stbi_uc(color), stbi_uc(color >> 8), stbi_uc(color >> 16), stbi_uc(color >> 24)
+		};
+
+		entry.placeholder = lut::create_image_texture2d(mAllocator, 1, 1, VK_FORMAT_R8G8B8A8_UNORM);
+		entry.placeholder.maxMipLevel = 1;
+		mStreamUploads->upload_texture2d(entry.placeholder, texel, 1, 1);
+		entry.placeholderView = lut::create_image_view_texture2d(mContext, entry.placeholder.image, VK_FORMAT_R8G8B8A8_UNORM);
+		entry.residentLevel = kPlaceholder;
+	}
+
+	// Placeholders must be ready before the first frame
+	mStreamUploads->flush();
+
+	// Same orientation as the other loaders. The flag is global in stb_image;
+	// set it before the decoders start.
+	stbi_set_flip_vertically_on_load(1);
+
+	unsigned const threads = aThreads ? aThreads : std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned i = 0; i < threads; ++i)
+	{
+		mDecoders.emplace_back([this] {
+			lut::profiler_set_thread_name("texture streaming");
+
+			for (;;)
+			{
+				StreamJob_ job;
+				{
+					std::unique_lock<std::mutex> lock(mStreamMutex);
+					mStreamCv.wait(lock, [this] { return mStopStreaming || !mJobs.empty(); });
+					if (mStopStreaming)
+						return;
+
+					job = mJobs.front();
+					mJobs.pop_front();
+				}
+
+				LUT_PROFILE_ZONE("stream texture");
+
+				Decoded_ result{ job.textureId, job.level, 0, 0, nullptr };
+
+				int w, h, channels;
+				if (stbi_uc* data = stbi_load(mModel.textures[job.textureId].path.c_str(), &w, &h, &channels, 4))
+				{
+					result.pixels = std::shared_ptr<void>(data, [](void* aData) { stbi_image_free(aData); });
+					result.width = std::uint32_t(w);
+					result.height = std::uint32_t(h);
+
+					for (std::uint32_t level = 0; level < job.level; ++level)
+						downsample_(data, result.width, result.height);
+				}
+
+				std::lock_guard<std::mutex> lock(mStreamMutex);
+				mDecoded.emplace_back(std::move(result));
+			}
+		});
+	}
+
+	mLoadSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+std::vector<std::uint32_t> TextureCache::stream(std::vector<float> const& aScreenSize)
+{
+	std::vector<std::uint32_t> changed;
+	if (!mStreaming)
+		return changed;
+
+	LUT_PROFILE_ZONE("TextureCache::stream");
+
+	// With VK_EXT_memory_budget, VMA refreshes the budget on a new frame
+	++mFrame;
+	vmaSetCurrentFrameIndex(mAllocator.allocator, std::uint32_t(mFrame));
+
+	// Every frame in flight has replaced the views retired that many calls ago
+	while (!mRetired.empty() && mRetired.front().frame + mFramesInFlight <= mFrame)
+		mRetired.pop_front();
+
+	for (std::size_t i = 0; i < std::min(aScreenSize.size(), mEntries.size()); ++i)
+	{
+		if (aScreenSize[i] > 0.f)
+			mEntries[i].lastUsed = mFrame;
+	}
+
+	// Swap in the levels whose uploads have completed
+	mStreamUploads->retire();
+	auto const completed = mStreamUploads->completed_submits();
+
+	std::size_t kept = 0;
+	for (auto& upload : mUploads)
+	{
+		if (upload.submit > completed)
+		{
+			mUploads[kept++] = std::move(upload);
+			continue;
+		}
+
+		auto& entry = mEntries[upload.textureId];
+		mRetired.emplace_back(Retired_{ std::move(entry.image), std::move(entry.view), mFrame });
+
+		if (kPlaceholder == entry.residentLevel)
+			++mStreamedLoads;
+		else if (upload.level < entry.residentLevel)
+			++mStreamedUpgrades;
+
+		mStreamedBytes -= entry.streamBytes;
+		entry.streamBytes = level_bytes_(entry.width, entry.height, upload.level);
+
+		entry.image = std::move(upload.image);
+		entry.view = lut::create_image_view_texture2d(mContext, entry.image.image, VK_FORMAT_R8G8B8A8_UNORM);
+		entry.residentLevel = upload.level;
+		entry.pendingLevel = kPlaceholder;
+
+		changed.emplace_back(upload.textureId);
+	}
+	mUploads.resize(kept);
+
+	// Upload decoded levels, up to a per-frame limit
+	std::vector<Decoded_> decoded;
+	{
+		std::lock_guard<std::mutex> lock(mStreamMutex);
+
+		VkDeviceSize bytes = 0;
+		while (!mDecoded.empty() && bytes < kStreamUploadBytesPerFrame)
+		{
+			bytes += VkDeviceSize(mDecoded.front().width) * mDecoded.front().height * 4;
+			decoded.emplace_back(std::move(mDecoded.front()));
+			mDecoded.pop_front();
+		}
+	}
+
+	std::size_t const firstUpload = mUploads.size();
+	for (auto& result : decoded)
+	{
+		--mJobsInFlight;
+
+		auto& entry = mEntries[result.textureId];
+		if (!result.pixels)
+		{
+			std::fprintf(stderr, "TextureCache: '%s' failed to load; using its average color\n", mModel.textures[result.textureId].path.c_str());
+			cancel_pending_(result.textureId);
+			entry.failed = true;
+			continue;
+		}
+
+		lut::Image image;
+		try
+		{
+			image = lut::create_image_texture2d(mAllocator, result.width, result.height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+			image.maxMipLevel = lut::compute_mip_level_count(result.width, result.height);
+			mStreamUploads->upload_texture2d(image, result.pixels.get(), result.width, result.height);
+		}
+		catch (lut::Error const& eErr)
+		{
+			// Device memory ran out within the budget (e.g., it was only an
+			// estimate, or other processes use more now). Stay at what fits;
+			// the texture is requested again later.
+			std::fprintf(stderr, "TextureCache: can't allocate '%s' (%s); reducing the budget\n", mModel.textures[result.textureId].path.c_str(), eErr.what());
+			cancel_pending_(result.textureId);
+			mBudget = std::min(mBudget, mStreamedBytes);
+			++mAllocationFailures;
+			continue;
+		}
+
+		mStreamedUploadBytes += VkDeviceSize(result.width) * result.height * 4;
+		mUploads.emplace_back(Upload_{ result.textureId, result.level, 0, std::move(image) });
+	}
+
+	if (mStreamUploads->has_recorded())
+	{
+		mStreamUploads->submit();
+		for (std::size_t i = firstUpload; i < mUploads.size(); ++i)
+			mUploads[i].submit = mStreamUploads->stats().submits;
+	}
+
+	// Textures that may be evicted, least recently used (then largest) first
+	mEffectiveBudget = effective_budget_();
+	mMinEffectiveBudget = std::min(mMinEffectiveBudget, mEffectiveBudget);
+
+	std::vector<std::uint32_t> lru;
+	for (std::size_t i = 0; i < mEntries.size(); ++i)
+	{
+		auto const& entry = mEntries[i];
+		if (entry.lastUsed < mFrame && kPlaceholder != entry.residentLevel && kPlaceholder == entry.pendingLevel && entry.streamBytes)
+			lru.emplace_back(std::uint32_t(i));
+	}
+
+	std::sort(lru.begin(), lru.end(), [this](std::uint32_t aX, std::uint32_t aY) {
+		auto const& x = mEntries[aX];
+		auto const& y = mEntries[aY];
+		return x.lastUsed != y.lastUsed ? x.lastUsed < y.lastUsed : x.streamBytes > y.streamBytes;
+	});
+
+	std::size_t nextEvicted = 0;
+	auto const make_room_ = [&](VkDeviceSize aBytes) {
+		while (mStreamedBytes + aBytes > mEffectiveBudget && nextEvicted < lru.size())
+			evict_(lru[nextEvicted++], changed);
+		return mStreamedBytes + aBytes <= mEffectiveBudget;
+	};
+
+	std::size_t const maxJobs = kJobsPerDecoder * mDecoders.size();
+	std::size_t queued = 0;
+
+	// Over budget even without the textures that aren't visible: visible
+	// textures drop a level, starting with those that have the most texels
+	// per pixel on screen
+	if (!make_room_(0))
+	{
+		struct Drop_
+		{
+			std::uint32_t textureId;
+			float texelsPerPixel;
+		};
+
+		std::vector<Drop_> drops;
+		for (std::size_t i = 0; i < std::min(aScreenSize.size(), mEntries.size()); ++i)
+		{
+			auto const& entry = mEntries[i];
+			if (kPlaceholder == entry.residentLevel || kPlaceholder != entry.pendingLevel || !entry.streamBytes)
+				continue;
+			if (entry.residentLevel + 1 >= lut::compute_mip_level_count(entry.width, entry.height))
+				continue;
+
+			float const size = float(std::max(entry.width, entry.height) >> entry.residentLevel);
+			drops.emplace_back(Drop_{ std::uint32_t(i), size / std::max(aScreenSize[i], 1.f) });
+		}
+
+		std::sort(drops.begin(), drops.end(), [](Drop_ const& aX, Drop_ const& aY) {
+			return aX.texelsPerPixel > aY.texelsPerPixel;
+		});
+
+		for (auto const& drop : drops)
+		{
+			if (mStreamedBytes <= mEffectiveBudget || mJobsInFlight >= maxJobs)
+				break;
+
+			// The resident level stops counting right away; it is replaced
+			// once the coarser one has been uploaded
+			auto& entry = mEntries[drop.textureId];
+			mStreamedBytes -= entry.streamBytes;
+			entry.streamBytes = 0;
+
+			queue_job_(drop.textureId, entry.residentLevel + 1);
+			++mMipDrops;
+			++queued;
+		}
+	}
+
+	if (mJobsInFlight >= maxJobs)
+	{
+		if (queued)
+			mStreamCv.notify_all();
+		return changed;
+	}
+
+	// Queue new levels, largest on-screen textures first
+	struct Candidate_
+	{
+		std::uint32_t textureId;
+		float screenSize;
+	};
+
+	std::vector<Candidate_> candidates;
+	for (std::size_t i = 0; i < std::min(aScreenSize.size(), mEntries.size()); ++i)
+	{
+		auto const& entry = mEntries[i];
+		if (aScreenSize[i] > 0.f && !entry.failed && kPlaceholder == entry.pendingLevel && 0 != entry.residentLevel)
+			candidates.emplace_back(Candidate_{ std::uint32_t(i), aScreenSize[i] });
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](Candidate_ const& aX, Candidate_ const& aY) {
+		return aX.screenSize > aY.screenSize;
+	});
+
+	for (auto const& candidate : candidates)
+	{
+		if (mJobsInFlight >= maxJobs)
+			break;
+
+		auto& entry = mEntries[candidate.textureId];
+
+		// Coarsest level that still covers the surface
+		std::uint32_t const levels = lut::compute_mip_level_count(entry.width, entry.height);
+		std::uint32_t wanted = 0;
+		while (wanted + 1 < levels && float(std::max(entry.width, entry.height) >> (wanted + 1)) >= candidate.screenSize)
+			++wanted;
+
+		if (wanted >= entry.residentLevel)
+			continue;
+
+		// Make room by evicting textures that aren't visible, or go coarser
+		// still if that is not enough
+		std::uint32_t level = wanted;
+		auto const fits = [&] { return make_room_(level_bytes_(entry.width, entry.height, level)); };
+		while (level + 1 < levels && level < entry.residentLevel && !fits())
+			++level;
+
+		if (level >= entry.residentLevel || !fits())
+		{
+			++mBudgetDeferrals;
+			continue;
+		}
+
+		queue_job_(candidate.textureId, level);
+		++queued;
+	}
+
+	if (queued)
+		mStreamCv.notify_all();
+
+	return changed;
+}
+
+VkDeviceSize TextureCache::effective_budget_() const
+{
+	auto const device = lut::query_device_local_budget(mAllocator);
+
+	// Everything in device memory that isn't a streamed level: geometry,
+	// render targets, placeholders and, with VK_EXT_memory_budget, other
+	// allocations of the process
+	VkDeviceSize const other = device.usage - std::min(device.usage, mStreamedBytes);
+	VkDeviceSize const usable = VkDeviceSize(device.budget * kDeviceBudgetHeadroom);
+
+	return std::min(mBudget, usable - std::min(usable, other));
+}
+
+void TextureCache::queue_job_(std::uint32_t aTextureId, std::uint32_t aLevel)
+{
+	auto& entry = mEntries[aTextureId];
+	mStreamedBytes += level_bytes_(entry.width, entry.height, aLevel);
+	entry.pendingLevel = aLevel;
+	++mJobsInFlight;
+
+	std::lock_guard<std::mutex> lock(mStreamMutex);
+	mJobs.emplace_back(StreamJob_{ aTextureId, aLevel });
+}
+
+void TextureCache::cancel_pending_(std::uint32_t aTextureId)
+{
+	auto& entry = mEntries[aTextureId];
+	mStreamedBytes -= level_bytes_(entry.width, entry.height, entry.pendingLevel);
+	entry.pendingLevel = kPlaceholder;
+
+	// A level that was to be dropped stays after all
+	if (kPlaceholder != entry.residentLevel && !entry.streamBytes)
+	{
+		entry.streamBytes = level_bytes_(entry.width, entry.height, entry.residentLevel);
+		mStreamedBytes += entry.streamBytes;
+	}
+}
+
+void TextureCache::evict_(std::uint32_t aTextureId, std::vector<std::uint32_t>& aChanged)
+{
+	auto& entry = mEntries[aTextureId];
+	assert(kPlaceholder != entry.residentLevel && kPlaceholder == entry.pendingLevel);
+
+	mRetired.emplace_back(Retired_{ std::move(entry.image), std::move(entry.view), mFrame });
+
+	++mEvictions;
+	mEvictedBytes += entry.streamBytes;
+
+	mStreamedBytes -= entry.streamBytes;
+	entry.streamBytes = 0;
+	entry.residentLevel = kPlaceholder;
+
+	aChanged.emplace_back(aTextureId);
+}
+
+void TextureCache::stop_streaming_()
+{
+	{
+		std::lock_guard<std::mutex> lock(mStreamMutex);
+		mStopStreaming = true;
+	}
+	mStreamCv.notify_all();
+
+	for (auto& decoder : mDecoders)
+		decoder.join();
+	mDecoders.clear();
+
+	// Wait for uploads before their images are destroyed
+	mStreamUploads.reset();
+}
+
+void TextureCache::report() const
+{
+	std::printf("Textures: %zu requests => %zu loads (%zu avoided) in %.1f ms\n", mRequests, mLoads, mHits, mLoadSeconds * 1000.0);
+	std::printf("Texture VRAM: %.1f MiB (%.1f MiB avoided)\n", mBytesLoaded / (1024.0 * 1024.0), mBytesAvoided / (1024.0 * 1024.0));
+
+	if (auto const& stats = mPreloadStats; stats.textures)
+	{
+		std::printf("Parallel load: %zu textures (%zu with dedicated staging), %.1f MiB in %zu batches (%zu stalls), %u decoder threads\n", stats.textures, stats.dedicatedStaging, stats.bytes / (1024.0 * 1024.0), stats.batches, stats.stalls, stats.threads);
+		std::printf("  decode %.1f ms, stage %.1f ms (all threads), record %.1f ms, GPU wait %.1f ms => %.1f ms total, %.1f MiB/s\n", stats.decodeSeconds * 1000.0, stats.stageSeconds * 1000.0, stats.recordSeconds * 1000.0, stats.waitSeconds * 1000.0, stats.totalSeconds * 1000.0, stats.bytes / (1024.0 * 1024.0) / std::max(stats.totalSeconds, 1e-9));
+	}
+
+	if (mStreaming)
+	{
+		std::printf("Streaming: %zu placeholders, %zu streamed in, %zu upgraded, %zu deferred by the budget, %u decoder threads\n", mEntries.size(), mStreamedLoads, mStreamedUpgrades, mBudgetDeferrals, unsigned(mDecoders.size()));
+		std::printf("  %.1f MiB uploaded, %.1f of %.1f MiB budget in use\n", mStreamedUploadBytes / (1024.0 * 1024.0), mStreamedBytes / (1024.0 * 1024.0), mBudget / (1024.0 * 1024.0));
+
+		auto const device = lut::query_device_local_budget(mAllocator);
+		std::printf("Residency: device budget %.1f MiB (%s), %.1f MiB in use; effective texture budget %.1f MiB (%.1f MiB at least)\n", device.budget / (1024.0 * 1024.0), mContext.haveMemoryBudget ? "VK_EXT_memory_budget" : "estimated", device.usage / (1024.0 * 1024.0), mEffectiveBudget / (1024.0 * 1024.0), mFrame ? mMinEffectiveBudget / (1024.0 * 1024.0) : 0.0);
+		std::printf("  %zu evictions (%.1f MiB), %zu mip levels dropped, %zu failed allocations\n", mEvictions, mEvictedBytes / (1024.0 * 1024.0), mMipDrops, mAllocationFailures);
+	}
+}
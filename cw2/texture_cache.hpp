@@ -0,0 +1,183 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../labutils/vulkan_context.hpp"
+
+#include "../labutils/vkimage.hpp"
+#include "../labutils/vkobject.hpp"
+#include "../labutils/allocator.hpp"
+#include "../labutils/upload_batch.hpp"
+
+#include "baked_model.hpp"
+
+// Images of a baked model, keyed by the baked texture ID. The baker already
+// stores each unique texture once; the cache makes sure that each one is also
+// decoded, uploaded and mipmapped only once, no matter how many materials
+// (or meshes) reference it. Textures are loaded on first use.
+//
+// Alternatively, textures can be streamed (see start_streaming()): every
+// texture starts out as a 1x1 placeholder with the average color recorded
+// by the baker, and is replaced by a larger mip level once it is visible.
+//
+// Streamed textures are also kept resident within the device memory budget
+// that VMA reports (see labutils::query_device_local_budget()). When over
+// budget, or when a visible texture needs room, the least recently used
+// textures that are not visible are evicted back to their placeholder; they
+// are streamed in again once they become visible. If that is not enough,
+// visible textures drop to coarser levels, most over-resolved first.
+class TextureCache
+{
+	public:
+		TextureCache(labutils::VulkanContext const&, labutils::Allocator const&, VkCommandPool, BakedModel const&);
+		~TextureCache();
+
+		TextureCache(TextureCache const&) = delete;
+		TextureCache& operator= (TextureCache const&) = delete;
+
+	public:
+		// Loads all of the given textures that are not loaded yet, decoding
+		// them in parallel (see labutils::load_image_textures2d())
+		void preload(std::vector<std::uint32_t> const& aTextureIds, unsigned aThreads = 0);
+
+		// Returns the image view of texture aTextureId, loading it if needed.
+		// When streaming, this is the currently resident level (or the
+		// placeholder).
+		VkImageView view(std::uint32_t aTextureId);
+
+		// Creates placeholders for all textures and starts aThreads decoder
+		// threads (0 = one per hardware thread). The resident levels of all
+		// streamed textures together are kept within aBudget bytes. Replaced
+		// views are kept for aFramesInFlight calls to stream(); see there.
+		void start_streaming(VkDeviceSize aBudget, std::uint32_t aFramesInFlight, unsigned aThreads = 0);
+
+		// Advances streaming; call once per frame. aScreenSize holds, for
+		// each texture, the on-screen size in pixels of the largest visible
+		// surface that uses it (0 if not visible). Larger surfaces are
+		// streamed first, at the coarsest level that still matches them.
+		//
+		// Each call counts as a frame; textures with a non-zero size are
+		// marked as used in it, which orders them for eviction.
+		//
+		// Returns the textures whose view() has changed, including evicted
+		// ones. The previous views stay valid for the next aFramesInFlight - 1
+		// calls, i.e., until every frame in flight has had the chance to
+		// update its own descriptor sets once the GPU is done with them.
+		std::vector<std::uint32_t> stream(std::vector<float> const& aScreenSize);
+
+		// Prints the number of requests, loads and the VRAM used and saved
+		void report() const;
+
+	private:
+		void finish_load_(std::uint32_t aTextureId, labutils::Image);
+		void stop_streaming_();
+
+		VkDeviceSize effective_budget_() const;
+		void queue_job_(std::uint32_t aTextureId, std::uint32_t aLevel);
+		void cancel_pending_(std::uint32_t aTextureId);
+		void evict_(std::uint32_t aTextureId, std::vector<std::uint32_t>& aChanged);
+
+	private:
+		static constexpr std::uint32_t kPlaceholder = ~std::uint32_t(0);
+
+		struct Entry_
+		{
+			labutils::Image image;
+			labutils::ImageView view;
+			VkDeviceSize bytes = 0;
+			bool requested = false;
+
+			// Streaming only
+			std::uint32_t width = 0, height = 0; // full resolution
+			std::uint32_t residentLevel = kPlaceholder;
+			std::uint32_t pendingLevel = kPlaceholder; // being decoded or uploaded
+			VkDeviceSize streamBytes = 0; // budgeted size of residentLevel
+			std::uint64_t lastUsed = 0; // frame, see stream()
+			bool failed = false;
+
+			// Used while residentLevel is kPlaceholder; kept for evictions
+			labutils::Image placeholder;
+			labutils::ImageView placeholderView;
+		};
+
+		labutils::VulkanContext const& mContext;
+		labutils::Allocator const& mAllocator;
+		VkCommandPool mCmdPool;
+		BakedModel const& mModel;
+
+		std::vector<Entry_> mEntries;
+
+		std::size_t mRequests = 0;
+		std::size_t mLoads = 0;
+		std::size_t mHits = 0;
+		VkDeviceSize mBytesLoaded = 0;
+		VkDeviceSize mBytesAvoided = 0;
+		double mLoadSeconds = 0.0;
+
+		labutils::TextureLoadStats mPreloadStats;
+
+		// Streaming
+		struct StreamJob_
+		{
+			std::uint32_t textureId;
+			std::uint32_t level;
+		};
+		struct Decoded_
+		{
+			std::uint32_t textureId;
+			std::uint32_t level;
+			std::uint32_t width, height;
+			std::shared_ptr<void> pixels; // RGBA8; null if decoding failed
+		};
+		struct Upload_
+		{
+			std::uint32_t textureId;
+			std::uint32_t level;
+			std::size_t submit; // see labutils::UploadBatch::completed_submits()
+			labutils::Image image;
+		};
+		struct Retired_
+		{
+			labutils::Image image;
+			labutils::ImageView view;
+			std::uint64_t frame; // see stream()
+		};
+
+		bool mStreaming = false;
+		VkDeviceSize mBudget = 0;
+		VkDeviceSize mEffectiveBudget = 0; // mBudget, limited by the device budget
+		VkDeviceSize mStreamedBytes = 0; // resident and pending levels
+		std::uint64_t mFrame = 0;
+		std::uint32_t mFramesInFlight = 1;
+
+		std::unique_ptr<labutils::UploadBatch> mStreamUploads;
+		std::vector<Upload_> mUploads;
+		std::deque<Retired_> mRetired; // in retirement order
+
+		std::mutex mStreamMutex;
+		std::condition_variable mStreamCv;
+		std::deque<StreamJob_> mJobs;
+		std::deque<Decoded_> mDecoded;
+		std::size_t mJobsInFlight = 0; // queued or decoding, or decoded and not taken
+		bool mStopStreaming = false;
+		std::vector<std::thread> mDecoders;
+
+		std::size_t mStreamedLoads = 0;
+		std::size_t mStreamedUpgrades = 0;
+		std::size_t mBudgetDeferrals = 0;
+		VkDeviceSize mStreamedUploadBytes = 0;
+
+		std::size_t mEvictions = 0;
+		std::size_t mMipDrops = 0;
+		std::size_t mAllocationFailures = 0;
+		VkDeviceSize mEvictedBytes = 0;
+		VkDeviceSize mMinEffectiveBudget = ~VkDeviceSize(0);
+};
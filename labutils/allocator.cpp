@@ -3,6 +3,7 @@
 #include <utility>
 
 #include <cassert>
+#include <cstdint>
 
 #include "error.hpp"
 #include "to_string.hpp"
@@ -50,6 +51,9 @@ namespace labutils
 		allocInfo.device            = aContext.device;
 		allocInfo.instance          = aContext.instance;
 		allocInfo.pVulkanFunctions  = &functions;
+
+		if( aContext.haveMemoryBudget )
+			allocInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
 		
 		VmaAllocator allocator = VK_NULL_HANDLE;
 		if( auto const res = vmaCreateAllocator( &allocInfo, &allocator ); VK_SUCCESS != res )
@@ -63,3 +67,26 @@ namespace labutils
 	}
 }
 
+namespace labutils
+{
+	MemoryBudget query_device_local_budget( Allocator const& aAllocator )
+	{
+		VkPhysicalDeviceMemoryProperties const* memProps = nullptr;
+		vmaGetMemoryProperties( aAllocator.allocator, &memProps );
+
+		VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+		vmaGetHeapBudgets( aAllocator.allocator, budgets );
+
+		MemoryBudget ret;
+		for( std::uint32_t i = 0; i < memProps->memoryHeapCount; ++i )
+		{
+			if( !(VK_MEMORY_HEAP_DEVICE_LOCAL_BIT & memProps->memoryHeaps[i].flags) )
+				continue;
+
+			ret.usage += budgets[i].usage;
+			ret.budget += budgets[i].budget;
+		}
+
+		return ret;
+	}
+}
@@ -29,4 +29,18 @@ namespace labutils
 	};
 
 	Allocator create_allocator( VulkanContext const& );
+
+	// Device memory used by the process, and the amount it can use without
+	// hurting performance (or failing), summed over the DEVICE_LOCAL heaps.
+	// With VK_EXT_memory_budget (VulkanContext::haveMemoryBudget) both come
+	// from the driver and include other allocations of the process; VMA
+	// refreshes them in vmaSetCurrentFrameIndex(). Otherwise the usage is
+	// what VMA allocated and the budget is an estimate (80% of the heaps).
+	struct MemoryBudget
+	{
+		VkDeviceSize usage = 0;
+		VkDeviceSize budget = 0;
+	};
+
+	MemoryBudget query_device_local_budget( Allocator const& );
 }
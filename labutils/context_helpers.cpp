@@ -167,4 +167,29 @@ namespace labutils::detail
 
 		return ret;
 	}
+
+	std::optional<std::uint32_t> find_dedicated_transfer_queue_family( VkPhysicalDevice aPhysicalDev )
+	{
+		std::uint32_t numQueues = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties( aPhysicalDev, &numQueues, nullptr );
+
+		std::vector<VkQueueFamilyProperties> families( numQueues );
+		vkGetPhysicalDeviceQueueFamilyProperties( aPhysicalDev, &numQueues, families.data() );
+
+		std::optional<std::uint32_t> ret;
+		for( std::uint32_t i = 0; i < numQueues; ++i )
+		{
+			auto const flags = families[i].queueFlags;
+			if( !(VK_QUEUE_TRANSFER_BIT & flags) || (VK_QUEUE_GRAPHICS_BIT & flags) )
+				continue;
+
+			if( !(VK_QUEUE_COMPUTE_BIT & flags) )
+				return i;
+
+			if( !ret )
+				ret = i;
+		}
+
+		return ret;
+	}
 }
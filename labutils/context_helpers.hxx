@@ -9,8 +9,11 @@
 
 #include <string>
 #include <vector>
+#include <optional>
 #include <unordered_set>
 
+#include <cstdint>
+
 namespace labutils
 {
 	namespace detail
@@ -30,5 +33,9 @@ namespace labutils
 
 
 		std::unordered_set<std::string> get_device_extensions( VkPhysicalDevice );
+
+		// Finds a queue family that supports TRANSFER but not GRAPHICS,
+		// preferring families without COMPUTE (i.e., pure copy engines)
+		std::optional<std::uint32_t> find_dedicated_transfer_queue_family( VkPhysicalDevice );
 	}
 }
@@ -0,0 +1,204 @@
+#include "parallel_recorder.hpp"
+
+#include <chrono>
+#include <algorithm>
+
+#include <cstdio>
+#include <cassert>
+
+#include "error.hpp"
+#include "vkutil.hpp"
+#include "profiler.hpp"
+#include "to_string.hpp"
+
+namespace labutils
+{
+	ParallelRecorder::ParallelRecorder(VulkanContext const& aContext, std::uint32_t aFramesInFlight, unsigned aMaxThreads)
+		: mContext(&aContext)
+		, mMaxThreads(aMaxThreads ? aMaxThreads : std::max(1u, std::thread::hardware_concurrency()))
+		, mThreads(mMaxThreads)
+		, mTimings(mMaxThreads)
+	{
+		for (std::uint32_t frame = 0; frame < aFramesInFlight; ++frame)
+		{
+			mPools.emplace_back();
+			mBuffers.emplace_back();
+
+			for (unsigned i = 0; i < mMaxThreads; ++i)
+			{
+				mPools.back().emplace_back(create_command_pool(aContext, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT));
+				mBuffers.back().emplace_back(alloc_command_buffer(aContext, mPools.back().back().handle, VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+			}
+		}
+
+		// The calling thread records the first range
+		for (unsigned i = 1; i < mMaxThreads; ++i)
+			mWorkers.emplace_back([this, i] { worker_(i); });
+	}
+
+	ParallelRecorder::~ParallelRecorder()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStop = true;
+		}
+
+		mStartCv.notify_all();
+		for (auto& worker : mWorkers)
+			worker.join();
+	}
+
+	unsigned ParallelRecorder::max_threads() const noexcept
+	{
+		return mMaxThreads;
+	}
+
+	unsigned ParallelRecorder::threads() const noexcept
+	{
+		return mThreads;
+	}
+
+	void ParallelRecorder::set_threads(unsigned aThreads)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mThreads = std::clamp(aThreads, 1u, mMaxThreads);
+	}
+
+	std::vector<VkCommandBuffer> const& ParallelRecorder::record(std::uint32_t aFrame, VkRenderPass aRenderPass, std::uint32_t aSubpass, VkFramebuffer aFramebuffer, std::uint32_t aDrawCount, RecordFn const& aRecord)
+	{
+		LUT_PROFILE_ZONE("ParallelRecorder::record");
+
+		assert(aFrame < mPools.size());
+		auto const startTime = std::chrono::steady_clock::now();
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+
+			mFrame = aFrame;
+			mInheritance = VkCommandBufferInheritanceInfo{};
+			mInheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			mInheritance.renderPass = aRenderPass;
+			mInheritance.subpass = aSubpass;
+			mInheritance.framebuffer = aFramebuffer;
+			mDrawCount = aDrawCount;
+			mRecord = &aRecord;
+
+			mError = nullptr;
+			mPending = mThreads - 1;
+			++mGeneration;
+		}
+
+		mStartCv.notify_all();
+
+		std::exception_ptr error;
+		try
+		{
+			record_range_(0);
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mDoneCv.wait(lock, [this] { return 0 == mPending; });
+
+			if (!error)
+				error = mError;
+			mRecord = nullptr;
+		}
+
+		if (error)
+			std::rethrow_exception(error);
+
+		auto& timing = mTimings[mThreads - 1];
+		++timing.frames;
+		timing.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+		mRecorded.assign(mBuffers[aFrame].begin(), mBuffers[aFrame].begin() + mThreads);
+		return mRecorded;
+	}
+
+	void ParallelRecorder::report() const
+	{
+		std::printf("Command recording (up to %u threads):\n", mMaxThreads);
+		for (std::size_t i = 0; i < mTimings.size(); ++i)
+		{
+			if (mTimings[i].frames)
+				std::printf("  %zu thread(s): %.3f ms/frame over %zu frames\n", i + 1, mTimings[i].seconds * 1000.0 / mTimings[i].frames, mTimings[i].frames);
+		}
+	}
+
+	void ParallelRecorder::record_range_(unsigned aThread)
+	{
+		LUT_PROFILE_ZONE("record draws");
+
+		if (auto const res = vkResetCommandPool(mContext->device, mPools[mFrame][aThread].handle, 0); VK_SUCCESS != res)
+		{
+			throw Error("Unable to reset recording command pool\n"
+				"vkResetCommandPool() returned %s", to_string(res).c_str());
+		}
+
+		auto const cbuff = mBuffers[mFrame][aThread];
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		beginInfo.pInheritanceInfo = &mInheritance;
+
+		if (auto const res = vkBeginCommandBuffer(cbuff, &beginInfo); VK_SUCCESS != res)
+		{
+			throw Error("Unable to begin recording secondary command buffer\n"
+				"vkBeginCommandBuffer() returned %s", to_string(res).c_str());
+		}
+
+		// Contiguous ranges keep the draw order across the command buffers
+		auto const begin = std::uint32_t(std::uint64_t(mDrawCount) * aThread / mThreads);
+		auto const end = std::uint32_t(std::uint64_t(mDrawCount) * (aThread + 1) / mThreads);
+		(*mRecord)(cbuff, begin, end);
+
+		if (auto const res = vkEndCommandBuffer(cbuff); VK_SUCCESS != res)
+		{
+			throw Error("Unable to end recording secondary command buffer\n"
+				"vkEndCommandBuffer() returned %s", to_string(res).c_str());
+		}
+	}
+
+	void ParallelRecorder::worker_(unsigned aThread)
+	{
+		profiler_set_thread_name("command recorder");
+
+		std::uint64_t generation = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mStartCv.wait(lock, [&] { return mStop || mGeneration != generation; });
+				if (mStop)
+					return;
+
+				generation = mGeneration;
+				if (aThread >= mThreads)
+					continue;
+			}
+
+			std::exception_ptr error;
+			try
+			{
+				record_range_(aThread);
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (error && !mError)
+				mError = error;
+
+			if (0 == --mPending)
+				mDoneCv.notify_one();
+		}
+	}
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkobject.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Records the draws of a frame in parallel. The draw list is split into
+	// contiguous ranges, one per thread; each range is recorded into a
+	// secondary command buffer that continues the caller's render pass. The
+	// calling thread records the first range itself, worker threads the
+	// others. Executing the returned command buffers in order keeps the draw
+	// order.
+	//
+	// Every thread has its own command pool per frame in flight, which it
+	// resets before recording. The caller must therefore only record frame n
+	// once the GPU is done with the previous commands of frame n (i.e., after
+	// waiting on the frame's fence).
+	//
+	// Secondary command buffers don't inherit state: the callback has to bind
+	// pipelines, descriptor sets and geometry itself.
+	class ParallelRecorder
+	{
+		public:
+			// Records draws [aBegin, aEnd) into aCmdBuff. Called concurrently
+			// from several threads.
+			using RecordFn = std::function<void ( VkCommandBuffer aCmdBuff, std::uint32_t aBegin, std::uint32_t aEnd )>;
+
+		public:
+			// aMaxThreads = 0 uses one thread per hardware thread
+			ParallelRecorder( VulkanContext const&, std::uint32_t aFramesInFlight, unsigned aMaxThreads = 0 );
+			~ParallelRecorder();
+
+			ParallelRecorder( ParallelRecorder const& ) = delete;
+			ParallelRecorder& operator= (ParallelRecorder const&) = delete;
+
+		public:
+			unsigned max_threads() const noexcept;
+
+			// Threads used by record(), 1 to max_threads()
+			unsigned threads() const noexcept;
+			void set_threads( unsigned );
+
+			// Records aDrawCount draws of frame aFrame. Returns one secondary
+			// command buffer per thread, in draw order, for vkCmdExecuteCommands()
+			// in subpass aSubpass of a render pass instance begun with
+			// VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. An exception thrown
+			// by aRecord on any thread is rethrown here.
+			std::vector<VkCommandBuffer> const& record( std::uint32_t aFrame, VkRenderPass, std::uint32_t aSubpass, VkFramebuffer, std::uint32_t aDrawCount, RecordFn const& aRecord );
+
+			// Prints the average recording time per frame for each thread
+			// count that was used
+			void report() const;
+
+		private:
+			void record_range_( unsigned aThread );
+			void worker_( unsigned aThread );
+
+		private:
+			struct Timing_
+			{
+				std::size_t frames = 0;
+				double seconds = 0.0;
+			};
+
+			VulkanContext const* mContext;
+			unsigned mMaxThreads;
+			unsigned mThreads;
+
+			// Indexed by frame, then by thread
+			std::vector<std::vector<CommandPool>> mPools;
+			std::vector<std::vector<VkCommandBuffer>> mBuffers;
+			std::vector<VkCommandBuffer> mRecorded;
+
+			std::vector<Timing_> mTimings; // indexed by thread count - 1
+
+			// Current job; written by record() before the workers are woken
+			std::uint32_t mFrame = 0;
+			VkCommandBufferInheritanceInfo mInheritance{};
+			std::uint32_t mDrawCount = 0;
+			RecordFn const* mRecord = nullptr;
+
+			std::mutex mMutex;
+			std::condition_variable mStartCv, mDoneCv;
+			std::uint64_t mGeneration = 0;
+			unsigned mPending = 0;
+			bool mStop = false;
+			std::exception_ptr mError;
+
+			std::vector<std::thread> mWorkers;
+	};
+}
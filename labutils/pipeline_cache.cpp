@@ -0,0 +1,225 @@
+#include "pipeline_cache.hpp"
+
+#include <vector>
+#include <utility>
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include "error.hpp"
+#include "profiler.hpp"
+#include "to_string.hpp"
+
+namespace
+{
+	// Written in front of the Vulkan cache data. The driver version is not
+	// part of the Vulkan header, but caches are generally not portable
+	// between driver versions.
+	struct FileHeader_
+	{
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t driverVersion;
+		std::uint64_t coldMicroseconds;
+		std::uint64_t coldPipelines;
+		std::uint64_t dataSize;
+	};
+
+	constexpr char kFileMagic_[8] = { 'L', 'U', 'T', 'P', 'C', 'A', 'C', 'H' };
+	constexpr std::uint32_t kFileVersion_ = 1;
+
+	// Layout of VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+	constexpr std::size_t kVulkanHeaderSize_ = 16 + VK_UUID_SIZE;
+
+	std::uint32_t read_u32_(std::uint8_t const* aData)
+	{
+		std::uint32_t ret;
+		std::memcpy(&ret, aData, sizeof(ret));
+		return ret;
+	}
+
+	// Returns nullptr if the data is valid for the device, otherwise the
+	// reason. The file format has been checked already.
+	char const* validate_(FileHeader_ const& aHeader, std::vector<std::uint8_t> const& aData, VkPhysicalDeviceProperties const& aProps)
+	{
+		if (aHeader.driverVersion != aProps.driverVersion)
+			return "driver version changed";
+		if (aData.size() < kVulkanHeaderSize_)
+			return "truncated header";
+
+		if (read_u32_(aData.data()) < kVulkanHeaderSize_)
+			return "invalid header length";
+		if (VK_PIPELINE_CACHE_HEADER_VERSION_ONE != read_u32_(aData.data() + 4))
+			return "unsupported header version";
+		if (aProps.vendorID != read_u32_(aData.data() + 8))
+			return "vendor ID mismatch";
+		if (aProps.deviceID != read_u32_(aData.data() + 12))
+			return "device ID mismatch";
+		if (0 != std::memcmp(aData.data() + 16, aProps.pipelineCacheUUID, VK_UUID_SIZE))
+			return "pipeline cache UUID mismatch";
+
+		return nullptr;
+	}
+}
+
+namespace labutils
+{
+	PipelineCache::PipelineCache(VulkanContext const& aContext, std::string aPath)
+		: mContext(&aContext)
+		, mPath(std::move(aPath))
+	{
+		LUT_PROFILE_ZONE("load pipeline cache");
+
+		VkPhysicalDeviceProperties props;
+		vkGetPhysicalDeviceProperties(aContext.physicalDevice, &props);
+
+		std::vector<std::uint8_t> data;
+		if (std::FILE* fin = std::fopen(mPath.c_str(), "rb"))
+		{
+			FileHeader_ header{};
+			char const* problem = "truncated file";
+
+			if (1 == std::fread(&header, sizeof(header), 1, fin))
+			{
+				// The data size can only be trusted once the header is known
+				// to be ours, and it must match the rest of the file
+				long const dataStart = std::ftell(fin);
+				long fileEnd = -1;
+				if (dataStart >= 0 && 0 == std::fseek(fin, 0, SEEK_END))
+				{
+					fileEnd = std::ftell(fin);
+					if (0 != std::fseek(fin, dataStart, SEEK_SET))
+						fileEnd = -1;
+				}
+
+				if (0 != std::memcmp(header.magic, kFileMagic_, sizeof(kFileMagic_)) || kFileVersion_ != header.version)
+				{
+					problem = "unknown file format";
+				}
+				else if (fileEnd >= dataStart && std::uint64_t(fileEnd - dataStart) == header.dataSize)
+				{
+					data.resize(std::size_t(header.dataSize));
+					if (data.size() == std::fread(data.data(), 1, data.size(), fin))
+						problem = validate_(header, data, props);
+				}
+			}
+
+			std::fclose(fin);
+
+			if (problem)
+			{
+				std::fprintf(stderr, "Ignoring pipeline cache '%s': %s\n", mPath.c_str(), problem);
+				data.clear();
+			}
+			else
+			{
+				mLoaded = true;
+				mColdSeconds = header.coldMicroseconds * 1e-6;
+				mColdPipelines = std::size_t(header.coldPipelines);
+			}
+		}
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cacheInfo.initialDataSize = data.size();
+		cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+		VkPipelineCache cache = VK_NULL_HANDLE;
+		if (auto const res = vkCreatePipelineCache(aContext.device, &cacheInfo, nullptr, &cache); VK_SUCCESS != res)
+		{
+			throw Error("Unable to create pipeline cache\n"
+				"vkCreatePipelineCache() returned %s", to_string(res).c_str()
+			);
+		}
+
+		mCache = decltype(mCache)(aContext.device, cache);
+
+		if (mLoaded)
+			std::fprintf(stderr, "Loaded pipeline cache '%s' (%zu bytes)\n", mPath.c_str(), data.size());
+	}
+
+	VkPipelineCache PipelineCache::handle() const noexcept
+	{
+		return mCache.handle;
+	}
+
+	bool PipelineCache::loaded() const noexcept
+	{
+		return mLoaded;
+	}
+
+	void PipelineCache::add_creation_time(double aSeconds, std::size_t aPipelines)
+	{
+		mSeconds += aSeconds;
+		mPipelines += aPipelines;
+	}
+
+	bool PipelineCache::save() const
+	{
+		LUT_PROFILE_ZONE("save pipeline cache");
+
+		std::size_t size = 0;
+		if (auto const res = vkGetPipelineCacheData(mContext->device, mCache.handle, &size, nullptr); VK_SUCCESS != res)
+		{
+			std::fprintf(stderr, "Unable to save pipeline cache: vkGetPipelineCacheData() returned %s\n", to_string(res).c_str());
+			return false;
+		}
+
+		std::vector<std::uint8_t> data(size);
+		if (auto const res = vkGetPipelineCacheData(mContext->device, mCache.handle, &size, data.data()); VK_SUCCESS != res)
+		{
+			std::fprintf(stderr, "Unable to save pipeline cache: vkGetPipelineCacheData() returned %s\n", to_string(res).c_str());
+			return false;
+		}
+		data.resize(size);
+
+		VkPhysicalDeviceProperties props;
+		vkGetPhysicalDeviceProperties(mContext->physicalDevice, &props);
+
+		// Keep the reference times of the run that started from scratch
+		FileHeader_ header{};
+		std::memcpy(header.magic, kFileMagic_, sizeof(kFileMagic_));
+		header.version = kFileVersion_;
+		header.driverVersion = props.driverVersion;
+		header.coldMicroseconds = std::uint64_t((mLoaded ? mColdSeconds : mSeconds) * 1e6);
+		header.coldPipelines = mLoaded ? mColdPipelines : mPipelines;
+		header.dataSize = data.size();
+
+		// Write to a temporary file first, so that an interrupted write does
+		// not leave a truncated cache behind
+		auto const tempPath = mPath + ".tmp";
+		std::FILE* fout = std::fopen(tempPath.c_str(), "wb");
+		if (!fout)
+		{
+			std::fprintf(stderr, "Unable to save pipeline cache: can't open '%s' for writing\n", tempPath.c_str());
+			return false;
+		}
+
+		bool const ok = 1 == std::fwrite(&header, sizeof(header), 1, fout)
+			&& data.size() == std::fwrite(data.data(), 1, data.size(), fout);
+		bool const closed = 0 == std::fclose(fout);
+
+		std::remove(mPath.c_str());
+		if (!ok || !closed || 0 != std::rename(tempPath.c_str(), mPath.c_str()))
+		{
+			std::fprintf(stderr, "Unable to save pipeline cache to '%s'\n", mPath.c_str());
+			std::remove(tempPath.c_str());
+			return false;
+		}
+
+		std::fprintf(stderr, "Saved pipeline cache '%s' (%zu bytes)\n", mPath.c_str(), data.size());
+		return true;
+	}
+
+	void PipelineCache::report() const
+	{
+		std::printf("Pipelines: %zu created in %.1f ms (%s)\n", mPipelines, mSeconds * 1000.0, mLoaded ? "cache loaded from disk" : "no cache on disk");
+
+		if (mLoaded && mColdPipelines)
+		{
+			double const coldSeconds = mColdSeconds / mColdPipelines * mPipelines;
+			std::printf("  vs. %.1f ms without cache => %.1f ms saved\n", coldSeconds * 1000.0, (coldSeconds - mSeconds) * 1000.0);
+		}
+	}
+}
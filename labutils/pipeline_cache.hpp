@@ -0,0 +1,62 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <string>
+
+#include <cstddef>
+
+#include "vkobject.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// A VkPipelineCache that persists across runs. The constructor loads the
+	// cache from aPath if the file was written for the same device and
+	// driver: the Vulkan cache header must match the vendor ID, device ID
+	// and pipeline cache UUID, and the driver version stored next to it must
+	// match too. Otherwise (or if the file is missing) the cache starts out
+	// empty. save() writes the cache back.
+	//
+	// Pipeline creation times reported through add_creation_time() are
+	// compared against those of the run that created the cache from
+	// scratch, which are stored in the file as well; see report().
+	class PipelineCache
+	{
+		public:
+			PipelineCache( VulkanContext const&, std::string aPath );
+
+			PipelineCache( PipelineCache const& ) = delete;
+			PipelineCache& operator= (PipelineCache const&) = delete;
+
+		public:
+			VkPipelineCache handle() const noexcept;
+
+			// True if a valid cache was loaded from disk
+			bool loaded() const noexcept;
+
+			void add_creation_time( double aSeconds, std::size_t aPipelines = 1 );
+
+			// Writes the cache to disk. Failure is reported on stderr but is
+			// not an error, as the cache is only an optimization.
+			bool save() const;
+
+			// Prints the pipeline creation time and, for a cache loaded from
+			// disk, the estimated time saved
+			void report() const;
+
+		private:
+			VulkanContext const* mContext;
+			std::string mPath;
+
+			UniqueHandle< VkPipelineCache, VkDevice, vkDestroyPipelineCache > mCache;
+			bool mLoaded = false;
+
+			double mSeconds = 0.0;
+			std::size_t mPipelines = 0;
+
+			// Creation time without a cache, from the run that created it
+			double mColdSeconds = 0.0;
+			std::size_t mColdPipelines = 0;
+	};
+}
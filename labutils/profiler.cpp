@@ -0,0 +1,202 @@
+#include "profiler.hpp"
+
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <cstdio>
+
+namespace
+{
+	struct Zone_
+	{
+		char const* name;
+		std::uint64_t begin, end; // nanoseconds since the profiler epoch
+	};
+
+	struct ThreadRing_
+	{
+		std::uint32_t tid;
+		std::atomic<char const*> name{ nullptr };
+
+		// Number of zones recorded so far. The first `kept` zones are never
+		// overwritten; the others rotate through the rest of the ring (see
+		// slot_()).
+		std::atomic<std::uint64_t> count{ 0 };
+		std::atomic<std::uint64_t> kept{ 0 };
+		std::unique_ptr<Zone_[]> zones;
+	};
+
+	using Clock_ = std::chrono::steady_clock;
+
+	Clock_::time_point const kEpoch_ = Clock_::now();
+
+	std::atomic<bool> gEnabled_{ true };
+
+	std::mutex gRingsMutex_;
+	std::vector<std::unique_ptr<ThreadRing_>> gRings_;
+
+	thread_local ThreadRing_* tRing_ = nullptr;
+
+	std::uint64_t now_ns_() noexcept
+	{
+		return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock_::now() - kEpoch_).count());
+	}
+
+	std::uint64_t slot_(std::uint64_t aIndex, std::uint64_t aKept) noexcept
+	{
+		return aIndex < aKept ? aIndex : aKept + (aIndex - aKept) % (labutils::kProfilerZonesPerThread - aKept);
+	}
+
+	ThreadRing_& thread_ring_()
+	{
+		if (!tRing_)
+		{
+			auto ring = std::make_unique<ThreadRing_>();
+			ring->zones = std::make_unique<Zone_[]>(labutils::kProfilerZonesPerThread);
+
+			std::lock_guard<std::mutex> lock(gRingsMutex_);
+			ring->tid = std::uint32_t(gRings_.size());
+			tRing_ = ring.get();
+			gRings_.emplace_back(std::move(ring));
+		}
+
+		return *tRing_;
+	}
+
+	void write_json_string_(std::FILE* aOut, char const* aString)
+	{
+		std::fputc('"', aOut);
+		for (char const* c = aString; *c; ++c)
+		{
+			if ('"' == *c || '\\' == *c)
+				std::fputc('\\', aOut);
+
+			if (std::uint8_t(*c) < 0x20)
+				std::fprintf(aOut, "\\u%04x", unsigned(*c));
+			else
+				std::fputc(*c, aOut);
+		}
+		std::fputc('"', aOut);
+	}
+}
+
+namespace labutils
+{
+	ProfileScope::ProfileScope(char const* aName) noexcept
+		: mName(aName)
+		, mBegin(now_ns_())
+	{}
+
+	ProfileScope::~ProfileScope()
+	{
+		if (!gEnabled_.load(std::memory_order_relaxed))
+			return;
+
+		auto const end = now_ns_();
+
+		auto& ring = thread_ring_();
+		auto const index = ring.count.load(std::memory_order_relaxed);
+		ring.zones[slot_(index, ring.kept.load(std::memory_order_relaxed))] = Zone_{ mName, mBegin, end };
+		ring.count.store(index + 1, std::memory_order_release);
+	}
+
+	void profiler_keep_thread_zones()
+	{
+		auto& ring = thread_ring_();
+		if (ring.kept.load(std::memory_order_relaxed))
+			return;
+
+		// Move the newest zones (at most half of the ring) to the front, in
+		// recording order. Only this thread writes to the ring.
+		auto const count = ring.count.load(std::memory_order_relaxed);
+		auto const keep = std::min<std::uint64_t>(count, kProfilerZonesPerThread / 2);
+
+		std::vector<Zone_> zones;
+		for (auto i = count - keep; i < count; ++i)
+			zones.emplace_back(ring.zones[slot_(i, 0)]);
+
+		for (std::size_t i = 0; i < zones.size(); ++i)
+			ring.zones[i] = zones[i];
+
+		ring.kept.store(keep, std::memory_order_release);
+		ring.count.store(keep, std::memory_order_release);
+	}
+
+	void profiler_set_thread_name(char const* aName)
+	{
+		thread_ring_().name.store(aName, std::memory_order_release);
+	}
+
+	void profiler_enable(bool aEnabled)
+	{
+		gEnabled_.store(aEnabled, std::memory_order_relaxed);
+	}
+
+	bool profiler_write_chrome_trace(char const* aPath)
+	{
+		std::FILE* fout = std::fopen(aPath, "w");
+		if (!fout)
+		{
+			std::fprintf(stderr, "Unable to write trace '%s'\n", aPath);
+			return false;
+		}
+
+		std::size_t zones = 0;
+		std::fprintf(fout, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+		{
+			std::lock_guard<std::mutex> lock(gRingsMutex_);
+
+			bool first = true;
+			for (auto const& ring : gRings_)
+			{
+				if (char const* name = ring->name.load(std::memory_order_acquire))
+				{
+					std::fprintf(fout, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", ring->tid);
+					write_json_string_(fout, name);
+					std::fprintf(fout, "}}");
+					first = false;
+				}
+
+				auto const count = ring->count.load(std::memory_order_acquire);
+				auto const kept = std::min(ring->kept.load(std::memory_order_acquire), count);
+
+				// Kept zones, then the ones that haven't been overwritten
+				auto const rotating = kProfilerZonesPerThread - kept;
+				auto const oldest = count - kept > rotating ? count - rotating : kept;
+
+				auto const write_zone_ = [&](std::uint64_t aIndex)
+				{
+					auto const& zone = ring->zones[slot_(aIndex, kept)];
+
+					std::fprintf(fout, "%s{\"ph\":\"X\",\"name\":", first ? "" : ",\n");
+					write_json_string_(fout, zone.name);
+					std::fprintf(fout, ",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", ring->tid, zone.begin / 1000.0, (zone.end - zone.begin) / 1000.0);
+					first = false;
+				};
+
+				for (std::uint64_t i = 0; i < kept; ++i)
+					write_zone_(i);
+				for (auto i = oldest; i < count; ++i)
+					write_zone_(i);
+
+				zones += std::size_t(kept + count - oldest);
+			}
+		}
+
+		std::fprintf(fout, "\n]}\n");
+
+		if (0 != std::fclose(fout))
+		{
+			std::fprintf(stderr, "Unable to write trace '%s'\n", aPath);
+			return false;
+		}
+
+		std::fprintf(stderr, "Wrote %zu zones to '%s'\n", zones, aPath);
+		return true;
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace labutils
+{
+	// Completed zones kept per thread; older zones are overwritten
+	constexpr std::size_t kProfilerZonesPerThread = 64*1024;
+
+	// Lightweight CPU zone profiler. Each thread records completed zones into
+	// its own fixed-size ring buffer, which is allocated the first time the
+	// thread records a zone (or names itself). Recording a zone afterwards
+	// neither locks nor allocates.
+	//
+	// Zone and thread names are not copied; they must outlive the profiler
+	// (string literals, typically).
+	//
+	// Rings are kept after their thread exits, so that zones of worker
+	// threads remain available for export.
+	class ProfileScope
+	{
+		public:
+			explicit ProfileScope( char const* aName ) noexcept;
+			~ProfileScope();
+
+			ProfileScope( ProfileScope const& ) = delete;
+			ProfileScope& operator= (ProfileScope const&) = delete;
+
+		private:
+			char const* mName;
+			std::uint64_t mBegin;
+	};
+
+	// Names the calling thread in exported traces
+	void profiler_set_thread_name( char const* );
+
+	// Keeps the zones that the calling thread has recorded so far (the newest
+	// half of its ring, at most) from being overwritten; later zones rotate
+	// through the rest of the ring. Typically called once at the end of
+	// startup, so that the startup timeline survives a long run. Further
+	// calls have no effect.
+	void profiler_keep_thread_zones();
+
+	// Enables or disables recording (enabled by default)
+	void profiler_enable( bool );
+
+	// Writes all recorded zones as Chrome trace JSON (chrome://tracing,
+	// https://ui.perfetto.dev). Threads may keep recording while this runs;
+	// zones that are overwritten during the export may come out garbled, so
+	// prefer exporting at a quiet point. Returns false if the file can't be
+	// written.
+	bool profiler_write_chrome_trace( char const* aPath );
+}
+
+#define LUT_PROFILE_CAT_2_( a, b ) a##b
+#define LUT_PROFILE_CAT_( a, b ) LUT_PROFILE_CAT_2_( a, b )
+
+// Records a zone from here to the end of the enclosing scope
+#define LUT_PROFILE_ZONE( name ) ::labutils::ProfileScope LUT_PROFILE_CAT_( lutProfileZone_, __LINE__ )( name )
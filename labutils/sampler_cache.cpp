@@ -0,0 +1,64 @@
+#include "sampler_cache.hpp"
+
+#include <utility>
+
+#include "error.hpp"
+#include "vkutil.hpp"
+
+namespace
+{
+	bool same_sampler_(VkSamplerCreateInfo const& aX, VkSamplerCreateInfo const& aY)
+	{
+		return aX.flags == aY.flags
+			&& aX.magFilter == aY.magFilter
+			&& aX.minFilter == aY.minFilter
+			&& aX.mipmapMode == aY.mipmapMode
+			&& aX.addressModeU == aY.addressModeU
+			&& aX.addressModeV == aY.addressModeV
+			&& aX.addressModeW == aY.addressModeW
+			&& aX.mipLodBias == aY.mipLodBias
+			&& aX.anisotropyEnable == aY.anisotropyEnable
+			&& aX.maxAnisotropy == aY.maxAnisotropy
+			&& aX.compareEnable == aY.compareEnable
+			&& aX.compareOp == aY.compareOp
+			&& aX.minLod == aY.minLod
+			&& aX.maxLod == aY.maxLod
+			&& aX.borderColor == aY.borderColor
+			&& aX.unnormalizedCoordinates == aY.unnormalizedCoordinates;
+	}
+}
+
+namespace labutils
+{
+	SamplerCache::SamplerCache(VulkanContext const& aContext)
+		: mContext(&aContext)
+	{}
+
+	VkSampler SamplerCache::get(VkSamplerCreateInfo const& aInfo)
+	{
+		if (aInfo.pNext)
+			throw Error("SamplerCache: sampler create infos with a pNext chain are not supported");
+
+		++mRequests;
+
+		for (auto const& entry : mEntries)
+		{
+			if (same_sampler_(entry.info, aInfo))
+				return entry.sampler.handle;
+		}
+
+		Entry_ entry{ aInfo, create_sampler(*mContext, aInfo) };
+		mEntries.emplace_back(std::move(entry));
+		return mEntries.back().sampler.handle;
+	}
+
+	std::size_t SamplerCache::size() const noexcept
+	{
+		return mEntries.size();
+	}
+
+	std::size_t SamplerCache::requests() const noexcept
+	{
+		return mRequests;
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <volk/volk.h>
+
+#include <vector>
+
+#include <cstddef>
+
+#include "vkobject.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Samplers keyed by their create info: requests with the same sampler
+	// state share one VkSampler. Only a handful of distinct samplers are
+	// expected, so lookups are linear. Create infos with a pNext chain are
+	// not supported.
+	class SamplerCache
+	{
+		public:
+			explicit SamplerCache( VulkanContext const& );
+
+			SamplerCache( SamplerCache const& ) = delete;
+			SamplerCache& operator= (SamplerCache const&) = delete;
+
+		public:
+			// Returns the sampler for aInfo, creating it on first use. The
+			// sampler lives as long as the cache.
+			VkSampler get( VkSamplerCreateInfo const& aInfo );
+
+			std::size_t size() const noexcept;
+			std::size_t requests() const noexcept;
+
+		private:
+			struct Entry_
+			{
+				VkSamplerCreateInfo info;
+				Sampler sampler;
+			};
+
+			VulkanContext const* mContext;
+			std::vector<Entry_> mEntries;
+			std::size_t mRequests = 0;
+	};
+}
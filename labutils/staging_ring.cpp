@@ -0,0 +1,85 @@
+#include "staging_ring.hpp"
+
+#include <cassert>
+
+#include "error.hpp"
+#include "to_string.hpp"
+
+namespace labutils
+{
+	StagingRing::StagingRing(Allocator const& aAllocator, VkDeviceSize aSize)
+		: mAllocator(&aAllocator)
+		, mBuffer(create_buffer(aAllocator, aSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU))
+		, mSize(aSize)
+	{
+		void* ptr = nullptr;
+		if (auto const res = vmaMapMemory(aAllocator.allocator, mBuffer.allocation, &ptr); VK_SUCCESS != res)
+		{
+			throw Error("Mapping memory for writing\n"
+				"vmaMapMemory() returned %s", to_string(res).c_str());
+		}
+
+		mMapped = static_cast<std::byte*>(ptr);
+	}
+
+	StagingRing::~StagingRing()
+	{
+		if (mMapped)
+			vmaUnmapMemory(mAllocator->allocator, mBuffer.allocation);
+	}
+
+	bool StagingRing::allocate(VkDeviceSize aSize, VkDeviceSize aAlignment, StagingRegion& aRegion)
+	{
+		assert(aAlignment && 0 == (aAlignment & (aAlignment-1)));
+
+		if (aSize > mSize)
+			return false;
+
+		std::uint64_t pos = (mHead + aAlignment-1) & ~std::uint64_t(aAlignment-1);
+
+		// Regions are contiguous; skip the end of the buffer if it is too short
+		if (pos % mSize + aSize > mSize)
+			pos = (pos / mSize + 1) * mSize;
+
+		if (pos + aSize - mTail > mSize)
+			return false;
+
+		mHead = pos + aSize;
+
+		aRegion.buffer = mBuffer.buffer;
+		aRegion.offset = pos % mSize;
+		aRegion.size = aSize;
+		aRegion.data = mMapped + aRegion.offset;
+		return true;
+	}
+
+	void StagingRing::flush(StagingRegion const& aRegion)
+	{
+		if (auto const res = vmaFlushAllocation(mAllocator->allocator, mBuffer.allocation, aRegion.offset, aRegion.size); VK_SUCCESS != res)
+		{
+			throw Error("Flushing staging memory\n"
+				"vmaFlushAllocation() returned %s", to_string(res).c_str());
+		}
+	}
+
+	std::uint64_t StagingRing::head() const noexcept
+	{
+		return mHead;
+	}
+
+	void StagingRing::release(std::uint64_t aHead) noexcept
+	{
+		assert(aHead <= mHead);
+		if (aHead > mTail)
+			mTail = aHead;
+	}
+
+	VkDeviceSize StagingRing::capacity() const noexcept
+	{
+		return mSize;
+	}
+	VkDeviceSize StagingRing::used() const noexcept
+	{
+		return mHead - mTail;
+	}
+}
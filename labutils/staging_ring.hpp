@@ -0,0 +1,75 @@
+#pragma once
+
+#include <volk/volk.h>
+#include <vk_mem_alloc.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkbuffer.hpp"
+#include "allocator.hpp"
+
+namespace labutils
+{
+	constexpr VkDeviceSize kDefaultStagingRingBytes = 128*1024*1024;
+
+	// A sub-allocation of a StagingRing
+	struct StagingRegion
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		void* data = nullptr; // mapped pointer to the region
+	};
+
+	// A single persistently mapped CPU_TO_GPU buffer that is handed out in
+	// FIFO order. Regions are allocated at the head of the ring and released
+	// from its tail, in the order in which they were allocated.
+	//
+	// The ring does not know when the GPU is done with a region. Callers
+	// remember head() when submitting work that reads from the ring and pass
+	// it to release() once that work has completed (e.g., when its fence has
+	// been signalled). See UploadBatch.
+	//
+	// The ring is not thread safe.
+	class StagingRing
+	{
+		public:
+			explicit StagingRing( Allocator const&, VkDeviceSize aSize = kDefaultStagingRingBytes );
+			~StagingRing();
+
+			StagingRing( StagingRing const& ) = delete;
+			StagingRing& operator= (StagingRing const&) = delete;
+
+		public:
+			// Allocates aSize bytes at the given alignment (a power of two).
+			// Returns false if the ring does not currently have space; the
+			// caller must then release regions before trying again. Requests
+			// larger than capacity() never succeed.
+			bool allocate( VkDeviceSize aSize, VkDeviceSize aAlignment, StagingRegion& aRegion );
+
+			// Makes the data written to aRegion visible to the device (no-op
+			// for host-coherent memory)
+			void flush( StagingRegion const& aRegion );
+
+			// Position just past the last allocation. Positions increase
+			// monotonically and are only meaningful for release().
+			std::uint64_t head() const noexcept;
+
+			// Releases all regions allocated before aHead
+			void release( std::uint64_t aHead ) noexcept;
+
+			VkDeviceSize capacity() const noexcept;
+			VkDeviceSize used() const noexcept;
+
+		private:
+			Allocator const* mAllocator;
+
+			Buffer mBuffer;
+			std::byte* mMapped = nullptr;
+			VkDeviceSize mSize;
+
+			std::uint64_t mHead = 0;
+			std::uint64_t mTail = 0;
+	};
+}
@@ -0,0 +1,459 @@
+#include "upload_batch.hpp"
+
+#include <limits>
+#include <utility>
+
+#include <cassert>
+#include <cstring> // for std::memcpy()
+
+#include "error.hpp"
+#include "vkutil.hpp"
+#include "profiler.hpp"
+#include "to_string.hpp"
+
+namespace
+{
+	// Alignment of staged data; covers the texel size of all formats used
+	constexpr VkDeviceSize kStagingAlignment = 16;
+
+	double seconds_since_(std::chrono::steady_clock::time_point aStart)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - aStart).count();
+	}
+
+	VkCommandBuffer begin_command_buffer_(labutils::VulkanContext const& aContext, VkCommandPool aPool)
+	{
+		VkCommandBuffer cbuff = labutils::alloc_command_buffer(aContext, aPool);
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if (auto const res = vkBeginCommandBuffer(cbuff, &beginInfo); VK_SUCCESS != res)
+		{
+			throw labutils::Error("Beginning command buffer recording\n"
+				"vkBeginCommandBuffer() returned %s", labutils::to_string(res).c_str());
+		}
+
+		return cbuff;
+	}
+
+	void end_command_buffer_(VkCommandBuffer aCmdBuff)
+	{
+		if (auto const res = vkEndCommandBuffer(aCmdBuff); VK_SUCCESS != res)
+		{
+			throw labutils::Error("Ending command buffer recording\n"
+				"vkEndCommandBuffer() returned %s", labutils::to_string(res).c_str());
+		}
+	}
+}
+
+namespace labutils
+{
+	UploadBatch::UploadBatch(VulkanContext const& aContext, Allocator const& aAllocator, VkDeviceSize aSubmitBytes, VkDeviceSize aPendingBytes, VkDeviceSize aRingBytes)
+		: mContext(&aContext)
+		, mAllocator(&aAllocator)
+		, mSubmitBytes(aSubmitBytes)
+		, mPendingBytes(aPendingBytes)
+		, mTransferQueue(aContext.transferFamilyIndex != aContext.graphicsFamilyIndex)
+		, mPool(create_command_pool(aContext, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, aContext.transferFamilyIndex))
+		, mRing(aAllocator, aRingBytes)
+	{
+		if (mTransferQueue)
+			mAcquirePool = create_command_pool(aContext, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, aContext.graphicsFamilyIndex);
+	}
+
+	UploadBatch::~UploadBatch()
+	{
+		// Staging buffers must outlive the commands that read them
+		for (auto& sub : mSubmitted)
+			vkWaitForFences(mContext->device, 1, &sub.fence.handle, VK_TRUE, std::numeric_limits<std::uint64_t>::max());
+	}
+
+	void UploadBatch::upload_buffer(VkBuffer aDst, void const* aData, VkDeviceSize aSize, VkAccessFlags aDstAccess, VkPipelineStageFlags aDstStage, VkDeviceSize aDstOffset)
+	{
+		if (0 == aSize)
+			return;
+
+		auto const staging = stage_(aData, aSize);
+		auto cbuff = record_();
+
+		VkBufferCopy copy{};
+		copy.srcOffset = staging.offset;
+		copy.dstOffset = aDstOffset;
+		copy.size = aSize;
+		vkCmdCopyBuffer(cbuff, staging.buffer, aDst, 1, &copy);
+
+		if (mTransferQueue)
+		{
+			// Release on the transfer queue, acquire on the graphics queue
+			auto const srcFamily = mContext->transferFamilyIndex;
+			auto const dstFamily = mContext->graphicsFamilyIndex;
+
+			buffer_barrier(cbuff,
+				aDst,
+				VK_ACCESS_TRANSFER_WRITE_BIT,
+				0,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+				aSize,
+				aDstOffset,
+				srcFamily,
+				dstFamily
+			);
+			buffer_barrier(acquire_(),
+				aDst,
+				0,
+				aDstAccess,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				aDstStage,
+				aSize,
+				aDstOffset,
+				srcFamily,
+				dstFamily
+			);
+		}
+		else
+		{
+			buffer_barrier(cbuff,
+				aDst,
+				VK_ACCESS_TRANSFER_WRITE_BIT,
+				aDstAccess,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				aDstStage,
+				aSize,
+				aDstOffset
+			);
+		}
+
+		mCurrent.bytes += aSize;
+
+		++mStats.bufferUploads;
+		mStats.bytes += aSize;
+
+		end_upload_();
+	}
+
+	void UploadBatch::upload_texture2d(Image const& aImage, void const* aData, std::uint32_t aWidth, std::uint32_t aHeight)
+	{
+		auto const size = VkDeviceSize(aWidth) * aHeight * 4;
+
+		auto const staging = stage_(aData, size);
+		record_texture2d_(aImage, staging, aWidth, aHeight);
+
+		end_upload_();
+	}
+
+	bool UploadBatch::upload_texture2d_deferred(Image const& aImage, std::uint32_t aWidth, std::uint32_t aHeight, StagingRegion& aRegion)
+	{
+		auto const size = VkDeviceSize(aWidth) * aHeight * 4;
+		if (size > mRing.capacity() / 4)
+			return false;
+
+		// Submit a full command buffer now rather than after recording:
+		// submitting waits for the region's data, which the caller only
+		// writes once we return.
+		end_upload_();
+
+		aRegion = stage_(nullptr, size);
+		record_texture2d_(aImage, aRegion, aWidth, aHeight);
+
+		std::lock_guard<std::mutex> lock(mWriteMutex);
+		++mOpenWrites;
+
+		return true;
+	}
+
+	void UploadBatch::finish_write(StagingRegion const& aRegion)
+	{
+		auto const finish_ = [this] {
+			std::lock_guard<std::mutex> lock(mWriteMutex);
+			assert(mOpenWrites > 0);
+			if (0 == --mOpenWrites)
+				mWriteCv.notify_all();
+		};
+
+		// Finish even if flushing fails, so that submit() doesn't wait forever
+		try
+		{
+			mRing.flush(aRegion);
+		}
+		catch (...)
+		{
+			finish_();
+			throw;
+		}
+
+		finish_();
+	}
+
+	void UploadBatch::submit()
+	{
+		if (VK_NULL_HANDLE == mCurrent.cbuff)
+			return;
+
+		// Deferred writes must be complete before the GPU reads them
+		{
+			std::unique_lock<std::mutex> lock(mWriteMutex);
+			mWriteCv.wait(lock, [this] { return 0 == mOpenWrites; });
+		}
+
+		end_command_buffer_(mCurrent.cbuff);
+		if (VK_NULL_HANDLE != mCurrent.acquire)
+			end_command_buffer_(mCurrent.acquire);
+
+		mCurrent.fence = create_fence(*mContext);
+		mCurrent.ringHead = mRing.head();
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &mCurrent.cbuff;
+
+		if (VK_NULL_HANDLE == mCurrent.acquire)
+		{
+			if (auto const res = vkQueueSubmit(mContext->transferQueue, 1, &submitInfo, mCurrent.fence.handle); VK_SUCCESS != res)
+			{
+				throw Error("Submitting commands\n"
+					"vkQueueSubmit() returned %s", to_string(res).c_str());
+			}
+		}
+		else
+		{
+			// Uploads on the transfer queue; acquisition (and mipmaps) on the
+			// graphics queue once they are done. The fence of the latter
+			// covers both.
+			mCurrent.uploaded = create_semaphore(*mContext);
+
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores = &mCurrent.uploaded.handle;
+
+			if (auto const res = vkQueueSubmit(mContext->transferQueue, 1, &submitInfo, VK_NULL_HANDLE); VK_SUCCESS != res)
+			{
+				throw Error("Submitting commands\n"
+					"vkQueueSubmit() returned %s", to_string(res).c_str());
+			}
+
+			VkPipelineStageFlags const waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+			VkSubmitInfo acquireInfo{};
+			acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			acquireInfo.waitSemaphoreCount = 1;
+			acquireInfo.pWaitSemaphores = &mCurrent.uploaded.handle;
+			acquireInfo.pWaitDstStageMask = &waitStage;
+			acquireInfo.commandBufferCount = 1;
+			acquireInfo.pCommandBuffers = &mCurrent.acquire;
+
+			if (auto const res = vkQueueSubmit(mContext->graphicsQueue, 1, &acquireInfo, mCurrent.fence.handle); VK_SUCCESS != res)
+			{
+				throw Error("Submitting commands\n"
+					"vkQueueSubmit() returned %s", to_string(res).c_str());
+			}
+		}
+
+		++mStats.submits;
+		mSubmittedBytes += mCurrent.bytes;
+		mSubmitted.emplace_back(std::move(mCurrent));
+		mCurrent = Submission_{};
+	}
+
+	VkDeviceSize UploadBatch::retire(bool aWait)
+	{
+		auto const before = mSubmittedBytes;
+
+		if (aWait && !mSubmitted.empty())
+		{
+			++mStats.stalls;
+			wait_(1);
+		}
+
+		// Release everything that has completed, in submission order
+		std::size_t done = 0;
+		while (done < mSubmitted.size() && VK_SUCCESS == vkGetFenceStatus(mContext->device, mSubmitted[done].fence.handle))
+			++done;
+
+		wait_(done);
+
+		return before - mSubmittedBytes;
+	}
+
+	void UploadBatch::flush()
+	{
+		LUT_PROFILE_ZONE("UploadBatch::flush");
+
+		submit();
+		wait_(mSubmitted.size());
+
+		if (mActive)
+		{
+			mStats.activeSeconds += seconds_since_(mActiveStart);
+			mActive = false;
+		}
+	}
+
+	bool UploadBatch::has_recorded() const noexcept
+	{
+		return VK_NULL_HANDLE != mCurrent.cbuff;
+	}
+	bool UploadBatch::has_pending() const noexcept
+	{
+		return !mSubmitted.empty();
+	}
+
+	VkDeviceSize UploadBatch::staged_bytes() const noexcept
+	{
+		return mCurrent.bytes + mSubmittedBytes;
+	}
+
+	std::size_t UploadBatch::completed_submits() const noexcept
+	{
+		return mStats.submits - mSubmitted.size();
+	}
+
+	UploadStats const& UploadBatch::stats() const noexcept
+	{
+		return mStats;
+	}
+
+	StagingRegion UploadBatch::stage_(void const* aData, VkDeviceSize aSize)
+	{
+		if (!mActive)
+		{
+			mActive = true;
+			mActiveStart = std::chrono::steady_clock::now();
+		}
+
+		// Stay within the pending limit; a single oversized upload is allowed
+		// once nothing else is staged.
+		if (staged_bytes() > 0 && staged_bytes() + aSize > mPendingBytes)
+		{
+			submit();
+			while (!mSubmitted.empty() && staged_bytes() + aSize > mPendingBytes)
+				retire(true);
+		}
+
+		// Note: no submission may happen between staging and recording the
+		// copy, as the ring space is released per submission.
+		StagingRegion region;
+		if (aSize <= mRing.capacity() / 4)
+		{
+			while (!mRing.allocate(aSize, kStagingAlignment, region))
+			{
+				submit();
+				if (mSubmitted.empty())
+					throw Error("UploadBatch: staging ring exhausted (%llu bytes requested)", static_cast<unsigned long long>(aSize));
+
+				retire(true);
+			}
+
+			// Without data, the caller writes the region later
+			if (aData)
+			{
+				std::memcpy(region.data, aData, aSize);
+				mRing.flush(region);
+			}
+			return region;
+		}
+
+		// Oversized: use a dedicated staging buffer
+		assert(aData);
+		auto staging = create_buffer(*mAllocator, aSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+		void* ptr = nullptr;
+		if (auto const res = vmaMapMemory(mAllocator->allocator, staging.allocation, &ptr); VK_SUCCESS != res)
+		{
+			throw Error("Mapping memory for writing\n"
+				"vmaMapMemory() returned %s", to_string(res).c_str());
+		}
+
+		std::memcpy(ptr, aData, aSize);
+		vmaUnmapMemory(mAllocator->allocator, staging.allocation);
+
+		region.buffer = staging.buffer;
+		region.size = aSize;
+
+		mCurrent.staging.emplace_back(std::move(staging));
+		++mStats.dedicatedStaging;
+
+		return region;
+	}
+
+	void UploadBatch::record_texture2d_(Image const& aImage, StagingRegion const& aStaging, std::uint32_t aWidth, std::uint32_t aHeight)
+	{
+		auto const size = VkDeviceSize(aWidth) * aHeight * 4;
+		auto cbuff = record_();
+
+		if (mTransferQueue)
+		{
+			auto const srcFamily = mContext->transferFamilyIndex;
+			auto const dstFamily = mContext->graphicsFamilyIndex;
+
+			record_texture_copy2d(cbuff, aStaging.buffer, aStaging.offset, aImage.image, aWidth, aHeight, srcFamily, dstFamily);
+			record_texture_mipmaps2d(acquire_(), aImage.image, aWidth, aHeight, srcFamily, dstFamily);
+		}
+		else
+		{
+			record_texture_upload2d(cbuff, aStaging.buffer, aStaging.offset, aImage.image, aWidth, aHeight);
+		}
+
+		mCurrent.bytes += size;
+
+		++mStats.imageUploads;
+		mStats.bytes += size;
+	}
+
+	VkCommandBuffer UploadBatch::record_()
+	{
+		if (VK_NULL_HANDLE == mCurrent.cbuff)
+			mCurrent.cbuff = begin_command_buffer_(*mContext, mPool.handle);
+
+		return mCurrent.cbuff;
+	}
+
+	VkCommandBuffer UploadBatch::acquire_()
+	{
+		assert(mTransferQueue);
+
+		if (VK_NULL_HANDLE == mCurrent.acquire)
+			mCurrent.acquire = begin_command_buffer_(*mContext, mAcquirePool.handle);
+
+		return mCurrent.acquire;
+	}
+
+	void UploadBatch::end_upload_()
+	{
+		if (mCurrent.bytes >= mSubmitBytes)
+			submit();
+	}
+
+	void UploadBatch::wait_(std::size_t aCount)
+	{
+		if (0 == aCount)
+			return;
+
+		// Waiting for the last of the submissions suffices, as the fences of
+		// a single queue signal in submission order.
+		auto const waitStart = std::chrono::steady_clock::now();
+
+		auto& last = mSubmitted[aCount-1];
+		if (auto const res = vkWaitForFences(mContext->device, 1, &last.fence.handle, VK_TRUE, std::numeric_limits<std::uint64_t>::max()); VK_SUCCESS != res)
+		{
+			throw Error("Waiting for upload to complete\n"
+				"vkWaitForFences() returned %s", to_string(res).c_str());
+		}
+
+		mStats.waitSeconds += seconds_since_(waitStart);
+
+		// Release the command buffers and staging memory
+		for (std::size_t i = 0; i < aCount; ++i)
+		{
+			auto& sub = mSubmitted.front();
+			vkFreeCommandBuffers(mContext->device, mPool.handle, 1, &sub.cbuff);
+			if (VK_NULL_HANDLE != sub.acquire)
+				vkFreeCommandBuffers(mContext->device, mAcquirePool.handle, 1, &sub.acquire);
+			mRing.release(sub.ringHead);
+			mSubmittedBytes -= sub.bytes;
+			mSubmitted.pop_front();
+		}
+	}
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <volk/volk.h>
+#include <vk_mem_alloc.h>
+
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <condition_variable>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vkimage.hpp"
+#include "vkbuffer.hpp"
+#include "vkobject.hpp"
+#include "allocator.hpp"
+#include "staging_ring.hpp"
+#include "vulkan_context.hpp"
+
+namespace labutils
+{
+	// Limits of an UploadBatch
+	constexpr VkDeviceSize kDefaultUploadSubmitBytes = 32*1024*1024;   // per command buffer
+	constexpr VkDeviceSize kDefaultUploadPendingBytes = 256*1024*1024; // staged, not yet released
+
+	// Statistics of an UploadBatch
+	struct UploadStats
+	{
+		std::size_t bufferUploads = 0;
+		std::size_t imageUploads = 0;
+		std::uint64_t bytes = 0;
+
+		std::size_t dedicatedStaging = 0; // uploads too large for the staging ring
+
+		std::size_t submits = 0;
+		std::size_t stalls = 0; // waits forced by the limits (or retire(true))
+
+		double waitSeconds = 0.0;   // time spent waiting for the GPU, including flush()
+		double activeSeconds = 0.0; // from the first upload to the end of the last flush()
+	};
+
+	// Collects uploads (buffer copies, image copies and mipmap generation)
+	// into a few large command buffers. Each command buffer is submitted
+	// with a single fence once it holds kDefaultUploadSubmitBytes of data, or
+	// when submit() is called; submission does not wait.
+	//
+	// Data is staged in a StagingRing owned by the batch; only uploads larger
+	// than a quarter of the ring get a dedicated staging buffer. Staging
+	// memory is released in one step by flush(), which waits for all
+	// submitted work. If the ring is full or the staged data exceeds the
+	// pending limit before that, the batch stalls until the oldest
+	// submissions have completed.
+	//
+	// Uploads are made visible to the given access/stage with a barrier.
+	// If the context has a dedicated transfer queue, copies run there and
+	// ownership of the destinations is transferred to the graphics queue
+	// family. The acquiring barriers (and the mipmap blits, which need a
+	// GRAPHICS queue) are recorded into a second command buffer that is
+	// submitted to the graphics queue, waiting on a semaphore. Otherwise
+	// everything is recorded into a single command buffer for the graphics
+	// queue.
+	//
+	// Texture data may instead be written to the staging ring by another
+	// thread; see upload_texture2d_deferred(). Apart from finish_write(), the
+	// batch is not thread safe. The destructor waits for outstanding work
+	// but does not report errors; call flush() explicitly.
+	class UploadBatch
+	{
+		public:
+			explicit UploadBatch( VulkanContext const&, Allocator const&, VkDeviceSize aSubmitBytes = kDefaultUploadSubmitBytes, VkDeviceSize aPendingBytes = kDefaultUploadPendingBytes, VkDeviceSize aRingBytes = kDefaultStagingRingBytes );
+			~UploadBatch();
+
+			UploadBatch( UploadBatch const& ) = delete;
+			UploadBatch& operator= (UploadBatch const&) = delete;
+
+		public:
+			void upload_buffer( VkBuffer aDst, void const* aData, VkDeviceSize aSize, VkAccessFlags aDstAccess, VkPipelineStageFlags aDstStage, VkDeviceSize aDstOffset = 0 );
+
+			// Uploads tightly packed RGBA8 data to mip level 0 and generates
+			// the remaining levels; see record_texture_upload2d().
+			void upload_texture2d( Image const&, void const* aData, std::uint32_t aWidth, std::uint32_t aHeight );
+
+			// Like upload_texture2d(), but the data is written later: the
+			// caller copies it to aRegion.data, possibly on another thread,
+			// and then calls finish_write(). Submitting waits until all such
+			// writes are finished, so the writer must not wait for the batch.
+			// Returns false without recording anything if the image is too
+			// large for the staging ring; use upload_texture2d() instead.
+			bool upload_texture2d_deferred( Image const&, std::uint32_t aWidth, std::uint32_t aHeight, StagingRegion& aRegion );
+
+			// Completes a write begun by upload_texture2d_deferred(). May be
+			// called from any thread.
+			void finish_write( StagingRegion const& );
+
+			// Submits the recorded uploads, if any, without waiting
+			void submit();
+
+			// Releases the staging memory of submissions that have completed.
+			// With aWait, waits for at least the oldest one. Returns the number
+			// of bytes released.
+			VkDeviceSize retire( bool aWait = false );
+
+			// Submits and waits for all uploads, then releases all staging
+			// memory at once.
+			void flush();
+
+			bool has_recorded() const noexcept;
+			bool has_pending() const noexcept;
+
+			// Staged bytes: recorded plus submitted but not yet released
+			VkDeviceSize staged_bytes() const noexcept;
+
+			// Number of submissions whose staging memory has been released;
+			// submission n (counting from 1, see UploadStats::submits) has
+			// completed once this is at least n
+			std::size_t completed_submits() const noexcept;
+
+			UploadStats const& stats() const noexcept;
+
+		private:
+			StagingRegion stage_( void const*, VkDeviceSize );
+			void record_texture2d_( Image const&, StagingRegion const&, std::uint32_t aWidth, std::uint32_t aHeight );
+			VkCommandBuffer record_();
+			VkCommandBuffer acquire_();
+			void end_upload_();
+			void wait_( std::size_t aCount );
+
+		private:
+			struct Submission_
+			{
+				VkCommandBuffer cbuff = VK_NULL_HANDLE;   // upload queue
+				VkCommandBuffer acquire = VK_NULL_HANDLE; // graphics queue, if different
+				Semaphore uploaded;
+				Fence fence;
+				std::vector<Buffer> staging; // dedicated staging buffers
+				std::uint64_t ringHead = 0;
+				VkDeviceSize bytes = 0;
+			};
+
+			VulkanContext const* mContext;
+			Allocator const* mAllocator;
+
+			VkDeviceSize mSubmitBytes;
+			VkDeviceSize mPendingBytes;
+
+			bool mTransferQueue; // uploads run on a dedicated transfer queue
+
+			CommandPool mPool;
+			CommandPool mAcquirePool;
+			StagingRing mRing;
+
+			Submission_ mCurrent;
+			std::deque<Submission_> mSubmitted;
+			VkDeviceSize mSubmittedBytes = 0;
+
+			// Deferred writes that have not finished yet
+			std::mutex mWriteMutex;
+			std::condition_variable mWriteCv;
+			std::size_t mOpenWrites = 0;
+
+			UploadStats mStats;
+			bool mActive = false;
+			std::chrono::steady_clock::time_point mActiveStart;
+	};
+}
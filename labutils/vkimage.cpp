@@ -1,9 +1,16 @@
 #include "vkimage.hpp"
 
+#include <mutex>
+#include <memory>
+#include <deque>
+#include <chrono>
 #include <limits>
+#include <thread>
 #include <vector>
 #include <utility>
 #include <algorithm>
+#include <exception>
+#include <condition_variable>
 
 #include <cstdio>
 #include <cassert>
@@ -14,7 +21,9 @@
 #include "error.hpp"
 #include "vkutil.hpp"
 #include "vkbuffer.hpp"
+#include "profiler.hpp"
 #include "to_string.hpp"
+#include "upload_batch.hpp"
 
 
 
@@ -45,6 +54,22 @@ namespace
 
 		return res;
 	}
+
+	// Tweakables for load_image_textures2d()
+	constexpr VkDeviceSize kMaxStagedBytes = 256*1024*1024; // decoded or staged, not yet uploaded
+
+	using Clock_ = std::chrono::steady_clock;
+
+	struct StbiFree_
+	{
+		void operator()(stbi_uc* aData) const noexcept { stbi_image_free(aData); }
+	};
+	using StbiImage_ = std::unique_ptr<stbi_uc, StbiFree_>;
+
+	double seconds_since_(Clock_::time_point aStart)
+	{
+		return std::chrono::duration<double>(Clock_::now() - aStart).count();
+	}
 }
 
 namespace labutils
@@ -86,6 +111,8 @@ namespace labutils
 {
 	Image load_image_texture2d(char const* aPath, VulkanContext const& aContext, VkCommandPool aCmdPool, Allocator const& aAllocator)
 	{
+		LUT_PROFILE_ZONE("load_image_texture2d");
+
 		//TODO- (Section 4) implement me!
 		stbi_set_flip_vertically_on_load(1);
 
@@ -136,9 +163,54 @@ namespace labutils
 		}
 
 		const auto mipLevels = compute_mip_level_count(baseWidth, baseHeight);
+
+		record_texture_upload2d(cbuff, staging.buffer, 0, ret.image, baseWidth, baseHeight);
+
+		if (const auto res = vkEndCommandBuffer(cbuff);
+			VK_SUCCESS != res)
+		{
+			throw Error("Ending command buffer recording\n"
+				"vkEndCommandBuffer() returned %s", to_string(res).c_str()
+			);
+		}
+
+		Fence uploadComplete = create_fence(aContext);
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &cbuff;
+
+		if (const auto res = vkQueueSubmit(aContext.graphicsQueue, 1, &submitInfo, uploadComplete.handle);
+			VK_SUCCESS != res)
+		{
+			throw Error("Submitting commands\n"
+				"vkQueueSubmit() returned %s", to_string(res).c_str()
+			);
+		}
+
+		if (const auto res = vkWaitForFences(aContext.device, 1, &uploadComplete.handle, VK_TRUE, std::numeric_limits<std::uint64_t>::max()); VK_SUCCESS != res)
+		{
+			throw Error("Waiting for upload to complete\n"
+				"vkWaitForFences() returned %s", to_string(res).c_str()
+			);
+		}
+
+		vkFreeCommandBuffers(aContext.device, aCmdPool, 1, &cbuff);
+
 		ret.maxMipLevel = mipLevels;
+		return ret;
+	}
+
+	void record_texture_upload2d(VkCommandBuffer aCmdBuff, VkBuffer aStaging, VkDeviceSize aOffset, VkImage aImage, std::uint32_t aWidth, std::uint32_t aHeight)
+	{
+		record_texture_copy2d(aCmdBuff, aStaging, aOffset, aImage, aWidth, aHeight);
+		record_texture_mipmaps2d(aCmdBuff, aImage, aWidth, aHeight);
+	}
 
-		image_barrier(cbuff, ret.image,
+	void record_texture_copy2d(VkCommandBuffer aCmdBuff, VkBuffer aStaging, VkDeviceSize aOffset, VkImage aImage, std::uint32_t aWidth, std::uint32_t aHeight, std::uint32_t aSrcQueueFamilyIndex, std::uint32_t aDstQueueFamilyIndex)
+	{
+		image_barrier(aCmdBuff, aImage,
 			0,
 			VK_ACCESS_TRANSFER_WRITE_BIT,
 			VK_IMAGE_LAYOUT_UNDEFINED,
@@ -147,13 +219,13 @@ namespace labutils
 			VK_PIPELINE_STAGE_TRANSFER_BIT,
 			VkImageSubresourceRange{
 				VK_IMAGE_ASPECT_COLOR_BIT,
-				0, mipLevels,
+				0, 1,
 				0, 1
 			}
 		);
 
 		VkBufferImageCopy copy;
-		copy.bufferOffset = 0;
+		copy.bufferOffset = aOffset;
 		copy.bufferRowLength = 0;
 		copy.bufferImageHeight = 0;
 		copy.imageSubresource = VkImageSubresourceLayers{
@@ -162,26 +234,76 @@ namespace labutils
 			0,1
 		};
 		copy.imageOffset = VkOffset3D{ 0,0,0 };
-		copy.imageExtent = VkExtent3D{ baseWidth,baseHeight,1 };
+		copy.imageExtent = VkExtent3D{ aWidth,aHeight,1 };
 
-		vkCmdCopyBufferToImage(cbuff, staging.buffer, ret.image,
+		vkCmdCopyBufferToImage(aCmdBuff, aStaging, aImage,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
 
-		image_barrier(cbuff, ret.image,
+		// Level 0 becomes the source of the mipmap blits. When transferring
+		// ownership, this is the release half; the matching acquire is
+		// recorded by record_texture_mipmaps2d().
+		bool const release = aSrcQueueFamilyIndex != aDstQueueFamilyIndex;
+		image_barrier(aCmdBuff, aImage,
 			VK_ACCESS_TRANSFER_WRITE_BIT,
-			VK_ACCESS_TRANSFER_READ_BIT,
+			release ? 0 : VK_ACCESS_TRANSFER_READ_BIT,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
 			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			release ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT,
 			VkImageSubresourceRange{
 				VK_IMAGE_ASPECT_COLOR_BIT,
 				0, 1,
 				0, 1
-			}
+			},
+			release ? aSrcQueueFamilyIndex : VK_QUEUE_FAMILY_IGNORED,
+			release ? aDstQueueFamilyIndex : VK_QUEUE_FAMILY_IGNORED
 		);
+	}
+
+	void record_texture_mipmaps2d(VkCommandBuffer aCmdBuff, VkImage aImage, std::uint32_t aWidth, std::uint32_t aHeight, std::uint32_t aSrcQueueFamilyIndex, std::uint32_t aDstQueueFamilyIndex)
+	{
+		const auto mipLevels = compute_mip_level_count(aWidth, aHeight);
+
+		// Acquire level 0 from the queue that uploaded it
+		if (aSrcQueueFamilyIndex != aDstQueueFamilyIndex)
+		{
+			image_barrier(aCmdBuff, aImage,
+				0,
+				VK_ACCESS_TRANSFER_READ_BIT,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VkImageSubresourceRange{
+					VK_IMAGE_ASPECT_COLOR_BIT,
+					0, 1,
+					0, 1
+				},
+				aSrcQueueFamilyIndex,
+				aDstQueueFamilyIndex
+			);
+		}
+
+		// The remaining levels are overwritten, so their contents (and hence
+		// their ownership) do not matter
+		if (mipLevels > 1)
+		{
+			image_barrier(aCmdBuff, aImage,
+				0,
+				VK_ACCESS_TRANSFER_WRITE_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VkImageSubresourceRange{
+					VK_IMAGE_ASPECT_COLOR_BIT,
+					1, mipLevels - 1,
+					0, 1
+				}
+			);
+		}
 
-		std::uint32_t width = baseWidth, height = baseHeight;
+		std::uint32_t width = aWidth, height = aHeight;
 
 		for (std::uint32_t level = 1; level < mipLevels; ++level)
 		{
@@ -206,14 +328,14 @@ namespace labutils
 			blit.dstOffsets[0] = { 0,0,0 };
 			blit.dstOffsets[1] = { std::int32_t(width),std::int32_t(height),1 };
 
-			vkCmdBlitImage(cbuff,
-				ret.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				ret.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			vkCmdBlitImage(aCmdBuff,
+				aImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				aImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 				1, &blit,
 				VK_FILTER_LINEAR
 			);
 
-			image_barrier(cbuff, ret.image,
+			image_barrier(aCmdBuff, aImage,
 				VK_ACCESS_TRANSFER_WRITE_BIT,
 				VK_ACCESS_TRANSFER_READ_BIT,
 				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
@@ -228,7 +350,7 @@ namespace labutils
 			);
 		}
 
-		image_barrier(cbuff, ret.image,
+		image_barrier(aCmdBuff, aImage,
 			VK_ACCESS_TRANSFER_READ_BIT,
 			VK_ACCESS_SHADER_READ_BIT,
 			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
@@ -241,41 +363,6 @@ namespace labutils
 				0, 1
 			}
 		);
-
-		if (const auto res = vkEndCommandBuffer(cbuff);
-			VK_SUCCESS != res)
-		{
-			throw Error("Ending command buffer recording\n"
-				"vkEndCommandBuffer() returned %s", to_string(res).c_str()
-			);
-		}
-
-		Fence uploadComplete = create_fence(aContext);
-
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &cbuff;
-
-		if (const auto res = vkQueueSubmit(aContext.graphicsQueue, 1, &submitInfo, uploadComplete.handle);
-			VK_SUCCESS != res)
-		{
-			throw Error("Submitting commands\n"
-				"vkQueueSubmit() returned %s", to_string(res).c_str()
-			);
-		}
-
-		if (const auto res = vkWaitForFences(aContext.device, 1, &uploadComplete.handle, VK_TRUE, std::numeric_limits<std::uint64_t>::max()); VK_SUCCESS != res)
-		{
-			throw Error("Waiting for upload to complete\n"
-				"vkWaitForFences() returned %s", to_string(res).c_str()
-			);
-		}
-
-		vkFreeCommandBuffers(aContext.device, aCmdPool, 1, &cbuff);
-
-		ret.maxMipLevel = mipLevels;
-		return ret;
 	}
 
 	Image create_image_texture2d(Allocator const& aAllocator, std::uint32_t aWidth, std::uint32_t aHeight, VkFormat aFormat, VkImageUsageFlags aUsage)
@@ -321,3 +408,351 @@ namespace labutils
 		return 32 - leadingZeros;
 	}
 }
+
+namespace labutils
+{
+	std::vector<Image> load_image_textures2d(std::vector<std::string> const& aPaths, UploadBatch& aBatch, Allocator const& aAllocator, unsigned aThreads, TextureLoadStats* aStats)
+	{
+		LUT_PROFILE_ZONE("load_image_textures2d");
+
+		auto const startTime = Clock_::now();
+		auto const batchStart = aBatch.stats();
+
+		TextureLoadStats stats;
+		stats.textures = aPaths.size();
+		stats.threads = aThreads ? aThreads : std::max(1u, std::thread::hardware_concurrency());
+		stats.threads = std::min<unsigned>(stats.threads, unsigned(std::max<std::size_t>(aPaths.size(), 1)));
+
+		// Note: the flag is global in stb_image; set it before the workers start
+		stbi_set_flip_vertically_on_load(1);
+
+		// A decoded texture, waiting for the calling thread to create its
+		// image and to record its upload
+		struct Decoded_
+		{
+			std::size_t index;
+			std::uint32_t width, height;
+			StbiImage_ data;
+		};
+
+		// A decoded texture whose upload has been recorded, waiting to be
+		// copied into its region of the batch's staging ring
+		struct Copy_
+		{
+			StagingRegion region;
+			StbiImage_ data;
+		};
+
+		// Shared between the decoder threads and the calling thread. Data is
+		// either decoded (and not yet copied to the staging ring) or staged
+		// by the batch; the calling thread mirrors the latter into batchBytes.
+		std::mutex mutex;
+		std::condition_variable readyCv, decoderCv;
+		std::deque<Decoded_> ready;
+		std::deque<Copy_> copies;
+		std::size_t nextIndex = 0;
+		VkDeviceSize decodedBytes = 0, batchBytes = aBatch.staged_bytes();
+		bool handedOut = false; // all uploads recorded; no further copies
+		bool abort = false;
+		std::exception_ptr error;
+
+		auto const copy_ = [&] (Copy_ aCopy) {
+			auto const copyStart = Clock_::now();
+			{
+				LUT_PROFILE_ZONE("stage texture");
+				std::memcpy(aCopy.region.data, aCopy.data.get(), aCopy.region.size);
+			}
+			aCopy.data.reset();
+			aBatch.finish_write(aCopy.region);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			decodedBytes -= aCopy.region.size;
+			stats.stageSeconds += seconds_since_(copyStart);
+			decoderCv.notify_all();
+		};
+
+		auto const fail_ = [&] {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!error)
+				error = std::current_exception();
+
+			abort = true;
+			readyCv.notify_all();
+			decoderCv.notify_all();
+		};
+
+		auto const decode_ = [&] {
+			try
+			{
+				double decodeTime = 0.0;
+				for (;;)
+				{
+					// Copies come first, as the batch may be waiting for them
+					Copy_ copy;
+					std::size_t i = 0;
+					{
+						std::unique_lock<std::mutex> lock(mutex);
+						decoderCv.wait(lock, [&] {
+							return abort || !copies.empty() || nextIndex < aPaths.size() || handedOut;
+						});
+
+						if (abort)
+							break;
+
+						if (!copies.empty())
+						{
+							copy = std::move(copies.front());
+							copies.pop_front();
+						}
+						else if (nextIndex < aPaths.size())
+							i = nextIndex++;
+						else
+							break;
+					}
+
+					if (copy.data)
+					{
+						copy_(std::move(copy));
+						continue;
+					}
+
+					auto const decodeStart = Clock_::now();
+
+					int w, h, channels;
+					StbiImage_ data;
+					{
+						LUT_PROFILE_ZONE("decode texture");
+						data.reset(stbi_load(aPaths[i].c_str(), &w, &h, &channels, 4));
+					}
+					if (!data)
+						throw Error("%s: unable to load texture base image (%s)", aPaths[i].c_str(), stbi_failure_reason());
+
+					decodeTime += seconds_since_(decodeStart);
+
+					auto const sizeInBytes = VkDeviceSize(w) * VkDeviceSize(h) * 4;
+
+					// Wait until enough staging memory has been released,
+					// copying textures meanwhile. A single texture larger
+					// than the limit is allowed through once nothing else is
+					// staged.
+					auto const fits_ = [&] {
+						auto const staged = decodedBytes + batchBytes;
+						return 0 == staged || staged + sizeInBytes <= kMaxStagedBytes;
+					};
+
+					std::unique_lock<std::mutex> lock(mutex);
+					for (;;)
+					{
+						decoderCv.wait(lock, [&] { return abort || !copies.empty() || fits_(); });
+						if (abort || fits_())
+							break;
+
+						auto pending = std::move(copies.front());
+						copies.pop_front();
+
+						lock.unlock();
+						copy_(std::move(pending));
+						lock.lock();
+					}
+
+					if (abort)
+						break;
+
+					decodedBytes += sizeInBytes;
+
+					ready.emplace_back(Decoded_{ i, std::uint32_t(w), std::uint32_t(h), std::move(data) });
+					readyCv.notify_one();
+				}
+
+				std::lock_guard<std::mutex> lock(mutex);
+				stats.decodeSeconds += decodeTime;
+			}
+			catch (...)
+			{
+				fail_();
+			}
+
+			// Uploads recorded before an error still need their data, or
+			// flushing the batch would wait for it forever
+			for (;;)
+			{
+				Copy_ copy;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (copies.empty())
+						break;
+
+					copy = std::move(copies.front());
+					copies.pop_front();
+				}
+
+				try
+				{
+					copy_(std::move(copy));
+				}
+				catch (...)
+				{
+					fail_();
+				}
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (unsigned i = 0; i < stats.threads; ++i)
+		{
+			workers.emplace_back([&] {
+				profiler_set_thread_name("texture decoder");
+				decode_();
+			});
+		}
+
+		std::vector<Image> ret(aPaths.size());
+
+		// Publishes the batch's staged bytes to the decoder threads
+		auto const sync_staged_ = [&] {
+			std::lock_guard<std::mutex> lock(mutex);
+			batchBytes = aBatch.staged_bytes();
+			decoderCv.notify_all();
+		};
+
+		auto const shutdown_ = [&] {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				abort = true;
+				readyCv.notify_all();
+				decoderCv.notify_all();
+			}
+
+			for (auto& worker : workers)
+			{
+				if (worker.joinable())
+					worker.join();
+			}
+		};
+
+		// Error handling: the batch may hold commands that refer to the images
+		// created here; complete them before the images are destroyed.
+		auto const abandon_ = [&] {
+			try
+			{
+				aBatch.flush();
+			}
+			catch (...)
+			{}
+		};
+
+		try
+		{
+			for (std::size_t recorded = 0; recorded < aPaths.size(); )
+			{
+				Decoded_ item;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					if (error)
+						break;
+
+					// Nothing decoded yet: hand the recorded work to the GPU,
+					// or release staging memory, before blocking
+					if (ready.empty() && (aBatch.has_recorded() || aBatch.has_pending()))
+					{
+						lock.unlock();
+
+						if (aBatch.has_recorded())
+							aBatch.submit();
+						else
+							aBatch.retire(true);
+
+						sync_staged_();
+						continue;
+					}
+
+					readyCv.wait(lock, [&] { return error || !ready.empty(); });
+					if (error)
+						break;
+
+					item = std::move(ready.front());
+					ready.pop_front();
+				}
+
+				auto const recordStart = Clock_::now();
+
+				auto const bytes = VkDeviceSize(item.width) * item.height * 4;
+
+				auto& image = ret[item.index];
+				image = create_image_texture2d(aAllocator, item.width, item.height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+				image.maxMipLevel = compute_mip_level_count(item.width, item.height);
+
+				// A decoder thread copies the data into the staging region
+				// reserved by the batch. Only images too large for the
+				// staging ring are copied here.
+				StagingRegion region;
+				if (aBatch.upload_texture2d_deferred(image, item.width, item.height, region))
+				{
+					Copy_ copy{ region, std::move(item.data) };
+
+					std::unique_lock<std::mutex> lock(mutex);
+					if (!abort)
+					{
+						copies.emplace_back(std::move(copy));
+						decoderCv.notify_one();
+					}
+					else
+					{
+						// The decoder threads may have exited already
+						lock.unlock();
+						copy_(std::move(copy));
+					}
+				}
+				else
+				{
+					aBatch.upload_texture2d(image, item.data.get(), item.width, item.height);
+					item.data.reset();
+
+					std::lock_guard<std::mutex> lock(mutex);
+					decodedBytes -= bytes;
+				}
+				sync_staged_();
+
+				stats.bytes += bytes;
+				++recorded;
+
+				stats.recordSeconds += seconds_since_(recordStart);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				handedOut = true;
+				decoderCv.notify_all();
+			}
+
+			if (!error)
+				aBatch.flush();
+		}
+		catch (...)
+		{
+			shutdown_();
+			abandon_();
+			throw;
+		}
+
+		shutdown_();
+
+		if (error)
+		{
+			abandon_();
+			std::rethrow_exception(error);
+		}
+
+		auto const& batchEnd = aBatch.stats();
+		stats.batches = batchEnd.submits - batchStart.submits;
+		stats.stalls = batchEnd.stalls - batchStart.stalls;
+		stats.dedicatedStaging = batchEnd.dedicatedStaging - batchStart.dedicatedStaging;
+		stats.waitSeconds = batchEnd.waitSeconds - batchStart.waitSeconds;
+
+		stats.totalSeconds = seconds_since_(startTime);
+		if (aStats)
+			*aStats = stats;
+
+		return ret;
+	}
+}
@@ -3,14 +3,20 @@
 #include <volk/volk.h>
 #include <vk_mem_alloc.h>
 
+#include <string>
+#include <vector>
 #include <utility>
 
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 
 #include "allocator.hpp"
 
 namespace labutils
 {
+	class UploadBatch;
+
 	class Image
 	{
 		public:
@@ -35,6 +41,53 @@ namespace labutils
 
 	Image load_image_texture2d( char const* aPath, VulkanContext const&, VkCommandPool, Allocator const& );
 
+	// Statistics of load_image_textures2d()
+	struct TextureLoadStats
+	{
+		std::size_t textures = 0;
+		std::size_t batches = 0;  // command buffers submitted
+		std::size_t stalls = 0;   // waits for the GPU forced by the staging limits
+		std::size_t dedicatedStaging = 0; // too large for the staging ring
+		std::uint64_t bytes = 0;  // decoded RGBA8 data uploaded
+
+		unsigned threads = 0;     // decoder threads
+
+		double decodeSeconds = 0.0; // summed over decoder threads
+		double stageSeconds = 0.0;  // copying into the staging ring, summed over threads
+		double recordSeconds = 0.0; // main thread: image creation + recording
+		double waitSeconds = 0.0;   // main thread: waiting for the GPU
+		double totalSeconds = 0.0;
+	};
+
+	// Loads several textures at once. Images are decoded on aThreads worker
+	// threads (0 = one per hardware thread). The calling thread creates the
+	// images and records the copies and mipmap generation into aBatch, which
+	// submits them without waiting; the worker threads then copy the decoded
+	// data into the staging memory that aBatch reserved for each upload.
+	// Decoding, staging and GPU work therefore overlap. The amount of decoded
+	// and staged memory in use is bounded.
+	//
+	// Returns one image per path, in the same order, in layout
+	// SHADER_READ_ONLY_OPTIMAL. aBatch is flushed before returning, so all
+	// uploads are complete on return.
+	std::vector<Image> load_image_textures2d( std::vector<std::string> const& aPaths, UploadBatch& aBatch, Allocator const&, unsigned aThreads = 0, TextureLoadStats* = nullptr );
+
+	// Records the upload of a tightly packed RGBA8 image at aOffset in
+	// aStaging to mip level 0 of aImage, the generation of the remaining
+	// mip levels by blitting, and the transition of the whole image to
+	// SHADER_READ_ONLY_OPTIMAL. The image must have been created with the
+	// full mip chain and TRANSFER_SRC/TRANSFER_DST usage.
+	void record_texture_upload2d( VkCommandBuffer, VkBuffer aStaging, VkDeviceSize aOffset, VkImage, std::uint32_t aWidth, std::uint32_t aHeight );
+
+	// The two halves of record_texture_upload2d(), for uploads on a queue
+	// that cannot blit (e.g., a dedicated TRANSFER queue). The copy leaves
+	// mip level 0 in TRANSFER_SRC_OPTIMAL; if the queue families differ, it
+	// releases level 0 to aDstQueueFamilyIndex, and the mipmap generation
+	// (recorded on a GRAPHICS queue of that family) acquires it first.
+	// Submissions must be ordered, e.g., with a semaphore.
+	void record_texture_copy2d( VkCommandBuffer, VkBuffer aStaging, VkDeviceSize aOffset, VkImage, std::uint32_t aWidth, std::uint32_t aHeight, std::uint32_t aSrcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED, std::uint32_t aDstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED );
+	void record_texture_mipmaps2d( VkCommandBuffer, VkImage, std::uint32_t aWidth, std::uint32_t aHeight, std::uint32_t aSrcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED, std::uint32_t aDstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED );
+
 	Image create_image_texture2d( Allocator const&, std::uint32_t aWidth, std::uint32_t aHeight, VkFormat, VkImageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT );
 
 	std::uint32_t compute_mip_level_count( std::uint32_t aWidth, std::uint32_t aHeight );
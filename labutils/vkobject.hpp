@@ -93,6 +93,7 @@ namespace labutils
 
 	using DescriptorPool = UniqueHandle< VkDescriptorPool, VkDevice, vkDestroyDescriptorPool >;
 	using DescriptorSetLayout = UniqueHandle< VkDescriptorSetLayout, VkDevice, vkDestroyDescriptorSetLayout >;
+	using DescriptorUpdateTemplate = UniqueHandle< VkDescriptorUpdateTemplate, VkDevice, vkDestroyDescriptorUpdateTemplate >;
 
 	using Pipeline = UniqueHandle< VkPipeline, VkDevice, vkDestroyPipeline >;
 	using PipelineLayout = UniqueHandle< VkPipelineLayout, VkDevice, vkDestroyPipelineLayout >;
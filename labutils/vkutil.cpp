@@ -67,11 +67,16 @@ namespace labutils
 
 
 	CommandPool create_command_pool(VulkanContext const& aContext, VkCommandPoolCreateFlags aFlags)
+	{
+		return create_command_pool(aContext, aFlags, aContext.graphicsFamilyIndex);
+	}
+
+	CommandPool create_command_pool(VulkanContext const& aContext, VkCommandPoolCreateFlags aFlags, std::uint32_t aQueueFamilyIndex)
 	{
 		//Create coomandPool structure
 		VkCommandPoolCreateInfo poolInfo{};
 		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		poolInfo.queueFamilyIndex = aContext.graphicsFamilyIndex;
+		poolInfo.queueFamilyIndex = aQueueFamilyIndex;
 		poolInfo.flags = aFlags;
 		VkCommandPool cpool = VK_NULL_HANDLE;
 		if (auto const res = vkCreateCommandPool(aContext.device, &poolInfo, nullptr, &cpool); VK_SUCCESS != res)
@@ -83,13 +88,13 @@ namespace labutils
 
 	}
 
-	VkCommandBuffer alloc_command_buffer(VulkanContext const& aContext, VkCommandPool aCmdPool)
+	VkCommandBuffer alloc_command_buffer(VulkanContext const& aContext, VkCommandPool aCmdPool, VkCommandBufferLevel aLevel)
 	{
 		//Create command buffer info
 		VkCommandBufferAllocateInfo cbufInfo{};
 		cbufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 		cbufInfo.commandPool = aCmdPool;
-		cbufInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		cbufInfo.level = aLevel;
 		cbufInfo.commandBufferCount = 1;
 
 		//Create command buffer
@@ -241,7 +246,32 @@ namespace labutils
 		return dset;
 	}
 
+	DescriptorUpdateTemplate create_descriptor_update_template(VulkanContext const& aContext, VkDescriptorSetLayout aSetLayout, std::vector<VkDescriptorUpdateTemplateEntry> const& aEntries)
+	{
+		VkDescriptorUpdateTemplateCreateInfo templateInfo{};
+		templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+		templateInfo.descriptorUpdateEntryCount = std::uint32_t(aEntries.size());
+		templateInfo.pDescriptorUpdateEntries = aEntries.data();
+		templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+		templateInfo.descriptorSetLayout = aSetLayout;
+
+		VkDescriptorUpdateTemplate updateTemplate = VK_NULL_HANDLE;
+		if (auto const res = vkCreateDescriptorUpdateTemplate(aContext.device, &templateInfo, nullptr, &updateTemplate); VK_SUCCESS != res)
+		{
+			throw Error("Unable to create descriptor update template\n"
+				"vkCreateDescriptorUpdateTemplate() returned %s", to_string(res).c_str()
+			);
+		}
+
+		return DescriptorUpdateTemplate(aContext.device, updateTemplate);
+	}
+
 	Sampler create_default_sampler(VulkanContext const& aContext)
+	{
+		return create_sampler(aContext, default_sampler_info());
+	}
+
+	VkSamplerCreateInfo default_sampler_info()
 	{
 		VkSamplerCreateInfo samplerInfo{};
 		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -255,9 +285,13 @@ namespace labutils
 		//samplerInfo.maxLod = static_cast<float>(mipLevels);
 		samplerInfo.mipLodBias = 0.f;
 
+		return samplerInfo;
+	}
 
+	Sampler create_sampler(VulkanContext const& aContext, VkSamplerCreateInfo const& aSamplerInfo)
+	{
 		VkSampler sampler = VK_NULL_HANDLE;
-		if (const auto res = vkCreateSampler(aContext.device, &samplerInfo, nullptr, &sampler); VK_SUCCESS != res)
+		if (const auto res = vkCreateSampler(aContext.device, &aSamplerInfo, nullptr, &sampler); VK_SUCCESS != res)
 		{
 			throw Error("Unable to create sampler\n"
 				"vkCreateSampler() returned %s", to_string(res).c_str()
@@ -265,7 +299,6 @@ namespace labutils
 		}
 
 		return Sampler(aContext.device, sampler);
-
 	}
 
 	ImageView create_image_view_texture2d(VulkanContext const& aContext, VkImage aImage, VkFormat aFormat)
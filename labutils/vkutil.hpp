@@ -2,6 +2,8 @@
 
 #include <volk/volk.h>
 
+#include <vector>
+
 #include "vkobject.hpp"
 #include "vulkan_context.hpp"
 
@@ -12,7 +14,8 @@ namespace labutils
 	ShaderModule load_shader_module(VulkanContext const&, char const* aSpirvPath);
 
 	CommandPool create_command_pool(VulkanContext const&, VkCommandPoolCreateFlags = 0);
-	VkCommandBuffer alloc_command_buffer(VulkanContext const&, VkCommandPool);
+	CommandPool create_command_pool(VulkanContext const&, VkCommandPoolCreateFlags, std::uint32_t aQueueFamilyIndex);
+	VkCommandBuffer alloc_command_buffer(VulkanContext const&, VkCommandPool, VkCommandBufferLevel = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 
 	Fence create_fence(VulkanContext const&, VkFenceCreateFlags = 0);
 	Semaphore create_semaphore(VulkanContext const&);
@@ -47,8 +50,17 @@ namespace labutils
 	);
 	DescriptorPool create_descriptor_pool(VulkanContext const&, std::uint32_t aMaxDescriptors = 2048, std::uint32_t aMaxSets = 1024);
 	VkDescriptorSet alloc_desc_set(VulkanContext const&, VkDescriptorPool, VkDescriptorSetLayout);
+
+	// Template for vkUpdateDescriptorSetWithTemplate() on sets of the given
+	// layout; the entries describe where the descriptors are in the data
+	DescriptorUpdateTemplate create_descriptor_update_template(VulkanContext const&, VkDescriptorSetLayout, std::vector<VkDescriptorUpdateTemplateEntry> const&);
+
 	ImageView create_image_view_texture2d(VulkanContext const&, VkImage, VkFormat);
 	Sampler create_default_sampler(VulkanContext const&);
 
+	// Create info of create_default_sampler(), e.g., for a SamplerCache
+	VkSamplerCreateInfo default_sampler_info();
+	Sampler create_sampler(VulkanContext const&, VkSamplerCreateInfo const&);
+
 	Sampler create_anisotrpic_sampler(VulkanContext const&);
 }
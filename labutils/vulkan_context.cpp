@@ -21,7 +21,7 @@ namespace
 
 	VkDevice create_device( 
 		VkPhysicalDevice,
-		std::uint32_t aQueueFamily
+		std::vector<std::uint32_t> const& aQueueFamilies
 	);
 }
 
@@ -51,6 +51,10 @@ namespace labutils
 		, device( std::exchange( aOther.device, VK_NULL_HANDLE ) )
 		, graphicsFamilyIndex( aOther.graphicsFamilyIndex )
 		, graphicsQueue( std::exchange( aOther.graphicsQueue, VK_NULL_HANDLE ) )
+		, transferFamilyIndex( aOther.transferFamilyIndex )
+		, transferQueue( std::exchange( aOther.transferQueue, VK_NULL_HANDLE ) )
+		, haveMemoryBudget( aOther.haveMemoryBudget )
+		, haveDescriptorIndexing( aOther.haveDescriptorIndexing )
 		, debugMessenger( std::exchange( aOther.debugMessenger, VK_NULL_HANDLE ) )
 	{}
 
@@ -72,6 +76,10 @@ namespace labutils
 		std::swap( device, aOther.device );
 		std::swap( graphicsFamilyIndex, aOther.graphicsFamilyIndex );
 		std::swap( graphicsQueue, aOther.graphicsQueue );
+		std::swap( transferFamilyIndex, aOther.transferFamilyIndex );
+		std::swap( transferQueue, aOther.transferQueue );
+		std::swap( haveMemoryBudget, aOther.haveMemoryBudget );
+		std::swap( haveDescriptorIndexing, aOther.haveDescriptorIndexing );
 		std::swap( debugMessenger, aOther.debugMessenger );
 		return *this;
 	}
@@ -149,13 +157,30 @@ namespace labutils
 			throw lut::Error( "No queue family with GRAPHICS" );
 		}
 
-		ret.device = create_device( ret.physicalDevice, ret.graphicsFamilyIndex );
+		std::vector<std::uint32_t> queueFamilyIndices{ ret.graphicsFamilyIndex };
 
-		// Retrieve VkQueue
+		ret.transferFamilyIndex = ret.graphicsFamilyIndex;
+		if( auto const index = lut::detail::find_dedicated_transfer_queue_family( ret.physicalDevice ) )
+		{
+			ret.transferFamilyIndex = *index;
+			queueFamilyIndices.emplace_back( *index );
+		}
+
+		ret.device = create_device( ret.physicalDevice, queueFamilyIndices );
+
+		// Retrieve VkQueues
 		vkGetDeviceQueue( ret.device, ret.graphicsFamilyIndex, 0, &ret.graphicsQueue );
 
 		assert( VK_NULL_HANDLE != ret.graphicsQueue );
 
+		if( ret.transferFamilyIndex != ret.graphicsFamilyIndex )
+		{
+			vkGetDeviceQueue( ret.device, ret.transferFamilyIndex, 0, &ret.transferQueue );
+			std::fprintf( stderr, "Using dedicated transfer queue family %u\n", ret.transferFamilyIndex );
+		}
+		else
+			ret.transferQueue = ret.graphicsQueue;
+
 		// Done
 		return ret;
 	}
@@ -182,15 +207,19 @@ namespace
 		return {};
 	}
 
-	VkDevice create_device( VkPhysicalDevice aPhysicalDev, std::uint32_t aQueueFamily )
+	VkDevice create_device( VkPhysicalDevice aPhysicalDev, std::vector<std::uint32_t> const& aQueueFamilies )
 	{
 		float queuePriorities[1] = { 1.f };
 
-		VkDeviceQueueCreateInfo queueInfo{};
-		queueInfo.sType  = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-		queueInfo.queueFamilyIndex  = aQueueFamily;
-		queueInfo.queueCount        = 1;
-		queueInfo.pQueuePriorities  = queuePriorities;
+		std::vector<VkDeviceQueueCreateInfo> queueInfos( aQueueFamilies.size() );
+		for( std::size_t i = 0; i < aQueueFamilies.size(); ++i )
+		{
+			auto& queueInfo = queueInfos[i];
+			queueInfo.sType  = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+			queueInfo.queueFamilyIndex  = aQueueFamilies[i];
+			queueInfo.queueCount        = 1;
+			queueInfo.pQueuePriorities  = queuePriorities;
+		}
 
 		VkPhysicalDeviceFeatures deviceFeatures{};
 		// No extra features for now.
@@ -198,8 +227,8 @@ namespace
 		VkDeviceCreateInfo deviceInfo{};
 		deviceInfo.sType  = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
-		deviceInfo.queueCreateInfoCount  = 1;
-		deviceInfo.pQueueCreateInfos     = &queueInfo;
+		deviceInfo.queueCreateInfoCount  = std::uint32_t(queueInfos.size());
+		deviceInfo.pQueueCreateInfos     = queueInfos.data();
 
 		deviceInfo.pEnabledFeatures      = &deviceFeatures;
 
@@ -28,6 +28,22 @@ namespace labutils
 			std::uint32_t graphicsFamilyIndex = 0;
 			VkQueue graphicsQueue = VK_NULL_HANDLE;
 
+			// Queue for uploads. This is a dedicated TRANSFER queue (from a
+			// family without GRAPHICS) if the device has one, and the graphics
+			// queue otherwise. Resources written on a dedicated transfer queue
+			// must have their ownership transferred to the graphics family.
+			std::uint32_t transferFamilyIndex = 0;
+			VkQueue transferQueue = VK_NULL_HANDLE;
+
+			// VK_EXT_memory_budget is enabled: the allocator reports the
+			// driver's memory budget rather than an estimate
+			bool haveMemoryBudget = false;
+
+			// Descriptor indexing (core in Vulkan 1.2) is enabled with runtime
+			// descriptor arrays and partially bound descriptors, along with
+			// dynamic indexing of sampled image arrays
+			bool haveDescriptorIndexing = false;
+
 			
 			//bool haveDebugUtils = false;
 			VkDebugUtilsMessengerEXT debugMessenger = VK_NULL_HANDLE;
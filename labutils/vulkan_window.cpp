@@ -13,6 +13,7 @@
 #include <vulkan/vulkan_core.h>
 
 #include "error.hpp"
+#include "profiler.hpp"
 #include "to_string.hpp"
 #include "context_helpers.hxx"
 namespace lut = labutils;
@@ -30,7 +31,8 @@ namespace
 	VkDevice create_device(
 		VkPhysicalDevice,
 		std::vector<std::uint32_t> const& aQueueFamilies,
-		std::vector<char const*> const& aEnabledDeviceExtensions = {}
+		std::vector<char const*> const& aEnabledDeviceExtensions = {},
+		bool aEnableDescriptorIndexing = false
 	);
 
 	std::vector<VkSurfaceFormatKHR> get_surface_formats(VkPhysicalDevice, VkSurfaceKHR);
@@ -112,6 +114,8 @@ namespace labutils
 	// make_vulkan_window()
 	VulkanWindow make_vulkan_window()
 	{
+		LUT_PROFILE_ZONE("make_vulkan_window");
+
 		VulkanWindow ret;
 
 		// Initialize Volk
@@ -245,6 +249,33 @@ namespace labutils
 		std::vector<char const*> enabledDevExensions;
 		enabledDevExensions.emplace_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
+		// Optional: lets the allocator report the actual memory budget
+		if (lut::detail::get_device_extensions(ret.physicalDevice).count(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+		{
+			enabledDevExensions.emplace_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+			ret.haveMemoryBudget = true;
+		}
+
+		// Optional: descriptor indexing, for bindless textures. Devices are
+		// at least Vulkan 1.2, where it is core; only the features need to
+		// be checked.
+		{
+			VkPhysicalDeviceDescriptorIndexingFeatures indexing{};
+			indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+
+			VkPhysicalDeviceFeatures2 features{};
+			features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			features.pNext = &indexing;
+			vkGetPhysicalDeviceFeatures2(ret.physicalDevice, &features);
+
+			// The shaders index the texture array with dynamically uniform
+			// values, which needs the core dynamic indexing feature as well
+			ret.haveDescriptorIndexing = indexing.runtimeDescriptorArray && indexing.descriptorBindingPartiallyBound
+				&& features.features.shaderSampledImageArrayDynamicIndexing;
+			if (ret.haveDescriptorIndexing)
+				std::fprintf(stderr, "Enabling descriptor indexing\n");
+		}
+
 
 		//TODO: list necessary extensions here
 
@@ -277,7 +308,22 @@ namespace labutils
 			queueFamilyIndices.emplace_back(*present);
 		}
 
-		ret.device = create_device(ret.physicalDevice, queueFamilyIndices, enabledDevExensions);
+		// Optionally, a dedicated TRANSFER queue for uploads. It is not
+		// added to queueFamilyIndices, as those determine the sharing mode of
+		// the swap chain images. If the family is already in use (i.e., it is
+		// the present family), uploads stay on the graphics queue instead of
+		// sharing the present queue.
+		std::vector<std::uint32_t> deviceQueueFamilies = queueFamilyIndices;
+
+		ret.transferFamilyIndex = ret.graphicsFamilyIndex;
+		if (auto const index = lut::detail::find_dedicated_transfer_queue_family(ret.physicalDevice);
+			index && deviceQueueFamilies.end() == std::find(deviceQueueFamilies.begin(), deviceQueueFamilies.end(), *index))
+		{
+			ret.transferFamilyIndex = *index;
+			deviceQueueFamilies.emplace_back(*index);
+		}
+
+		ret.device = create_device(ret.physicalDevice, deviceQueueFamilies, enabledDevExensions, ret.haveDescriptorIndexing);
 
 		// Retrieve VkQueues
 		vkGetDeviceQueue(ret.device, ret.graphicsFamilyIndex, 0, &ret.graphicsQueue);
@@ -292,6 +338,14 @@ namespace labutils
 			ret.presentQueue = ret.graphicsQueue;
 		}
 
+		if (ret.transferFamilyIndex != ret.graphicsFamilyIndex)
+		{
+			vkGetDeviceQueue(ret.device, ret.transferFamilyIndex, 0, &ret.transferQueue);
+			std::fprintf(stderr, "Using dedicated transfer queue family %u\n", ret.transferFamilyIndex);
+		}
+		else
+			ret.transferQueue = ret.graphicsQueue;
+
 		// Create swap chain
 		std::tie(ret.swapchain, ret.swapchainFormat, ret.swapchainExtent) = create_swapchain(ret.physicalDevice, ret.surface, ret.device, ret.window, queueFamilyIndices);
 
@@ -621,7 +675,8 @@ namespace
 	// also set TRANSFER (and indeed most other operations; GRAPHICS queues are
 	// required to support those operations regardless). If you wanted to find
 	// a dedicated TRANSFER queue (e.g., such as those that exist on NVIDIA
-	// GPUs), you would need to use different logic.
+	// GPUs), you would need to use different logic; see
+	// detail::find_dedicated_transfer_queue_family().
 	std::optional<std::uint32_t> find_queue_family(VkPhysicalDevice aPhysicalDev, VkQueueFlags aQueueFlags, VkSurfaceKHR aSurface)
 	{
 		//TODO: find queue family with the specified queue flags that can 
@@ -652,7 +707,7 @@ namespace
 		return {};
 	}
 
-	VkDevice create_device(VkPhysicalDevice aPhysicalDev, std::vector<std::uint32_t> const& aQueues, std::vector<char const*> const& aEnabledExtensions)
+	VkDevice create_device(VkPhysicalDevice aPhysicalDev, std::vector<std::uint32_t> const& aQueues, std::vector<char const*> const& aEnabledExtensions, bool aEnableDescriptorIndexing)
 	{
 		if (aQueues.empty())
 			throw lut::Error("create_device(): no queues requested");
@@ -672,7 +727,7 @@ namespace
 		VkPhysicalDeviceFeatures deviceFeatures{};
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
 		deviceFeatures.geometryShader = VK_TRUE;
-		// No extra features for now.
+		deviceFeatures.shaderSampledImageArrayDynamicIndexing = aEnableDescriptorIndexing ? VK_TRUE : VK_FALSE;
 
 		VkDeviceCreateInfo deviceInfo{};
 		deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -685,6 +740,14 @@ namespace
 
 		deviceInfo.pEnabledFeatures = &deviceFeatures;
 
+		VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+		indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+		indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+		indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+
+		if (aEnableDescriptorIndexing)
+			deviceInfo.pNext = &indexingFeatures;
+
 		VkDevice device = VK_NULL_HANDLE;
 		if (auto const res = vkCreateDevice(aPhysicalDev, &deviceInfo, nullptr, &device); VK_SUCCESS != res)
 		{
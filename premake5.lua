@@ -116,6 +116,7 @@ project "cw2-bake"
 
 	links "labutils" -- for lut::Error
 	links "x-tgen" -- Task 1.4
+	links "x-stb" -- texture deduplication and downscaling
 
 	dependson "x-glm" 
 	dependson "x-rapidobj"